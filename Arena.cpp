@@ -0,0 +1,87 @@
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <stdint.h>
+
+namespace gps {
+
+    Arena::Arena(size_t blockSize) : blockSize(blockSize)
+    {
+        current = NULL;
+        allocations = 0;
+        blockAllocations = 0;
+        peakBytes = 0;
+    }
+
+    Arena::~Arena()
+    {
+        for (size_t i = 0; i < blocks.size(); i++) {
+            delete[] blocks[i]->data;
+            delete blocks[i];
+        }
+    }
+
+    void* Arena::Allocate(size_t size, size_t alignment)
+    {
+        size_t padded = size + alignment - 1;
+        allocations++;
+
+        for (;;) {
+            Block* block = current.load(std::memory_order_acquire);
+            if (block != NULL) {
+                size_t offset = block->used.fetch_add(padded, std::memory_order_relaxed);
+                if (offset + padded <= block->size) {
+                    uintptr_t address = (uintptr_t)(block->data + offset);
+                    return (void*)((address + alignment - 1) & ~(uintptr_t)(alignment - 1));
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            // another thread may have added a block while this one waited
+            if (current.load(std::memory_order_relaxed) != block)
+                continue;
+
+            Block* next = new Block;
+            next->size = std::max(blockSize, padded);
+            next->data = new char[next->size];
+            next->used = 0;
+            blocks.push_back(next);
+            blockAllocations++;
+            current.store(next, std::memory_order_release);
+        }
+    }
+
+    void Arena::Reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        peakBytes = std::max(peakBytes, GetUsedBytes());
+
+        for (size_t i = 1; i < blocks.size(); i++) {
+            delete[] blocks[i]->data;
+            delete blocks[i];
+        }
+        if (!blocks.empty()) {
+            blocks.resize(1);
+            blocks[0]->used = 0;
+        }
+        current = blocks.empty() ? NULL : blocks[0];
+    }
+
+    ArenaStats Arena::GetStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ArenaStats stats;
+        stats.allocations = allocations;
+        stats.blocks = blockAllocations;
+        stats.peakBytes = std::max(peakBytes, GetUsedBytes());
+        return stats;
+    }
+
+    size_t Arena::GetUsedBytes()
+    {
+        size_t used = 0;
+        for (size_t i = 0; i < blocks.size(); i++)
+            used += std::min(blocks[i]->used.load(), blocks[i]->size);
+        return used;
+    }
+}
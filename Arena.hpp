@@ -0,0 +1,88 @@
+#ifndef Arena_hpp
+#define Arena_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace gps {
+
+    struct ArenaStats
+    {
+        // requests served from the arena, each one a heap allocation avoided
+        size_t allocations;
+        // blocks taken from the heap to serve them
+        size_t blocks;
+        // most bytes handed out between two resets
+        size_t peakBytes;
+    };
+
+    // Linear allocator for load-scoped temporaries. Requests are carved out of large blocks
+    // and never freed one by one; Reset drops them all at once. Allocate may be called from
+    // several threads at a time (one atomic add in the common case), Reset may not.
+    class Arena
+    {
+    public:
+        explicit Arena(size_t blockSize = 1024 * 1024);
+        ~Arena();
+
+        void* Allocate(size_t size, size_t alignment);
+        // Forgets every allocation and keeps the first block for the next model
+        void Reset();
+        ArenaStats GetStats();
+
+    private:
+        struct Block
+        {
+            char* data;
+            size_t size;
+            // may run past size when a request does not fit
+            std::atomic<size_t> used;
+        };
+
+        size_t blockSize;
+        std::mutex mutex;
+        std::vector<Block*> blocks;
+        std::atomic<Block*> current;
+        std::atomic<size_t> allocations;
+        size_t blockAllocations;
+        size_t peakBytes;
+
+        size_t GetUsedBytes();
+
+        Arena(const Arena&);
+        Arena& operator=(const Arena&);
+    };
+
+    // STL allocator handing out memory from an Arena; deallocate does nothing
+    template <class T>
+    class ArenaAllocator
+    {
+    public:
+        typedef T value_type;
+
+        explicit ArenaAllocator(gps::Arena& arena) : arena(&arena) {}
+        template <class U>
+        ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+        T* allocate(size_t count)
+        {
+            return static_cast<T*>(arena->Allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T*, size_t) {}
+
+        template <class U>
+        bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+        template <class U>
+        bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+        gps::Arena* arena;
+    };
+
+    template <class T>
+    using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+}
+
+#endif /* Arena_hpp */
@@ -0,0 +1,661 @@
+#include "AssetStreamer.hpp"
+#include "ObjLoader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+
+namespace gps {
+
+    // Vertex chunks in the pool; with the 1 MB chunks that caps streamed geometry in flight at 8 MB
+    static const size_t streamChunkCount = 8;
+    // warming the mesh cache parses the whole file again, which streaming exists to avoid for large ones
+    static const size_t warmMeshCacheMaxBytes = 64 * 1024 * 1024;
+
+    static int levelCount(const gps::Image& image)
+    {
+        return image.levelOffsets.empty() ? 1 : (int)image.levelOffsets.size() - 1;
+    }
+
+    AssetStreamer::AssetStreamer(gps::ThreadPool& pool) : pool(pool)
+    {
+        pendingAssets = 0;
+        uploadingModel = false;
+        currentMesh = 0;
+        uploading = false;
+        currentTextureId = 0;
+        currentRow = 0;
+        currentLevel = 0;
+        budgetBytes = 8 * 1024 * 1024;
+        budgetMilliseconds = 4.0;
+        uploadedBytes = 0;
+        placeholderTexture = 0;
+        placeholderMesh = NULL;
+        streamGeometry = true;
+        warmMeshCache = false;
+        stopping = false;
+    }
+
+    void AssetStreamer::Init()
+    {
+        // 2x2 grey checker so untextured surfaces are still readable
+        unsigned char checker[16] = {
+            160, 160, 160, 255,   96,  96,  96, 255,
+             96,  96,  96, 255,  160, 160, 160, 255
+        };
+        glGenTextures(1, &placeholderTexture);
+        glBindTexture(GL_TEXTURE_2D, placeholderTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // unit ground quad drawn in place of models whose geometry has not arrived
+        std::vector<gps::Vertex> vertices(4);
+        float corners[4][2] = { {-1.0f, -1.0f}, {-1.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, -1.0f} };
+        for (int i = 0; i < 4; i++) {
+            vertices[i].Position = glm::vec3(corners[i][0], 0.0f, corners[i][1]);
+            vertices[i].Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            vertices[i].TexCoords = glm::vec2(corners[i][0] * 8.0f, corners[i][1] * 8.0f);
+        }
+        GLuint quadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+        std::vector<GLuint> indices(quadIndices, quadIndices + 6);
+
+        std::vector<gps::Texture> textures(2);
+        textures[0].id = placeholderTexture;
+        textures[0].type = "diffuseTexture";
+        textures[1].id = placeholderTexture;
+        textures[1].type = "specularTexture";
+        placeholderMesh = new gps::Mesh(vertices, indices, textures);
+
+        // a few frames worth of budget, so the ring only fills up when the GPU falls behind
+        stagingRing.Init(4 * budgetBytes);
+    }
+
+    void AssetStreamer::Delete()
+    {
+        // wake parsers waiting for a chunk, then let in-flight jobs finish before the queues go away
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        chunkFreed.notify_all();
+        pool.WaitIdle();
+
+        if (uploading)
+            glDeleteTextures(1, &currentTextureId);
+        for (size_t i = 0; i < skyBoxUploads.size(); i++) {
+            if (skyBoxUploads[i].facesLeft > 0)
+                glDeleteTextures(1, &skyBoxUploads[i].textureId);
+        }
+
+        if (placeholderMesh != NULL) {
+            gps::Buffers buffers = placeholderMesh->getBuffers();
+            glDeleteBuffers(1, &buffers.VBO);
+            glDeleteBuffers(1, &buffers.EBO);
+            glDeleteVertexArrays(1, &buffers.VAO);
+            glDeleteBuffers(1, &buffers.depthVBO);
+            glDeleteVertexArrays(1, &buffers.depthVAO);
+            delete placeholderMesh;
+            placeholderMesh = NULL;
+        }
+        glDeleteTextures(1, &placeholderTexture);
+        stagingRing.Delete();
+    }
+
+    void AssetStreamer::RequestModel(gps::Model3D* model, std::string fileName)
+    {
+        model->SetPlaceholder(placeholderMesh);
+        pendingAssets++;
+
+        if (streamGeometry) {
+            pool.Submit([this, model, fileName]() { StreamModel(model, fileName); });
+            return;
+        }
+
+        pool.Submit([this, model, fileName]() {
+            std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+            ParsedModel parsed;
+            parsed.model = model;
+            // the other workers help with the chunks of this file
+            Model3D::ParseOBJ(fileName, basePath, parsed.meshes, &pool);
+
+            // texture jobs are counted before the model is handed over, so the
+            // pending count cannot drop to zero in between
+            DecodeModelTextures(model, parsed.meshes);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            parsedModels.push_back(std::move(parsed));
+        });
+    }
+
+    // Worker side of a streamed model: parses the file into pooled chunks and queues them in order
+    void AssetStreamer::StreamModel(gps::Model3D* model, std::string fileName)
+    {
+        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+
+        // a cached model is already optimized and indexed, which beats streaming the raw file
+        ParsedModel cached;
+        cached.model = model;
+        if (Model3D::LoadCachedOBJ(fileName, basePath, cached.meshes)) {
+            DecodeModelTextures(model, cached.meshes);
+            std::lock_guard<std::mutex> lock(mutex);
+            parsedModels.push_back(std::move(cached));
+            return;
+        }
+
+        // only the texture lists, for DecodeModelTextures
+        std::vector<gps::MeshData> meshes;
+
+        gps::ObjStreamCallbacks callbacks;
+        callbacks.beginMesh = [&](const tinyobj::material_t* material) {
+            StreamedChunk chunk;
+            chunk.model = model;
+            chunk.beginsMesh = true;
+            if (material != NULL)
+                chunk.textures = Model3D::GetMaterialTextures(*material, basePath);
+            chunk.vertices = NULL;
+            chunk.count = 0;
+            chunk.finished = false;
+            meshes.push_back(gps::MeshData());
+            meshes.back().textures = chunk.textures;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            streamedChunks.push_back(std::move(chunk));
+        };
+        callbacks.acquireChunk = [this]() { return AcquireChunk(); };
+        callbacks.submitChunk = [&](gps::Vertex* vertices, size_t count) {
+            if (count == 0) {
+                ReleaseChunk(vertices);
+                return;
+            }
+            StreamedChunk chunk;
+            chunk.model = model;
+            chunk.beginsMesh = false;
+            chunk.vertices = vertices;
+            chunk.count = count;
+            chunk.finished = false;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            streamedChunks.push_back(std::move(chunk));
+        };
+
+        std::cout << "Streaming : " << fileName << std::endl;
+        std::string err;
+        if (!gps::StreamObj(fileName.c_str(), basePath.c_str(), callbacks, &err) && !stopping)
+            std::cerr << "ERROR: could not stream " << fileName << std::endl;
+        if (!err.empty())
+            std::cerr << err << std::endl;
+
+        DecodeModelTextures(model, meshes);
+
+        // counted before the model is handed over, so the pending count cannot drop to zero in between
+        struct stat info;
+        bool warm = warmMeshCache && Model3D::meshOptions.cache != NULL && !stopping &&
+                    stat(fileName.c_str(), &info) == 0 && (size_t)info.st_size <= warmMeshCacheMaxBytes;
+        if (warm)
+            pendingAssets++;
+
+        StreamedChunk last;
+        last.model = model;
+        last.beginsMesh = false;
+        last.vertices = NULL;
+        last.count = 0;
+        last.finished = true;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            streamedChunks.push_back(std::move(last));
+        }
+
+        // the streamed copy stays as it is; parsing once more in the background fills the
+        // mesh cache, so the next run gets the optimized meshes
+        if (warm) {
+            std::vector<gps::MeshData> parsed;
+            Model3D::ParseOBJ(fileName, basePath, parsed, &pool);
+            pendingAssets--;
+        }
+    }
+
+    // Blocks until the GL thread hands a chunk back, unless the pool is not full yet
+    gps::Vertex* AssetStreamer::AcquireChunk()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        chunkFreed.wait(lock, [this] {
+            return stopping || !freeChunks.empty() || chunkStorage.size() < streamChunkCount;
+        });
+        if (stopping)
+            return NULL;
+
+        if (freeChunks.empty()) {
+            chunkStorage.push_back(std::unique_ptr<gps::Vertex[]>(new gps::Vertex[gps::objChunkVertices]));
+            return chunkStorage.back().get();
+        }
+        gps::Vertex* chunk = freeChunks.back();
+        freeChunks.pop_back();
+        return chunk;
+    }
+
+    void AssetStreamer::ReleaseChunk(gps::Vertex* chunk)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeChunks.push_back(chunk);
+        }
+        chunkFreed.notify_one();
+    }
+
+    // Copies a chunk into the staging ring and appends it to its mesh on the GPU. Returns
+    // false while the ring is full.
+    bool AssetStreamer::UploadStreamedChunk(StreamedChunk& chunk, size_t& frameBytes)
+    {
+        if (chunk.beginsMesh) {
+            streamedMeshes[chunk.model] = chunk.model->AddStreamedMesh(chunk.textures, placeholderTexture);
+            return true;
+        }
+        if (chunk.finished) {
+            streamedMeshes.erase(chunk.model);
+            pendingAssets--;
+            return true;
+        }
+
+        size_t size = chunk.count * sizeof(gps::Vertex);
+        size_t offset;
+        unsigned char* staging = stagingRing.Allocate(size, offset);
+        if (staging == NULL)
+            return false;
+        memcpy(staging, chunk.vertices, size);
+        stagingRing.Commit();
+        ReleaseChunk(chunk.vertices);
+
+        chunk.model->AppendToMesh(streamedMeshes[chunk.model], stagingRing.GetBuffer(), offset, (GLsizei)chunk.count);
+        frameBytes += size;
+        return true;
+    }
+
+    void AssetStreamer::DecodeModelTextures(gps::Model3D* model, std::vector<gps::MeshData>& meshes)
+    {
+        std::vector<std::string> paths;
+        for (size_t s = 0; s < meshes.size(); s++) {
+            for (size_t t = 0; t < meshes[s].textures.size(); t++) {
+                std::string path = meshes[s].textures[t].path;
+                bool seen = false;
+                for (size_t i = 0; i < paths.size(); i++)
+                    seen = seen || paths[i] == path;
+                if (!seen)
+                    paths.push_back(path);
+            }
+        }
+
+        for (size_t i = 0; i < paths.size(); i++) {
+            pendingAssets++;
+            std::string path = paths[i];
+            pool.Submit([this, model, path]() {
+                DecodedTexture decoded;
+                decoded.model = model;
+                decoded.skyBox = NULL;
+                decoded.face = 0;
+                decoded.path = path;
+                if (!Model3D::DecodeTexture(path.c_str(), decoded.image)) {
+                    // the meshes keep the placeholder
+                    pendingAssets--;
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                decodedTextures.push_back(std::move(decoded));
+            });
+        }
+    }
+
+    void AssetStreamer::RequestSkyBox(gps::SkyBox* skyBox, std::vector<const GLchar*> faces)
+    {
+        skyBox->LoadPlaceholder(glm::vec3(0.75f, 0.7f, 0.5f));
+
+        SkyBoxUpload upload;
+        upload.skyBox = skyBox;
+        glGenTextures(1, &upload.textureId);
+        upload.facesLeft = (int)faces.size();
+        skyBoxUploads.push_back(upload);
+
+        for (size_t i = 0; i < faces.size(); i++) {
+            pendingAssets++;
+            std::string path = faces[i];
+            int face = (int)i;
+            pool.Submit([this, skyBox, path, face]() {
+                DecodedTexture decoded;
+                decoded.model = NULL;
+                decoded.skyBox = skyBox;
+                decoded.face = face;
+                decoded.path = path;
+                if (!SkyBox::DecodeFace(path.c_str(), decoded.image)) {
+                    pendingAssets--;
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                decodedTextures.push_back(std::move(decoded));
+            });
+        }
+    }
+
+    void AssetStreamer::Update()
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t frameBytes = 0;
+
+        stagingRing.Retire();
+
+        // geometry goes first so streamed textures find the meshes that use them; parsed and
+        // cached models go up a mesh at a time, and a mesh over the budget gets a frame to itself
+        for (;;) {
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (frameBytes >= budgetBytes || elapsed >= budgetMilliseconds)
+                break;
+
+            if (!uploadingModel) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (parsedModels.empty())
+                    break;
+                currentModel = std::move(parsedModels.front());
+                parsedModels.pop_front();
+                currentMesh = 0;
+                uploadingModel = true;
+            }
+
+            if (currentMesh < currentModel.meshes.size()) {
+                gps::MeshData& mesh = currentModel.meshes[currentMesh++];
+                size_t meshBytes = mesh.vertices.size() * sizeof(gps::Vertex) + mesh.indices.size() * sizeof(GLuint);
+                if (frameBytes > 0 && frameBytes + meshBytes > budgetBytes) {
+                    currentMesh--;
+                    break;
+                }
+                currentModel.model->AddMesh(mesh, placeholderTexture);
+                frameBytes += meshBytes;
+                // the GL copy is all that is needed from here on
+                mesh = gps::MeshData();
+            }
+            if (currentMesh == currentModel.meshes.size()) {
+                currentModel = ParsedModel();
+                uploadingModel = false;
+                pendingAssets--;
+            }
+        }
+
+        // streamed geometry shares the frame budget with textures and goes first for the same reason
+        for (;;) {
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (frameBytes >= budgetBytes || elapsed >= budgetMilliseconds)
+                break;
+
+            StreamedChunk chunk;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (streamedChunks.empty())
+                    break;
+                chunk = streamedChunks.front();
+            }
+            if (!UploadStreamedChunk(chunk, frameBytes))
+                break;
+            std::lock_guard<std::mutex> lock(mutex);
+            streamedChunks.pop_front();
+        }
+
+        for (;;) {
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (frameBytes >= budgetBytes || elapsed >= budgetMilliseconds)
+                break;
+
+            if (!uploading) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (decodedTextures.empty())
+                        break;
+                    current = std::move(decodedTextures.front());
+                    decodedTextures.pop_front();
+                }
+                BeginTextureUpload();
+            }
+
+            if (current.image.compressedFormat != 0) {
+                int levelHeight = std::max(1, current.image.height >> currentLevel);
+                size_t levelBytes = current.image.levelOffsets[currentLevel + 1] - current.image.levelOffsets[currentLevel];
+                size_t blockRowBytes = levelBytes / ((levelHeight + 3) / 4);
+                size_t blockRows = (levelHeight - currentRow + 3) / 4;
+                if (levelBytes > stagingRing.GetCapacity() / 2) {
+                    // too large to go up whole: bands of block rows, sized like the plain ones
+                    size_t bandRows = frameBytes == 0 ? 1 : 0;
+                    if (budgetBytes > frameBytes)
+                        bandRows = std::max(bandRows, (budgetBytes - frameBytes) / blockRowBytes);
+                    if (bandRows == 0)
+                        break;
+                    bandRows = std::max((size_t)1, std::min(bandRows, stagingRing.GetCapacity() / 2 / blockRowBytes));
+                    blockRows = std::min(blockRows, bandRows);
+                } else if (frameBytes > 0 && frameBytes + levelBytes > budgetBytes)
+                    break;
+                if (!UploadLevel((int)blockRows))
+                    break;
+                frameBytes += blockRows * blockRowBytes;
+
+                if (currentRow == levelHeight) {
+                    currentLevel++;
+                    currentRow = 0;
+                    if (currentLevel == (int)current.image.levelOffsets.size() - 1)
+                        FinishTextureUpload();
+                }
+                continue;
+            }
+
+            int levelWidth = std::max(1, current.image.width >> currentLevel);
+            int levelHeight = std::max(1, current.image.height >> currentLevel);
+            size_t rowBytes = (size_t)levelWidth * current.image.channels;
+            // always make some progress, even when a single row exceeds the budget
+            size_t rowCount = frameBytes == 0 ? 1 : 0;
+            if (budgetBytes > frameBytes)
+                rowCount = std::max(rowCount, (budgetBytes - frameBytes) / rowBytes);
+            if (rowCount == 0)
+                break;
+            rowCount = std::min(rowCount, (size_t)(levelHeight - currentRow));
+            // a band never takes more than half the ring so two can always be in flight
+            rowCount = std::max((size_t)1, std::min(rowCount, stagingRing.GetCapacity() / 2 / rowBytes));
+
+            // ring full: the GPU is still reading earlier bands, carry on next frame
+            if (!UploadRows((int)rowCount))
+                break;
+            frameBytes += rowCount * rowBytes;
+
+            if (currentRow == levelHeight) {
+                currentLevel++;
+                currentRow = 0;
+                if (currentLevel == levelCount(current.image))
+                    FinishTextureUpload();
+            }
+        }
+
+        stagingRing.Submit();
+        uploadedBytes += frameBytes;
+    }
+
+    void AssetStreamer::BeginTextureUpload()
+    {
+        uploading = true;
+        currentRow = 0;
+        currentLevel = 0;
+
+        if (current.skyBox != NULL) {
+            SkyBoxUpload* upload = FindSkyBoxUpload(current.skyBox);
+            currentTextureId = upload->textureId;
+            glBindTexture(GL_TEXTURE_CUBE_MAP, currentTextureId);
+            for (int level = 0; level < levelCount(current.image); level++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + current.face, level, GL_RGB,
+                             std::max(1, current.image.width >> level), std::max(1, current.image.height >> level),
+                             0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        } else if (current.image.compressedFormat != 0) {
+            // each level is allocated by its own glCompressedTexImage2D
+            glGenTextures(1, &currentTextureId);
+        } else {
+            glGenTextures(1, &currentTextureId);
+            glBindTexture(GL_TEXTURE_2D, currentTextureId);
+            for (int level = 0; level < levelCount(current.image); level++)
+                glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB,
+                             std::max(1, current.image.width >> level), std::max(1, current.image.height >> level),
+                             0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+
+    // Copies a band of rows of the current level into a staging slot and lets the driver pull it from there
+    bool AssetStreamer::UploadRows(int rowCount)
+    {
+        int levelWidth = std::max(1, current.image.width >> currentLevel);
+        size_t levelOffset = current.image.levelOffsets.empty() ? 0 : current.image.levelOffsets[currentLevel];
+        size_t rowBytes = (size_t)levelWidth * current.image.channels;
+        size_t size = rowBytes * rowCount;
+        GLenum format = current.image.channels == 4 ? GL_RGBA : GL_RGB;
+
+        size_t offset;
+        unsigned char* staging = stagingRing.Allocate(size, offset);
+        if (staging == NULL)
+            return false;
+        memcpy(staging, current.image.pixels.get() + levelOffset + currentRow * rowBytes, size);
+        stagingRing.Commit();
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingRing.GetBuffer());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (current.skyBox != NULL) {
+            glBindTexture(GL_TEXTURE_CUBE_MAP, currentTextureId);
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + current.face, currentLevel, 0, currentRow,
+                            levelWidth, rowCount, format, GL_UNSIGNED_BYTE, (GLvoid*)offset);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        } else {
+            glBindTexture(GL_TEXTURE_2D, currentTextureId);
+            glTexSubImage2D(GL_TEXTURE_2D, currentLevel, 0, currentRow,
+                            levelWidth, rowCount, format, GL_UNSIGNED_BYTE, (GLvoid*)offset);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        currentRow += rowCount;
+        return true;
+    }
+
+    // Block compressed textures come with their mip chain and go up a whole level at a time;
+    // levels larger than half the staging ring go up blockRows rows of 4x4 blocks at a time
+    bool AssetStreamer::UploadLevel(int blockRows)
+    {
+        int levelWidth = std::max(1, current.image.width >> currentLevel);
+        int levelHeight = std::max(1, current.image.height >> currentLevel);
+        size_t begin = current.image.levelOffsets[currentLevel];
+        size_t levelBytes = current.image.levelOffsets[currentLevel + 1] - begin;
+        size_t blockRowBytes = levelBytes / ((levelHeight + 3) / 4);
+        size_t size = blockRowBytes * blockRows;
+        int rows = std::min(levelHeight - currentRow, blockRows * 4);
+
+        size_t offset;
+        unsigned char* staging = stagingRing.Allocate(size, offset);
+        if (staging == NULL)
+            return false;
+        memcpy(staging, current.image.pixels.get() + begin + currentRow / 4 * blockRowBytes, size);
+        stagingRing.Commit();
+
+        glBindTexture(GL_TEXTURE_2D, currentTextureId);
+        if (rows == levelHeight) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingRing.GetBuffer());
+            glCompressedTexImage2D(GL_TEXTURE_2D, currentLevel, current.image.compressedFormat,
+                                   levelWidth, levelHeight, 0, size, (GLvoid*)offset);
+        } else {
+            // the first band allocates the level, with no buffer bound so nothing is read
+            if (currentRow == 0)
+                glCompressedTexImage2D(GL_TEXTURE_2D, currentLevel, current.image.compressedFormat,
+                                       levelWidth, levelHeight, 0, levelBytes, NULL);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingRing.GetBuffer());
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, currentLevel, 0, currentRow, levelWidth, rows,
+                                      current.image.compressedFormat, size, (GLvoid*)offset);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        currentRow += rows;
+        return true;
+    }
+
+    void AssetStreamer::FinishTextureUpload()
+    {
+        if (current.skyBox != NULL) {
+            SkyBoxUpload* upload = FindSkyBoxUpload(current.skyBox);
+            upload->facesLeft--;
+            if (upload->facesLeft == 0) {
+                glBindTexture(GL_TEXTURE_CUBE_MAP, upload->textureId);
+                if (currentLevel > 1)
+                    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, currentLevel - 1);
+                else
+                    Model3D::GenerateDriverMipmaps(GL_TEXTURE_CUBE_MAP);
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+                upload->skyBox->SetTexture(upload->textureId);
+            }
+        } else {
+            glBindTexture(GL_TEXTURE_2D, currentTextureId);
+            // uploaded with its mip chain, unless the driver has to build it
+            if (current.image.compressedFormat != 0 || currentLevel > 1)
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, currentLevel - 1);
+            else
+                Model3D::GenerateDriverMipmaps(GL_TEXTURE_2D);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            current.model->SetTexture(current.path, currentTextureId);
+        }
+
+        // release the decoded pixels right away
+        current.image.pixels.reset();
+        uploading = false;
+        pendingAssets--;
+    }
+
+    AssetStreamer::SkyBoxUpload* AssetStreamer::FindSkyBoxUpload(gps::SkyBox* skyBox)
+    {
+        for (size_t i = 0; i < skyBoxUploads.size(); i++) {
+            if (skyBoxUploads[i].skyBox == skyBox)
+                return &skyBoxUploads[i];
+        }
+        return NULL;
+    }
+
+    void AssetStreamer::SetUploadBudget(size_t bytesPerFrame, double millisecondsPerFrame)
+    {
+        budgetBytes = bytesPerFrame;
+        budgetMilliseconds = millisecondsPerFrame;
+    }
+
+    void AssetStreamer::SetGeometryStreaming(bool enabled)
+    {
+        streamGeometry = enabled;
+    }
+
+    void AssetStreamer::SetMeshCacheWarming(bool enabled)
+    {
+        warmMeshCache = enabled;
+    }
+
+    bool AssetStreamer::IsIdle()
+    {
+        return pendingAssets == 0;
+    }
+
+    size_t AssetStreamer::GetUploadedBytes()
+    {
+        return uploadedBytes;
+    }
+}
@@ -0,0 +1,141 @@
+#ifndef AssetStreamer_hpp
+#define AssetStreamer_hpp
+
+#include "Model3D.hpp"
+#include "SkyBox.hpp"
+#include "StagingRing.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Loads models and textures in the background: parsing and decoding run on the
+    // worker threads, GPU uploads are spread over frames within a fixed budget
+    class AssetStreamer
+    {
+    public:
+        explicit AssetStreamer(gps::ThreadPool& pool);
+
+        // Creates the placeholder texture and mesh (GL thread)
+        void Init();
+        void Delete();
+
+        // Parses the model and decodes its textures on the worker threads
+        void RequestModel(gps::Model3D* model, std::string fileName);
+        // Decodes the six cube map faces on the worker threads
+        void RequestSkyBox(gps::SkyBox* skyBox, std::vector<const GLchar*> faces);
+
+        // Uploads finished work until the per-frame budget is spent (GL thread)
+        void Update();
+        void SetUploadBudget(size_t bytesPerFrame, double millisecondsPerFrame);
+        // Streams model geometry to the GPU chunk by chunk instead of parsing whole files
+        // first (the default); only affects models requested afterwards
+        void SetGeometryStreaming(bool enabled);
+        // Parses streamed models once more after streaming to fill the mesh cache, so the next
+        // run loads them optimized. Off by default, as the second parse holds the whole model in
+        // memory; files over 64 MB are skipped either way. Counts as pending until it is done.
+        void SetMeshCacheWarming(bool enabled);
+        // True once every requested asset is resident on the GPU
+        bool IsIdle();
+        size_t GetUploadedBytes();
+
+    private:
+        struct ParsedModel
+        {
+            gps::Model3D* model;
+            std::vector<gps::MeshData> meshes;
+        };
+
+        // One record of a streamed model, in file order
+        struct StreamedChunk
+        {
+            gps::Model3D* model;
+            // starts a new mesh with these textures; vertices is NULL then
+            bool beginsMesh;
+            std::vector<gps::Texture> textures;
+            gps::Vertex* vertices;
+            size_t count;
+            // the last record of the model
+            bool finished;
+        };
+
+        struct DecodedTexture
+        {
+            gps::Model3D* model;
+            // set instead of model for cube map faces
+            gps::SkyBox* skyBox;
+            int face;
+            std::string path;
+            gps::Image image;
+        };
+
+        struct SkyBoxUpload
+        {
+            gps::SkyBox* skyBox;
+            GLuint textureId;
+            int facesLeft;
+        };
+
+        gps::ThreadPool& pool;
+        std::mutex mutex;
+        std::deque<ParsedModel> parsedModels;
+        // parsed model going up a mesh at a time, within the frame budget
+        bool uploadingModel;
+        ParsedModel currentModel;
+        size_t currentMesh;
+        std::deque<DecodedTexture> decodedTextures;
+        std::deque<StreamedChunk> streamedChunks;
+        // requested assets that are not yet on the GPU
+        std::atomic<int> pendingAssets;
+
+        // Fixed pool of vertex chunks shared by the streamed models; the parsers wait for a
+        // free one, which keeps the memory in flight bounded whatever the model size
+        bool streamGeometry;
+        bool warmMeshCache;
+        std::vector<std::unique_ptr<gps::Vertex[]>> chunkStorage;
+        std::vector<gps::Vertex*> freeChunks;
+        std::condition_variable chunkFreed;
+        std::atomic<bool> stopping;
+        // mesh of each streamed model that chunks are appended to (GL thread)
+        std::map<gps::Model3D*, int> streamedMeshes;
+
+        std::vector<SkyBoxUpload> skyBoxUploads;
+        // texture being uploaded band by band across frames
+        bool uploading;
+        DecodedTexture current;
+        GLuint currentTextureId;
+        int currentRow;
+        // mip level being uploaded; block compressed levels go up whole unless they would take
+        // more than half the staging ring, plain ones in row bands
+        int currentLevel;
+
+        size_t budgetBytes;
+        double budgetMilliseconds;
+        size_t uploadedBytes;
+
+        gps::StagingRing stagingRing;
+        GLuint placeholderTexture;
+        gps::Mesh* placeholderMesh;
+
+        void StreamModel(gps::Model3D* model, std::string fileName);
+        gps::Vertex* AcquireChunk();
+        void ReleaseChunk(gps::Vertex* chunk);
+        bool UploadStreamedChunk(StreamedChunk& chunk, size_t& frameBytes);
+        void DecodeModelTextures(gps::Model3D* model, std::vector<gps::MeshData>& meshes);
+        void BeginTextureUpload();
+        bool UploadRows(int rowCount);
+        bool UploadLevel(int blockRows);
+        void FinishTextureUpload();
+        SkyBoxUpload* FindSkyBoxUpload(gps::SkyBox* skyBox);
+    };
+}
+
+#endif /* AssetStreamer_hpp */
@@ -0,0 +1,121 @@
+#include "BatchRenderer.hpp"
+
+#include <fstream>
+#include <sstream>
+
+namespace gps {
+
+    // every pose gets its image, however long the encoders take
+    static gps::CaptureOptions GetCaptureOptions(gps::BatchOptions options)
+    {
+        gps::CaptureOptions capture;
+        capture.format = CAPTURE_PNG;
+        capture.backpressure = CAPTURE_QUEUE;
+        capture.readbacks = options.readbacks;
+        capture.path = options.directory;
+        return capture;
+    }
+
+    BatchRenderer::BatchRenderer(gps::ThreadPool& pool, gps::BatchOptions options) : options(options),
+        capture(pool, GetCaptureOptions(options))
+    {
+        framebuffers[0] = framebuffers[1] = 0;
+        renderbuffers[0] = renderbuffers[1] = renderbuffers[2] = 0;
+    }
+
+    bool BatchRenderer::LoadPoses(std::string fileName, std::vector<gps::CameraPose>& poses)
+    {
+        std::ifstream file(fileName.c_str());
+        if (!file)
+            return false;
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t text = line.find_first_not_of(" \t\r");
+            if (text == std::string::npos || line[text] == '#')
+                continue;
+            std::istringstream fields(line);
+            gps::CameraPose pose;
+            if (!(fields >> pose.position.x >> pose.position.y >> pose.position.z >> pose.yaw >> pose.pitch))
+                return false;
+            poses.push_back(pose);
+        }
+        return true;
+    }
+
+    void BatchRenderer::Init()
+    {
+        capture.Init();
+
+        // sRGB like the window, so the files hold what it would show
+        glGenRenderbuffers(3, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, options.samples, GL_SRGB8_ALPHA8, options.width, options.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, options.samples, GL_DEPTH_COMPONENT24, options.width, options.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[2]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, options.width, options.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(2, framebuffers);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[1]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[2]);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void BatchRenderer::Delete()
+    {
+        capture.Delete();
+        glDeleteFramebuffers(2, framebuffers);
+        glDeleteRenderbuffers(3, renderbuffers);
+        framebuffers[0] = framebuffers[1] = 0;
+        renderbuffers[0] = renderbuffers[1] = renderbuffers[2] = 0;
+    }
+
+    GLuint BatchRenderer::GetFramebuffer()
+    {
+        return framebuffers[0];
+    }
+
+    int BatchRenderer::GetWidth()
+    {
+        return options.width;
+    }
+
+    int BatchRenderer::GetHeight()
+    {
+        return options.height;
+    }
+
+    bool BatchRenderer::Capture()
+    {
+        // the clock starts with the first image rather than with the streaming before it
+        if (!capture.IsRecording() && !capture.Start(options.width, options.height))
+            return false;
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+        glBlitFramebuffer(0, 0, options.width, options.height, 0, 0, options.width, options.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[1]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        capture.Capture(options.width, options.height);
+        return true;
+    }
+
+    void BatchRenderer::Poll()
+    {
+        capture.Poll();
+    }
+
+    void BatchRenderer::Finish()
+    {
+        capture.Stop();
+    }
+
+    gps::CaptureStats BatchRenderer::GetStats()
+    {
+        return capture.GetStats();
+    }
+}
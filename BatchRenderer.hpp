@@ -0,0 +1,72 @@
+#ifndef BatchRenderer_hpp
+#define BatchRenderer_hpp
+
+#include "FrameCapture.hpp"
+#include "ThreadPool.hpp"
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // A camera the way the mouse sets it: yaw around the y axis and pitch up, in degrees
+    struct CameraPose
+    {
+        glm::vec3 position;
+        float yaw;
+        float pitch;
+    };
+
+    struct BatchOptions
+    {
+        int width = 1920;
+        int height = 1080;
+        int samples = 4;
+        // reads in flight before Capture waits for the GPU
+        int readbacks = 3;
+        std::string directory = "batch";
+    };
+
+    // Offscreen target for rendering many camera poses to PNG files. The scene is drawn into a
+    // multisampled framebuffer of a fixed size; Capture resolves it and hands it to a
+    // FrameCapture that queues every image, so the pixels are encoded and written on the worker
+    // pool while the GPU draws the next poses. GL thread only.
+    class BatchRenderer
+    {
+    public:
+        BatchRenderer(gps::ThreadPool& pool, gps::BatchOptions options = gps::BatchOptions());
+
+        // "x y z yaw pitch" per line; blank lines and lines starting with # are skipped
+        static bool LoadPoses(std::string fileName, std::vector<gps::CameraPose>& poses);
+
+        void Init();
+        void Delete();
+
+        // Draw the scene here, at GetWidth x GetHeight
+        GLuint GetFramebuffer();
+        int GetWidth();
+        int GetHeight();
+
+        // Reads back what was drawn; a worker writes it to the output directory, numbered
+        // from 00000.png in capture order. False if the directory cannot be created.
+        bool Capture();
+        // Hands the reads that arrived to the workers; call between frames
+        void Poll();
+        // Waits for every read and every file
+        void Finish();
+
+        gps::CaptureStats GetStats();
+
+    private:
+        gps::BatchOptions options;
+        gps::FrameCapture capture;
+        // drawn into, and the resolved copy that is read
+        GLuint framebuffers[2];
+        GLuint renderbuffers[3];
+    };
+}
+
+#endif /* BatchRenderer_hpp */
@@ -0,0 +1,1584 @@
+// Offline benchmarks for the CPU side of asset loading.
+//
+//   Benchmarks mips [--repeat N] [--threads N] image...
+//   Benchmarks image [image...]
+//   Benchmarks obj [--size MB] [--threads N] [file.obj...]
+//   Benchmarks floats [--count N]
+//   Benchmarks rss [--size MB] [file.obj...]
+//   Benchmarks mesh [--size MB] [file.obj...]
+//   Benchmarks lod [--size MB] [file.obj...]
+//   Benchmarks dunes [--tiles N] [--threads N] [--seed N]
+//   Benchmarks lights [--threads N] [--seed N]
+//   Benchmarks resolution [--seed N]
+//   Benchmarks png [--threads N] [image...]
+//   Benchmarks y4m [--threads N] [--seed N]
+//   Benchmarks ring
+//   Benchmarks bc [--threads N] [image...]
+//
+// mips: builds the mip chain of every image with the double precision reference filters and
+// with the SIMD ones, reports MP/s for each and the PSNR of the SIMD chain against the
+// reference. Then filters all images at once on the thread pool, as the streamer does.
+// Fails when any chain is further than minimumPsnr from the reference.
+//
+// image: microbenchmarks of the ImageUtils kernels against plain byte loops, in the style of
+// Google Benchmark (time per iteration and throughput). Defaults to the 2048x2048 cabin maps.
+//
+// obj: loads each file with tinyobj::LoadObj and with gps::LoadObj, reports MB/s for both and
+// the load arena counters of the latter, and fails if the results differ. Without files it writes a synthetic OBJ of --size MB (default
+// 100) to synthetic.obj and uses that.
+//
+// floats: checks gps::ParseDouble, which tinyobj's parser uses, against strtod on --count
+// (default 1000000) random numbers of each kind - OBJ style fixed point, short and full
+// precision scientific, and overlong digit strings - then compares their throughput on a
+// buffer of vertex coordinates.
+//
+// rss: loads each file in a child process, once the way ParseOBJ does (whole file, then a
+// de-indexed copy per shape) and once streamed through a fixed pool of chunks the way
+// AssetStreamer does, and reports the peak resident set of each. Uses synthetic.obj like obj.
+//
+// mesh: runs each stage of the mesh optimizer over the de-indexed shapes of each file, reports
+// the time of every stage and the ACMR/ATVR of a 16 entry FIFO cache before and after, and
+// fails if the optimized meshes do not draw the same triangles. Then packs the vertices into
+// the 16 byte compact layout and reports the largest error of each attribute. Uses
+// synthetic.obj like obj.
+//
+// lod: simplifies a flat grid, which must collapse to a few triangles without error, then
+// generates the levels of detail of each optimized mesh of each file and reports their
+// triangles, errors and time. Fails if a level references missing vertices, has degenerate
+// triangles or does not get coarser. Uses synthetic.obj like obj.
+//
+// dunes: checks that the SIMD dune generator matches its scalar reference, gives the same
+// heights for the same seed, different ones for another seed, and the same heights on the
+// shared edge of neighbouring tiles. Then reports megasamples per second of the reference, of
+// the SIMD path on one thread and of --tiles N x N (default 16) terrain tiles on the pool.
+//
+// lights: bins 1 to 4096 random point lights into the main camera's clusters, on one thread
+// and on the pool, and reports the binning time, the cluster entries and how many lights a
+// fragment loops over against the count a plain forward shader would. Fails if a fragment's
+// cluster misses a light that reaches it, checked against every light for random fragments.
+//
+// resolution: drives the dynamic resolution controller with a simulated GPU whose frame time
+// is a fixed part plus a part proportional to the pixels drawn, with noise and the profiler's
+// four frames of latency, through phases of light, heavy, impossible and light load again.
+// Reports the scale each phase settles at, how long it took and the frames over budget after.
+// Fails if a phase that fits the budget still misses it or keeps changing scale once settled,
+// or if the light phases do not return to full resolution.
+//
+// png: encodes each image (the cabin's diffuse map and a synthetic gradient with noise by
+// default) as RGBA and, flipped, as RGB the way batch rendering writes readbacks, decodes
+// the files with stb_image and fails if any pixel differs. Reports MB/s and the compressed
+// size, then images per second encoding 16 copies on the pool.
+//
+// y4m: converts random RGBA frames, one of them of odd size, to the 4:2:0 planes of a Y4M
+// recording, flipped like a readback, and fails if a sample is more than one step from a
+// double precision BT.601 reference or black and white do not land on 16 and 235. Reports
+// 1080p frames per second on one thread and on the pool, against the 60 a recording needs.
+//
+// ring: drives the staging ring's allocator with fake fence ids the way StagingRing does and
+// checks alignment, wrapping to offset 0, a full ring, requests larger than the ring, ranges
+// not submitted yet keeping it in use, and that retiring frees only up to the end of the last
+// signalled submission. Fails on the first case that does not hold.
+//
+// bc: compresses each image (the cabin's diffuse and normal maps by default) to BC1, to BC3
+// with a synthetic alpha ramp and cutout, and to BC5 the way TextureConverter does, decodes
+// the blocks again and reports the PSNR of the channels each format keeps and MP/s on the
+// pool. Fails when a format falls below its minimum PSNR.
+
+#include "ImageUtils.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "DuneGenerator.hpp"
+#include "LightClusters.hpp"
+#include "ResolutionController.hpp"
+#include "PngFile.hpp"
+#include "Y4mFile.hpp"
+#include "VertexFormat.hpp"
+#include "MipGenerator.hpp"
+#include "FastFloat.hpp"
+#include "ObjLoader.hpp"
+#include "ThreadPool.hpp"
+#include "RingAllocator.hpp"
+#include "BlockCompression.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <random>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct BenchmarkOptions
+{
+    int repeat = 3;
+    unsigned threads = 0;
+    size_t objMegabytes = 100;
+    int floatCount = 1000000;
+    int duneTiles = 16;
+    uint32_t seed = 1;
+};
+
+const double minimumPsnr = 45.0;
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool loadImage(std::string path, gps::Image& image)
+{
+    int n;
+    unsigned char* data = stbi_load(path.c_str(), &image.width, &image.height, &n, 4);
+    if (!data) {
+        std::cerr << "ERROR: could not load " << path << std::endl;
+        return false;
+    }
+    image.channels = 4;
+    image.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+    return true;
+}
+
+bool benchmarkMips(const std::vector<std::string>& paths, const BenchmarkOptions& options)
+{
+    std::vector<gps::Image> sources;
+    bool ok = true;
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        gps::Image source;
+        if (!loadImage(paths[i], source))
+            return false;
+        sources.push_back(source);
+        double megapixels = source.width * (double)source.height / 1e6;
+
+        for (int filter = gps::MIP_BOX; filter <= gps::MIP_KAISER; filter++) {
+            gps::Image reference = source;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            gps::GenerateMipChainReference(reference, (gps::MIP_FILTER)filter, true);
+            double referenceTime = millisecondsSince(start);
+
+            gps::Image fast;
+            double best = 1e30;
+            for (int run = 0; run < options.repeat; run++) {
+                fast = source;
+                start = std::chrono::steady_clock::now();
+                gps::GenerateMipChain(fast, (gps::MIP_FILTER)filter, true);
+                best = std::min(best, millisecondsSince(start));
+            }
+
+            double psnr = gps::CompareMipChains(fast, reference);
+            bool pass = psnr >= minimumPsnr;
+            ok = ok && pass;
+            std::cout << paths[i] << " " << source.width << "x" << source.height << " " << gps::GetMipFilterName((gps::MIP_FILTER)filter)
+                      << ": reference " << megapixels / (referenceTime / 1000.0) << " MP/s, simd "
+                      << megapixels / (best / 1000.0) << " MP/s (" << referenceTime / best << "x), PSNR "
+                      << psnr << " dB " << (pass ? "ok" : "FAIL") << std::endl;
+        }
+    }
+
+    gps::ThreadPool pool(options.threads);
+    double megapixels = 0.0;
+    for (size_t i = 0; i < sources.size(); i++)
+        megapixels += sources[i].width * (double)sources[i].height / 1e6;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sources.size(); i++) {
+        gps::Image image = sources[i];
+        gps::GenerateMipChain(image, gps::MIP_KAISER, true);
+    }
+    double serialTime = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    pool.ParallelFor(sources.size(), [&sources](size_t i) {
+        gps::Image image = sources[i];
+        gps::GenerateMipChain(image, gps::MIP_KAISER, true);
+    });
+    double parallelTime = millisecondsSince(start);
+
+    std::cout << "all images, kaiser: serial " << megapixels / (serialTime / 1000.0) << " MP/s, "
+              << pool.GetThreadCount() << " threads " << megapixels / (parallelTime / 1000.0) << " MP/s" << std::endl;
+    return ok;
+}
+
+// Runs body until it has taken at least a second of work, prints one result line and
+// returns the time per iteration in nanoseconds
+double runBenchmark(std::string name, size_t bytesPerIteration, std::function<void()> body)
+{
+    body();
+    long iterations = 0;
+    double elapsed = 0.0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (elapsed < 1000.0) {
+        body();
+        iterations++;
+        elapsed = millisecondsSince(start);
+    }
+
+    double nanoseconds = elapsed * 1e6 / iterations;
+    printf("%-44s %12.0f ns %8ld %10.2f GB/s\n", name.c_str(), nanoseconds, iterations,
+           bytesPerIteration / nanoseconds);
+    return nanoseconds;
+}
+
+// The loops the loaders used before ImageUtils, as the baseline
+void flipBytewise(unsigned char* pixels, int width, int height, int channels)
+{
+    int rowBytes = width * channels;
+    for (int row = 0; row < height / 2; row++) {
+        unsigned char* top = pixels + row * rowBytes;
+        unsigned char* bottom = pixels + (height - row - 1) * rowBytes;
+        for (int col = 0; col < rowBytes; col++) {
+            unsigned char temp = top[col];
+            top[col] = bottom[col];
+            bottom[col] = temp;
+        }
+    }
+}
+
+void expandBytewise(const unsigned char* rgb, unsigned char* rgba, size_t texelCount)
+{
+    for (size_t i = 0; i < texelCount; i++) {
+        for (int c = 0; c < 3; c++)
+            rgba[i * 4 + c] = rgb[i * 3 + c];
+        rgba[i * 4 + 3] = 255;
+    }
+}
+
+void swizzleBytewise(unsigned char* pixels, size_t texelCount, int channels)
+{
+    for (size_t i = 0; i < texelCount; i++)
+        std::swap(pixels[i * channels], pixels[i * channels + 2]);
+}
+
+void premultiplyBytewise(unsigned char* rgba, size_t texelCount)
+{
+    for (size_t i = 0; i < texelCount; i++) {
+        for (int c = 0; c < 3; c++)
+            rgba[i * 4 + c] = (unsigned char)((rgba[i * 4 + c] * rgba[i * 4 + 3] + 127) / 255);
+    }
+}
+
+bool benchmarkImageKernels(std::vector<std::string> paths)
+{
+    if (paths.empty()) {
+        paths.push_back("models/casa/WoodCabinDif.jpg");
+        paths.push_back("models/casa/WoodCabinNM.jpg");
+    }
+
+    for (size_t p = 0; p < paths.size(); p++) {
+        int width, height, n;
+        unsigned char* data = stbi_load(paths[p].c_str(), &width, &height, &n, 3);
+        if (!data) {
+            std::cerr << "ERROR: could not load " << paths[p] << std::endl;
+            return false;
+        }
+        size_t texels = (size_t)width * height;
+        std::vector<unsigned char> rgb(data, data + texels * 3);
+        stbi_image_free(data);
+        std::vector<unsigned char> rgba(texels * 4);
+        gps::ExpandRgbToRgba(rgb.data(), rgba.data(), texels);
+
+        std::string size = "/" + std::to_string(width) + "x" + std::to_string(height);
+        std::cout << paths[p] << std::endl;
+        runBenchmark("BM_FlipRows_Bytewise" + size, texels * 4, [&]() { flipBytewise(rgba.data(), width, height, 4); });
+        runBenchmark("BM_FlipRows" + size, texels * 4, [&]() { gps::FlipRows(rgba.data(), width, height, 4); });
+        runBenchmark("BM_ExpandRgbToRgba_Bytewise" + size, texels * 4, [&]() { expandBytewise(rgb.data(), rgba.data(), texels); });
+        runBenchmark("BM_ExpandRgbToRgba" + size, texels * 4, [&]() { gps::ExpandRgbToRgba(rgb.data(), rgba.data(), texels); });
+        runBenchmark("BM_SwizzleBgr3_Bytewise" + size, texels * 3, [&]() { swizzleBytewise(rgb.data(), texels, 3); });
+        runBenchmark("BM_SwizzleBgr3" + size, texels * 3, [&]() { gps::SwizzleBgr(rgb.data(), texels, 3); });
+        runBenchmark("BM_SwizzleBgr4_Bytewise" + size, texels * 4, [&]() { swizzleBytewise(rgba.data(), texels, 4); });
+        runBenchmark("BM_SwizzleBgr4" + size, texels * 4, [&]() { gps::SwizzleBgr(rgba.data(), texels, 4); });
+        // premultiplying repeatedly would darken the image to black, which some kernels handle faster
+        std::vector<unsigned char> original = rgba;
+        runBenchmark("BM_PremultiplyAlpha_Bytewise" + size, texels * 4, [&]() {
+            memcpy(rgba.data(), original.data(), rgba.size());
+            premultiplyBytewise(rgba.data(), texels);
+        });
+        runBenchmark("BM_PremultiplyAlpha" + size, texels * 4, [&]() {
+            memcpy(rgba.data(), original.data(), rgba.size());
+            gps::PremultiplyAlpha(rgba.data(), texels);
+        });
+    }
+    return true;
+}
+
+// A terrain-like grid split into groups with a few materials; some faces use relative indices
+bool writeSyntheticObj(std::string path, size_t megabytes)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        std::cerr << "ERROR: could not write " << path << std::endl;
+        return false;
+    }
+
+    const int rowLength = 512;
+    const int rowsPerGroup = 16;
+    long vertexCount = 0;
+    for (int group = 0; (size_t)ftell(file) < megabytes * 1024 * 1024; group++) {
+        fprintf(file, "g tile_%d\nusemtl sand%d\n", group, group % 3);
+        for (int row = 0; row <= rowsPerGroup; row++) {
+            for (int x = 0; x < rowLength; x++) {
+                float height = 0.25f * sinf(x * 0.05f) * cosf((group * rowsPerGroup + row) * 0.07f);
+                fprintf(file, "v %.6f %.6f %.6f\nvt %.5f %.5f\nvn %.4f %.4f %.4f\n",
+                        x * 0.1f, height, (group * rowsPerGroup + row) * 0.1f,
+                        x / (float)rowLength, row / (float)rowsPerGroup, 0.0f, 1.0f, 0.0f);
+            }
+        }
+        for (int row = 0; row < rowsPerGroup; row++) {
+            if (row == rowsPerGroup / 2)
+                fprintf(file, "usemtl rock\n");
+            for (int x = 0; x + 1 < rowLength; x++) {
+                long a = vertexCount + row * rowLength + x + 1;
+                long b = a + rowLength;
+                if (row == rowsPerGroup - 1 && x == 0) {
+                    // one face counted backwards from the last vertex of the group
+                    long relative = b + 1 - (vertexCount + (rowsPerGroup + 1) * rowLength) - 1;
+                    fprintf(file, "f %ld/%ld/%ld %ld/%ld/%ld %ld/%ld/%ld %ld/%ld/%ld\n", a, a, a, b, b, b,
+                            relative, relative, relative, a + 1, a + 1, a + 1);
+                    continue;
+                }
+                fprintf(file, "f %ld/%ld/%ld %ld/%ld/%ld %ld/%ld/%ld %ld/%ld/%ld\n", a, a, a, b, b, b, b + 1, b + 1, b + 1, a + 1, a + 1, a + 1);
+            }
+        }
+        vertexCount += (rowsPerGroup + 1) * rowLength;
+    }
+    fclose(file);
+    return true;
+}
+
+// Empty when both loaders produced the same data
+std::string compareObj(const tinyobj::attrib_t& attribA, const std::vector<tinyobj::shape_t>& shapesA,
+                       const tinyobj::attrib_t& attribB, const std::vector<tinyobj::shape_t>& shapesB)
+{
+    const std::vector<float>* arraysA[3] = { &attribA.vertices, &attribA.normals, &attribA.texcoords };
+    const std::vector<float>* arraysB[3] = { &attribB.vertices, &attribB.normals, &attribB.texcoords };
+    for (int a = 0; a < 3; a++) {
+        if (arraysA[a]->size() != arraysB[a]->size())
+            return "attribute counts differ";
+        for (size_t i = 0; i < arraysA[a]->size(); i++) {
+            float x = (*arraysA[a])[i], y = (*arraysB[a])[i];
+            // both parse numbers with gps::ParseDouble, so they must agree exactly
+            if (x != y)
+                return "attribute " + std::to_string(i) + " differs: " + std::to_string(x) + " vs " + std::to_string(y);
+        }
+    }
+
+    if (shapesA.size() != shapesB.size())
+        return "shape counts differ: " + std::to_string(shapesA.size()) + " vs " + std::to_string(shapesB.size());
+    for (size_t s = 0; s < shapesA.size(); s++) {
+        const tinyobj::mesh_t& a = shapesA[s].mesh;
+        const tinyobj::mesh_t& b = shapesB[s].mesh;
+        if (shapesA[s].name != shapesB[s].name)
+            return "shape " + std::to_string(s) + " names differ";
+        if (a.indices.size() != b.indices.size() || a.num_face_vertices != b.num_face_vertices || a.material_ids != b.material_ids)
+            return "shape " + std::to_string(s) + " faces differ";
+        for (size_t i = 0; i < a.indices.size(); i++) {
+            if (a.indices[i].vertex_index != b.indices[i].vertex_index ||
+                a.indices[i].normal_index != b.indices[i].normal_index ||
+                a.indices[i].texcoord_index != b.indices[i].texcoord_index)
+                return "shape " + std::to_string(s) + " index " + std::to_string(i) + " differs";
+        }
+    }
+    return "";
+}
+
+bool benchmarkObj(std::vector<std::string> paths, const BenchmarkOptions& options)
+{
+    if (paths.empty()) {
+        paths.push_back("synthetic.obj");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!writeSyntheticObj(paths[0], options.objMegabytes))
+            return false;
+        std::cout << "wrote " << paths[0] << " in " << millisecondsSince(start) << " ms" << std::endl;
+    }
+
+    gps::ThreadPool pool(options.threads);
+    bool ok = true;
+    for (size_t p = 0; p < paths.size(); p++) {
+        std::string basePath = paths[p].substr(0, paths[p].find_last_of('/') + 1);
+        struct stat info;
+        double megabytes = stat(paths[p].c_str(), &info) == 0 ? info.st_size / (1024.0 * 1024.0) : 0.0;
+
+        tinyobj::attrib_t attribA, attribB;
+        std::vector<tinyobj::shape_t> shapesA, shapesB;
+        std::vector<tinyobj::material_t> materialsA, materialsB;
+        std::string errA, errB;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool loadedA = tinyobj::LoadObj(&attribA, &shapesA, &materialsA, &errA, paths[p].c_str(), basePath.c_str(), true);
+        double tinyobjTime = millisecondsSince(start);
+
+        gps::Arena arena;
+        start = std::chrono::steady_clock::now();
+        bool loadedB = gps::LoadObj(&attribB, &shapesB, &materialsB, &errB, paths[p].c_str(), basePath.c_str(), true, &pool, &arena);
+        double parallelTime = millisecondsSince(start);
+        gps::ArenaStats arenaStats = arena.GetStats();
+
+        std::string difference = loadedA && loadedB ? compareObj(attribA, shapesA, attribB, shapesB) : "could not load";
+        if (materialsA.size() != materialsB.size())
+            difference = "material counts differ";
+        ok = ok && difference.empty();
+
+        std::cout << paths[p] << " (" << megabytes << " MB, " << shapesA.size() << " shapes): tinyobj "
+                  << tinyobjTime << " ms (" << megabytes / (tinyobjTime / 1000.0) << " MB/s), parallel "
+                  << parallelTime << " ms (" << megabytes / (parallelTime / 1000.0) << " MB/s, "
+                  << pool.GetThreadCount() + 1 << " threads), " << tinyobjTime / parallelTime << "x, "
+                  << (difference.empty() ? "identical" : "MISMATCH: " + difference) << std::endl;
+        std::cout << "  load arena: " << arenaStats.allocations << " allocations from " << arenaStats.blocks
+                  << " blocks, peak " << arenaStats.peakBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+    return ok;
+}
+
+// What a loader produced, to check both paths agree
+struct LoadSummary
+{
+    size_t vertices = 0;
+    double checksum = 0.0;
+};
+
+void addVertex(LoadSummary& summary, const gps::Vertex& vertex)
+{
+    summary.vertices++;
+    summary.checksum += vertex.Position.x + vertex.Position.y * 3.0 + vertex.Position.z * 7.0 +
+                        vertex.Normal.y + vertex.TexCoords.x + vertex.TexCoords.y;
+}
+
+// Model3D::ParseOBJ without the GL side: the parsed file plus de-indexed vertices for every shape
+bool loadBuffered(std::string path, std::string basePath, LoadSummary& summary)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    if (!gps::LoadObj(&attrib, &shapes, &materials, &err, path.c_str(), basePath.c_str(), true, NULL))
+        return false;
+
+    std::vector<std::vector<gps::Vertex>> meshes(shapes.size());
+    for (size_t s = 0; s < shapes.size(); s++) {
+        for (size_t i = 0; i < shapes[s].mesh.indices.size(); i++) {
+            const tinyobj::index_t& index = shapes[s].mesh.indices[i];
+            gps::Vertex vertex;
+            vertex.Position = glm::vec3(attrib.vertices[index.vertex_index * 3], attrib.vertices[index.vertex_index * 3 + 1],
+                                        attrib.vertices[index.vertex_index * 3 + 2]);
+            vertex.Normal = index.normal_index < 0 ? glm::vec3(0.0f) :
+                glm::vec3(attrib.normals[index.normal_index * 3], attrib.normals[index.normal_index * 3 + 1],
+                          attrib.normals[index.normal_index * 3 + 2]);
+            vertex.TexCoords = index.texcoord_index < 0 ? glm::vec2(0.0f) :
+                glm::vec2(attrib.texcoords[index.texcoord_index * 2], attrib.texcoords[index.texcoord_index * 2 + 1]);
+            meshes[s].push_back(vertex);
+            addVertex(summary, vertex);
+        }
+    }
+    return true;
+}
+
+// gps::StreamObj into a pool of chunks that are recycled as soon as they are summed up
+bool loadStreamed(std::string path, std::string basePath, LoadSummary& summary)
+{
+    std::vector<std::unique_ptr<gps::Vertex[]>> pool;
+    std::vector<gps::Vertex*> freeChunks;
+    for (int i = 0; i < 8; i++) {
+        pool.push_back(std::unique_ptr<gps::Vertex[]>(new gps::Vertex[gps::objChunkVertices]));
+        freeChunks.push_back(pool.back().get());
+    }
+
+    gps::ObjStreamCallbacks callbacks;
+    callbacks.beginMesh = [](const tinyobj::material_t*) {};
+    callbacks.acquireChunk = [&]() {
+        gps::Vertex* chunk = freeChunks.back();
+        freeChunks.pop_back();
+        return chunk;
+    };
+    callbacks.submitChunk = [&](gps::Vertex* chunk, size_t count) {
+        for (size_t i = 0; i < count; i++)
+            addVertex(summary, chunk[i]);
+        freeChunks.push_back(chunk);
+    };
+    std::string err;
+    return gps::StreamObj(path.c_str(), basePath.c_str(), callbacks, &err);
+}
+
+// Runs one loader in a child process so each gets its own peak resident set
+bool measurePeakRss(std::string name, std::string path, std::function<bool(std::string, std::string, LoadSummary&)> load)
+{
+    std::cout.flush();
+    pid_t child = fork();
+    if (child == 0) {
+        std::string basePath = path.substr(0, path.find_last_of('/') + 1);
+        LoadSummary summary;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool loaded = load(path, basePath, summary);
+        double time = millisecondsSince(start);
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        printf("  %-9s %9.1f ms, peak RSS %7.1f MB, %zu vertices, checksum %.6e\n", name.c_str(), time,
+               usage.ru_maxrss / 1024.0, summary.vertices, summary.checksum);
+        fflush(stdout);
+        _exit(loaded ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    return child > 0 && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+bool benchmarkObjMemory(std::vector<std::string> paths, const BenchmarkOptions& options)
+{
+    if (paths.empty()) {
+        paths.push_back("synthetic.obj");
+        struct stat info;
+        if (stat(paths[0].c_str(), &info) != 0 || info.st_size / (1024 * 1024) != (off_t)options.objMegabytes) {
+            if (!writeSyntheticObj(paths[0], options.objMegabytes))
+                return false;
+        }
+    }
+
+    bool ok = true;
+    for (size_t p = 0; p < paths.size(); p++) {
+        struct stat info;
+        double megabytes = stat(paths[p].c_str(), &info) == 0 ? info.st_size / (1024.0 * 1024.0) : 0.0;
+        std::cout << paths[p] << " (" << megabytes << " MB)" << std::endl;
+        ok = measurePeakRss("buffered", paths[p], loadBuffered) && ok;
+        ok = measurePeakRss("streamed", paths[p], loadStreamed) && ok;
+    }
+    return ok;
+}
+
+// Order independent hash of the triangles a mesh draws, each rotated to start at its
+// smallest vertex so reordering the corners of a triangle without flipping it does not count
+uint64_t hashTriangles(const gps::MeshData& mesh)
+{
+    uint64_t sum = 0;
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+        const gps::Vertex* corners[3];
+        for (int k = 0; k < 3; k++)
+            corners[k] = &mesh.vertices[mesh.indices[t + k]];
+        int first = 0;
+        for (int k = 1; k < 3; k++)
+            if (memcmp(corners[k], corners[first], sizeof(gps::Vertex)) < 0)
+                first = k;
+
+        uint64_t hash = 14695981039346656037ull;
+        for (int k = 0; k < 3; k++) {
+            const unsigned char* bytes = (const unsigned char*)corners[(first + k) % 3];
+            for (size_t b = 0; b < sizeof(gps::Vertex); b++)
+                hash = (hash ^ bytes[b]) * 1099511628211ull;
+        }
+        sum += hash;
+    }
+    return sum;
+}
+
+bool benchmarkMeshOptimizer(std::vector<std::string> paths, const BenchmarkOptions& options)
+{
+    if (paths.empty()) {
+        paths.push_back("synthetic.obj");
+        struct stat info;
+        if (stat(paths[0].c_str(), &info) != 0 || info.st_size / (1024 * 1024) != (off_t)options.objMegabytes) {
+            if (!writeSyntheticObj(paths[0], options.objMegabytes))
+                return false;
+        }
+    }
+
+    bool ok = true;
+    for (size_t p = 0; p < paths.size(); p++) {
+        std::string basePath = paths[p].substr(0, paths[p].find_last_of('/') + 1);
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string err;
+        if (!gps::LoadObj(&attrib, &shapes, &materials, &err, paths[p].c_str(), basePath.c_str(), true, NULL)) {
+            std::cerr << "ERROR: could not load " << paths[p] << std::endl;
+            ok = false;
+            continue;
+        }
+
+        // the de-indexed meshes ParseOBJ hands to the optimizer
+        std::vector<gps::MeshData> meshes(shapes.size());
+        for (size_t s = 0; s < shapes.size(); s++) {
+            for (size_t i = 0; i < shapes[s].mesh.indices.size(); i++) {
+                const tinyobj::index_t& index = shapes[s].mesh.indices[i];
+                gps::Vertex vertex;
+                vertex.Position = glm::vec3(attrib.vertices[index.vertex_index * 3], attrib.vertices[index.vertex_index * 3 + 1],
+                                            attrib.vertices[index.vertex_index * 3 + 2]);
+                vertex.Normal = index.normal_index < 0 ? glm::vec3(0.0f) :
+                    glm::vec3(attrib.normals[index.normal_index * 3], attrib.normals[index.normal_index * 3 + 1],
+                              attrib.normals[index.normal_index * 3 + 2]);
+                vertex.TexCoords = index.texcoord_index < 0 ? glm::vec2(0.0f) :
+                    glm::vec2(attrib.texcoords[index.texcoord_index * 2], attrib.texcoords[index.texcoord_index * 2 + 1]);
+                meshes[s].vertices.push_back(vertex);
+                meshes[s].indices.push_back((GLuint)i);
+            }
+        }
+
+        std::vector<uint64_t> hashes(meshes.size());
+        std::vector<gps::MeshOptimizationStats> stats(meshes.size());
+        for (size_t s = 0; s < meshes.size(); s++) {
+            hashes[s] = hashTriangles(meshes[s]);
+            stats[s].triangles = meshes[s].indices.size() / 3;
+            stats[s].verticesBefore = meshes[s].vertices.size();
+            stats[s].parsed = gps::AnalyzeVertexCache(meshes[s].indices, meshes[s].vertices.size());
+        }
+
+        // the stages of gps::OptimizeMesh, timed one at a time over every mesh
+        double times[4] = { 0.0, 0.0, 0.0, 0.0 };
+        const char* stages[4] = { "weld", "vertex cache", "overdraw", "vertex fetch" };
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < meshes.size(); s++) {
+            gps::WeldVertices(meshes[s].vertices, meshes[s].indices);
+            stats[s].welded = gps::AnalyzeVertexCache(meshes[s].indices, meshes[s].vertices.size());
+        }
+        times[0] = millisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < meshes.size(); s++)
+            gps::OptimizeVertexCache(meshes[s].indices, meshes[s].vertices.size());
+        times[1] = millisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < meshes.size(); s++)
+            gps::OptimizeOverdraw(meshes[s].indices, meshes[s].vertices);
+        times[2] = millisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < meshes.size(); s++)
+            gps::OptimizeVertexFetch(meshes[s].vertices, meshes[s].indices);
+        times[3] = millisecondsSince(start);
+
+        bool same = true;
+        for (size_t s = 0; s < meshes.size(); s++) {
+            stats[s].verticesAfter = meshes[s].vertices.size();
+            stats[s].optimized = gps::AnalyzeVertexCache(meshes[s].indices, meshes[s].vertices.size());
+            same = same && hashTriangles(meshes[s]) == hashes[s] && meshes[s].indices.size() == stats[s].triangles * 3;
+        }
+
+        gps::MeshOptimizationStats total = gps::CombineStats(stats);
+        std::cout << paths[p] << ": " << meshes.size() << " meshes, " << total.triangles << " triangles, "
+                  << total.verticesBefore << " -> " << total.verticesAfter << " vertices" << std::endl;
+        for (int i = 0; i < 4; i++)
+            printf("  %-13s %9.1f ms\n", stages[i], times[i]);
+        printf("  %-13s  ACMR %.3f  ATVR %.3f\n", "parsed", total.parsed.acmr, total.parsed.atvr);
+        printf("  %-13s  ACMR %.3f  ATVR %.3f\n", "welded", total.welded.acmr, total.welded.atvr);
+        printf("  %-13s  ACMR %.3f  ATVR %.3f\n", "optimized", total.optimized.acmr, total.optimized.atvr);
+
+        // the compact layout against the float vertices, position error relative to the bounds
+        double positionError = 0.0, normalDegrees = 0.0, texCoordError = 0.0;
+        start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < meshes.size(); s++) {
+            std::vector<gps::CompactVertex> compact;
+            gps::VertexDequantization dequantization;
+            gps::CompressVertices(meshes[s].vertices, compact, dequantization);
+            float extent = std::max(std::max(dequantization.positionScale.x, dequantization.positionScale.y),
+                                    dequantization.positionScale.z);
+            for (size_t v = 0; v < compact.size(); v++) {
+                const gps::Vertex& original = meshes[s].vertices[v];
+                gps::Vertex decoded = gps::DecompressVertex(compact[v], dequantization);
+                if (extent > 0.0f)
+                    positionError = std::max(positionError, (double)glm::length(decoded.Position - original.Position) / extent);
+                texCoordError = std::max(texCoordError, (double)glm::length(decoded.TexCoords - original.TexCoords));
+                if (glm::length(original.Normal) > 0.0f) {
+                    float cosine = glm::dot(decoded.Normal, glm::normalize(original.Normal));
+                    normalDegrees = std::max(normalDegrees, acos(std::min(1.0f, cosine)) * 180.0 / M_PI);
+                }
+            }
+        }
+        printf("  %-13s %9.1f ms, %zu -> %zu bytes per vertex, max error: position %.2e of the bounds, normal %.4f deg, uv %.2e\n",
+               "compact", millisecondsSince(start), sizeof(gps::Vertex), sizeof(gps::CompactVertex),
+               positionError, normalDegrees, texCoordError);
+
+        if (!same) {
+            std::cerr << "ERROR: the optimized meshes of " << paths[p] << " draw different triangles" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Checks the levels of detail of a mesh are well formed and get coarser
+std::string checkLods(const gps::MeshData& mesh)
+{
+    for (size_t l = 0; l < mesh.lods.size(); l++) {
+        const gps::MeshLod& lod = mesh.lods[l];
+        if (lod.indexCount % 3 != 0 || (size_t)lod.firstIndex + lod.indexCount > mesh.indices.size())
+            return "level " + std::to_string(l) + " is out of range";
+        if (l > 0 && (lod.indexCount >= mesh.lods[l - 1].indexCount || lod.error < mesh.lods[l - 1].error))
+            return "level " + std::to_string(l) + " is not coarser than the one before";
+        for (size_t i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; i += 3) {
+            const GLuint* triangle = &mesh.indices[i];
+            if (triangle[0] >= mesh.vertices.size() || triangle[1] >= mesh.vertices.size() || triangle[2] >= mesh.vertices.size())
+                return "level " + std::to_string(l) + " references a missing vertex";
+            const glm::vec3& a = mesh.vertices[triangle[0]].Position;
+            const glm::vec3& b = mesh.vertices[triangle[1]].Position;
+            const glm::vec3& c = mesh.vertices[triangle[2]].Position;
+            // the source mesh may come with degenerate triangles, the simplifier may not add any
+            if (l > 0 && (a == b || b == c || a == c))
+                return "level " + std::to_string(l) + " has a degenerate triangle";
+        }
+    }
+    return "";
+}
+
+bool benchmarkLods(std::vector<std::string> paths, const BenchmarkOptions& options)
+{
+    // a flat, finely tessellated square has nothing to lose: it must collapse without error
+    const int gridSize = 64;
+    gps::MeshData grid;
+    for (int z = 0; z <= gridSize; z++) {
+        for (int x = 0; x <= gridSize; x++) {
+            gps::Vertex vertex;
+            vertex.Position = glm::vec3(x / (float)gridSize, 0.0f, z / (float)gridSize);
+            vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            vertex.TexCoords = glm::vec2(0.0f);
+            grid.vertices.push_back(vertex);
+        }
+    }
+    for (int z = 0; z < gridSize; z++) {
+        for (int x = 0; x < gridSize; x++) {
+            GLuint a = z * (gridSize + 1) + x, b = a + gridSize + 1;
+            GLuint quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+            grid.indices.insert(grid.indices.end(), quad, quad + 6);
+        }
+    }
+    std::vector<GLuint> simplified;
+    float gridError = gps::SimplifyMesh(grid.vertices, grid.indices, 6, simplified);
+    std::cout << "flat grid: " << grid.indices.size() / 3 << " -> " << simplified.size() / 3
+              << " triangles, error " << gridError << std::endl;
+    bool ok = gridError < 1e-5f && simplified.size() <= grid.indices.size() / 20;
+    if (!ok)
+        std::cerr << "ERROR: the flat grid did not simplify cleanly" << std::endl;
+
+    if (paths.empty()) {
+        paths.push_back("synthetic.obj");
+        struct stat info;
+        if (stat(paths[0].c_str(), &info) != 0 || info.st_size / (1024 * 1024) != (off_t)options.objMegabytes) {
+            if (!writeSyntheticObj(paths[0], options.objMegabytes))
+                return false;
+        }
+    }
+
+    for (size_t p = 0; p < paths.size(); p++) {
+        std::string basePath = paths[p].substr(0, paths[p].find_last_of('/') + 1);
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string err;
+        if (!gps::LoadObj(&attrib, &shapes, &materials, &err, paths[p].c_str(), basePath.c_str(), true, NULL)) {
+            std::cerr << "ERROR: could not load " << paths[p] << std::endl;
+            ok = false;
+            continue;
+        }
+
+        std::vector<gps::MeshData> meshes(shapes.size());
+        for (size_t s = 0; s < shapes.size(); s++) {
+            for (size_t i = 0; i < shapes[s].mesh.indices.size(); i++) {
+                const tinyobj::index_t& index = shapes[s].mesh.indices[i];
+                gps::Vertex vertex;
+                vertex.Position = glm::vec3(attrib.vertices[index.vertex_index * 3], attrib.vertices[index.vertex_index * 3 + 1],
+                                            attrib.vertices[index.vertex_index * 3 + 2]);
+                vertex.Normal = index.normal_index < 0 ? glm::vec3(0.0f) :
+                    glm::vec3(attrib.normals[index.normal_index * 3], attrib.normals[index.normal_index * 3 + 1],
+                              attrib.normals[index.normal_index * 3 + 2]);
+                vertex.TexCoords = index.texcoord_index < 0 ? glm::vec2(0.0f) :
+                    glm::vec2(attrib.texcoords[index.texcoord_index * 2], attrib.texcoords[index.texcoord_index * 2 + 1]);
+                meshes[s].vertices.push_back(vertex);
+                meshes[s].indices.push_back((GLuint)i);
+            }
+            gps::OptimizeMesh(meshes[s]);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < meshes.size(); s++)
+            gps::GenerateLods(meshes[s], 4);
+        double time = millisecondsSince(start);
+
+        // per level totals, meshes with fewer levels counted at their coarsest
+        size_t triangles[4] = { 0, 0, 0, 0 };
+        float errors[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (size_t s = 0; s < meshes.size(); s++) {
+            std::string problem = checkLods(meshes[s]);
+            if (!problem.empty()) {
+                std::cerr << "ERROR: mesh " << s << " of " << paths[p] << ": " << problem << std::endl;
+                ok = false;
+            }
+            for (size_t l = 0; l < 4; l++) {
+                const gps::MeshLod& lod = meshes[s].lods[std::min(l, meshes[s].lods.size() - 1)];
+                triangles[l] += lod.indexCount / 3;
+                errors[l] = std::max(errors[l], lod.error);
+            }
+        }
+        std::cout << paths[p] << ": " << meshes.size() << " meshes in " << time << " ms" << std::endl;
+        for (int l = 0; l < 4; l++)
+            printf("  LOD %d %10zu triangles, error %.3e\n", l, triangles[l], errors[l]);
+    }
+    return ok;
+}
+
+bool benchmarkDunes(const BenchmarkOptions& options)
+{
+    // the terrain's default tile: 64 units, 256 quads and a one sample apron
+    const float tileSize = 64.0f;
+    const int resolution = 258;
+    const float spacing = tileSize / 256;
+    const size_t tileSamples = (size_t)(resolution + 1) * (resolution + 1);
+
+    gps::DuneOptions duneOptions;
+    duneOptions.seed = options.seed;
+    gps::DuneGenerator generator(duneOptions);
+    // far from the origin, at (-40000, 25000), where float coordinates have lost some precision
+    glm::ivec2 first(-160000, 100000);
+
+    std::vector<float> fast(tileSamples), reference(tileSamples), again(tileSamples);
+    generator.Generate(first, spacing, resolution, fast.data());
+    generator.GenerateReference(first, spacing, resolution, reference.data());
+    float maxError = 0.0f, minHeight = 1e30f, maxHeight = -1e30f;
+    for (size_t i = 0; i < tileSamples; i++) {
+        maxError = std::max(maxError, std::fabs(fast[i] - reference[i]));
+        minHeight = std::min(minHeight, fast[i]);
+        maxHeight = std::max(maxHeight, fast[i]);
+    }
+    bool ok = maxError <= 1e-3f * duneOptions.height;
+    std::cout << gps::DuneGenerator::GetInstructionSet() << " (" << gps::DuneGenerator::GetLaneCount() << " lanes), seed "
+              << duneOptions.seed << ": heights " << minHeight << " to " << maxHeight << ", largest difference from the reference "
+              << maxError << (ok ? " ok" : " FAIL") << std::endl;
+
+    generator.Generate(first, spacing, resolution, again.data());
+    bool deterministic = memcmp(fast.data(), again.data(), tileSamples * sizeof(float)) == 0;
+    gps::DuneOptions otherOptions = duneOptions;
+    otherOptions.seed++;
+    gps::DuneGenerator(otherOptions).Generate(first, spacing, resolution, again.data());
+    bool seeded = memcmp(fast.data(), again.data(), tileSamples * sizeof(float)) != 0;
+
+    // the last columns of one tile are the first of the next, and must come out the same exactly
+    gps::DuneGenerator(duneOptions).Generate(first + glm::ivec2(256, 0), spacing, resolution, again.data());
+    float seamError = 0.0f;
+    for (int j = 0; j <= resolution; j++)
+        for (int i = 0; i + 256 <= resolution; i++)
+            seamError = std::max(seamError, std::fabs(fast[(size_t)j * (resolution + 1) + i + 256] - again[(size_t)j * (resolution + 1) + i]));
+    bool seamless = seamError == 0.0f;
+    std::cout << "same seed " << (deterministic ? "identical" : "DIFFERS") << ", next seed " << (seeded ? "differs" : "IDENTICAL")
+              << ", tile edges differ by " << seamError << (seamless ? " ok" : " FAIL") << std::endl;
+    ok = ok && deterministic && seeded && seamless;
+
+    double referenceTime = 1e30, fastTime = 1e30;
+    for (int run = 0; run < options.repeat; run++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        generator.GenerateReference(first, spacing, resolution, reference.data());
+        referenceTime = std::min(referenceTime, millisecondsSince(start));
+        start = std::chrono::steady_clock::now();
+        generator.Generate(first, spacing, resolution, fast.data());
+        fastTime = std::min(fastTime, millisecondsSince(start));
+    }
+    std::cout << "one tile: reference " << tileSamples / (referenceTime * 1e3) << " MS/s, simd "
+              << tileSamples / (fastTime * 1e3) << " MS/s (" << referenceTime / fastTime << "x)" << std::endl;
+
+    gps::ThreadPool pool(options.threads);
+    size_t tileCount = (size_t)options.duneTiles * options.duneTiles;
+    std::vector<std::vector<float>> tiles(tileCount, std::vector<float>(tileSamples));
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.ParallelFor(tileCount, [&](size_t t) {
+        glm::ivec2 tileFirst = first + glm::ivec2((int)(t % options.duneTiles), (int)(t / options.duneTiles)) * 256;
+        generator.Generate(tileFirst, spacing, resolution, tiles[t].data());
+    });
+    double worldTime = millisecondsSince(start);
+    std::cout << options.duneTiles << "x" << options.duneTiles << " tiles (" << options.duneTiles * tileSize << " units square) on "
+              << pool.GetThreadCount() << " threads: " << tileCount * tileSamples / (worldTime * 1e3) << " MS/s, "
+              << worldTime << " ms" << std::endl;
+    return ok;
+}
+
+// One random number as text, in one of the forms checkFloats covers
+std::string randomNumber(int kind, std::mt19937_64& random)
+{
+    char text[128];
+    std::uniform_int_distribution<int> digit(0, 9);
+    const char* sign = random() & 1 ? "-" : "";
+    switch (kind) {
+        case 0: {
+            // what exporters write into .obj files: a few integer digits and up to 9 decimals
+            int decimals = 1 + random() % 9;
+            double value = std::uniform_real_distribution<double>(0.0, 2000.0)(random);
+            snprintf(text, sizeof(text), "%s%.*f", sign, decimals, value);
+            break;
+        }
+        case 1: {
+            double value = std::uniform_real_distribution<double>(1.0, 10.0)(random);
+            int exponent = (int)(random() % 80) - 40;
+            snprintf(text, sizeof(text), "%s%.*e", sign, (int)(random() % 8), value * pow(10.0, exponent));
+            break;
+        }
+        case 2: {
+            // shortest round trip text of any finite double, the hardest case for the fast path
+            uint64_t bits;
+            double value;
+            do {
+                bits = random();
+                memcpy(&value, &bits, sizeof(value));
+            } while (!std::isfinite(value));
+            snprintf(text, sizeof(text), "%.17g", value);
+            break;
+        }
+        default: {
+            // more digits than fit in 64 bits
+            std::string digits = sign;
+            int length = 20 + random() % 40;
+            int point = random() % length;
+            for (int i = 0; i < length; i++) {
+                if (i == point)
+                    digits += '.';
+                digits += (char)('0' + digit(random));
+            }
+            snprintf(text, sizeof(text), "%se%d", digits.c_str(), (int)(random() % 40) - 20);
+            break;
+        }
+    }
+    return text;
+}
+
+bool checkFloats(const BenchmarkOptions& options)
+{
+    const char* kindNames[] = {"fixed point", "scientific", "round trip", "long"};
+    std::mt19937_64 random(12345);
+    bool ok = true;
+
+    for (int kind = 0; kind < 4; kind++) {
+        long doubleMismatches = 0, floatMismatches = 0;
+        uint64_t worstUlps = 0;
+        std::string worst;
+        for (int i = 0; i < options.floatCount; i++) {
+            std::string text = randomNumber(kind, random);
+            double expected = strtod(text.c_str(), NULL);
+            double parsed = 0.0;
+            const char* end = gps::ParseDouble(text.c_str(), text.c_str() + text.size(), parsed);
+            if (end != text.c_str() + text.size()) {
+                std::cerr << "ERROR: stopped early on " << text << std::endl;
+                return false;
+            }
+            if (parsed == expected)
+                continue;
+            doubleMismatches++;
+            floatMismatches += (float)parsed != (float)expected;
+            uint64_t a, b;
+            memcpy(&a, &parsed, sizeof(a));
+            memcpy(&b, &expected, sizeof(b));
+            uint64_t ulps = a > b ? a - b : b - a;
+            if (ulps > worstUlps) {
+                worstUlps = ulps;
+                worst = text;
+            }
+        }
+        // OBJ coordinates end up as floats, so those must match; doubles may be an ulp off
+        // outside the exact fast path
+        bool passed = floatMismatches == 0 && (kind == 0 ? doubleMismatches == 0 : worstUlps <= 1);
+        ok = ok && passed;
+        std::cout << kindNames[kind] << ": " << options.floatCount << " numbers, " << doubleMismatches
+                  << " doubles and " << floatMismatches << " floats differ from strtod";
+        if (worstUlps > 0)
+            std::cout << ", worst " << worstUlps << " ulp on " << worst;
+        std::cout << (passed ? "" : " - FAILED") << std::endl;
+    }
+
+    // vertex lines without the "v", as tinyobj hands tokens to the parser
+    std::string buffer;
+    std::vector<size_t> starts;
+    for (int i = 0; i < options.floatCount; i++) {
+        starts.push_back(buffer.size());
+        buffer += randomNumber(0, random);
+        buffer += i % 3 == 2 ? '\n' : ' ';
+    }
+    const char* base = buffer.c_str();
+    double sum = 0.0;
+    double strtodTime = runBenchmark("BM_strtod/" + std::to_string(options.floatCount), buffer.size(), [&]() {
+        for (size_t i = 0; i < starts.size(); i++)
+            sum += strtod(base + starts[i], NULL);
+    });
+    double fastTime = runBenchmark("BM_ParseDouble/" + std::to_string(options.floatCount), buffer.size(), [&]() {
+        const char* end = base + buffer.size();
+        for (size_t i = 0; i < starts.size(); i++) {
+            double value = 0.0;
+            gps::ParseDouble(base + starts[i], end, value);
+            sum += value;
+        }
+    });
+    std::cout << "strtod " << buffer.size() / (strtodTime / 1e3) << " MB/s, ParseDouble "
+              << buffer.size() / (fastTime / 1e3) << " MB/s, " << strtodTime / fastTime << "x"
+              << (sum == 0.0 ? " " : "") << std::endl;
+    return ok;
+}
+
+bool benchmarkLights(const BenchmarkOptions& options)
+{
+    // the main pass's camera, looking down -z from the origin of a 16:9 window
+    const float fovY = 45.0f * 3.14159265f / 180.0f;
+    const float aspect = 16.0f / 9.0f;
+    const float tanHalfY = std::tan(fovY * 0.5f);
+    const int fragmentCount = 20000;
+    gps::ThreadPool pool(options.threads);
+    std::mt19937 random(options.seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // fragments anywhere on screen, spread evenly over the depth slices up to 100 units
+    std::vector<glm::vec3> fragments(fragmentCount);
+    for (int i = 0; i < fragmentCount; i++) {
+        float depth = 0.5f * std::pow(200.0f, unit(random));
+        fragments[i] = glm::vec3((unit(random) * 2.0f - 1.0f) * depth * tanHalfY * aspect,
+                                 (unit(random) * 2.0f - 1.0f) * depth * tanHalfY, -depth);
+    }
+
+    bool ok = true;
+    for (int lightCount = 1; lightCount <= 4096; lightCount *= 4) {
+        // campfire sized lights on and above the ground, up to 120 units ahead
+        std::vector<gps::PointLight> lights(lightCount);
+        for (int i = 0; i < lightCount; i++) {
+            lights[i].position = glm::vec3(unit(random) * 120.0f - 60.0f, unit(random) * 4.0f - 1.5f, -unit(random) * 120.0f);
+            lights[i].radius = 1.5f + 4.5f * unit(random);
+            lights[i].color = glm::vec3(1.0f);
+        }
+
+        gps::LightClusters clusters;
+        clusters.SetProjection(fovY, aspect);
+        glm::mat4 view(1.0f);
+        double serialTime = 1e30, poolTime = 1e30;
+        for (int run = 0; run < options.repeat; run++) {
+            clusters.Bin(lights, view);
+            serialTime = std::min(serialTime, clusters.GetStats().binMilliseconds);
+            clusters.Bin(lights, view, &pool);
+            poolTime = std::min(poolTime, clusters.GetStats().binMilliseconds);
+        }
+        gps::ClusterStats stats = clusters.GetStats();
+
+        // every light that reaches a fragment must be in its cluster's list
+        const std::vector<uint32_t>& ranges = clusters.GetClusterRanges();
+        const std::vector<uint16_t>& indices = clusters.GetLightIndices();
+        long long looped = 0, reaching = 0, missed = 0;
+        for (int f = 0; f < fragmentCount; f++) {
+            int cluster = clusters.FindCluster(fragments[f]);
+            uint32_t first = ranges[cluster * 2], count = ranges[cluster * 2 + 1];
+            looped += count;
+            for (int i = 0; i < lightCount; i++) {
+                if (glm::length(lights[i].position - fragments[f]) >= lights[i].radius)
+                    continue;
+                reaching++;
+                if (std::find(indices.begin() + first, indices.begin() + first + count, (uint16_t)i) == indices.begin() + first + count)
+                    missed++;
+            }
+        }
+        ok = ok && missed == 0;
+        printf("%4d lights: binned in %.3f ms, %.3f ms on %u threads; %d visible, %d cluster entries, at most %d per cluster; "
+               "a fragment loops over %.2f lights (forward: %d), %.3f reach it%s\n",
+               lightCount, serialTime, poolTime, pool.GetThreadCount(), stats.visibleLights, stats.lightIndices,
+               stats.maxClusterLights, looped / (double)fragmentCount, lightCount, reaching / (double)fragmentCount,
+               missed == 0 ? "" : " FAIL: lights missing from clusters");
+    }
+    return ok;
+}
+
+bool benchmarkResolution(const BenchmarkOptions& options)
+{
+    struct Phase
+    {
+        const char* name;
+        // GPU milliseconds of a full resolution frame, of which fixed do not scale
+        double full;
+        double fixed;
+    };
+    const Phase phases[] = { { "light", 10.0, 2.0 }, { "heavy", 30.0, 2.0 }, { "impossible", 70.0, 2.0 }, { "light again", 10.0, 2.0 } };
+    const int phaseFrames = 600;
+    const int latency = 4;
+    gps::ResolutionController controller;
+    gps::ResolutionOptions settings = controller.GetOptions();
+    std::mt19937 random(options.seed);
+    std::uniform_real_distribution<double> noise(0.95, 1.05);
+    // frames drawn but not yet read back
+    std::deque<double> inFlight;
+
+    bool ok = true;
+    for (const Phase& phase : phases) {
+        int changesBefore = controller.GetChangeCount();
+        int lastChange = 0, changesLate = 0, overLate = 0;
+        for (int frame = 0; frame < phaseFrames; frame++) {
+            double scale = controller.GetScale();
+            inFlight.push_back((phase.fixed + (phase.full - phase.fixed) * scale * scale) * noise(random));
+            if ((int)inFlight.size() <= latency)
+                continue;
+            int changes = controller.GetChangeCount();
+            controller.AddFrameTime(inFlight.front());
+            inFlight.pop_front();
+            if (controller.GetChangeCount() != changes) {
+                lastChange = frame;
+                changesLate += frame >= phaseFrames / 2;
+            }
+            if (frame >= phaseFrames / 2 && controller.GetHistory().back().milliseconds > settings.budgetMilliseconds)
+                overLate++;
+        }
+
+        // whether the smallest scale fits the budget
+        double floor = phase.fixed + (phase.full - phase.fixed) * settings.minScale * settings.minScale;
+        bool feasible = floor * 1.05 < settings.budgetMilliseconds;
+        bool settled = changesLate <= 1 && (!feasible || overLate <= phaseFrames / 20);
+        bool full = phase.full * 1.05 < settings.budgetMilliseconds * settings.headroom;
+        bool phaseOk = settled && (!full || controller.GetScale() == settings.maxScale) &&
+                       (feasible || controller.GetScale() == settings.minScale);
+        ok = ok && phaseOk;
+        printf("%-11s (%4.1f ms at full resolution): scale %.3f, %d changes, last after %d frames; %d of the last %d frames "
+               "over the %.1f ms budget%s%s\n",
+               phase.name, phase.full, controller.GetScale(), controller.GetChangeCount() - changesBefore, lastChange, overLate,
+               phaseFrames / 2, settings.budgetMilliseconds, feasible ? "" : " (cannot fit)", phaseOk ? "" : " FAIL");
+    }
+    return ok;
+}
+
+bool benchmarkPng(std::vector<std::string> paths, const BenchmarkOptions& options)
+{
+    struct Source
+    {
+        std::string name;
+        int width;
+        int height;
+        std::vector<unsigned char> rgba;
+    };
+    std::vector<Source> sources;
+    if (paths.empty()) {
+        paths.push_back("models/casa/WoodCabinDif.jpg");
+        // smooth like sky and sand, with noise like foliage and a flat block like the clear color
+        Source synthetic;
+        synthetic.name = "synthetic";
+        synthetic.width = 1920;
+        synthetic.height = 1080;
+        synthetic.rgba.resize((size_t)synthetic.width * synthetic.height * 4);
+        std::mt19937 random(options.seed);
+        for (int y = 0; y < synthetic.height; y++) {
+            for (int x = 0; x < synthetic.width; x++) {
+                unsigned char* pixel = &synthetic.rgba[((size_t)y * synthetic.width + x) * 4];
+                bool flat = x > 1400 && y > 700;
+                bool noisy = x < 600 && y > 500;
+                pixel[0] = flat ? 178 : (unsigned char)(x * 255 / synthetic.width);
+                pixel[1] = flat ? 178 : (unsigned char)(y * 255 / synthetic.height);
+                pixel[2] = flat ? 178 : noisy ? (unsigned char)random() : 128;
+                pixel[3] = 255;
+            }
+        }
+        sources.push_back(synthetic);
+    }
+    for (size_t p = 0; p < paths.size(); p++) {
+        Source source;
+        int n;
+        unsigned char* data = stbi_load(paths[p].c_str(), &source.width, &source.height, &n, 4);
+        if (!data) {
+            std::cerr << "ERROR: could not load " << paths[p] << std::endl;
+            return false;
+        }
+        source.name = paths[p];
+        source.rgba.assign(data, data + (size_t)source.width * source.height * 4);
+        stbi_image_free(data);
+        sources.insert(sources.begin() + p, source);
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < sources.size(); i++) {
+        const Source& source = sources[i];
+        size_t texels = (size_t)source.width * source.height;
+        for (int variant = 0; variant < 2; variant++) {
+            // 0: RGBA as is; 1: RGB, last row first, like a GL readback
+            bool readback = variant == 1;
+            std::vector<unsigned char> png;
+            double best = 1e30;
+            for (int run = 0; run < options.repeat; run++) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                gps::EncodePng(source.rgba.data(), source.width, source.height, 4, png, readback, readback);
+                best = std::min(best, millisecondsSince(start));
+            }
+
+            int width = 0, height = 0, n = 0;
+            int channels = readback ? 3 : 4;
+            unsigned char* decoded = stbi_load_from_memory(png.data(), (int)png.size(), &width, &height, &n, channels);
+            size_t mismatches = 0;
+            if (!decoded || width != source.width || height != source.height || n != channels) {
+                mismatches = texels;
+            } else {
+                for (int y = 0; y < height; y++) {
+                    const unsigned char* expected = &source.rgba[(size_t)(readback ? height - 1 - y : y) * width * 4];
+                    const unsigned char* actual = decoded + (size_t)y * width * channels;
+                    for (int x = 0; x < width; x++)
+                        mismatches += memcmp(expected + x * 4, actual + x * channels, channels) != 0;
+                }
+            }
+            if (decoded)
+                stbi_image_free(decoded);
+            ok = ok && mismatches == 0;
+            printf("%s %dx%d %s: %.1f ms, %.1f MB/s, %.2f MB (%.1f%% of raw)%s\n", source.name.c_str(), source.width,
+                   source.height, readback ? "RGB flipped" : "RGBA", best, texels * 4 / (best * 1e3), png.size() / 1048576.0,
+                   100.0 * png.size() / (texels * channels), mismatches == 0 ? "" : " FAIL: decoded pixels differ");
+        }
+    }
+
+    // the batch renderer encodes one readback per worker
+    gps::ThreadPool pool(options.threads);
+    const Source& last = sources.back();
+    const int copies = 16;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.ParallelFor(copies, [&](size_t) {
+        std::vector<unsigned char> png;
+        gps::EncodePng(last.rgba.data(), last.width, last.height, 4, png, true, true);
+    });
+    double elapsed = millisecondsSince(start);
+    printf("%d copies of %s on %u threads: %.1f images/s\n", copies, last.name.c_str(), pool.GetThreadCount(), copies / (elapsed / 1e3));
+    return ok;
+}
+
+bool benchmarkY4m(const BenchmarkOptions& options)
+{
+    std::mt19937 random(options.seed);
+    bool ok = true;
+    const int sizes[][2] = { { 1920, 1080 }, { 641, 359 } };
+    for (const int* size : sizes) {
+        int width = size[0], height = size[1];
+        std::vector<unsigned char> rgba((size_t)width * height * 4);
+        for (size_t i = 0; i < rgba.size(); i++)
+            rgba[i] = (unsigned char)random();
+        std::vector<unsigned char> yuv(gps::GetI420Size(width, height));
+        gps::ConvertRgbaToI420(rgba.data(), width, height, true, yuv.data());
+
+        // the planes hold the image top row first, so the reference reads the rows flipped
+        auto pixel = [&](int x, int y, int c) {
+            return (double)rgba[((size_t)(height - 1 - y) * width + x) * 4 + c];
+        };
+        int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+        double worst = 0.0;
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++) {
+                double luma = 16.0 + (65.481 * pixel(x, y, 0) + 128.553 * pixel(x, y, 1) + 24.966 * pixel(x, y, 2)) / 255.0;
+                worst = std::max(worst, fabs(yuv[(size_t)y * width + x] - luma));
+            }
+        const unsigned char* u = yuv.data() + (size_t)width * height;
+        const unsigned char* v = u + (size_t)chromaWidth * chromaHeight;
+        for (int cy = 0; cy < chromaHeight; cy++)
+            for (int cx = 0; cx < chromaWidth; cx++) {
+                int x0 = cx * 2, x1 = std::min(cx * 2 + 1, width - 1);
+                int y0 = cy * 2, y1 = std::min(cy * 2 + 1, height - 1);
+                double rgb[3];
+                for (int c = 0; c < 3; c++)
+                    rgb[c] = (pixel(x0, y0, c) + pixel(x1, y0, c) + pixel(x0, y1, c) + pixel(x1, y1, c)) / 4.0;
+                double cb = 128.0 + (-37.797 * rgb[0] - 74.203 * rgb[1] + 112.0 * rgb[2]) / 255.0;
+                double cr = 128.0 + (112.0 * rgb[0] - 93.786 * rgb[1] - 18.214 * rgb[2]) / 255.0;
+                size_t i = (size_t)cy * chromaWidth + cx;
+                worst = std::max(worst, std::max(fabs(u[i] - cb), fabs(v[i] - cr)));
+            }
+        // fixed point coefficients and rounding stay within a step
+        bool sizeOk = worst < 1.0;
+        ok = ok && sizeOk;
+        printf("%dx%d: largest difference from the reference %.2f%s\n", width, height, worst, sizeOk ? "" : " FAIL");
+    }
+
+    const unsigned char black[4 * 4] = { 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255 };
+    unsigned char white[4 * 4];
+    memset(white, 255, sizeof(white));
+    unsigned char planes[6];
+    gps::ConvertRgbaToI420(black, 2, 2, false, planes);
+    bool levelsOk = planes[0] == 16 && planes[4] == 128 && planes[5] == 128;
+    gps::ConvertRgbaToI420(white, 2, 2, false, planes);
+    levelsOk = levelsOk && planes[0] == 235 && planes[4] == 128 && planes[5] == 128;
+    ok = ok && levelsOk;
+    printf("Black and white levels%s\n", levelsOk ? " ok" : " FAIL");
+
+    const int width = 1920, height = 1080;
+    std::vector<unsigned char> rgba((size_t)width * height * 4);
+    for (size_t i = 0; i < rgba.size(); i++)
+        rgba[i] = (unsigned char)(i * 7 + (i >> 12));
+    std::vector<unsigned char> yuv(gps::GetI420Size(width, height));
+    double best = 1e30;
+    for (int run = 0; run < options.repeat; run++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        gps::ConvertRgbaToI420(rgba.data(), width, height, true, yuv.data());
+        best = std::min(best, millisecondsSince(start));
+    }
+    printf("%dx%d on one thread: %.2f ms, %.0f frames/s\n", width, height, best, 1e3 / best);
+
+    // a recording converts one readback per worker
+    gps::ThreadPool pool(options.threads);
+    const int frames = 32;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.ParallelFor(frames, [&](size_t) {
+        std::vector<unsigned char> frame(gps::GetI420Size(width, height));
+        gps::ConvertRgbaToI420(rgba.data(), width, height, true, frame.data());
+    });
+    double elapsed = millisecondsSince(start);
+    printf("%d frames on %u threads: %.0f frames/s\n", frames, pool.GetThreadCount(), frames / (elapsed / 1e3));
+    return ok;
+}
+
+bool checkRing()
+{
+    bool ok = true;
+    auto check = [&](const char* name, bool passed) {
+        printf("%-58s %s\n", name, passed ? "ok" : "FAIL");
+        ok = ok && passed;
+    };
+    // fences up to this id have signalled
+    uint64_t signalled = 0;
+    auto isSignaled = [&](uint64_t fence) { return fence <= signalled; };
+    size_t offset = 0;
+
+    gps::RingAllocator ring(1024);
+    check("empty ring hands out offset 0", ring.Allocate(10, 1, offset) && offset == 0);
+    check("aligned range starts on the next multiple", ring.Allocate(16, 256, offset) && offset == 256);
+    check("request larger than the ring fails", !ring.Allocate(2048, 1, offset) && ring.GetUsedBytes() == 272);
+    ring.Submit(1);
+    signalled = 1;
+    ring.Retire(isSignaled);
+    check("retiring every submission empties the ring", ring.GetUsedBytes() == 0 && ring.GetPendingSubmissions() == 0);
+
+    ring.Reset(1024);
+    signalled = 0;
+    ring.Allocate(400, 1, offset);
+    ring.Submit(1);
+    ring.Allocate(400, 1, offset);
+    ring.Submit(2);
+    check("nothing is freed before its fence signals", !ring.Allocate(300, 1, offset) && ring.GetUsedBytes() == 800);
+    signalled = 1;
+    ring.Retire(isSignaled);
+    check("range that does not fit the end wraps to offset 0", ring.Allocate(300, 1, offset) && offset == 0);
+    check("range up to the tail fills the ring", ring.Allocate(100, 1, offset) && offset == 300 && ring.GetUsedBytes() == 1024);
+    check("full ring (head == tail) refuses even one byte", !ring.Allocate(1, 1, offset));
+    check("request larger than the ring fails when full", !ring.Allocate(2048, 1, offset));
+    ring.Submit(3);
+
+    ring.Reset(1024);
+    signalled = 0;
+    ring.Allocate(100, 1, offset);
+    ring.Submit(1);
+    ring.Allocate(100, 1, offset);
+    ring.Submit(2);
+    ring.Allocate(100, 1, offset);
+    ring.Submit(3);
+    ring.Allocate(50, 1, offset);
+    // a later fence signalling does not free anything while an older one is pending
+    ring.Retire([](uint64_t fence) { return fence == 3; });
+    check("retiring stops at the oldest unsignalled fence", ring.GetUsedBytes() == 350 && ring.GetPendingSubmissions() == 3);
+    signalled = 2;
+    ring.Retire(isSignaled);
+    check("tail moves to the end of the last signalled submission", ring.GetUsedBytes() == 150 && ring.GetPendingSubmissions() == 1);
+    signalled = 3;
+    ring.Retire(isSignaled);
+    check("open ranges keep the ring in use after retiring", ring.HasOpenRanges() && ring.GetUsedBytes() == 50);
+    check("open ranges keep allocating after them, not at 0", ring.Allocate(10, 1, offset) && offset == 350);
+    ring.Submit(4);
+    signalled = 4;
+    ring.Retire(isSignaled);
+    check("submitting and retiring the open ranges empties the ring", !ring.HasOpenRanges() && ring.GetUsedBytes() == 0);
+    return ok;
+}
+
+// Decodes the 4x4 block the way the GPU does, into 16 RGBA texels in row order
+void decodeColorBlock(const unsigned char* block, unsigned char* rgba)
+{
+    unsigned c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+    int palette[4][3];
+    for (int e = 0; e < 2; e++) {
+        unsigned packed = e == 0 ? c0 : c1;
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        palette[e][0] = (r << 3) | (r >> 2);
+        palette[e][1] = (g << 2) | (g >> 4);
+        palette[e][2] = (b << 3) | (b >> 2);
+    }
+    for (int c = 0; c < 3; c++) {
+        // c0 <= c1 selects three colours and black
+        palette[2][c] = c0 > c1 ? (2 * palette[0][c] + palette[1][c]) / 3 : (palette[0][c] + palette[1][c]) / 2;
+        palette[3][c] = c0 > c1 ? (palette[0][c] + 2 * palette[1][c]) / 3 : 0;
+    }
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            rgba[i * 4 + c] = (unsigned char)palette[(indices >> (2 * i)) & 3][c];
+}
+
+// BC3 alpha and each BC5 channel: two endpoints and 3 bit indices
+void decodeChannelBlock(const unsigned char* block, unsigned char* rgba, int channel)
+{
+    int a0 = block[0], a1 = block[1];
+    int values[8] = { a0, a1 };
+    for (int i = 1; i < 7; i++) {
+        if (a0 > a1)
+            values[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+        else if (i < 5)
+            values[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+    }
+    if (a0 <= a1) {
+        values[6] = 0;
+        values[7] = 255;
+    }
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; i++)
+        indices |= (uint64_t)block[2 + i] << (8 * i);
+    for (int i = 0; i < 16; i++)
+        rgba[i * 4 + channel] = (unsigned char)values[(indices >> (3 * i)) & 7];
+}
+
+bool benchmarkBlockCompression(std::vector<std::string> paths, const BenchmarkOptions& options)
+{
+    struct Case
+    {
+        gps::BLOCK_FORMAT format;
+        const char* name;
+        // channels the format keeps, and the quality it must reach on them
+        int channels;
+        double minimum;
+    };
+    const Case colorCases[] = { { gps::BLOCK_BC1, "BC1", 3, 30.0 }, { gps::BLOCK_BC3, "BC3", 4, 30.0 } };
+    const Case normalCase = { gps::BLOCK_BC5, "BC5", 2, 35.0 };
+    bool defaults = paths.empty();
+    if (defaults) {
+        paths.push_back("models/casa/WoodCabinDif.jpg");
+        paths.push_back("models/casa/WoodCabinNM.jpg");
+    }
+
+    gps::ThreadPool pool(options.threads);
+    bool ok = true;
+    for (size_t p = 0; p < paths.size(); p++) {
+        int width, height, n;
+        unsigned char* data = stbi_load(paths[p].c_str(), &width, &height, &n, 4);
+        if (!data) {
+            std::cerr << "ERROR: could not load " << paths[p] << std::endl;
+            return false;
+        }
+        std::vector<unsigned char> rgba(data, data + (size_t)width * height * 4);
+        stbi_image_free(data);
+        // an alpha ramp with a hard cutout, like the palm leaves
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                rgba[((size_t)y * width + x) * 4 + 3] = (x / 64 + y / 64) % 5 == 0 ? 0 : (unsigned char)(x * 255 / width);
+
+        // the second default is a normal map, which only goes to BC5
+        std::vector<Case> cases;
+        if (!defaults || p == 0)
+            cases.assign(colorCases, colorCases + 2);
+        if (!defaults || p == 1)
+            cases.push_back(normalCase);
+
+        for (const Case& test : cases) {
+            std::vector<unsigned char> blocks;
+            double best = 1e30;
+            for (int run = 0; run < options.repeat; run++) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                gps::CompressImage(test.format, rgba.data(), width, height, blocks, &pool);
+                best = std::min(best, millisecondsSince(start));
+            }
+
+            int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+            size_t blockBytes = gps::GetBlockBytes(test.format);
+            bool sized = blocks.size() == gps::GetCompressedSize(test.format, width, height) &&
+                         blocks.size() == (size_t)blocksX * blocksY * blockBytes;
+            double squaredError = 0.0;
+            size_t samples = 0;
+            for (int by = 0; sized && by < blocksY; by++)
+                for (int bx = 0; bx < blocksX; bx++) {
+                    const unsigned char* block = &blocks[((size_t)by * blocksX + bx) * blockBytes];
+                    unsigned char decoded[16 * 4] = {};
+                    if (test.format == gps::BLOCK_BC1)
+                        decodeColorBlock(block, decoded);
+                    else if (test.format == gps::BLOCK_BC3) {
+                        decodeChannelBlock(block, decoded, 3);
+                        decodeColorBlock(block + 8, decoded);
+                    } else {
+                        decodeChannelBlock(block, decoded, 0);
+                        decodeChannelBlock(block + 8, decoded, 1);
+                    }
+                    for (int i = 0; i < 16; i++) {
+                        int x = bx * 4 + i % 4, y = by * 4 + i / 4;
+                        if (x >= width || y >= height)
+                            continue;
+                        const unsigned char* texel = &rgba[((size_t)y * width + x) * 4];
+                        for (int c = 0; c < test.channels; c++) {
+                            double difference = (double)texel[c] - decoded[i * 4 + c];
+                            squaredError += difference * difference;
+                        }
+                        samples += test.channels;
+                    }
+                }
+            double mse = squaredError / std::max<size_t>(samples, 1);
+            double psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+            bool pass = sized && psnr >= test.minimum;
+            ok = ok && pass;
+            printf("%s %dx%d %s: %.1f dB over %d channels (minimum %.0f), %.1f ms, %.1f MP/s on %u threads%s\n",
+                   paths[p].c_str(), width, height, test.name, psnr, test.channels, test.minimum, best,
+                   (double)width * height / (best * 1e3), pool.GetThreadCount(), pass ? "" : " FAIL");
+        }
+    }
+    return ok;
+}
+
+int main(int argc, const char* argv[])
+{
+    BenchmarkOptions options;
+    std::vector<std::string> inputs;
+    std::string command = argc > 1 ? argv[1] : "";
+
+    for (int i = 2; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--repeat" && i + 1 < argc)
+            options.repeat = std::max(1, atoi(argv[++i]));
+        else if (argument == "--threads" && i + 1 < argc)
+            options.threads = atoi(argv[++i]);
+        else if (argument == "--size" && i + 1 < argc)
+            options.objMegabytes = std::max(1, atoi(argv[++i]));
+        else if (argument == "--count" && i + 1 < argc)
+            options.floatCount = std::max(1, atoi(argv[++i]));
+        else if (argument == "--tiles" && i + 1 < argc)
+            options.duneTiles = std::max(1, atoi(argv[++i]));
+        else if (argument == "--seed" && i + 1 < argc)
+            options.seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else
+            inputs.push_back(argument);
+    }
+
+    if (command == "mips" && !inputs.empty())
+        return benchmarkMips(inputs, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "image")
+        return benchmarkImageKernels(inputs) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "obj")
+        return benchmarkObj(inputs, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "rss")
+        return benchmarkObjMemory(inputs, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "mesh")
+        return benchmarkMeshOptimizer(inputs, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "lod")
+        return benchmarkLods(inputs, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "dunes")
+        return benchmarkDunes(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "lights")
+        return benchmarkLights(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "resolution")
+        return benchmarkResolution(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "png")
+        return benchmarkPng(inputs, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "y4m")
+        return benchmarkY4m(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "bc")
+        return benchmarkBlockCompression(inputs, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "ring")
+        return checkRing() ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (command == "floats")
+        return checkFloats(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    std::cerr << "usage: Benchmarks mips [--repeat N] [--threads N] image..." << std::endl;
+    std::cerr << "       Benchmarks image [image...]" << std::endl;
+    std::cerr << "       Benchmarks obj [--size MB] [--threads N] [file.obj...]" << std::endl;
+    std::cerr << "       Benchmarks floats [--count N]" << std::endl;
+    std::cerr << "       Benchmarks rss [--size MB] [file.obj...]" << std::endl;
+    std::cerr << "       Benchmarks mesh [--size MB] [file.obj...]" << std::endl;
+    std::cerr << "       Benchmarks lod [--size MB] [file.obj...]" << std::endl;
+    std::cerr << "       Benchmarks dunes [--tiles N] [--threads N] [--seed N]" << std::endl;
+    std::cerr << "       Benchmarks lights [--threads N] [--seed N]" << std::endl;
+    std::cerr << "       Benchmarks resolution [--seed N]" << std::endl;
+    std::cerr << "       Benchmarks png [--threads N] [image...]" << std::endl;
+    std::cerr << "       Benchmarks y4m [--threads N] [--seed N]" << std::endl;
+    std::cerr << "       Benchmarks ring" << std::endl;
+    std::cerr << "       Benchmarks bc [--threads N] [image...]" << std::endl;
+    return EXIT_FAILURE;
+}
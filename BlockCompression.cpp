@@ -0,0 +1,303 @@
+#include "BlockCompression.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace gps {
+
+    // weight of the first endpoint for each BC1 palette index
+    static const float paletteWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+    static int clampInt(int value, int low, int high)
+    {
+        return value < low ? low : (value > high ? high : value);
+    }
+
+    static unsigned short packRGB565(const float color[3])
+    {
+        int r = clampInt((int)(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+        int g = clampInt((int)(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+        int b = clampInt((int)(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+        return (unsigned short)((r << 11) | (g << 5) | b);
+    }
+
+    static void unpackRGB565(unsigned short packed, int color[3])
+    {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // Picks the closest of the four palette entries for every texel, returns the squared error
+    static int assignColorIndices(const unsigned char* rgba, unsigned short c0, unsigned short c1, unsigned char indices[16])
+    {
+        int palette[4][3];
+        unpackRGB565(c0, palette[0]);
+        unpackRGB565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        int totalError = 0;
+        for (int i = 0; i < 16; i++) {
+            const unsigned char* texel = rgba + i * 4;
+            int best = 0;
+            int bestError = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int dr = texel[0] - palette[p][0];
+                int dg = texel[1] - palette[p][1];
+                int db = texel[2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices[i] = (unsigned char)best;
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    // Least squares endpoints for a fixed index assignment, false if the system is singular
+    static bool refineEndpoints(const unsigned char* rgba, const unsigned char indices[16], float end0[3], float end1[3])
+    {
+        float alpha2 = 0.0f, beta2 = 0.0f, alphaBeta = 0.0f;
+        float alphaX[3] = { 0.0f, 0.0f, 0.0f };
+        float betaX[3] = { 0.0f, 0.0f, 0.0f };
+
+        for (int i = 0; i < 16; i++) {
+            float alpha = paletteWeights[indices[i]];
+            float beta = 1.0f - alpha;
+            alpha2 += alpha * alpha;
+            beta2 += beta * beta;
+            alphaBeta += alpha * beta;
+            for (int c = 0; c < 3; c++) {
+                alphaX[c] += alpha * rgba[i * 4 + c];
+                betaX[c] += beta * rgba[i * 4 + c];
+            }
+        }
+
+        float determinant = alpha2 * beta2 - alphaBeta * alphaBeta;
+        if (std::fabs(determinant) < 1e-6f)
+            return false;
+
+        for (int c = 0; c < 3; c++) {
+            end0[c] = (alphaX[c] * beta2 - betaX[c] * alphaBeta) / determinant;
+            end1[c] = (betaX[c] * alpha2 - alphaX[c] * alphaBeta) / determinant;
+        }
+        return true;
+    }
+
+    // Endpoints at the extremes of the block's principal axis
+    static void principalAxisEndpoints(const unsigned char* rgba, float end0[3], float end1[3])
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+                mean[c] += rgba[i * 4 + c];
+        for (int c = 0; c < 3; c++)
+            mean[c] /= 16.0f;
+
+        // covariance: xx xy xz yy yz zz
+        float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++) {
+            float r = rgba[i * 4 + 0] - mean[0];
+            float g = rgba[i * 4 + 1] - mean[1];
+            float b = rgba[i * 4 + 2] - mean[2];
+            cov[0] += r * r;
+            cov[1] += r * g;
+            cov[2] += r * b;
+            cov[3] += g * g;
+            cov[4] += g * b;
+            cov[5] += b * b;
+        }
+
+        // a few power iterations are plenty for a 3x3 matrix
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 4; iteration++) {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float length = std::sqrt(x * x + y * y + z * z);
+            if (length < 1e-6f)
+                break;
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+
+        float minProjection = 1e30f, maxProjection = -1e30f;
+        for (int i = 0; i < 16; i++) {
+            float projection = 0.0f;
+            for (int c = 0; c < 3; c++)
+                projection += (rgba[i * 4 + c] - mean[c]) * axis[c];
+            minProjection = std::fmin(minProjection, projection);
+            maxProjection = std::fmax(maxProjection, projection);
+        }
+
+        for (int c = 0; c < 3; c++) {
+            end0[c] = mean[c] + axis[c] * maxProjection;
+            end1[c] = mean[c] + axis[c] * minProjection;
+        }
+    }
+
+    static void encodeColorBlock(const unsigned char* rgba, unsigned char* output)
+    {
+        float end0[3], end1[3];
+        principalAxisEndpoints(rgba, end0, end1);
+
+        unsigned short c0 = packRGB565(end0);
+        unsigned short c1 = packRGB565(end1);
+        unsigned char indices[16];
+        int error = assignColorIndices(rgba, c0, c1, indices);
+
+        // one least squares pass, kept only if it actually helps
+        float refined0[3], refined1[3];
+        if (error > 0 && refineEndpoints(rgba, indices, refined0, refined1)) {
+            unsigned short r0 = packRGB565(refined0);
+            unsigned short r1 = packRGB565(refined1);
+            unsigned char refinedIndices[16];
+            int refinedError = assignColorIndices(rgba, r0, r1, refinedIndices);
+            if (refinedError < error) {
+                c0 = r0;
+                c1 = r1;
+                memcpy(indices, refinedIndices, 16);
+            }
+        }
+
+        // c0 > c1 selects the four colour mode
+        if (c0 < c1) {
+            unsigned short swap = c0;
+            c0 = c1;
+            c1 = swap;
+            for (int i = 0; i < 16; i++)
+                indices[i] ^= 1;
+        } else if (c0 == c1) {
+            memset(indices, 0, 16);
+        }
+
+        unsigned int packedIndices = 0;
+        for (int i = 0; i < 16; i++)
+            packedIndices |= (unsigned int)indices[i] << (2 * i);
+
+        output[0] = (unsigned char)(c0 & 0xFF);
+        output[1] = (unsigned char)(c0 >> 8);
+        output[2] = (unsigned char)(c1 & 0xFF);
+        output[3] = (unsigned char)(c1 >> 8);
+        for (int i = 0; i < 4; i++)
+            output[4 + i] = (unsigned char)(packedIndices >> (8 * i));
+    }
+
+    // BC4 style block for one channel, using the eight value mode
+    static void encodeChannelBlock(const unsigned char* rgba, int channel, unsigned char* output)
+    {
+        int minValue = 255, maxValue = 0;
+        for (int i = 0; i < 16; i++) {
+            int value = rgba[i * 4 + channel];
+            minValue = value < minValue ? value : minValue;
+            maxValue = value > maxValue ? value : maxValue;
+        }
+
+        output[0] = (unsigned char)maxValue;
+        output[1] = (unsigned char)minValue;
+        memset(output + 2, 0, 6);
+        if (maxValue == minValue)
+            return;
+
+        int palette[8];
+        palette[0] = maxValue;
+        palette[1] = minValue;
+        for (int i = 2; i < 8; i++)
+            palette[i] = ((8 - i) * maxValue + (i - 1) * minValue) / 7;
+
+        unsigned long long packedIndices = 0;
+        for (int i = 0; i < 16; i++) {
+            int value = rgba[i * 4 + channel];
+            int best = 0;
+            int bestError = 256;
+            for (int p = 0; p < 8; p++) {
+                int error = std::abs(value - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            packedIndices |= (unsigned long long)best << (3 * i);
+        }
+
+        for (int i = 0; i < 6; i++)
+            output[2 + i] = (unsigned char)(packedIndices >> (8 * i));
+    }
+
+    size_t GetBlockBytes(BLOCK_FORMAT format)
+    {
+        return format == BLOCK_BC1 ? 8 : 16;
+    }
+
+    size_t GetCompressedSize(BLOCK_FORMAT format, int width, int height)
+    {
+        size_t blocksX = (width + 3) / 4;
+        size_t blocksY = (height + 3) / 4;
+        return blocksX * blocksY * GetBlockBytes(format);
+    }
+
+    void EncodeBC1Block(const unsigned char* rgba, unsigned char* output)
+    {
+        encodeColorBlock(rgba, output);
+    }
+
+    void EncodeBC3Block(const unsigned char* rgba, unsigned char* output)
+    {
+        encodeChannelBlock(rgba, 3, output);
+        encodeColorBlock(rgba, output + 8);
+    }
+
+    void EncodeBC5Block(const unsigned char* rgba, unsigned char* output)
+    {
+        encodeChannelBlock(rgba, 0, output);
+        encodeChannelBlock(rgba, 1, output + 8);
+    }
+
+    void CompressImage(BLOCK_FORMAT format, const unsigned char* rgba, int width, int height,
+                       std::vector<unsigned char>& output, gps::ThreadPool* pool)
+    {
+        int blocksX = (width + 3) / 4;
+        int blocksY = (height + 3) / 4;
+        size_t blockBytes = GetBlockBytes(format);
+        output.resize(GetCompressedSize(format, width, height));
+
+        std::function<void(size_t)> encodeRow = [&](size_t blockY) {
+            unsigned char block[64];
+            for (int blockX = 0; blockX < blocksX; blockX++) {
+                for (int y = 0; y < 4; y++) {
+                    int sourceY = clampInt((int)blockY * 4 + y, 0, height - 1);
+                    for (int x = 0; x < 4; x++) {
+                        int sourceX = clampInt(blockX * 4 + x, 0, width - 1);
+                        memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+                    }
+                }
+
+                unsigned char* destination = &output[(blockY * blocksX + blockX) * blockBytes];
+                if (format == BLOCK_BC1)
+                    EncodeBC1Block(block, destination);
+                else if (format == BLOCK_BC3)
+                    EncodeBC3Block(block, destination);
+                else
+                    EncodeBC5Block(block, destination);
+            }
+        };
+
+        if (pool == NULL) {
+            for (int blockY = 0; blockY < blocksY; blockY++)
+                encodeRow(blockY);
+        } else {
+            pool->ParallelFor(blocksY, encodeRow);
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef BlockCompression_hpp
+#define BlockCompression_hpp
+
+#include "ThreadPool.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    enum BLOCK_FORMAT {BLOCK_BC1, BLOCK_BC3, BLOCK_BC5};
+
+    // Bytes per 4x4 block: 8 for BC1, 16 for BC3 and BC5
+    size_t GetBlockBytes(BLOCK_FORMAT format);
+    size_t GetCompressedSize(BLOCK_FORMAT format, int width, int height);
+
+    // Single block encoders, input is 16 RGBA texels in row order
+    void EncodeBC1Block(const unsigned char* rgba, unsigned char* output);
+    void EncodeBC3Block(const unsigned char* rgba, unsigned char* output);
+    // Packs the red and green channels, for tangent space normal maps
+    void EncodeBC5Block(const unsigned char* rgba, unsigned char* output);
+
+    // Compresses a whole RGBA8 image, rows of blocks are shared out across the pool.
+    // Edge blocks of sizes that are not a multiple of 4 repeat the last row/column.
+    void CompressImage(BLOCK_FORMAT format, const unsigned char* rgba, int width, int height,
+                       std::vector<unsigned char>& output, gps::ThreadPool* pool);
+}
+
+#endif /* BlockCompression_hpp */
@@ -0,0 +1,82 @@
+#include "ClusteredLighting.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    ClusteredLighting::ClusteredLighting(gps::ThreadPool& pool, gps::ClusterOptions options) :
+        pool(pool), clusters(options), width(1), height(1)
+    {
+        for (int i = 0; i < BUFFER_COUNT; i++)
+            buffers[i] = textures[i] = 0;
+    }
+
+    void ClusteredLighting::Init()
+    {
+        // cluster ranges are (first, count) pairs, indices 16 bit, lights two RGBA texels each
+        const GLenum formats[BUFFER_COUNT] = { GL_RG32UI, GL_R16UI, GL_RGBA32F };
+        glGenBuffers(BUFFER_COUNT, buffers);
+        glGenTextures(BUFFER_COUNT, textures);
+        for (int i = 0; i < BUFFER_COUNT; i++) {
+            // a texture buffer needs storage before it is sampled, even with nothing to light
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void ClusteredLighting::Delete()
+    {
+        glDeleteTextures(BUFFER_COUNT, textures);
+        glDeleteBuffers(BUFFER_COUNT, buffers);
+        for (int i = 0; i < BUFFER_COUNT; i++)
+            buffers[i] = textures[i] = 0;
+    }
+
+    void ClusteredLighting::Upload(int buffer, const void* data, size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+        // a fresh store each frame, so the draws of the last frame can still read the old one
+        glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), NULL, GL_STREAM_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+    }
+
+    void ClusteredLighting::Update(const std::vector<gps::PointLight>& lights, const glm::mat4& view, float fovY, int width, int height)
+    {
+        this->width = std::max(width, 1);
+        this->height = std::max(height, 1);
+        clusters.SetProjection(fovY, this->width / (float)this->height);
+        clusters.Bin(lights, view, &pool);
+
+        Upload(RANGES, clusters.GetClusterRanges().data(), clusters.GetClusterRanges().size() * sizeof(uint32_t));
+        Upload(INDICES, clusters.GetLightIndices().data(), clusters.GetLightIndices().size() * sizeof(uint16_t));
+        Upload(LIGHTS, clusters.GetLightData().data(), clusters.GetLightData().size() * sizeof(glm::vec4));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void ClusteredLighting::Bind(GLuint program)
+    {
+        const char* names[BUFFER_COUNT] = { "clusterRanges", "clusterLightIndices", "clusterLights" };
+        for (int i = 0; i < BUFFER_COUNT; i++) {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glUniform1i(glGetUniformLocation(program, names[i]), firstUnit + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        gps::ClusterOptions options = clusters.GetOptions();
+        glUniform3i(glGetUniformLocation(program, "clusterCounts"), options.tilesX, options.tilesY, options.slices);
+        glUniform2f(glGetUniformLocation(program, "clusterTileScale"), options.tilesX / (float)width, options.tilesY / (float)height);
+        glm::vec2 slices = clusters.GetSliceParameters();
+        glUniform2f(glGetUniformLocation(program, "clusterSliceParameters"), slices.x, slices.y);
+    }
+
+    gps::ClusterStats ClusteredLighting::GetStats()
+    {
+        return clusters.GetStats();
+    }
+}
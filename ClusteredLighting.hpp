@@ -0,0 +1,50 @@
+#ifndef ClusteredLighting_hpp
+#define ClusteredLighting_hpp
+
+#include "LightClusters.hpp"
+#include "ThreadPool.hpp"
+
+#include <GL/glew.h>
+
+#include <vector>
+
+namespace gps {
+
+    // GL side of clustered forward lighting: bins the lights on the worker pool every frame and
+    // uploads the cluster ranges, light index lists and eye space lights as texture buffers,
+    // which the CLUSTERED_LIGHTS variant of basic.frag loops over per fragment. GL thread only.
+    class ClusteredLighting
+    {
+    public:
+        ClusteredLighting(gps::ThreadPool& pool, gps::ClusterOptions options = gps::ClusterOptions());
+
+        void Init();
+        void Delete();
+
+        // Bins lights for a perspective camera of the given field of view and viewport, then
+        // uploads the lists, orphaning last frame's buffers
+        void Update(const std::vector<gps::PointLight>& lights, const glm::mat4& view, float fovY, int width, int height);
+
+        // Binds the buffers and sets the cluster uniforms of the current program
+        void Bind(GLuint program);
+
+        gps::ClusterStats GetStats();
+
+    private:
+        // clear of the units meshes and terrain bind their maps to
+        static const int firstUnit = 4;
+
+        enum { RANGES, INDICES, LIGHTS, BUFFER_COUNT };
+
+        gps::ThreadPool& pool;
+        gps::LightClusters clusters;
+        GLuint buffers[BUFFER_COUNT];
+        GLuint textures[BUFFER_COUNT];
+        int width;
+        int height;
+
+        void Upload(int buffer, const void* data, size_t size);
+    };
+}
+
+#endif /* ClusteredLighting_hpp */
@@ -0,0 +1,190 @@
+#include "DdsFile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <sys/stat.h>
+
+namespace gps {
+
+    static const uint32_t ddsMagic = 0x20534444; // "DDS "
+    static const uint32_t ddsCaps = 0x1;
+    static const uint32_t ddsHeight = 0x2;
+    static const uint32_t ddsWidth = 0x4;
+    static const uint32_t ddsPixelFormat = 0x1000;
+    static const uint32_t ddsMipMapCount = 0x20000;
+    static const uint32_t ddsLinearSize = 0x80000;
+    static const uint32_t ddsFourCC = 0x4;
+    static const uint32_t ddsCapsTexture = 0x1000;
+    static const uint32_t ddsCapsComplex = 0x8;
+    static const uint32_t ddsCapsMipMap = 0x400000;
+
+    struct DdsPixelFormat
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t fourCC;
+        uint32_t rgbBitCount;
+        uint32_t masks[4];
+    };
+
+    struct DdsHeader
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t height;
+        uint32_t width;
+        uint32_t pitchOrLinearSize;
+        uint32_t depth;
+        uint32_t mipMapCount;
+        uint32_t reserved1[11];
+        DdsPixelFormat pixelFormat;
+        uint32_t caps[4];
+        uint32_t reserved2;
+    };
+
+    static uint32_t makeFourCC(const char* code)
+    {
+        return (uint32_t)code[0] | ((uint32_t)code[1] << 8) | ((uint32_t)code[2] << 16) | ((uint32_t)code[3] << 24);
+    }
+
+    bool WriteDds(const char* fileName, BLOCK_FORMAT format, int width, int height,
+                  const std::vector<std::vector<unsigned char> >& levels)
+    {
+        FILE* file = fopen(fileName, "wb");
+        if (!file) {
+            fprintf(stderr, "ERROR: could not write %s\n", fileName);
+            return false;
+        }
+
+        DdsHeader header;
+        memset(&header, 0, sizeof(header));
+        header.size = sizeof(DdsHeader);
+        header.flags = ddsCaps | ddsHeight | ddsWidth | ddsPixelFormat | ddsMipMapCount | ddsLinearSize;
+        header.height = height;
+        header.width = width;
+        header.pitchOrLinearSize = (uint32_t)levels[0].size();
+        header.mipMapCount = (uint32_t)levels.size();
+        header.pixelFormat.size = sizeof(DdsPixelFormat);
+        header.pixelFormat.flags = ddsFourCC;
+        if (format == BLOCK_BC1)
+            header.pixelFormat.fourCC = makeFourCC("DXT1");
+        else if (format == BLOCK_BC3)
+            header.pixelFormat.fourCC = makeFourCC("DXT5");
+        else
+            header.pixelFormat.fourCC = makeFourCC("ATI2");
+        header.caps[0] = ddsCapsTexture | (levels.size() > 1 ? ddsCapsComplex | ddsCapsMipMap : 0);
+
+        bool ok = fwrite(&ddsMagic, sizeof(ddsMagic), 1, file) == 1;
+        ok = ok && fwrite(&header, sizeof(header), 1, file) == 1;
+        for (size_t level = 0; ok && level < levels.size(); level++)
+            ok = fwrite(levels[level].data(), 1, levels[level].size(), file) == levels[level].size();
+        fclose(file);
+
+        if (!ok)
+            fprintf(stderr, "ERROR: could not write %s\n", fileName);
+        return ok;
+    }
+
+    // larger than any texture the GL is guaranteed to take, so a header claiming more is damaged
+    static const uint32_t maxDdsSize = 16384;
+
+    bool ReadDds(const char* fileName, gps::Image& image)
+    {
+        FILE* file = fopen(fileName, "rb");
+        if (!file)
+            return false;
+
+        uint32_t magic = 0;
+        DdsHeader header;
+        if (fread(&magic, sizeof(magic), 1, file) != 1 || magic != ddsMagic ||
+            fread(&header, sizeof(header), 1, file) != 1 || header.size != sizeof(DdsHeader)) {
+            fprintf(stderr, "ERROR: %s is not a DDS file\n", fileName);
+            fclose(file);
+            return false;
+        }
+
+        BLOCK_FORMAT format;
+        if (header.pixelFormat.fourCC == makeFourCC("DXT1")) {
+            format = BLOCK_BC1;
+            image.compressedFormat = GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        } else if (header.pixelFormat.fourCC == makeFourCC("DXT5")) {
+            format = BLOCK_BC3;
+            image.compressedFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        } else if (header.pixelFormat.fourCC == makeFourCC("ATI2")) {
+            format = BLOCK_BC5;
+            image.compressedFormat = GL_COMPRESSED_RG_RGTC2;
+        } else {
+            fprintf(stderr, "ERROR: %s uses an unsupported DDS format\n", fileName);
+            fclose(file);
+            return false;
+        }
+
+        if (header.width == 0 || header.height == 0 || header.width > maxDdsSize || header.height > maxDdsSize) {
+            fprintf(stderr, "ERROR: %s has an invalid size of %ux%u\n", fileName, header.width, header.height);
+            fclose(file);
+            return false;
+        }
+        image.width = (int)header.width;
+        image.height = (int)header.height;
+        image.channels = format == BLOCK_BC5 ? 2 : 4;
+
+        // no more levels than it takes to get down to 1x1
+        int maxLevels = 1;
+        while ((std::max(image.width, image.height) >> maxLevels) > 0)
+            maxLevels++;
+        int levelCount = header.mipMapCount > 0 ? (int)std::min<uint32_t>(header.mipMapCount, maxLevels) : 1;
+        image.levelOffsets.clear();
+        size_t total = 0;
+        int width = image.width, height = image.height;
+        for (int level = 0; level < levelCount; level++) {
+            image.levelOffsets.push_back(total);
+            total += GetCompressedSize(format, width, height);
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+        image.levelOffsets.push_back(total);
+
+        // checked before allocating, so a damaged header cannot ask for more than the file holds
+        long dataStart = ftell(file);
+        bool sized = dataStart >= 0 && fseek(file, 0, SEEK_END) == 0;
+        long fileEnd = sized ? ftell(file) : -1;
+        if (!sized || fileEnd < dataStart || total > (size_t)(fileEnd - dataStart) || fseek(file, dataStart, SEEK_SET) != 0) {
+            fprintf(stderr, "ERROR: %s is truncated\n", fileName);
+            fclose(file);
+            return false;
+        }
+
+        image.pixels = std::shared_ptr<unsigned char>(new unsigned char[total], std::default_delete<unsigned char[]>());
+        bool ok = fread(image.pixels.get(), 1, total, file) == total;
+        fclose(file);
+
+        if (!ok) {
+            fprintf(stderr, "ERROR: %s is truncated\n", fileName);
+            image.pixels.reset();
+            return false;
+        }
+        return true;
+    }
+
+    bool HasCurrentDds(std::string imagePath)
+    {
+        struct stat dds, source;
+        if (stat(GetDdsPath(imagePath).c_str(), &dds) != 0)
+            return false;
+        // without the source image the copy is all there is
+        if (stat(imagePath.c_str(), &source) != 0)
+            return true;
+        return dds.st_mtime >= source.st_mtime;
+    }
+
+    std::string GetDdsPath(std::string imagePath)
+    {
+        size_t dot = imagePath.find_last_of('.');
+        size_t slash = imagePath.find_last_of('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            return imagePath + ".dds";
+        return imagePath.substr(0, dot) + ".dds";
+    }
+}
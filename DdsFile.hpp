@@ -0,0 +1,27 @@
+#ifndef DdsFile_hpp
+#define DdsFile_hpp
+
+#include "Mesh.hpp"
+#include "BlockCompression.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Writes block compressed mip levels with the legacy DDS header (FourCC DXT1, DXT5 or ATI2).
+    // Unlike most DDS writers the rows are stored bottom row first, ready for OpenGL.
+    bool WriteDds(const char* fileName, BLOCK_FORMAT format, int width, int height,
+                  const std::vector<std::vector<unsigned char> >& levels);
+
+    // Reads a file written by WriteDds; the whole mip chain ends up in one allocation.
+    // DXT1/DXT5 map to the sRGB formats since all colour textures in the scene are sRGB.
+    bool ReadDds(const char* fileName, gps::Image& image);
+
+    // <path without extension>.dds, where the converter puts its output
+    std::string GetDdsPath(std::string imagePath);
+    // True when the .dds copy exists and is not older than the image, which may have been
+    // edited since it was converted
+    bool HasCurrentDds(std::string imagePath);
+}
+
+#endif /* DdsFile_hpp */
@@ -0,0 +1,330 @@
+#include "DuneGenerator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace gps {
+
+    // The noise is written once against these lane types and instantiated for plain floats,
+    // which is the reference, and for the widest registers the target has
+    struct ScalarLanes
+    {
+        typedef float F;
+        typedef uint32_t I;
+        typedef bool M;
+        static const int count = 1;
+        static F Splat(float s) { return s; }
+        static I SplatI(uint32_t s) { return s; }
+        static F Ramp() { return 0.0f; }
+        static void Store(float* p, F v) { *p = v; }
+        static F Add(F a, F b) { return a + b; }
+        static F Sub(F a, F b) { return a - b; }
+        static F Mul(F a, F b) { return a * b; }
+        static F Abs(F a) { return std::fabs(a); }
+        static F Floor(F a) { return std::floor(a); }
+        static M Less(F a, F b) { return a < b; }
+        static F Select(M m, F a, F b) { return m ? a : b; }
+        static I ToInt(F a) { return (uint32_t)(int32_t)a; }
+        static F ToFloat(I a) { return (float)(int32_t)a; }
+        static I IMul(I a, I b) { return a * b; }
+        static I IAdd(I a, I b) { return a + b; }
+        static I IXor(I a, I b) { return a ^ b; }
+        static I IAnd(I a, I b) { return a & b; }
+        static I Shr(I a, int n) { return a >> n; }
+    };
+
+#if defined(__AVX2__)
+    struct WideLanes
+    {
+        typedef __m256 F;
+        typedef __m256i I;
+        typedef __m256 M;
+        static const int count = 8;
+        static F Splat(float s) { return _mm256_set1_ps(s); }
+        static I SplatI(uint32_t s) { return _mm256_set1_epi32((int)s); }
+        static F Ramp() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+        static void Store(float* p, F v) { _mm256_storeu_ps(p, v); }
+        static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+        static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+        static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+        static F Abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+        static F Floor(F a) { return _mm256_floor_ps(a); }
+        static M Less(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static F Select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+        static I ToInt(F a) { return _mm256_cvttps_epi32(a); }
+        static F ToFloat(I a) { return _mm256_cvtepi32_ps(a); }
+        static I IMul(I a, I b) { return _mm256_mullo_epi32(a, b); }
+        static I IAdd(I a, I b) { return _mm256_add_epi32(a, b); }
+        static I IXor(I a, I b) { return _mm256_xor_si256(a, b); }
+        static I IAnd(I a, I b) { return _mm256_and_si256(a, b); }
+        static I Shr(I a, int n) { return _mm256_srli_epi32(a, n); }
+    };
+#elif defined(__SSE4_1__)
+    struct WideLanes
+    {
+        typedef __m128 F;
+        typedef __m128i I;
+        typedef __m128 M;
+        static const int count = 4;
+        static F Splat(float s) { return _mm_set1_ps(s); }
+        static I SplatI(uint32_t s) { return _mm_set1_epi32((int)s); }
+        static F Ramp() { return _mm_setr_ps(0, 1, 2, 3); }
+        static void Store(float* p, F v) { _mm_storeu_ps(p, v); }
+        static F Add(F a, F b) { return _mm_add_ps(a, b); }
+        static F Sub(F a, F b) { return _mm_sub_ps(a, b); }
+        static F Mul(F a, F b) { return _mm_mul_ps(a, b); }
+        static F Abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+        static F Floor(F a) { return _mm_floor_ps(a); }
+        static M Less(F a, F b) { return _mm_cmplt_ps(a, b); }
+        static F Select(M m, F a, F b) { return _mm_blendv_ps(b, a, m); }
+        static I ToInt(F a) { return _mm_cvttps_epi32(a); }
+        static F ToFloat(I a) { return _mm_cvtepi32_ps(a); }
+        static I IMul(I a, I b) { return _mm_mullo_epi32(a, b); }
+        static I IAdd(I a, I b) { return _mm_add_epi32(a, b); }
+        static I IXor(I a, I b) { return _mm_xor_si128(a, b); }
+        static I IAnd(I a, I b) { return _mm_and_si128(a, b); }
+        static I Shr(I a, int n) { return _mm_srli_epi32(a, n); }
+    };
+#else
+    typedef ScalarLanes WideLanes;
+#endif
+
+    // Everything the noise needs from DuneOptions, derived once per call
+    struct DuneParameters
+    {
+        uint32_t seed;
+        // unit wind direction
+        float windX, windZ;
+        // world units to dune wavelengths, along and across the wind
+        float alongScale, acrossScale;
+        float meander;
+        float crest, windwardScale, leeScale;
+        float height;
+        int octaves;
+        float ripples;
+    };
+
+    static DuneParameters makeParameters(const DuneOptions& options)
+    {
+        DuneParameters p;
+        p.seed = options.seed;
+        glm::vec2 wind = options.wind;
+        float length = std::sqrt(wind.x * wind.x + wind.y * wind.y);
+        p.windX = length > 0.0f ? wind.x / length : 1.0f;
+        p.windZ = length > 0.0f ? wind.y / length : 0.0f;
+        p.alongScale = 1.0f / std::max(options.wavelength, 1e-3f);
+        p.acrossScale = p.alongScale / std::max(options.stretch, 1e-3f);
+        p.meander = options.meander;
+        p.crest = std::min(std::max(options.crest, 0.05f), 0.95f);
+        p.windwardScale = 1.0f / p.crest;
+        p.leeScale = 1.0f / (1.0f - p.crest);
+        p.height = options.height;
+        p.octaves = std::max(options.octaves, 0);
+        p.ripples = options.ripples;
+        return p;
+    }
+
+    // Integer hash of a lattice point (lowbias32 style finalizer), so nothing is looked up
+    template <typename L>
+    static inline typename L::I hashLattice(typename L::I x, typename L::I y, uint32_t seed)
+    {
+        typename L::I h = L::IXor(L::IXor(L::IMul(x, L::SplatI(0x27d4eb2du)), L::IMul(y, L::SplatI(0x165667b1u))), L::SplatI(seed));
+        h = L::IXor(h, L::Shr(h, 16));
+        h = L::IMul(h, L::SplatI(0x7feb352du));
+        h = L::IXor(h, L::Shr(h, 15));
+        h = L::IMul(h, L::SplatI(0x846ca68bu));
+        return L::IXor(h, L::Shr(h, 16));
+    }
+
+    // Dot product of the lattice point's pseudo random gradient, with both components in
+    // [-1, 1), and the offset from the lattice point
+    template <typename L>
+    static inline typename L::F gradientDot(typename L::I h, typename L::F dx, typename L::F dy)
+    {
+        typedef typename L::F F;
+        const F scale = L::Splat(1.0f / 32768.0f);
+        const F one = L::Splat(1.0f);
+        F gx = L::Sub(L::Mul(L::ToFloat(L::IAnd(h, L::SplatI(0xffff))), scale), one);
+        F gy = L::Sub(L::Mul(L::ToFloat(L::Shr(h, 16)), scale), one);
+        return L::Add(L::Mul(gx, dx), L::Mul(gy, dy));
+    }
+
+    // 2D gradient noise with quintic interpolation, roughly in [-1, 1]
+    template <typename L>
+    static inline typename L::F gradientNoise(typename L::F x, typename L::F y, uint32_t seed)
+    {
+        typedef typename L::F F;
+        typedef typename L::I I;
+        const F one = L::Splat(1.0f);
+
+        F fx = L::Floor(x);
+        F fy = L::Floor(y);
+        I ix = L::ToInt(fx);
+        I iy = L::ToInt(fy);
+        I ix1 = L::IAdd(ix, L::SplatI(1));
+        I iy1 = L::IAdd(iy, L::SplatI(1));
+        F tx = L::Sub(x, fx);
+        F ty = L::Sub(y, fy);
+        F tx1 = L::Sub(tx, one);
+        F ty1 = L::Sub(ty, one);
+
+        F d00 = gradientDot<L>(hashLattice<L>(ix, iy, seed), tx, ty);
+        F d10 = gradientDot<L>(hashLattice<L>(ix1, iy, seed), tx1, ty);
+        F d01 = gradientDot<L>(hashLattice<L>(ix, iy1, seed), tx, ty1);
+        F d11 = gradientDot<L>(hashLattice<L>(ix1, iy1, seed), tx1, ty1);
+
+        // t^3 (t (6 t - 15) + 10)
+        F u = L::Mul(L::Mul(L::Mul(tx, tx), tx), L::Add(L::Mul(tx, L::Sub(L::Mul(tx, L::Splat(6.0f)), L::Splat(15.0f))), L::Splat(10.0f)));
+        F v = L::Mul(L::Mul(L::Mul(ty, ty), ty), L::Add(L::Mul(ty, L::Sub(L::Mul(ty, L::Splat(6.0f)), L::Splat(15.0f))), L::Splat(10.0f)));
+        F bottom = L::Add(d00, L::Mul(u, L::Sub(d10, d00)));
+        F top = L::Add(d01, L::Mul(u, L::Sub(d11, d01)));
+        return L::Add(bottom, L::Mul(v, L::Sub(top, bottom)));
+    }
+
+    // Octaves are rotated and offset against each other so their lattices do not line up
+    const float octaveRotationCos = 0.8f;
+    const float octaveRotationSin = 0.6f;
+    const uint32_t octaveSeedStep = 0x9e3779b9u;
+
+    template <typename L>
+    static inline typename L::F fractalNoise(typename L::F x, typename L::F y, int octaves, uint32_t seed)
+    {
+        typedef typename L::F F;
+        F sum = L::Splat(0.0f);
+        float amplitude = 0.5f;
+        for (int octave = 0; octave < octaves; octave++) {
+            sum = L::Add(sum, L::Mul(L::Splat(amplitude), gradientNoise<L>(x, y, seed)));
+            F rx = L::Sub(L::Mul(x, L::Splat(2.0f * octaveRotationCos)), L::Mul(y, L::Splat(2.0f * octaveRotationSin)));
+            F ry = L::Add(L::Mul(x, L::Splat(2.0f * octaveRotationSin)), L::Mul(y, L::Splat(2.0f * octaveRotationCos)));
+            x = L::Add(rx, L::Splat(17.0f));
+            y = ry;
+            amplitude *= 0.5f;
+            seed += octaveSeedStep;
+        }
+        return sum;
+    }
+
+    // Sharp creases where the noise crosses zero, which read as small dune crests and ripples
+    template <typename L>
+    static inline typename L::F ridgedNoise(typename L::F x, typename L::F y, int octaves, uint32_t seed)
+    {
+        typedef typename L::F F;
+        const F one = L::Splat(1.0f);
+        F sum = L::Splat(0.0f);
+        float amplitude = 0.5f;
+        for (int octave = 0; octave < octaves; octave++) {
+            F ridge = L::Sub(one, L::Abs(gradientNoise<L>(x, y, seed)));
+            sum = L::Add(sum, L::Mul(L::Splat(amplitude), L::Mul(ridge, ridge)));
+            F rx = L::Sub(L::Mul(x, L::Splat(2.0f * octaveRotationCos)), L::Mul(y, L::Splat(2.0f * octaveRotationSin)));
+            F ry = L::Add(L::Mul(x, L::Splat(2.0f * octaveRotationSin)), L::Mul(y, L::Splat(2.0f * octaveRotationCos)));
+            x = L::Add(rx, L::Splat(17.0f));
+            y = ry;
+            amplitude *= 0.5f;
+            seed += octaveSeedStep;
+        }
+        return sum;
+    }
+
+    template <typename L>
+    static inline typename L::F duneHeight(const DuneParameters& p, typename L::F x, typename L::F z)
+    {
+        typedef typename L::F F;
+        const F one = L::Splat(1.0f);
+
+        // dune space: wavelengths along the wind and stretched wavelengths across it
+        F along = L::Mul(L::Add(L::Mul(x, L::Splat(p.windX)), L::Mul(z, L::Splat(p.windZ))), L::Splat(p.alongScale));
+        F across = L::Mul(L::Sub(L::Mul(z, L::Splat(p.windX)), L::Mul(x, L::Splat(p.windZ))), L::Splat(p.acrossScale));
+
+        // bend the crests, then cut each wavelength into a long windward ramp and a short slip face
+        F bend = fractalNoise<L>(L::Mul(along, L::Splat(0.35f)), L::Mul(across, L::Splat(1.5f)), 3, p.seed);
+        F phase = L::Add(along, L::Mul(bend, L::Splat(p.meander)));
+        phase = L::Sub(phase, L::Floor(phase));
+        F windward = L::Mul(phase, L::Splat(p.windwardScale));
+        F lee = L::Mul(L::Sub(one, phase), L::Splat(p.leeScale));
+        F t = L::Select(L::Less(phase, L::Splat(p.crest)), windward, lee);
+        F profile = L::Mul(L::Mul(t, t), L::Sub(L::Splat(3.0f), L::Add(t, t)));
+
+        // crest heights drift slowly along the dune field
+        F envelope = gradientNoise<L>(L::Mul(along, L::Splat(0.25f)), L::Mul(across, L::Splat(0.25f)), p.seed + 1);
+        envelope = L::Add(L::Splat(0.6f), L::Mul(envelope, L::Splat(0.4f)));
+
+        F ripples = ridgedNoise<L>(L::Mul(along, L::Splat(4.0f)), L::Mul(across, L::Splat(4.0f)), p.octaves, p.seed + 2);
+        F shape = L::Add(L::Mul(profile, envelope), L::Mul(ripples, L::Splat(p.ripples)));
+        return L::Mul(shape, L::Splat(p.height));
+    }
+
+    // Positions are whole sample indices times spacing, rounded once, so a sample shared by two
+    // tiles gets the same coordinates in both; indices are exact in floats up to 2^24
+    template <typename L>
+    static void generateRows(const DuneParameters& p, glm::ivec2 first, float spacing, int resolution, float* heights)
+    {
+        int samples = resolution + 1;
+        for (int j = 0; j < samples; j++) {
+            typename L::F z = L::Mul(L::Splat((float)(first.y + j)), L::Splat(spacing));
+            float* row = heights + (size_t)j * samples;
+            for (int i = 0; i < samples; i += L::count) {
+                typename L::F x = L::Mul(L::Add(L::Splat((float)(first.x + i)), L::Ramp()), L::Splat(spacing));
+                // the last samples of a row go through the same lanes as the rest, since a
+                // neighbouring tile computes them with the lanes, and scalar code may round differently
+                if (i + L::count <= samples)
+                    L::Store(row + i, duneHeight<L>(p, x, z));
+                else {
+                    float tail[L::count];
+                    L::Store(tail, duneHeight<L>(p, x, z));
+                    std::copy(tail, tail + samples - i, row + i);
+                }
+            }
+        }
+    }
+
+    DuneGenerator::DuneGenerator(DuneOptions options)
+        : options(options)
+    {
+    }
+
+    void DuneGenerator::Generate(glm::ivec2 first, float spacing, int resolution, float* heights) const
+    {
+        generateRows<WideLanes>(makeParameters(options), first, spacing, resolution, heights);
+    }
+
+    void DuneGenerator::GenerateReference(glm::ivec2 first, float spacing, int resolution, float* heights) const
+    {
+        generateRows<ScalarLanes>(makeParameters(options), first, spacing, resolution, heights);
+    }
+
+    float DuneGenerator::Sample(glm::vec2 position) const
+    {
+        return duneHeight<ScalarLanes>(makeParameters(options), position.x, position.y);
+    }
+
+    HeightSource DuneGenerator::GetHeightSource() const
+    {
+        DuneGenerator generator = *this;
+        return [generator](glm::ivec2 first, float spacing, int resolution, float* heights) {
+            generator.Generate(first, spacing, resolution, heights);
+        };
+    }
+
+    const char* DuneGenerator::GetInstructionSet()
+    {
+#if defined(__AVX2__)
+        return "avx2";
+#elif defined(__SSE4_1__)
+        return "sse4.1";
+#else
+        return "scalar";
+#endif
+    }
+
+    int DuneGenerator::GetLaneCount()
+    {
+        return WideLanes::count;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef DuneGenerator_hpp
+#define DuneGenerator_hpp
+
+#include "Terrain.hpp"
+
+#include <stdint.h>
+
+namespace gps {
+
+    struct DuneOptions
+    {
+        uint32_t seed = 1;
+        // direction the wind blows towards; crests run across it
+        glm::vec2 wind = glm::vec2(1.0f, 0.35f);
+        // distance between neighbouring crests, along the wind
+        float wavelength = 96.0f;
+        // how much longer features are across the wind than along it
+        float stretch = 3.0f;
+        // how far crests wander from a straight line, in wavelengths
+        float meander = 0.9f;
+        // share of each dune taken by the gentle windward slope; the rest is the slip face
+        float crest = 0.75f;
+        // height of the tallest crests, in world units
+        float height = 24.0f;
+        // ridged noise octaves of the smaller dunes and ripples on top
+        int octaves = 5;
+        // their amplitude relative to height
+        float ripples = 0.2f;
+    };
+
+    // Procedural desert heightfield: asymmetric transverse dunes whose crests meander and vary
+    // in height, with ridged fractal noise on top, all stretched across the wind. Heights only
+    // depend on the seed and the world position, so tiles generated in any order, on any
+    // thread, match at their edges and the same seed always gives the same world.
+    class DuneGenerator
+    {
+    public:
+        explicit DuneGenerator(gps::DuneOptions options = gps::DuneOptions());
+
+        // Fills (resolution + 1)^2 heights like a HeightSource, 8 (AVX2) or 4 (SSE4.1) samples at a time
+        void Generate(glm::ivec2 first, float spacing, int resolution, float* heights) const;
+        // The same, one sample at a time, as a reference for Generate
+        void GenerateReference(glm::ivec2 first, float spacing, int resolution, float* heights) const;
+        float Sample(glm::vec2 position) const;
+
+        // Generate as a terrain height source; the terrain spreads its tiles over the worker pool
+        gps::HeightSource GetHeightSource() const;
+
+        // "avx2", "sse4.1" or "scalar", and the samples Generate computes at once
+        static const char* GetInstructionSet();
+        static int GetLaneCount();
+
+    private:
+        gps::DuneOptions options;
+    };
+}
+
+#endif /* DuneGenerator_hpp */
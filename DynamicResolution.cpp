@@ -0,0 +1,152 @@
+#include "DynamicResolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    DynamicResolution::DynamicResolution(gps::ResolutionOptions options) : controller(options), width(0), height(0), samples(0),
+        frameScale(1.0f), drawFramebuffer(0), resolveFramebuffer(0), colorBuffer(0), depthBuffer(0), texture(0), vertexArray(0)
+    {
+        frameScale = controller.GetScale();
+    }
+
+    void DynamicResolution::Init(int width, int height, int samples)
+    {
+        this->samples = samples > 1 ? samples : 0;
+        glGenVertexArrays(1, &vertexArray);
+        Resize(width, height);
+    }
+
+    void DynamicResolution::Delete()
+    {
+        Release();
+        glDeleteVertexArrays(1, &vertexArray);
+        vertexArray = 0;
+    }
+
+    void DynamicResolution::Resize(int width, int height)
+    {
+        width = std::max(width, 1);
+        height = std::max(height, 1);
+        if (width == this->width && height == this->height)
+            return;
+        this->width = width;
+        this->height = height;
+        Release();
+        Allocate();
+    }
+
+    void DynamicResolution::Allocate()
+    {
+        // sRGB like the window, so the scene is blended and filtered in linear space
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+
+        glGenFramebuffers(1, &resolveFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, resolveFramebuffer);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0);
+        if (samples > 0) {
+            glGenRenderbuffers(1, &colorBuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_SRGB8_ALPHA8, width, height);
+            glGenFramebuffers(1, &drawFramebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+        } else {
+            // nothing to resolve, the scene is drawn straight into the texture
+            drawFramebuffer = resolveFramebuffer;
+        }
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void DynamicResolution::Release()
+    {
+        if (drawFramebuffer != resolveFramebuffer)
+            glDeleteFramebuffers(1, &drawFramebuffer);
+        glDeleteFramebuffers(1, &resolveFramebuffer);
+        glDeleteRenderbuffers(1, &colorBuffer);
+        glDeleteRenderbuffers(1, &depthBuffer);
+        glDeleteTextures(1, &texture);
+        drawFramebuffer = resolveFramebuffer = colorBuffer = depthBuffer = texture = 0;
+    }
+
+    void DynamicResolution::AddFrameTime(double milliseconds)
+    {
+        controller.AddFrameTime(milliseconds);
+    }
+
+    void DynamicResolution::BeginFrame()
+    {
+        // the scale holds for the whole frame, whatever arrives while it is drawn
+        frameScale = controller.GetScale();
+    }
+
+    void DynamicResolution::Bind()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+        glViewport(0, 0, GetWidth(), GetHeight());
+        // clears stop at the scaled corner too
+        glScissor(0, 0, GetWidth(), GetHeight());
+        glEnable(GL_SCISSOR_TEST);
+    }
+
+    void DynamicResolution::Resolve()
+    {
+        glDisable(GL_SCISSOR_TEST);
+        if (drawFramebuffer != resolveFramebuffer) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFramebuffer);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer);
+            glBlitFramebuffer(0, 0, GetWidth(), GetHeight(), 0, 0, GetWidth(), GetHeight(), GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, resolveFramebuffer);
+    }
+
+    void DynamicResolution::Present(gps::Shader& shader, int windowWidth, int windowHeight)
+    {
+        glViewport(0, 0, windowWidth, windowHeight);
+        glDisable(GL_DEPTH_TEST);
+        shader.useShaderProgram();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glUniform1i(glGetUniformLocation(shader.shaderProgram, "scene"), 0);
+        glUniform2f(glGetUniformLocation(shader.shaderProgram, "regionScale"), GetWidth() / (float)width, GetHeight() / (float)height);
+        glBindVertexArray(vertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    int DynamicResolution::GetWidth()
+    {
+        return std::max((int)std::lround(width * frameScale), 1);
+    }
+
+    int DynamicResolution::GetHeight()
+    {
+        return std::max((int)std::lround(height * frameScale), 1);
+    }
+
+    float DynamicResolution::GetScale()
+    {
+        return frameScale;
+    }
+
+    gps::ResolutionController& DynamicResolution::GetController()
+    {
+        return controller;
+    }
+}
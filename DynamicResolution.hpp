@@ -0,0 +1,64 @@
+#ifndef DynamicResolution_hpp
+#define DynamicResolution_hpp
+
+#include "ResolutionController.hpp"
+#include "Shader.hpp"
+
+#include <GL/glew.h>
+
+namespace gps {
+
+    // Renders the scene into an offscreen target at a scale of the window that a
+    // ResolutionController picks from GPU frame times, then stretches it over the window.
+    // The target is allocated at the window's size and the scene drawn into its lower left
+    // corner, so changing the scale reallocates nothing. It is multisampled like the window
+    // and resolved before the stretch. GL thread only.
+    class DynamicResolution
+    {
+    public:
+        explicit DynamicResolution(gps::ResolutionOptions options = gps::ResolutionOptions());
+
+        // Size of the window's framebuffer; samples as the window has (0 or 1 for none)
+        void Init(int width, int height, int samples);
+        void Delete();
+        void Resize(int width, int height);
+
+        // Feeds the controller the GPU time of a finished frame
+        void AddFrameTime(double milliseconds);
+
+        // Takes the controller's scale for the frame about to be drawn
+        void BeginFrame();
+        // Binds the target with viewport and scissor at the frame's scaled size
+        void Bind();
+        // Resolves the scene and leaves it bound for reading, at the same size
+        void Resolve();
+        // Draws the resolved scene over the bound framebuffer, filtered
+        void Present(gps::Shader& shader, int windowWidth, int windowHeight);
+
+        // Scaled size of the frame since BeginFrame
+        int GetWidth();
+        int GetHeight();
+        float GetScale();
+        gps::ResolutionController& GetController();
+
+    private:
+        gps::ResolutionController controller;
+        int width;
+        int height;
+        int samples;
+        float frameScale;
+        // drawn into, multisampled when the window is; the resolve target samples a texture
+        GLuint drawFramebuffer;
+        GLuint resolveFramebuffer;
+        GLuint colorBuffer;
+        GLuint depthBuffer;
+        GLuint texture;
+        // the stretch draws one triangle from gl_VertexID, but core profile needs a VAO bound
+        GLuint vertexArray;
+
+        void Allocate();
+        void Release();
+    };
+}
+
+#endif /* DynamicResolution_hpp */
@@ -0,0 +1,87 @@
+#ifndef FastFloat_hpp
+#define FastFloat_hpp
+
+#include <cmath>
+#include <stdint.h>
+
+namespace gps {
+
+    // Parses [sign] digits [. digits] [(e|E) [sign] digits] from [s, end) without strtod or
+    // the locale. Returns the first character after the number, or s if there is none.
+    // Up to 19 significant digits and a power of ten within 1e22 are exact (the Clinger
+    // fast path); anything else is scaled in long double, which can leave a double one ulp
+    // off but in practice rounds to the same float as strtod.
+    inline const char* ParseDouble(const char* s, const char* end, double& result)
+    {
+        static const double powersOfTen[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        const char* p = s;
+        bool negative = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            negative = *p == '-';
+            p++;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool any = false;
+        for (; p < end && (unsigned)(*p - '0') < 10; p++) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+            } else {
+                exponent++;
+            }
+        }
+        if (p < end && *p == '.') {
+            p++;
+            for (; p < end && (unsigned)(*p - '0') < 10; p++) {
+                any = true;
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                }
+            }
+        }
+        if (!any)
+            return s;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char* q = p + 1;
+            bool negativeExponent = false;
+            if (q < end && (*q == '+' || *q == '-')) {
+                negativeExponent = *q == '-';
+                q++;
+            }
+            if (q < end && (unsigned)(*q - '0') < 10) {
+                int value = 0;
+                for (; q < end && (unsigned)(*q - '0') < 10; q++)
+                    value = value < 100000 ? value * 10 + (*q - '0') : value;
+                exponent += negativeExponent ? -value : value;
+                p = q;
+            }
+        }
+
+        double value;
+        if (mantissa == 0)
+            value = 0.0;
+        else if (mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+            value = exponent < 0 ? (double)mantissa / powersOfTen[-exponent] : (double)mantissa * powersOfTen[exponent];
+        else if (mantissa <= (1ULL << 53) && exponent > 22 && exponent <= 22 + 15 &&
+                 mantissa <= (1ULL << 53) / (uint64_t)powersOfTen[exponent - 22])
+            // a short mantissa can take the surplus zeros and still be exact, e.g. 3e25
+            value = (double)(mantissa * (uint64_t)powersOfTen[exponent - 22]) * 1e22;
+        else
+            value = (double)((long double)mantissa * std::pow(10.0L, (long double)exponent));
+        result = negative ? -value : value;
+        return p;
+    }
+}
+
+#endif /* FastFloat_hpp */
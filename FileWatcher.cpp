@@ -0,0 +1,51 @@
+#include "FileWatcher.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace gps {
+
+    FileWatcher::FileWatcher(std::string directory)
+    {
+        descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (descriptor >= 0 && inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            close(descriptor);
+            descriptor = -1;
+        }
+        if (descriptor < 0)
+            fprintf(stderr, "WARNING: cannot watch %s for changes\n", directory.c_str());
+    }
+
+    FileWatcher::~FileWatcher()
+    {
+        if (descriptor >= 0)
+            close(descriptor);
+    }
+
+    std::vector<std::string> FileWatcher::Poll()
+    {
+        std::vector<std::string> changed;
+        if (descriptor < 0)
+            return changed;
+
+        // aligned for the inotify_event records read into it
+        alignas(struct inotify_event) char buffer[4096];
+        for (;;) {
+            ssize_t length = read(descriptor, buffer, sizeof(buffer));
+            if (length <= 0)
+                break;
+            for (ssize_t offset = 0; offset < length;) {
+                const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+                if (event->len > 0) {
+                    std::string name = event->name;
+                    if (std::find(changed.begin(), changed.end(), name) == changed.end())
+                        changed.push_back(name);
+                }
+                offset += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        return changed;
+    }
+}
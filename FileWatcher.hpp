@@ -0,0 +1,28 @@
+#ifndef FileWatcher_hpp
+#define FileWatcher_hpp
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Watches one directory with inotify for files that were written or replaced; editors
+    // that save through a temporary file and a rename are covered too. Linux only.
+    class FileWatcher
+    {
+    public:
+        explicit FileWatcher(std::string directory);
+        ~FileWatcher();
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+
+        // Names (without the directory) of the files changed since the last call, each once;
+        // never blocks
+        std::vector<std::string> Poll();
+
+    private:
+        int descriptor;
+    };
+}
+
+#endif /* FileWatcher_hpp */
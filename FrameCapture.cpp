@@ -0,0 +1,244 @@
+#include "FrameCapture.hpp"
+#include "PngFile.hpp"
+#include "Y4mFile.hpp"
+
+#include <memory>
+#include <thread>
+#include <sys/stat.h>
+
+namespace gps {
+
+    FrameCapture::FrameCapture(gps::ThreadPool& pool, gps::CaptureOptions options) : pool(pool), options(options),
+        readback(options.readbacks), recording(false), width(0), height(0), sequence(0), encoding(0), queue(new EncodeQueue()), stream(NULL), nextWrite(0)
+    {
+        stats = gps::CaptureStats();
+    }
+
+    void FrameCapture::Init()
+    {
+        readback.Init();
+    }
+
+    void FrameCapture::Delete()
+    {
+        Stop();
+        readback.Delete();
+    }
+
+    bool FrameCapture::Start(int width, int height)
+    {
+        Stop();
+        if (options.format == CAPTURE_PNG) {
+            mkdir(options.path.c_str(), 0755);
+            struct stat info;
+            if (stat(options.path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode))
+                return false;
+        } else {
+            stream = fopen(options.path.c_str(), "wb");
+            if (stream == NULL)
+                return false;
+            std::string header = gps::GetY4mHeader(width, height, options.frameRate);
+            fwrite(header.data(), 1, header.size(), stream);
+        }
+
+        this->width = width;
+        this->height = height;
+        sequence = 0;
+        nextWrite = 0;
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats = gps::CaptureStats();
+        }
+        start = std::chrono::steady_clock::now();
+        recording = true;
+        return true;
+    }
+
+    int FrameCapture::GetEncodingLimit()
+    {
+        // two frames per worker keep them busy; more would only pile up memory
+        return options.maxEncoding > 0 ? options.maxEncoding : 2 * (int)pool.GetThreadCount();
+    }
+
+    void FrameCapture::Capture(int width, int height)
+    {
+        if (!recording)
+            return;
+        // a stream has one size, and numbered files should match each other
+        if (width != this->width || height != this->height) {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats.dropped++;
+            return;
+        }
+
+        readback.Poll();
+        int limit = GetEncodingLimit();
+        if (options.backpressure == CAPTURE_DROP) {
+            // waiting on either would show up in the frame time being recorded
+            if (encoding >= limit || readback.IsFull()) {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                stats.dropped++;
+                return;
+            }
+        } else if (encoding >= limit) {
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                stats.encoderWaits++;
+            }
+            WaitForEncoders(limit);
+        }
+
+        int frame = sequence++;
+        int stalls = readback.GetStalls();
+        readback.Read(width, height, [this, frame](std::vector<unsigned char>& pixels, int, int) {
+            Encode(pixels, frame);
+        });
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.captured++;
+        stats.readbackStalls += readback.GetStalls() - stalls;
+    }
+
+    void FrameCapture::Encode(std::vector<unsigned char>& pixels, int frame)
+    {
+        // the read failed; the stream still has to get past the frame
+        if (pixels.empty()) {
+            if (options.format == CAPTURE_Y4M)
+                WriteFrames(frame, pixels);
+            else {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                stats.failed++;
+            }
+            return;
+        }
+
+        encoding++;
+        std::shared_ptr<std::vector<unsigned char> > image(new std::vector<unsigned char>());
+        image->swap(pixels);
+        std::function<void()> job = [this, image, frame]() {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            std::vector<unsigned char> encoded;
+            if (options.format == CAPTURE_PNG) {
+                // GL rows start at the bottom, and the alpha of the scene means nothing
+                gps::EncodePng(image->data(), width, height, 4, encoded, true, true);
+            } else {
+                encoded.resize(gps::GetI420Size(width, height));
+                gps::ConvertRgbaToI420(image->data(), width, height, true, encoded.data());
+            }
+            image->clear();
+            image->shrink_to_fit();
+            double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                stats.encodeMilliseconds += milliseconds;
+            }
+
+            if (options.format == CAPTURE_PNG) {
+                char name[16];
+                snprintf(name, sizeof(name), "/%05d.png", frame);
+                std::string path = options.path + name;
+                FILE* file = fopen(path.c_str(), "wb");
+                bool written = file != NULL && fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+                if (file != NULL)
+                    written = fclose(file) == 0 && written;
+                std::lock_guard<std::mutex> lock(statsMutex);
+                (written ? stats.written : stats.failed)++;
+                stats.bytes += written ? encoded.size() : 0;
+            } else
+                WriteFrames(frame, encoded);
+            encoding--;
+        };
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->jobs.push_back(job);
+        }
+        std::shared_ptr<EncodeQueue> shared = queue;
+        pool.Submit([shared]() { RunQueued(shared); });
+    }
+
+    bool FrameCapture::RunQueued(const std::shared_ptr<EncodeQueue>& queue)
+    {
+        std::function<void()> job;
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            if (queue->jobs.empty())
+                return false;
+            job = queue->jobs.front();
+            queue->jobs.pop_front();
+        }
+        job();
+        return true;
+    }
+
+    void FrameCapture::WaitForEncoders(int limit)
+    {
+        // the pool may be busy with streaming jobs that wait for the GL thread, so queued
+        // encodes run here; only those already running on a worker are waited for
+        while (encoding >= limit && RunQueued(queue)) {
+        }
+        while (encoding >= limit)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    void FrameCapture::WriteFrames(int frame, std::vector<unsigned char>& yuv)
+    {
+        // whichever worker finishes the next frame writes it and any that were waiting for it
+        std::lock_guard<std::mutex> lock(streamMutex);
+        converted[frame].swap(yuv);
+        std::map<int, std::vector<unsigned char> >::iterator next;
+        while ((next = converted.find(nextWrite)) != converted.end()) {
+            // an empty frame is a failed read, left out of the stream
+            static const char marker[] = "FRAME\n";
+            bool written = !next->second.empty() && fwrite(marker, 1, sizeof(marker) - 1, stream) == sizeof(marker) - 1 &&
+                fwrite(next->second.data(), 1, next->second.size(), stream) == next->second.size();
+            {
+                std::lock_guard<std::mutex> statsLock(statsMutex);
+                (written ? stats.written : stats.failed)++;
+                stats.bytes += written ? sizeof(marker) - 1 + next->second.size() : 0;
+            }
+            converted.erase(next);
+            nextWrite++;
+        }
+    }
+
+    void FrameCapture::Poll()
+    {
+        readback.Poll();
+    }
+
+    void FrameCapture::Stop()
+    {
+        if (!recording)
+            return;
+        recording = false;
+        readback.Flush();
+        WaitForEncoders(1);
+        if (stream != NULL) {
+            if (fclose(stream) != 0) {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                stats.failed++;
+            }
+            stream = NULL;
+        }
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool FrameCapture::IsRecording()
+    {
+        return recording;
+    }
+
+    int FrameCapture::GetPending()
+    {
+        return readback.GetPending() + encoding;
+    }
+
+    gps::CaptureStats FrameCapture::GetStats()
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        gps::CaptureStats current = stats;
+        if (recording)
+            current.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return current;
+    }
+}
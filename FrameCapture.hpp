@@ -0,0 +1,123 @@
+#ifndef FrameCapture_hpp
+#define FrameCapture_hpp
+
+#include "PixelReadback.hpp"
+#include "ThreadPool.hpp"
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    enum CAPTURE_FORMAT { CAPTURE_PNG, CAPTURE_Y4M };
+    // What Capture does when every readback is in flight or the encoders are behind: skip the
+    // frame, or wait for them and let the frame time suffer
+    enum CAPTURE_BACKPRESSURE { CAPTURE_DROP, CAPTURE_QUEUE };
+
+    struct CaptureOptions
+    {
+        CAPTURE_FORMAT format = CAPTURE_Y4M;
+        CAPTURE_BACKPRESSURE backpressure = CAPTURE_DROP;
+        // frames of latency before a read would wait for the GPU
+        int readbacks = 3;
+        // frames read back and not written yet; 0 for two per worker
+        int maxEncoding = 0;
+        // a directory of numbered PNG files, or the Y4M file
+        std::string path = "capture.y4m";
+        int frameRate = 60;
+    };
+
+    struct CaptureStats
+    {
+        // frames read back, and frames skipped by CAPTURE_DROP or a size change
+        int captured;
+        int dropped;
+        int written;
+        int failed;
+        // captures that waited for the GPU, and for the encoders to catch up
+        int readbackStalls;
+        int encoderWaits;
+        double seconds;
+        // summed over the workers
+        double encodeMilliseconds;
+        size_t bytes;
+    };
+
+    // Records frames without stalling the pipeline. Capture queues a read of the bound read
+    // framebuffer (the back buffer before swapping, or an offscreen target) into a ring of pixel
+    // pack buffers; a few frames later the pixels go to the worker pool, which encodes PNG files
+    // or converts frames for one Y4M stream, written in capture order. Encodes wait in a queue
+    // of their own that the GL thread drains itself when it has to wait for them, so it never
+    // depends on pool workers that may be blocked on it (the asset streamer's). GL thread
+    // only, apart from the encoding it hands out.
+    class FrameCapture
+    {
+    public:
+        FrameCapture(gps::ThreadPool& pool, gps::CaptureOptions options = gps::CaptureOptions());
+
+        void Init();
+        void Delete();
+
+        // Starts a recording of width x height frames; false if the output cannot be created
+        bool Start(int width, int height);
+        // Reads back the bound read framebuffer; frames of another size are dropped
+        void Capture(int width, int height);
+        // Hands the reads that arrived to the workers; call once a frame
+        void Poll();
+        // Waits for every frame and closes the output
+        void Stop();
+
+        bool IsRecording();
+        // Frames read back or encoding
+        int GetPending();
+        gps::CaptureStats GetStats();
+
+    private:
+        gps::ThreadPool& pool;
+        gps::CaptureOptions options;
+        gps::PixelReadback readback;
+        bool recording;
+        int width;
+        int height;
+        // numbers the frames read back, for file names and the order of the stream
+        int sequence;
+        // encodes queued or running; each holds a whole frame
+        std::atomic<int> encoding;
+        // shared with the pool tasks, which may only run after the capture is gone
+        struct EncodeQueue
+        {
+            std::mutex mutex;
+            std::deque<std::function<void()> > jobs;
+        };
+        std::shared_ptr<EncodeQueue> queue;
+        std::mutex statsMutex;
+        gps::CaptureStats stats;
+        std::chrono::steady_clock::time_point start;
+
+        // Y4M frames converted ahead of an earlier one wait here until it is written
+        std::mutex streamMutex;
+        FILE* stream;
+        int nextWrite;
+        std::map<int, std::vector<unsigned char> > converted;
+
+        int GetEncodingLimit();
+        static bool RunQueued(const std::shared_ptr<EncodeQueue>& queue);
+        // Runs queued encodes on this thread until fewer than limit are left, then waits for
+        // the ones running on workers
+        void WaitForEncoders(int limit);
+        void Encode(std::vector<unsigned char>& pixels, int frame);
+        void WriteFrames(int frame, std::vector<unsigned char>& yuv);
+    };
+}
+
+#endif /* FrameCapture_hpp */
@@ -0,0 +1,128 @@
+#include "GpuProfiler.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    void GpuProfiler::Init()
+    {
+        for (int f = 0; f < latency; f++) {
+            frames[f].sections.clear();
+            frames[f].queries.clear();
+            frames[f].used = 0;
+        }
+        frame = 0;
+        initialized = true;
+        Reset();
+    }
+
+    void GpuProfiler::Delete()
+    {
+        for (int f = 0; f < latency; f++) {
+            if (!frames[f].queries.empty())
+                glDeleteQueries((GLsizei)frames[f].queries.size(), frames[f].queries.data());
+            frames[f].queries.clear();
+            frames[f].sections.clear();
+        }
+        initialized = false;
+    }
+
+    void GpuProfiler::Resolve(Frame& slot)
+    {
+        if (slot.sections.empty())
+            return;
+        // if even the last timestamp is not done the frame is dropped rather than waited for
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(slot.last, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_TRUE) {
+            GLuint64 first = ~(GLuint64)0, last = 0;
+            for (size_t s = 0; s < slot.sections.size(); s++) {
+                GLuint64 begin = 0, end = 0;
+                glGetQueryObjectui64v(slot.sections[s].begin, GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(slot.sections[s].end, GL_QUERY_RESULT, &end);
+                const std::string& name = slot.sections[s].name;
+                if (totals.find(name) == totals.end())
+                    order.push_back(name);
+                totals[name] += (end - begin) / 1e6;
+                first = std::min(first, begin);
+                last = std::max(last, end);
+            }
+            resolvedFrames++;
+            lastFrameTime = (last - first) / 1e6;
+            if (frameCallback)
+                frameCallback(lastFrameTime);
+        }
+        slot.sections.clear();
+        slot.used = 0;
+    }
+
+    void GpuProfiler::BeginFrame()
+    {
+        if (!initialized)
+            return;
+        // sections left open last frame have no end timestamp to read
+        while (!open.empty())
+            End();
+        frame = (frame + 1) % latency;
+        Resolve(frames[frame]);
+    }
+
+    void GpuProfiler::Begin(std::string name)
+    {
+        if (!initialized)
+            return;
+        Frame& slot = frames[frame];
+        if (slot.used + 2 > slot.queries.size()) {
+            size_t grow = std::max<size_t>(slot.queries.size(), 8);
+            slot.queries.resize(slot.queries.size() + grow);
+            glGenQueries((GLsizei)grow, slot.queries.data() + slot.queries.size() - grow);
+        }
+        Section section;
+        section.name = name;
+        section.begin = slot.queries[slot.used++];
+        section.end = slot.queries[slot.used++];
+        glQueryCounter(section.begin, GL_TIMESTAMP);
+        open.push_back(slot.sections.size());
+        slot.sections.push_back(section);
+    }
+
+    void GpuProfiler::End()
+    {
+        if (!initialized || open.empty())
+            return;
+        Frame& slot = frames[frame];
+        slot.last = slot.sections[open.back()].end;
+        glQueryCounter(slot.last, GL_TIMESTAMP);
+        open.pop_back();
+    }
+
+    std::vector<std::pair<std::string, double>> GpuProfiler::GetAverages()
+    {
+        std::vector<std::pair<std::string, double>> averages;
+        for (size_t i = 0; i < order.size(); i++)
+            averages.push_back(std::make_pair(order[i], resolvedFrames > 0 ? totals[order[i]] / resolvedFrames : 0.0));
+        return averages;
+    }
+
+    int GpuProfiler::GetFrameCount()
+    {
+        return resolvedFrames;
+    }
+
+    void GpuProfiler::SetFrameCallback(gps::FrameTimeCallback callback)
+    {
+        frameCallback = callback;
+    }
+
+    double GpuProfiler::GetLastFrameTime()
+    {
+        return lastFrameTime;
+    }
+
+    void GpuProfiler::Reset()
+    {
+        order.clear();
+        totals.clear();
+        resolvedFrames = 0;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef GpuProfiler_hpp
+#define GpuProfiler_hpp
+
+#include <GL/glew.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Receives the GPU milliseconds of each frame read back, from its first timestamp to its last
+    typedef std::function<void(double milliseconds)> FrameTimeCallback;
+
+    // GPU time per named section of the frame, from GL_TIMESTAMP query pairs. Results are read
+    // a few frames late, once the GPU has caught up, so profiling never stalls the pipeline.
+    // Sections may nest; a name used several times in a frame is summed. GL thread only.
+    class GpuProfiler
+    {
+    public:
+        void Init();
+        void Delete();
+
+        void BeginFrame();
+        void Begin(std::string name);
+        // Ends the innermost open section
+        void End();
+
+        // Average milliseconds per frame of every section since the last Reset, in first-use order
+        std::vector<std::pair<std::string, double>> GetAverages();
+        int GetFrameCount();
+        void Reset();
+
+        // Called from BeginFrame for every frame read back, a few frames after it was drawn
+        void SetFrameCallback(gps::FrameTimeCallback callback);
+        // of the frame read back last, 0 before the first
+        double GetLastFrameTime();
+
+    private:
+        // frames in flight before their queries are read back
+        static const int latency = 4;
+
+        struct Section
+        {
+            std::string name;
+            GLuint begin;
+            GLuint end;
+        };
+
+        struct Frame
+        {
+            std::vector<Section> sections;
+            // query pairs allocated for this slot, reused from frame to frame
+            std::vector<GLuint> queries;
+            size_t used;
+            // the timestamp issued last, which completes last
+            GLuint last;
+        };
+
+        Frame frames[latency];
+        int frame = 0;
+        std::vector<size_t> open;
+        std::vector<std::string> order;
+        std::map<std::string, double> totals;
+        int resolvedFrames = 0;
+        bool initialized = false;
+        gps::FrameTimeCallback frameCallback;
+        double lastFrameTime = 0.0;
+
+        void Resolve(Frame& slot);
+    };
+}
+
+#endif /* GpuProfiler_hpp */
@@ -0,0 +1,196 @@
+#include "ImageUtils.hpp"
+#include "stb_image.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace gps {
+
+    static void swapRows(unsigned char* a, unsigned char* b, size_t size)
+    {
+        size_t i = 0;
+#if defined(__SSE2__)
+        for (; i + 64 <= size; i += 64) {
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i a1 = _mm_loadu_si128((const __m128i*)(a + i + 16));
+            __m128i a2 = _mm_loadu_si128((const __m128i*)(a + i + 32));
+            __m128i a3 = _mm_loadu_si128((const __m128i*)(a + i + 48));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(b + i));
+            __m128i b1 = _mm_loadu_si128((const __m128i*)(b + i + 16));
+            __m128i b2 = _mm_loadu_si128((const __m128i*)(b + i + 32));
+            __m128i b3 = _mm_loadu_si128((const __m128i*)(b + i + 48));
+            _mm_storeu_si128((__m128i*)(a + i), b0);
+            _mm_storeu_si128((__m128i*)(a + i + 16), b1);
+            _mm_storeu_si128((__m128i*)(a + i + 32), b2);
+            _mm_storeu_si128((__m128i*)(a + i + 48), b3);
+            _mm_storeu_si128((__m128i*)(b + i), a0);
+            _mm_storeu_si128((__m128i*)(b + i + 16), a1);
+            _mm_storeu_si128((__m128i*)(b + i + 32), a2);
+            _mm_storeu_si128((__m128i*)(b + i + 48), a3);
+        }
+#endif
+        unsigned char temp[64];
+        for (; i < size; i += 64) {
+            size_t count = size - i < 64 ? size - i : 64;
+            memcpy(temp, a + i, count);
+            memcpy(a + i, b + i, count);
+            memcpy(b + i, temp, count);
+        }
+    }
+
+    void FlipRows(unsigned char* pixels, int width, int height, int channels)
+    {
+        size_t rowBytes = (size_t)width * channels;
+        for (int row = 0; row < height / 2; row++)
+            swapRows(pixels + row * rowBytes, pixels + (height - row - 1) * rowBytes, rowBytes);
+    }
+
+    void ExpandRgbToRgba(const unsigned char* rgb, unsigned char* rgba, size_t texelCount)
+    {
+        size_t i = 0;
+#if defined(__SSSE3__)
+        // 16 texels: three loads realigned so each register starts on a texel
+        const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+        for (; i + 16 <= texelCount; i += 16) {
+            const unsigned char* source = rgb + i * 3;
+            __m128i a = _mm_loadu_si128((const __m128i*)source);
+            __m128i b = _mm_loadu_si128((const __m128i*)(source + 16));
+            __m128i c = _mm_loadu_si128((const __m128i*)(source + 32));
+            __m128i* destination = (__m128i*)(rgba + i * 4);
+            _mm_storeu_si128(destination, _mm_or_si128(_mm_shuffle_epi8(a, spread), opaque));
+            _mm_storeu_si128(destination + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), spread), opaque));
+            _mm_storeu_si128(destination + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), spread), opaque));
+            _mm_storeu_si128(destination + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), spread), opaque));
+        }
+#endif
+        for (; i < texelCount; i++) {
+            rgba[i * 4 + 0] = rgb[i * 3 + 0];
+            rgba[i * 4 + 1] = rgb[i * 3 + 1];
+            rgba[i * 4 + 2] = rgb[i * 3 + 2];
+            rgba[i * 4 + 3] = 255;
+        }
+    }
+
+#if defined(__SSSE3__)
+    // pshufb masks that take byte 3t + 2 - k of 48 to byte 3t + k, split per register pair
+    struct SwizzleMasks
+    {
+        unsigned char bytes[3][3][16];
+
+        SwizzleMasks()
+        {
+            memset(bytes, 0x80, sizeof(bytes));
+            for (int j = 0; j < 48; j++) {
+                int source = j / 3 * 3 + 2 - j % 3;
+                bytes[j / 16][source / 16][j % 16] = (unsigned char)(source % 16);
+            }
+        }
+    };
+#endif
+
+    void SwizzleBgr(unsigned char* pixels, size_t texelCount, int channels)
+    {
+        size_t i = 0;
+#if defined(__SSSE3__)
+        if (channels == 4) {
+            const __m128i swap = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+            for (; i + 4 <= texelCount; i += 4) {
+                __m128i* p = (__m128i*)(pixels + i * 4);
+                _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), swap));
+            }
+        } else {
+            // 16 texels span three registers; every output register gathers from its neighbours
+            static const SwizzleMasks masks;
+            __m128i mask[3][3];
+            for (int out = 0; out < 3; out++)
+                for (int r = 0; r < 3; r++)
+                    mask[out][r] = _mm_loadu_si128((const __m128i*)masks.bytes[out][r]);
+            // outputs 0 and 2 only reach into the adjacent register
+            for (; i + 16 <= texelCount; i += 16) {
+                __m128i* p = (__m128i*)(pixels + i * 3);
+                __m128i a = _mm_loadu_si128(p);
+                __m128i b = _mm_loadu_si128(p + 1);
+                __m128i c = _mm_loadu_si128(p + 2);
+                _mm_storeu_si128(p, _mm_or_si128(_mm_shuffle_epi8(a, mask[0][0]), _mm_shuffle_epi8(b, mask[0][1])));
+                _mm_storeu_si128(p + 1, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, mask[1][0]), _mm_shuffle_epi8(b, mask[1][1])),
+                                                     _mm_shuffle_epi8(c, mask[1][2])));
+                _mm_storeu_si128(p + 2, _mm_or_si128(_mm_shuffle_epi8(b, mask[2][1]), _mm_shuffle_epi8(c, mask[2][2])));
+            }
+        }
+#endif
+        for (; i < texelCount; i++) {
+            unsigned char temp = pixels[i * channels];
+            pixels[i * channels] = pixels[i * channels + 2];
+            pixels[i * channels + 2] = temp;
+        }
+    }
+
+    void PremultiplyAlpha(unsigned char* rgba, size_t texelCount)
+    {
+        size_t i = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i colourLanes = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+        // alpha is multiplied by 255, which leaves it as it was
+        const __m128i alphaLanes = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+        const __m128i half = _mm_set1_epi16(128);
+        for (; i + 4 <= texelCount; i += 4) {
+            __m128i* p = (__m128i*)(rgba + i * 4);
+            __m128i texels = _mm_loadu_si128(p);
+            __m128i halves[2] = { _mm_unpacklo_epi8(texels, zero), _mm_unpackhi_epi8(texels, zero) };
+            for (int h = 0; h < 2; h++) {
+                __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(halves[h], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+                alpha = _mm_or_si128(_mm_and_si128(alpha, colourLanes), alphaLanes);
+                __m128i product = _mm_add_epi16(_mm_mullo_epi16(halves[h], alpha), half);
+                halves[h] = _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+            }
+            _mm_storeu_si128(p, _mm_packus_epi16(halves[0], halves[1]));
+        }
+#endif
+        for (; i < texelCount; i++) {
+            unsigned alpha = rgba[i * 4 + 3];
+            for (int c = 0; c < 3; c++) {
+                unsigned product = rgba[i * 4 + c] * alpha + 128;
+                rgba[i * 4 + c] = (unsigned char)((product + (product >> 8)) >> 8);
+            }
+        }
+    }
+
+    bool DecodeRgba(const unsigned char* data, size_t size, bool flip, gps::Image& image)
+    {
+        int width, height, channels;
+        unsigned char* pixels = stbi_load_from_memory(data, (int)size, &width, &height, &channels, 0);
+        if (!pixels)
+            return false;
+
+        if (channels == 3) {
+            // stb's own conversion is a scalar loop, so RGB files are expanded here
+            unsigned char* expanded = (unsigned char*)malloc((size_t)width * height * 4);
+            ExpandRgbToRgba(pixels, expanded, (size_t)width * height);
+            stbi_image_free(pixels);
+            pixels = expanded;
+        } else if (channels != 4) {
+            stbi_image_free(pixels);
+            pixels = stbi_load_from_memory(data, (int)size, &width, &height, &channels, 4);
+            if (!pixels)
+                return false;
+        }
+
+        if (flip)
+            FlipRows(pixels, width, height, 4);
+
+        image.width = width;
+        image.height = height;
+        image.channels = 4;
+        image.pixels = std::shared_ptr<unsigned char>(pixels, stbi_image_free);
+        return true;
+    }
+}
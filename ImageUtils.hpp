@@ -0,0 +1,26 @@
+#ifndef ImageUtils_hpp
+#define ImageUtils_hpp
+
+#include "Mesh.hpp"
+
+#include <stddef.h>
+
+namespace gps {
+
+    // Pixel kernels used by the texture loaders. Each one has an SSE2/SSSE3 path, picked
+    // at compile time, and a plain loop for other targets.
+
+    // Turns the image upside down in place by swapping whole rows
+    void FlipRows(unsigned char* pixels, int width, int height, int channels);
+    // rgba may not overlap rgb; alpha is set to 255
+    void ExpandRgbToRgba(const unsigned char* rgb, unsigned char* rgba, size_t texelCount);
+    // Swaps the first and third channel in place, for BGR(A) data; channels is 3 or 4
+    void SwizzleBgr(unsigned char* pixels, size_t texelCount, int channels);
+    // Multiplies colour by alpha in place, rounding like colour * alpha / 255
+    void PremultiplyAlpha(unsigned char* rgba, size_t texelCount);
+
+    // Decodes an image file held in memory into 8-bit RGBA, flipped for OpenGL if asked
+    bool DecodeRgba(const unsigned char* data, size_t size, bool flip, gps::Image& image);
+}
+
+#endif /* ImageUtils_hpp */
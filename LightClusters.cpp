@@ -0,0 +1,197 @@
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace gps {
+
+    const int LightClusters::maxLights;
+
+    LightClusters::LightClusters(gps::ClusterOptions options) : options(options), tanHalfX(0.0f), tanHalfY(0.0f)
+    {
+        sliceLights.resize(options.slices);
+        clusterLights.resize(GetClusterCount());
+        clusterRanges.assign(GetClusterCount() * 2, 0);
+        stats = gps::ClusterStats();
+    }
+
+    int LightClusters::GetClusterCount()
+    {
+        return options.tilesX * options.tilesY * options.slices;
+    }
+
+    gps::ClusterOptions LightClusters::GetOptions()
+    {
+        return options;
+    }
+
+    gps::ClusterStats LightClusters::GetStats()
+    {
+        return stats;
+    }
+
+    glm::vec2 LightClusters::GetSliceParameters()
+    {
+        float scale = options.slices / std::log(options.far / options.near);
+        return glm::vec2(scale, -std::log(options.near) * scale);
+    }
+
+    float LightClusters::GetSliceDepth(int slice)
+    {
+        return options.near * std::pow(options.far / options.near, slice / (float)options.slices);
+    }
+
+    int LightClusters::GetSlice(float depth)
+    {
+        glm::vec2 parameters = GetSliceParameters();
+        int slice = (int)std::floor(std::log(std::max(depth, 1e-4f)) * parameters.x + parameters.y);
+        return std::min(std::max(slice, 0), options.slices - 1);
+    }
+
+    void LightClusters::SetProjection(float fovY, float aspect)
+    {
+        float halfY = std::tan(fovY * 0.5f);
+        if (halfY == tanHalfY && halfY * aspect == tanHalfX)
+            return;
+        tanHalfY = halfY;
+        tanHalfX = halfY * aspect;
+
+        bounds.resize(GetClusterCount());
+        for (int s = 0; s < options.slices; s++) {
+            // padded a little, so a depth the GPU rounds into the next slice still finds its lights
+            float nearDepth = GetSliceDepth(s) * 0.99f;
+            float farDepth = GetSliceDepth(s + 1) * 1.01f;
+            for (int y = 0; y < options.tilesY; y++) {
+                float y0 = (2.0f * y / options.tilesY - 1.0f) * tanHalfY;
+                float y1 = (2.0f * (y + 1) / options.tilesY - 1.0f) * tanHalfY;
+                for (int x = 0; x < options.tilesX; x++) {
+                    float x0 = (2.0f * x / options.tilesX - 1.0f) * tanHalfX;
+                    float x1 = (2.0f * (x + 1) / options.tilesX - 1.0f) * tanHalfX;
+                    // the tile's corners at both ends of the slice
+                    ClusterBounds& box = bounds[(s * options.tilesY + y) * options.tilesX + x];
+                    box.low = glm::vec3(std::min(x0 * nearDepth, x0 * farDepth), std::min(y0 * nearDepth, y0 * farDepth), -farDepth);
+                    box.high = glm::vec3(std::max(x1 * nearDepth, x1 * farDepth), std::max(y1 * nearDepth, y1 * farDepth), -nearDepth);
+                }
+            }
+        }
+    }
+
+    bool LightClusters::Intersects(int cluster, int light)
+    {
+        glm::vec4 sphere = lightData[light * 2];
+        glm::vec3 center(sphere);
+        glm::vec3 nearest = glm::clamp(center, bounds[cluster].low, bounds[cluster].high);
+        glm::vec3 offset = center - nearest;
+        return glm::dot(offset, offset) <= sphere.w * sphere.w;
+    }
+
+    // Projected extent of [low, high] at depths between nearDepth and farDepth, as tiles of
+    // a screen axis; false when it misses the screen
+    static bool GetTileRange(float low, float high, float nearDepth, float farDepth, float tanHalf, int tiles, int range[2])
+    {
+        // low / depth is smallest at the near end when negative, at the far end otherwise
+        float lowNdc = (low < 0.0f ? low / nearDepth : low / farDepth) / tanHalf;
+        float highNdc = (high > 0.0f ? high / nearDepth : high / farDepth) / tanHalf;
+        if (highNdc < -1.0f || lowNdc > 1.0f)
+            return false;
+        range[0] = std::max((int)std::floor((lowNdc * 0.5f + 0.5f) * tiles), 0);
+        range[1] = std::min((int)std::floor((highNdc * 0.5f + 0.5f) * tiles), tiles - 1);
+        return true;
+    }
+
+    void LightClusters::Bin(const std::vector<gps::PointLight>& lights, const glm::mat4& view, gps::ThreadPool* pool)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int lightCount = (int)std::min(lights.size(), (size_t)maxLights);
+        lightData.resize(lightCount * 2);
+        for (int s = 0; s < options.slices; s++)
+            sliceLights[s].clear();
+
+        // candidate clusters of each light: its projected tiles in every slice its depth range touches
+        stats.visibleLights = 0;
+        for (int i = 0; i < lightCount; i++) {
+            glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            float radius = lights[i].radius;
+            lightData[i * 2] = glm::vec4(center, radius);
+            lightData[i * 2 + 1] = glm::vec4(lights[i].color, 0.0f);
+
+            float depth = -center.z;
+            if (radius <= 0.0f || depth + radius < options.near || depth - radius > options.far)
+                continue;
+            float nearDepth = std::max(depth - radius, options.near);
+            float farDepth = std::min(depth + radius, options.far);
+            LightRange range;
+            range.light = i;
+            if (!GetTileRange(center.x - radius, center.x + radius, nearDepth, farDepth, tanHalfX, options.tilesX, range.tileX) ||
+                !GetTileRange(center.y - radius, center.y + radius, nearDepth, farDepth, tanHalfY, options.tilesY, range.tileY))
+                continue;
+            for (int s = GetSlice(nearDepth * 0.99f); s <= GetSlice(farDepth * 1.01f); s++)
+                sliceLights[s].push_back(range);
+            stats.visibleLights++;
+        }
+
+        // every cluster belongs to one slice, so slices bin without locking
+        if (pool != NULL)
+            pool->ParallelFor(options.slices, [this](size_t s) { BinSlice((int)s); });
+        else
+            for (int s = 0; s < options.slices; s++)
+                BinSlice(s);
+
+        lightIndices.clear();
+        stats.maxClusterLights = 0;
+        for (int c = 0; c < GetClusterCount(); c++) {
+            clusterRanges[c * 2] = (uint32_t)lightIndices.size();
+            clusterRanges[c * 2 + 1] = (uint32_t)clusterLights[c].size();
+            lightIndices.insert(lightIndices.end(), clusterLights[c].begin(), clusterLights[c].end());
+            stats.maxClusterLights = std::max(stats.maxClusterLights, (int)clusterLights[c].size());
+        }
+        stats.lightIndices = (int)lightIndices.size();
+        stats.binMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void LightClusters::BinSlice(int slice)
+    {
+        int first = slice * options.tilesX * options.tilesY;
+        for (int c = first; c < first + options.tilesX * options.tilesY; c++)
+            clusterLights[c].clear();
+
+        const std::vector<LightRange>& candidates = sliceLights[slice];
+        for (size_t i = 0; i < candidates.size(); i++) {
+            const LightRange& range = candidates[i];
+            for (int y = range.tileY[0]; y <= range.tileY[1]; y++) {
+                for (int x = range.tileX[0]; x <= range.tileX[1]; x++) {
+                    int cluster = first + y * options.tilesX + x;
+                    if (Intersects(cluster, range.light))
+                        clusterLights[cluster].push_back((uint16_t)range.light);
+                }
+            }
+        }
+    }
+
+    int LightClusters::FindCluster(glm::vec3 positionEye)
+    {
+        float depth = std::max(-positionEye.z, 1e-4f);
+        int slice = GetSlice(depth);
+        float ndcX = positionEye.x / (depth * tanHalfX);
+        float ndcY = positionEye.y / (depth * tanHalfY);
+        int x = std::min(std::max((int)std::floor((ndcX * 0.5f + 0.5f) * options.tilesX), 0), options.tilesX - 1);
+        int y = std::min(std::max((int)std::floor((ndcY * 0.5f + 0.5f) * options.tilesY), 0), options.tilesY - 1);
+        return (slice * options.tilesY + y) * options.tilesX + x;
+    }
+
+    const std::vector<uint32_t>& LightClusters::GetClusterRanges()
+    {
+        return clusterRanges;
+    }
+
+    const std::vector<uint16_t>& LightClusters::GetLightIndices()
+    {
+        return lightIndices;
+    }
+
+    const std::vector<glm::vec4>& LightClusters::GetLightData()
+    {
+        return lightData;
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef LightClusters_hpp
+#define LightClusters_hpp
+
+#include "ThreadPool.hpp"
+
+#include "glm/glm.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+namespace gps {
+
+    struct PointLight
+    {
+        // world space
+        glm::vec3 position;
+        // distance at which the light fades out completely
+        float radius;
+        glm::vec3 color;
+    };
+
+    struct ClusterOptions
+    {
+        // screen tiles across and down
+        int tilesX = 16;
+        int tilesY = 9;
+        // depth slices, exponentially spaced between near and far
+        int slices = 24;
+        float near = 0.1f;
+        // lights past it are dropped; fragments past it use the last slice
+        float far = 200.0f;
+    };
+
+    struct ClusterStats
+    {
+        int visibleLights;
+        int lightIndices;
+        int maxClusterLights;
+        double binMilliseconds;
+    };
+
+    // Clustered forward lighting, CPU side: the view frustum is cut into screen tiles and
+    // exponential depth slices, and each cluster gets the list of lights whose sphere reaches
+    // its bounds. Fragments then only loop over their cluster's lights. No GL calls, so the
+    // benchmarks can check it.
+    class LightClusters
+    {
+    public:
+        // Index lists are 16 bit
+        static const int maxLights = 65535;
+
+        explicit LightClusters(gps::ClusterOptions options = gps::ClusterOptions());
+
+        // Perspective the clusters divide the view of; rebuilds their bounds when it changes
+        void SetProjection(float fovY, float aspect);
+
+        // Assigns the lights to clusters for a camera. With a pool the depth slices are binned in parallel.
+        void Bin(const std::vector<gps::PointLight>& lights, const glm::mat4& view, gps::ThreadPool* pool = NULL);
+
+        // The cluster an eye space position falls in, as basic.frag computes it
+        int FindCluster(glm::vec3 positionEye);
+
+        // Whether a light's sphere reaches the bounding box of a cluster; what Bin tests
+        bool Intersects(int cluster, int light);
+
+        // First entry in GetLightIndices and light count of each cluster, x fastest, then y, then slice
+        const std::vector<uint32_t>& GetClusterRanges();
+        const std::vector<uint16_t>& GetLightIndices();
+        // Two texels per light: eye space position and radius, then color
+        const std::vector<glm::vec4>& GetLightData();
+        // log(depth) * x + y is the slice of a depth
+        glm::vec2 GetSliceParameters();
+        int GetClusterCount();
+        gps::ClusterOptions GetOptions();
+        gps::ClusterStats GetStats();
+
+    private:
+        // Bounding box of a cluster in eye space
+        struct ClusterBounds
+        {
+            glm::vec3 low;
+            glm::vec3 high;
+        };
+
+        // Clusters a visible light may touch, from its projected bounds
+        struct LightRange
+        {
+            int light;
+            int tileX[2];
+            int tileY[2];
+        };
+
+        gps::ClusterOptions options;
+        float tanHalfX;
+        float tanHalfY;
+        std::vector<ClusterBounds> bounds;
+        // candidates of each slice, and the lights found in each cluster; kept between frames
+        // so binning does not allocate once warmed up
+        std::vector<std::vector<LightRange> > sliceLights;
+        std::vector<std::vector<uint16_t> > clusterLights;
+        std::vector<uint32_t> clusterRanges;
+        std::vector<uint16_t> lightIndices;
+        std::vector<glm::vec4> lightData;
+        gps::ClusterStats stats;
+
+        float GetSliceDepth(int slice);
+        int GetSlice(float depth);
+        void BinSlice(int slice);
+    };
+}
+
+#endif /* LightClusters_hpp */
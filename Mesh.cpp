@@ -1,22 +1,137 @@
 #include "Mesh.hpp"
+#include "VertexFormat.hpp"
+
+#include <algorithm>
+#include <cstring>
 namespace gps {
 
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, VERTEX_LAYOUT layout,
+	           std::vector<MeshLod> lods)
 	{
 		this->vertices = vertices;
 		this->indices = indices;
 		this->textures = textures;
+		this->lods = lods;
+		if (this->lods.empty()) {
+			MeshLod full = { 0, (GLuint)indices.size(), 0.0f };
+			this->lods.push_back(full);
+		}
+
+		// centre of the bounding box and the farthest vertex from it
+		glm::vec3 low(0.0f), high(0.0f);
+		if (!vertices.empty())
+			low = high = vertices[0].Position;
+		for (size_t i = 1; i < vertices.size(); i++) {
+			low = glm::min(low, vertices[i].Position);
+			high = glm::max(high, vertices[i].Position);
+		}
+		this->boundsCenter = (low + high) * 0.5f;
+		this->boundsRadius = 0.0f;
+		for (size_t i = 0; i < vertices.size(); i++)
+			this->boundsRadius = std::max(this->boundsRadius, glm::length(vertices[i].Position - this->boundsCenter));
 
+		this->vertexCount = 0;
+		this->vertexCapacity = 0;
+		this->layout = layout;
 		this->setupMesh();
 	}
 
+	Mesh::Mesh(std::vector<Texture> textures)
+	{
+		this->textures = textures;
+		this->vertexCount = 0;
+		this->vertexCapacity = 0;
+		this->layout = VERTEX_FLOAT;
+		this->boundsCenter = glm::vec3(0.0f);
+		this->boundsRadius = 0.0f;
+		this->dequantization.positionOffset = glm::vec3(0.0f);
+		this->dequantization.positionScale = glm::vec3(1.0f);
+		this->dequantization.texCoordOffset = glm::vec2(0.0f);
+		this->dequantization.texCoordScale = glm::vec2(1.0f);
+
+		glGenVertexArrays(1, &this->buffers.VAO);
+		glGenBuffers(1, &this->buffers.VBO);
+		this->buffers.EBO = 0;
+		// the depth stream reads the positions straight out of the vertex buffer
+		glGenVertexArrays(1, &this->buffers.depthVAO);
+		this->buffers.depthVBO = 0;
+	}
+
+	void Mesh::Append(GLuint readBuffer, GLintptr readOffset, GLsizei count)
+	{
+		if (vertexCount + count > vertexCapacity) {
+			// double on the GPU, the vertices already there never come back to the CPU
+			GLsizei capacity = std::max(std::max(vertexCapacity * 2, vertexCount + count), (GLsizei)65536);
+			GLuint grown;
+			glGenBuffers(1, &grown);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+			glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+			if (vertexCount > 0) {
+				glBindBuffer(GL_COPY_READ_BUFFER, this->buffers.VBO);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, vertexCount * sizeof(Vertex));
+			}
+			glDeleteBuffers(1, &this->buffers.VBO);
+			this->buffers.VBO = grown;
+			vertexCapacity = capacity;
+
+			glBindVertexArray(this->buffers.VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, grown);
+			this->setupAttributes();
+			glBindVertexArray(this->buffers.depthVAO);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+			glBindVertexArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, readBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffers.VBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, readOffset,
+		                    vertexCount * sizeof(Vertex), count * sizeof(Vertex));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		vertexCount += count;
+	}
+
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
+	// Coarsest level whose projected error stays within the selection's limit
+	int Mesh::SelectLod(const gps::LodSelection& selection) {
+		float scale = selection.pixelsPerUnit;
+		if (selection.perspective) {
+			// nearest point of the bounding sphere; inside it the full mesh is needed
+			float distance = glm::length(selection.eye - boundsCenter) - boundsRadius;
+			if (distance <= 0.0f)
+				return 0;
+			scale /= distance;
+		}
+
+		int lod = 0;
+		while (lod + 1 < (int)lods.size() && lods[lod + 1].error * scale <= selection.maxPixelError)
+			lod++;
+		return lod;
+	}
+
+	void Mesh::GetBounds(glm::vec3& center, float& radius) {
+		center = boundsCenter;
+		radius = boundsRadius;
+	}
+
+	void Mesh::setDequantizationUniforms(gps::Shader shader)
+	{
+		// identity for float vertices
+		glUniform3fv(glGetUniformLocation(shader.shaderProgram, "positionOffset"), 1, &dequantization.positionOffset[0]);
+		glUniform3fv(glGetUniformLocation(shader.shaderProgram, "positionScale"), 1, &dequantization.positionScale[0]);
+		glUniform2fv(glGetUniformLocation(shader.shaderProgram, "texCoordOffset"), 1, &dequantization.texCoordOffset[0]);
+		glUniform2fv(glGetUniformLocation(shader.shaderProgram, "texCoordScale"), 1, &dequantization.texCoordScale[0]);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "octahedralNormals"), layout == VERTEX_COMPACT);
+	}
+
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	void Mesh::Draw(gps::Shader shader, int lod)
 	{
 		shader.useShaderProgram();
 
@@ -28,8 +143,14 @@ namespace gps {
 			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
 
+		this->setDequantizationUniforms(shader);
+
 		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+		if (this->buffers.EBO == 0)
+			glDrawArrays(GL_TRIANGLES, 0, this->vertexCount);
+		else
+			glDrawElements(GL_TRIANGLES, this->lods[lod].indexCount, GL_UNSIGNED_INT,
+			               (GLvoid*)(this->lods[lod].firstIndex * sizeof(GLuint)));
 		glBindVertexArray(0);
 
         for(GLuint i = 0; i < this->textures.size(); i++)
@@ -40,6 +161,21 @@ namespace gps {
 
     }
 
+	// Same draw as Draw, fetching only positions
+	void Mesh::DrawDepth(gps::Shader shader, int lod)
+	{
+		shader.useShaderProgram();
+		this->setDequantizationUniforms(shader);
+
+		glBindVertexArray(this->buffers.depthVAO);
+		if (this->buffers.EBO == 0)
+			glDrawArrays(GL_TRIANGLES, 0, this->vertexCount);
+		else
+			glDrawElements(GL_TRIANGLES, this->lods[lod].indexCount, GL_UNSIGNED_INT,
+			               (GLvoid*)(this->lods[lod].firstIndex * sizeof(GLuint)));
+		glBindVertexArray(0);
+	}
+
 	// Initializes all the buffer objects/arrays
 	void Mesh::setupMesh(){
 		// Create buffers/arrays
@@ -50,11 +186,70 @@ namespace gps {
 		glBindVertexArray(this->buffers.VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		if (this->layout == VERTEX_COMPACT) {
+			std::vector<CompactVertex> compact;
+			CompressVertices(this->vertices, compact, this->dequantization);
+			glBufferData(GL_ARRAY_BUFFER, compact.size() * sizeof(CompactVertex), compact.data(), GL_STATIC_DRAW);
+			// the quantized position and its padding, 8 bytes a vertex
+			std::vector<GLushort> positions(compact.size() * 4);
+			for (size_t i = 0; i < compact.size(); i++)
+				memcpy(&positions[i * 4], compact[i].Position, 4 * sizeof(GLushort));
+			this->setupDepthStream(positions.data(), positions.size() * sizeof(GLushort));
+			glBindVertexArray(this->buffers.VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
+		} else {
+			this->dequantization.positionOffset = glm::vec3(0.0f);
+			this->dequantization.positionScale = glm::vec3(1.0f);
+			this->dequantization.texCoordOffset = glm::vec2(0.0f);
+			this->dequantization.texCoordScale = glm::vec2(1.0f);
+			glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+			std::vector<glm::vec3> positions(this->vertices.size());
+			for (size_t i = 0; i < this->vertices.size(); i++)
+				positions[i] = this->vertices[i].Position;
+			this->setupDepthStream(positions.data(), positions.size() * sizeof(glm::vec3));
+			glBindVertexArray(this->buffers.VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
+		}
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
 
+		this->setupAttributes();
+
+		glBindVertexArray(this->buffers.depthVAO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
+		glBindVertexArray(0);
+	}
+
+	// Uploads packed positions as the position-only stream; the index buffer is bound by setupMesh
+	void Mesh::setupDepthStream(const GLvoid* positions, GLsizeiptr size)
+	{
+		glGenVertexArrays(1, &this->buffers.depthVAO);
+		glGenBuffers(1, &this->buffers.depthVBO);
+		glBindVertexArray(this->buffers.depthVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.depthVBO);
+		glBufferData(GL_ARRAY_BUFFER, size, positions, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		if (this->layout == VERTEX_COMPACT)
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(GLushort), (GLvoid*)0);
+		else
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+	}
+
+	// Points the vertex attributes of the VAO at the bound array buffer
+	void Mesh::setupAttributes(){
+		if (this->layout == VERTEX_COMPACT) {
+			// positions and texture coordinates as fractions of their bounds
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, Position));
+			// octahedral normals stay integers, GL 4.1 maps normalized shorts with a bias
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, Normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, TexCoords));
+			return;
+		}
+
 		// Set the vertex attribute pointers
 		// Vertex Positions
 		glEnableVertexAttribArray(0);
@@ -65,7 +260,5 @@ namespace gps {
 		// Vertex Texture Coords
 		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-
-		glBindVertexArray(0);
 	}
 }
@@ -6,6 +6,7 @@
 
 #include "Shader.hpp"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -19,6 +20,33 @@ struct Vertex
     glm::vec2 TexCoords;
 };
 
+// 16 byte vertex: position and texture coordinates as 16 bit fractions of the mesh bounds,
+// octahedral normal in two 16 bit components (see VertexFormat.hpp)
+struct CompactVertex
+{
+    GLushort Position[3];
+    GLushort Padding;
+    GLshort Normal[2];
+    GLushort TexCoords[2];
+};
+
+// Maps the normalized attributes of a compact mesh back to model space: attribute * scale + offset
+struct VertexDequantization
+{
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    glm::vec2 texCoordOffset;
+    glm::vec2 texCoordScale;
+};
+
+enum VERTEX_LAYOUT
+{
+    // gps::Vertex as is, 32 bytes
+    VERTEX_FLOAT,
+    // gps::CompactVertex, decoded in basic.vert
+    VERTEX_COMPACT
+};
+
 struct Texture
 {
     GLuint id;
@@ -27,6 +55,52 @@ struct Texture
     std::string path;
 };
 
+// Decoded pixel data waiting to be uploaded to the video memory
+struct Image
+{
+    int width;
+    int height;
+    int channels;
+    // 0 for plain texels, otherwise the GL block compressed format of pixels
+    GLenum compressedFormat = 0;
+    // Start of each mip level in pixels plus one past the end; empty for a single level
+    std::vector<size_t> levelOffsets;
+    std::shared_ptr<unsigned char> pixels;
+};
+
+// Range of the index buffer drawn at one level of detail
+struct MeshLod
+{
+    GLuint firstIndex;
+    GLuint indexCount;
+    // largest distance from the full mesh, in model units
+    float error;
+};
+
+// Where the camera is and how much error each pass tolerates when picking levels of detail
+struct LodSelection
+{
+    // camera position in the model's own coordinates
+    glm::vec3 eye;
+    // pixels covered by one model unit: at unit distance for a perspective projection,
+    // everywhere for an orthographic one
+    float pixelsPerUnit;
+    bool perspective;
+    // largest projected error allowed, in pixels
+    float maxPixelError;
+};
+
+// CPU side copy of a mesh, produced by the parser before any GL call
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    // Texture ids stay unresolved until the image is uploaded
+    std::vector<Texture> textures;
+    // Finest first; empty when the whole index buffer is the only level
+    std::vector<MeshLod> lods;
+};
+
 struct Material
     {
         glm::vec3 ambient;
@@ -38,6 +112,9 @@ struct Buffers {
     GLuint VAO;
     GLuint VBO;
     GLuint EBO;
+    // position-only stream for depth passes; depthVBO is 0 when depthVAO reads VBO itself
+    GLuint depthVAO;
+    GLuint depthVBO;
 };
 
 class Mesh
@@ -47,19 +124,55 @@ public:
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
 
-	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+	     VERTEX_LAYOUT layout = VERTEX_FLOAT, std::vector<MeshLod> lods = std::vector<MeshLod>());
+
+	// Empty, non-indexed mesh filled on the GPU through Append; keeps no CPU copy. Always
+	// uses the float layout, the chunks are copied as the parser wrote them.
+	Mesh(std::vector<Texture> textures);
+
+	// Appends count vertices (whole triangles) copied from readBuffer at readOffset,
+	// growing the vertex buffer when it is full
+	void Append(GLuint readBuffer, GLintptr readOffset, GLsizei count);
 
 	Buffers getBuffers();
 
-	void Draw(gps::Shader shader);
+	void Draw(gps::Shader shader, int lod = 0);
+
+	// Positions only, no textures: for a depth-only shader variant
+	void DrawDepth(gps::Shader shader, int lod = 0);
+
+	// Bounding sphere in model space; the radius is 0 for streamed meshes, whose vertices never reach the CPU
+	void GetBounds(glm::vec3& center, float& radius);
+
+	// Coarsest level whose projected error stays within the selection's limit
+	int SelectLod(const gps::LodSelection& selection);
 
 private:
     /*  Render data  */
     Buffers buffers;
+    // Streamed meshes draw vertexCount vertices without an index buffer
+    GLsizei vertexCount;
+    GLsizei vertexCapacity;
+    VERTEX_LAYOUT layout;
+    gps::VertexDequantization dequantization;
+    std::vector<MeshLod> lods;
+    // bounding sphere in model space, for the level of detail distance
+    glm::vec3 boundsCenter;
+    float boundsRadius;
 
 	// Initializes all the buffer objects/arrays
 	void setupMesh();
 
+	// Points the vertex attributes of the VAO at the bound array buffer
+	void setupAttributes();
+
+	// Uploads packed positions in the layout's format (4 shorts or 3 floats per vertex) as the
+	// position-only stream, sharing the index buffer
+	void setupDepthStream(const GLvoid* positions, GLsizeiptr size);
+
+	void setDequantizationUniforms(gps::Shader shader);
+
 };
 
 }
@@ -0,0 +1,175 @@
+#include "MeshCache.hpp"
+#include "TextureCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <sys/stat.h>
+#include <thread>
+
+namespace gps {
+
+    static const uint32_t meshCacheMagic = 0x534d5047; // "GPMS"
+    static const uint32_t meshCacheVersion = 2;
+
+    struct MeshCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t meshCount;
+        uint32_t reserved;
+    };
+
+    // followed by the texture records, the vertices, the indices and the levels of detail
+    struct MeshRecord
+    {
+        uint64_t vertexCount;
+        uint64_t indexCount;
+        uint32_t textureCount;
+        uint32_t lodCount;
+    };
+
+    MeshCache::MeshCache(std::string directory, gps::TextureCache* trim) : directory(directory), trim(trim)
+    {
+    }
+
+    uint64_t MeshCache::GetKey(std::string fileName, std::string variant)
+    {
+        struct stat info;
+        if (stat(fileName.c_str(), &info) != 0)
+            return 0;
+        char identity[64];
+        snprintf(identity, sizeof(identity), "%lld:%lld.%09ld", (long long)info.st_size,
+                 (long long)info.st_mtim.tv_sec, (long)info.st_mtim.tv_nsec);
+        std::string bytes = fileName + "|" + identity;
+        return TextureCache::GetKey((const unsigned char*)bytes.data(), bytes.size(), variant);
+    }
+
+    std::string MeshCache::GetEntryPath(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+        return directory + "/" + name + ".mesh";
+    }
+
+    bool MeshCache::Load(uint64_t key, std::vector<gps::MeshData>& meshes)
+    {
+        std::vector<unsigned char> data;
+        std::string entryPath = GetEntryPath(key);
+        if (key == 0 || !TextureCache::ReadFile(entryPath.c_str(), data))
+            return false;
+
+        size_t position = 0;
+        // copies the next size bytes out of the entry, false once it runs short
+        std::function<bool(void*, size_t)> read = [&](void* target, size_t size) {
+            if (size > data.size() - position)
+                return false;
+            memcpy(target, data.data() + position, size);
+            position += size;
+            return true;
+        };
+
+        MeshCacheHeader header;
+        // every mesh needs at least its record, which bounds the count before anything is allocated
+        bool ok = read(&header, sizeof(header)) && header.magic == meshCacheMagic && header.version == meshCacheVersion &&
+                  header.meshCount <= data.size() / sizeof(MeshRecord);
+        std::vector<gps::MeshData> loaded(ok ? header.meshCount : 0);
+        for (size_t m = 0; ok && m < loaded.size(); m++) {
+            MeshRecord record;
+            ok = read(&record, sizeof(record)) &&
+                 record.vertexCount <= data.size() / sizeof(gps::Vertex) && record.indexCount <= data.size() / sizeof(GLuint);
+            for (uint32_t t = 0; ok && t < record.textureCount; t++) {
+                gps::Texture texture;
+                texture.id = 0;
+                uint32_t length = 0;
+                ok = read(&length, sizeof(length)) && length <= data.size();
+                texture.type.resize(ok ? length : 0);
+                ok = ok && read(&texture.type[0], length) && read(&length, sizeof(length)) && length <= data.size();
+                texture.path.resize(ok ? length : 0);
+                ok = ok && read(&texture.path[0], length);
+                loaded[m].textures.push_back(texture);
+            }
+            if (ok) {
+                loaded[m].vertices.resize(record.vertexCount);
+                loaded[m].indices.resize(record.indexCount);
+                ok = read(loaded[m].vertices.data(), record.vertexCount * sizeof(gps::Vertex)) &&
+                     read(loaded[m].indices.data(), record.indexCount * sizeof(GLuint));
+                // an index past the vertices would read outside the vertex buffer when drawn
+                for (size_t i = 0; ok && i < loaded[m].indices.size(); i++)
+                    ok = loaded[m].indices[i] < record.vertexCount;
+            }
+            if (ok && record.lodCount <= data.size() / sizeof(gps::MeshLod)) {
+                loaded[m].lods.resize(record.lodCount);
+                ok = read(loaded[m].lods.data(), record.lodCount * sizeof(gps::MeshLod));
+                for (size_t l = 0; ok && l < loaded[m].lods.size(); l++)
+                    ok = (uint64_t)loaded[m].lods[l].firstIndex + loaded[m].lods[l].indexCount <= record.indexCount;
+            } else {
+                ok = false;
+            }
+        }
+        if (!ok) {
+            fprintf(stderr, "WARNING: ignoring damaged cache entry %s\n", entryPath.c_str());
+            return false;
+        }
+
+        // touching the entry makes it the most recently used one for trimming
+        utimensat(AT_FDCWD, entryPath.c_str(), NULL, 0);
+        meshes.swap(loaded);
+        return true;
+    }
+
+    bool MeshCache::Store(uint64_t key, const std::vector<gps::MeshData>& meshes)
+    {
+        if (key == 0)
+            return false;
+        mkdir(directory.c_str(), 0755);
+        std::string entryPath = GetEntryPath(key);
+
+        // written under a private name and renamed, so readers never see half an entry
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%zx.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+        std::string temporaryPath = entryPath + suffix;
+        FILE* file = fopen(temporaryPath.c_str(), "wb");
+        if (!file)
+            return false;
+
+        MeshCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = meshCacheMagic;
+        header.version = meshCacheVersion;
+        header.meshCount = (uint32_t)meshes.size();
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+        for (size_t m = 0; ok && m < meshes.size(); m++) {
+            MeshRecord record;
+            memset(&record, 0, sizeof(record));
+            record.vertexCount = meshes[m].vertices.size();
+            record.indexCount = meshes[m].indices.size();
+            record.textureCount = (uint32_t)meshes[m].textures.size();
+            record.lodCount = (uint32_t)meshes[m].lods.size();
+            ok = fwrite(&record, sizeof(record), 1, file) == 1;
+            for (size_t t = 0; ok && t < meshes[m].textures.size(); t++) {
+                const std::string* strings[2] = { &meshes[m].textures[t].type, &meshes[m].textures[t].path };
+                for (int s = 0; ok && s < 2; s++) {
+                    uint32_t length = (uint32_t)strings[s]->size();
+                    ok = fwrite(&length, sizeof(length), 1, file) == 1 &&
+                         fwrite(strings[s]->data(), 1, length, file) == length;
+                }
+            }
+            ok = ok && fwrite(meshes[m].vertices.data(), sizeof(gps::Vertex), record.vertexCount, file) == record.vertexCount;
+            ok = ok && fwrite(meshes[m].indices.data(), sizeof(GLuint), record.indexCount, file) == record.indexCount;
+            ok = ok && fwrite(meshes[m].lods.data(), sizeof(gps::MeshLod), record.lodCount, file) == record.lodCount;
+        }
+        ok = fclose(file) == 0 && ok;
+
+        if (!ok || rename(temporaryPath.c_str(), entryPath.c_str()) != 0) {
+            fprintf(stderr, "WARNING: could not write cache entry %s\n", entryPath.c_str());
+            remove(temporaryPath.c_str());
+            return false;
+        }
+        if (trim != NULL)
+            trim->Trim();
+        return true;
+    }
+}
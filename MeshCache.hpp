@@ -0,0 +1,40 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    class TextureCache;
+
+    // On-disk cache of parsed and optimized models, kept next to the texture cache entries.
+    // Entries are keyed on the .obj file's path, size and modification time rather than its
+    // bytes: hashing a large model would cost a good part of the parse it saves.
+    class MeshCache
+    {
+    public:
+        // trim is the texture cache sharing the directory, which keeps all its entries under
+        // one size limit; NULL leaves the entries untrimmed
+        explicit MeshCache(std::string directory = "cache", gps::TextureCache* trim = NULL);
+
+        // Key of a model file as it is on disk now, 0 when it cannot be found; variant tells
+        // apart entries that were processed differently
+        static uint64_t GetKey(std::string fileName, std::string variant);
+
+        // Safe to call from worker threads
+        bool Load(uint64_t key, std::vector<gps::MeshData>& meshes);
+        bool Store(uint64_t key, const std::vector<gps::MeshData>& meshes);
+
+    private:
+        std::string directory;
+        gps::TextureCache* trim;
+
+        std::string GetEntryPath(uint64_t key);
+    };
+}
+
+#endif /* MeshCache_hpp */
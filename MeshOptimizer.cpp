@@ -0,0 +1,376 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+    // Forsyth's model and constants
+    static const int forsythCacheSize = 32;
+    static const float lastTriangleScore = 0.75f;
+    static const float cacheDecayPower = 1.5f;
+    static const float valenceBoostScale = 2.0f;
+    static const float valenceBoostPower = 0.5f;
+    static const int maxValenceScore = 64;
+
+    struct VertexKey
+    {
+        const gps::Vertex* vertex;
+
+        bool operator==(const VertexKey& other) const
+        {
+            return memcmp(vertex, other.vertex, sizeof(gps::Vertex)) == 0;
+        }
+    };
+
+    struct VertexKeyHash
+    {
+        size_t operator()(const VertexKey& key) const
+        {
+            uint32_t words[sizeof(gps::Vertex) / 4];
+            memcpy(words, key.vertex, sizeof(words));
+            uint64_t hash = 0xcbf29ce484222325ULL;
+            for (size_t i = 0; i < sizeof(words) / 4; i++) {
+                hash ^= words[i];
+                hash *= 0x9e3779b97f4a7c15ULL;
+                hash ^= hash >> 29;
+            }
+            return (size_t)hash;
+        }
+    };
+
+    void WeldVertices(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices)
+    {
+        std::vector<GLuint> remap(vertices.size());
+        std::vector<gps::Vertex> unique;
+        unique.reserve(vertices.size());
+        {
+            std::unordered_map<VertexKey, GLuint, VertexKeyHash> seen;
+            seen.reserve(vertices.size());
+            for (size_t i = 0; i < vertices.size(); i++) {
+                VertexKey key = { &vertices[i] };
+                std::pair<std::unordered_map<VertexKey, GLuint, VertexKeyHash>::iterator, bool> inserted =
+                    seen.insert(std::make_pair(key, (GLuint)unique.size()));
+                if (inserted.second)
+                    unique.push_back(vertices[i]);
+                remap[i] = inserted.first->second;
+            }
+        }
+
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = remap[indices[i]];
+        vertices.swap(unique);
+    }
+
+    static float vertexScore(int cachePosition, unsigned liveTriangles, const float* cacheScores, const float* valenceScores)
+    {
+        if (liveTriangles == 0)
+            return -1.0f;
+        float score = cachePosition >= 0 ? cacheScores[cachePosition] : 0.0f;
+        return score + valenceScores[std::min(liveTriangles, (unsigned)maxValenceScore - 1)];
+    }
+
+    void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        float cacheScores[forsythCacheSize];
+        for (int i = 0; i < forsythCacheSize; i++) {
+            // the last triangle's vertices get a fixed score, so it does not matter which was used last
+            cacheScores[i] = i < 3 ? lastTriangleScore
+                                   : powf(1.0f - (i - 3) / (float)(forsythCacheSize - 3), cacheDecayPower);
+        }
+        float valenceScores[maxValenceScore];
+        valenceScores[0] = 0.0f;
+        for (int i = 1; i < maxValenceScore; i++)
+            valenceScores[i] = valenceBoostScale * powf((float)i, -valenceBoostPower);
+
+        // triangles of each vertex, the live ones first
+        std::vector<unsigned> liveTriangles(vertexCount, 0);
+        for (size_t i = 0; i < indices.size(); i++)
+            liveTriangles[indices[i]]++;
+        std::vector<size_t> adjacencyStart(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+        std::vector<unsigned> adjacency(indices.size());
+        {
+            std::vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++)
+                adjacency[fill[indices[i]]++] = (unsigned)(i / 3);
+        }
+
+        std::vector<float> scores(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            scores[v] = vertexScore(-1, liveTriangles[v], cacheScores, valenceScores);
+        std::vector<float> triangleScores(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+            triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        std::vector<GLuint> cache, nextCache;
+        cache.reserve(forsythCacheSize + 3);
+        nextCache.reserve(forsythCacheSize + 3);
+        // dead ends restart from the first triangle not yet emitted in input order
+        size_t cursor = 0;
+
+        long best = 0;
+        for (size_t t = 1; t < triangleCount; t++) {
+            if (triangleScores[t] > triangleScores[best])
+                best = (long)t;
+        }
+
+        while (best >= 0) {
+            emitted[best] = true;
+            const GLuint* triangle = &indices[best * 3];
+            result.insert(result.end(), triangle, triangle + 3);
+
+            for (int k = 0; k < 3; k++) {
+                GLuint v = triangle[k];
+                unsigned* live = &adjacency[adjacencyStart[v]];
+                for (unsigned i = 0; i < liveTriangles[v]; i++) {
+                    if (live[i] == (unsigned)best) {
+                        std::swap(live[i], live[liveTriangles[v] - 1]);
+                        break;
+                    }
+                }
+                liveTriangles[v]--;
+            }
+
+            // the triangle's vertices move to the front, the rest shift back and may fall out
+            nextCache.assign(triangle, triangle + 3);
+            for (size_t i = 0; i < cache.size(); i++) {
+                if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+                    nextCache.push_back(cache[i]);
+            }
+            cache.swap(nextCache);
+
+            for (size_t i = 0; i < cache.size(); i++) {
+                GLuint v = cache[i];
+                int position = i < (size_t)forsythCacheSize ? (int)i : -1;
+                float score = vertexScore(position, liveTriangles[v], cacheScores, valenceScores);
+                float change = score - scores[v];
+                scores[v] = score;
+
+                const unsigned* live = &adjacency[adjacencyStart[v]];
+                for (unsigned j = 0; j < liveTriangles[v]; j++)
+                    triangleScores[live[j]] += change;
+            }
+            if (cache.size() > (size_t)forsythCacheSize)
+                cache.resize(forsythCacheSize);
+
+            // only triangles touching the cache changed, so the next one is picked among them
+            best = -1;
+            float bestScore = 0.0f;
+            for (size_t i = 0; i < cache.size(); i++) {
+                GLuint v = cache[i];
+                const unsigned* live = &adjacency[adjacencyStart[v]];
+                for (unsigned j = 0; j < liveTriangles[v]; j++) {
+                    if (triangleScores[live[j]] > bestScore) {
+                        bestScore = triangleScores[live[j]];
+                        best = live[j];
+                    }
+                }
+            }
+
+            // every cached vertex is used up: carry on from the first triangle not yet emitted
+            if (best < 0) {
+                while (cursor < triangleCount && emitted[cursor])
+                    cursor++;
+                best = cursor < triangleCount ? (long)cursor : -1;
+            }
+        }
+
+        indices.swap(result);
+    }
+
+    // FIFO cache step shared by the overdraw clustering; returns how many of the triangle's
+    // vertices missed
+    static unsigned simulateTriangle(const GLuint* triangle, std::vector<unsigned>& timestamps, unsigned& time, int cacheSize)
+    {
+        unsigned misses = 0;
+        for (int k = 0; k < 3; k++) {
+            if (time - timestamps[triangle[k]] > (unsigned)cacheSize) {
+                timestamps[triangle[k]] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<gps::Vertex>& vertices, float threshold)
+    {
+        const int cacheSize = 16;
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2)
+            return;
+
+        std::vector<unsigned> timestamps(vertices.size(), 0);
+        unsigned time = cacheSize + 1;
+
+        // hard boundaries: triangles where the whole cache missed
+        std::vector<size_t> hard;
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (simulateTriangle(&indices[t * 3], timestamps, time, cacheSize) == 3)
+                hard.push_back(t);
+        }
+        if (hard.empty() || hard[0] != 0)
+            hard.insert(hard.begin(), 0);
+        hard.push_back(triangleCount);
+
+        // soft boundaries: within each, cut as soon as the running miss ratio gets close to the cluster's
+        std::vector<size_t> clusters;
+        for (size_t h = 0; h + 1 < hard.size(); h++) {
+            size_t start = hard[h], end = hard[h + 1];
+            time += cacheSize + 1;
+            unsigned clusterMisses = 0;
+            for (size_t t = start; t < end; t++)
+                clusterMisses += simulateTriangle(&indices[t * 3], timestamps, time, cacheSize);
+            float clusterThreshold = threshold * clusterMisses / (float)(end - start);
+
+            clusters.push_back(start);
+            time += cacheSize + 1;
+            unsigned misses = 0, faces = 0;
+            for (size_t t = start; t < end; t++) {
+                misses += simulateTriangle(&indices[t * 3], timestamps, time, cacheSize);
+                faces++;
+                if (misses / (float)faces <= clusterThreshold) {
+                    clusters.push_back(t + 1);
+                    time += cacheSize + 1;
+                    misses = 0;
+                    faces = 0;
+                }
+            }
+            if (clusters.back() == end)
+                clusters.pop_back();
+        }
+        clusters.push_back(triangleCount);
+
+        glm::vec3 meshCentroid(0.0f);
+        for (size_t i = 0; i < indices.size(); i++)
+            meshCentroid += vertices[indices[i]].Position;
+        meshCentroid /= (float)indices.size();
+
+        struct Cluster
+        {
+            size_t begin, end;
+            float key;
+        };
+        std::vector<Cluster> sorted(clusters.size() - 1);
+        for (size_t c = 0; c + 1 < clusters.size(); c++) {
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+                glm::vec3 a = vertices[indices[t * 3]].Position;
+                glm::vec3 b = vertices[indices[t * 3 + 1]].Position;
+                glm::vec3 d = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 n = glm::cross(b - a, d - a);
+                float triangleArea = glm::length(n);
+                centroid += (a + b + d) * (triangleArea / 3.0f);
+                normal += n;
+                area += triangleArea;
+            }
+            float normalLength = glm::length(normal);
+            centroid = area > 0.0f ? centroid / area : vertices[indices[clusters[c] * 3]].Position;
+            sorted[c].begin = clusters[c];
+            sorted[c].end = clusters[c + 1];
+            sorted[c].key = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        for (size_t c = 0; c < sorted.size(); c++)
+            result.insert(result.end(), indices.begin() + sorted[c].begin * 3, indices.begin() + sorted[c].end * 3);
+        indices.swap(result);
+    }
+
+    void OptimizeVertexFetch(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices)
+    {
+        const GLuint unused = ~0u;
+        std::vector<GLuint> remap(vertices.size(), unused);
+        std::vector<gps::Vertex> ordered;
+        ordered.reserve(vertices.size());
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint& target = remap[indices[i]];
+            if (target == unused) {
+                target = (GLuint)ordered.size();
+                ordered.push_back(vertices[indices[i]]);
+            }
+            indices[i] = target;
+        }
+        vertices.swap(ordered);
+    }
+
+    gps::VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, int cacheSize)
+    {
+        std::vector<unsigned> timestamps(vertexCount, 0);
+        std::vector<bool> used(vertexCount, false);
+        unsigned time = cacheSize + 1;
+        size_t misses = 0, unique = 0;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            misses += simulateTriangle(&indices[t], timestamps, time, cacheSize);
+            for (int k = 0; k < 3; k++) {
+                unique += !used[indices[t + k]];
+                used[indices[t + k]] = true;
+            }
+        }
+
+        gps::VertexCacheStats stats;
+        stats.acmr = indices.size() >= 3 ? misses / (double)(indices.size() / 3) : 0.0;
+        stats.atvr = unique > 0 ? misses / (double)unique : 0.0;
+        return stats;
+    }
+
+    gps::MeshOptimizationStats OptimizeMesh(gps::MeshData& mesh)
+    {
+        gps::MeshOptimizationStats stats;
+        stats.triangles = mesh.indices.size() / 3;
+        stats.verticesBefore = mesh.vertices.size();
+        stats.parsed = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+        WeldVertices(mesh.vertices, mesh.indices);
+        stats.welded = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+        OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+        OptimizeOverdraw(mesh.indices, mesh.vertices);
+        OptimizeVertexFetch(mesh.vertices, mesh.indices);
+
+        stats.verticesAfter = mesh.vertices.size();
+        stats.optimized = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+        return stats;
+    }
+
+    gps::MeshOptimizationStats CombineStats(const std::vector<gps::MeshOptimizationStats>& meshes)
+    {
+        gps::MeshOptimizationStats total;
+        memset(&total, 0, sizeof(total));
+        // vertex shader runs of each stage; the parsed mesh uses all its vertices, the welded and
+        // optimized ones all of theirs
+        double parsed = 0.0, welded = 0.0, optimized = 0.0;
+        for (size_t m = 0; m < meshes.size(); m++) {
+            total.triangles += meshes[m].triangles;
+            total.verticesBefore += meshes[m].verticesBefore;
+            total.verticesAfter += meshes[m].verticesAfter;
+            parsed += meshes[m].parsed.acmr * meshes[m].triangles;
+            welded += meshes[m].welded.acmr * meshes[m].triangles;
+            optimized += meshes[m].optimized.acmr * meshes[m].triangles;
+        }
+        if (total.triangles > 0) {
+            total.parsed.acmr = parsed / total.triangles;
+            total.welded.acmr = welded / total.triangles;
+            total.optimized.acmr = optimized / total.triangles;
+        }
+        if (total.verticesAfter > 0) {
+            total.parsed.atvr = parsed / total.verticesBefore;
+            total.welded.atvr = welded / total.verticesAfter;
+            total.optimized.atvr = optimized / total.verticesAfter;
+        }
+        return total;
+    }
+}
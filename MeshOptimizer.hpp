@@ -0,0 +1,56 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    struct VertexCacheStats
+    {
+        // average cache miss ratio: vertex shader runs per triangle, 3.0 without any reuse
+        double acmr;
+        // average transformed vertex ratio: shader runs per unique vertex, 1.0 is ideal
+        double atvr;
+    };
+
+    struct MeshOptimizationStats
+    {
+        size_t triangles;
+        size_t verticesBefore;
+        size_t verticesAfter;
+        // de-indexed as parsed, welded in file order, and after the whole pass
+        gps::VertexCacheStats parsed;
+        gps::VertexCacheStats welded;
+        gps::VertexCacheStats optimized;
+    };
+
+    // Merges bit identical vertices and rewrites the indices to match
+    void WeldVertices(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices);
+
+    // Tom Forsyth's linear speed vertex cache optimisation: greedily emits the triangle whose
+    // vertices score highest in a simulated 32 entry LRU cache, favouring vertices with few
+    // triangles left so no islands are left behind
+    void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+
+    // Cuts the cache ordered triangles into clusters where the cache restarts or the local
+    // miss ratio stays within threshold of the cluster's, then sorts the clusters so the ones
+    // facing away from the mesh centre come first and occlude the rest (Sander et al. 2007)
+    void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<gps::Vertex>& vertices, float threshold = 1.05f);
+
+    // Renumbers the vertices in the order the indices first use them, dropping unused ones,
+    // so vertex fetch walks the buffer front to back
+    void OptimizeVertexFetch(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices);
+
+    // Simulates a FIFO post-transform cache of cacheSize entries over the triangle list
+    gps::VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, int cacheSize = 16);
+
+    // Welds the de-indexed mesh and runs the three passes above in order
+    gps::MeshOptimizationStats OptimizeMesh(gps::MeshData& mesh);
+
+    // Stats of several meshes as if they were one, the ratios weighted by their sizes
+    gps::MeshOptimizationStats CombineStats(const std::vector<gps::MeshOptimizationStats>& meshes);
+}
+
+#endif /* MeshOptimizer_hpp */
@@ -0,0 +1,347 @@
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+    // borders are pinned much harder than surfaces, so they do not shrink
+    static const double borderWeight = 10.0;
+    // a collapse may not turn any triangle further than this cosine from its old normal
+    static const double minNormalCosine = 0.25;
+    // a level is only kept when it drops at least this share of the previous one's triangles
+    static const double minLodReduction = 0.1;
+
+    enum VERTEX_KIND
+    {
+        KIND_MANIFOLD,
+        KIND_BORDER,
+        // attribute seams and non-manifold edges
+        KIND_LOCKED
+    };
+
+    // Sum of squared distances to a set of weighted planes: p'Ap + 2b'p + c
+    struct Quadric
+    {
+        double a00, a01, a02, a11, a12, a22;
+        double b0, b1, b2;
+        double c;
+        double weight;
+    };
+
+    static void addPlane(Quadric& q, glm::dvec3 normal, double distance, double weight)
+    {
+        q.a00 += weight * normal.x * normal.x;
+        q.a01 += weight * normal.x * normal.y;
+        q.a02 += weight * normal.x * normal.z;
+        q.a11 += weight * normal.y * normal.y;
+        q.a12 += weight * normal.y * normal.z;
+        q.a22 += weight * normal.z * normal.z;
+        q.b0 += weight * normal.x * distance;
+        q.b1 += weight * normal.y * distance;
+        q.b2 += weight * normal.z * distance;
+        q.c += weight * distance * distance;
+        q.weight += weight;
+    }
+
+    static void addQuadric(Quadric& q, const Quadric& other)
+    {
+        q.a00 += other.a00; q.a01 += other.a01; q.a02 += other.a02;
+        q.a11 += other.a11; q.a12 += other.a12; q.a22 += other.a22;
+        q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+        q.c += other.c;
+        q.weight += other.weight;
+    }
+
+    // Weighted sum of squared distances of p to the planes of q
+    static double sumSquares(const Quadric& q, glm::dvec3 p)
+    {
+        double value = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z +
+                       2.0 * (q.a01 * p.x * p.y + q.a02 * p.x * p.z + q.a12 * p.y * p.z) +
+                       2.0 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+        return std::max(value, 0.0);
+    }
+
+    // Mean squared distance of p to the planes of q
+    static double evaluate(const Quadric& q, glm::dvec3 p)
+    {
+        return q.weight > 0.0 ? sumSquares(q, p) / q.weight : 0.0;
+    }
+
+    struct PositionKeyHash
+    {
+        size_t operator()(const glm::vec3& position) const
+        {
+            uint32_t words[3];
+            memcpy(words, &position, sizeof(words));
+            return (size_t)((words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u));
+        }
+    };
+
+    struct PositionKeyEqual
+    {
+        bool operator()(const glm::vec3& a, const glm::vec3& b) const
+        {
+            return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+        }
+    };
+
+    static uint64_t edgeKey(GLuint from, GLuint to)
+    {
+        return ((uint64_t)from << 32) | to;
+    }
+
+    struct Collapse
+    {
+        GLuint from;
+        GLuint to;
+        double cost;
+
+        bool operator<(const Collapse& other) const
+        {
+            return cost < other.cost;
+        }
+    };
+
+    static glm::dvec3 triangleNormal(glm::dvec3 a, glm::dvec3 b, glm::dvec3 c)
+    {
+        return glm::cross(b - a, c - a);
+    }
+
+    float SimplifyMesh(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices,
+                       size_t targetIndexCount, std::vector<GLuint>& result)
+    {
+        result = indices;
+        if (indices.size() <= targetIndexCount || vertices.empty())
+            return 0.0f;
+
+        // the simplifier works on positions: vertices that only differ in attributes share one
+        std::vector<GLuint> position(vertices.size());
+        std::vector<glm::dvec3> points;
+        // the vertex standing for each position, and how many distinct vertices use it
+        std::vector<GLuint> wedge;
+        std::vector<int> wedgeCount;
+        {
+            std::unordered_map<glm::vec3, GLuint, PositionKeyHash, PositionKeyEqual> seen;
+            seen.reserve(vertices.size());
+            for (size_t i = 0; i < vertices.size(); i++) {
+                std::pair<std::unordered_map<glm::vec3, GLuint, PositionKeyHash, PositionKeyEqual>::iterator, bool> inserted =
+                    seen.insert(std::make_pair(vertices[i].Position, (GLuint)points.size()));
+                if (inserted.second) {
+                    points.push_back(glm::dvec3(vertices[i].Position));
+                    wedge.push_back((GLuint)i);
+                    wedgeCount.push_back(0);
+                }
+                position[i] = inserted.first->second;
+            }
+        }
+        std::vector<bool> referenced(vertices.size(), false);
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (!referenced[indices[i]]) {
+                referenced[indices[i]] = true;
+                wedge[position[indices[i]]] = indices[i];
+                wedgeCount[position[indices[i]]]++;
+            }
+        }
+
+        // directed edges between positions; an edge without its twin is on a border
+        size_t pointCount = points.size();
+        std::unordered_map<uint64_t, int> edges;
+        edges.reserve(indices.size());
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            for (int k = 0; k < 3; k++)
+                edges[edgeKey(position[indices[t + k]], position[indices[t + (k + 1) % 3]])]++;
+        }
+
+        std::vector<VERTEX_KIND> kind(pointCount, KIND_MANIFOLD);
+        std::vector<Quadric> quadrics(pointCount);
+        memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+        // the same planes with unit weights: their sum of squares is at least the square of the
+        // largest distance to any one of them, which makes it a bound for level selection, while
+        // the area weighted mean above only orders the collapses
+        std::vector<Quadric> bounds(quadrics);
+        for (size_t p = 0; p < pointCount; p++) {
+            if (wedgeCount[p] > 1)
+                kind[p] = KIND_LOCKED;
+        }
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            GLuint corner[3] = { position[indices[t]], position[indices[t + 1]], position[indices[t + 2]] };
+            glm::dvec3 normal = triangleNormal(points[corner[0]], points[corner[1]], points[corner[2]]);
+            double area = glm::length(normal);
+            if (area == 0.0)
+                continue;
+            normal /= area;
+            for (int k = 0; k < 3; k++) {
+                addPlane(quadrics[corner[k]], normal, -glm::dot(normal, points[corner[k]]), area);
+                addPlane(bounds[corner[k]], normal, -glm::dot(normal, points[corner[k]]), 1.0);
+            }
+
+            for (int k = 0; k < 3; k++) {
+                GLuint from = corner[k], to = corner[(k + 1) % 3];
+                int count = edges[edgeKey(from, to)];
+                std::unordered_map<uint64_t, int>::iterator twin = edges.find(edgeKey(to, from));
+                if (count > 1 || (twin != edges.end() && twin->second > 1)) {
+                    kind[from] = kind[to] = KIND_LOCKED;
+                    continue;
+                }
+                if (twin != edges.end())
+                    continue;
+                // plane through the border edge, perpendicular to the triangle
+                for (int end = 0; end < 2; end++) {
+                    GLuint p = end == 0 ? from : to;
+                    if (kind[p] == KIND_MANIFOLD)
+                        kind[p] = KIND_BORDER;
+                }
+                glm::dvec3 edge = points[to] - points[from];
+                double length = glm::length(edge);
+                if (length == 0.0)
+                    continue;
+                glm::dvec3 side = glm::normalize(glm::cross(edge, normal));
+                double distance = -glm::dot(side, points[from]);
+                addPlane(quadrics[from], side, distance, length * length * borderWeight);
+                addPlane(quadrics[to], side, distance, length * length * borderWeight);
+                addPlane(bounds[from], side, distance, 1.0);
+                addPlane(bounds[to], side, distance, 1.0);
+            }
+        }
+
+        std::vector<GLuint> collapsed(pointCount);
+        std::vector<bool> touched(pointCount);
+        std::vector<size_t> adjacencyOffsets(pointCount + 1);
+        std::vector<size_t> adjacency;
+        std::vector<Collapse> collapses;
+        size_t triangleCount = result.size() / 3;
+        double maxError = 0.0;
+
+        // each pass collapses the cheapest edges that do not touch one another, then rebuilds
+        while (triangleCount * 3 > targetIndexCount) {
+            // triangles around each position
+            std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+            for (size_t i = 0; i < result.size(); i++)
+                adjacencyOffsets[position[result[i]] + 1]++;
+            for (size_t p = 0; p < pointCount; p++)
+                adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+            adjacency.resize(result.size());
+            std::vector<size_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < result.size(); i++)
+                adjacency[fill[position[result[i]]]++] = i / 3;
+
+            collapses.clear();
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int k = 0; k < 3; k++) {
+                    GLuint a = position[result[t * 3 + k]], b = position[result[t * 3 + (k + 1) % 3]];
+                    for (int direction = 0; direction < 2; direction++) {
+                        GLuint from = direction == 0 ? a : b, to = direction == 0 ? b : a;
+                        if (kind[from] == KIND_LOCKED || wedgeCount[to] > 1)
+                            continue;
+                        // border vertices only move along their border
+                        if (kind[from] == KIND_BORDER &&
+                            edges.count(edgeKey(from, to)) + edges.count(edgeKey(to, from)) != 1)
+                            continue;
+                        Quadric merged = quadrics[from];
+                        addQuadric(merged, quadrics[to]);
+                        Collapse collapse = { from, to, evaluate(merged, points[to]) };
+                        collapses.push_back(collapse);
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end());
+
+            for (size_t p = 0; p < pointCount; p++)
+                collapsed[p] = (GLuint)p;
+            std::fill(touched.begin(), touched.end(), false);
+            size_t remaining = triangleCount;
+            size_t performed = 0;
+            for (size_t c = 0; c < collapses.size() && remaining * 3 > targetIndexCount; c++) {
+                GLuint from = collapses[c].from, to = collapses[c].to;
+                if (touched[from] || touched[to])
+                    continue;
+
+                // reject collapses that fold a surviving triangle over
+                bool flips = false;
+                size_t removed = 0;
+                for (size_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1] && !flips; i++) {
+                    const GLuint* triangle = &result[adjacency[i] * 3];
+                    GLuint corner[3] = { position[triangle[0]], position[triangle[1]], position[triangle[2]] };
+                    if (corner[0] == to || corner[1] == to || corner[2] == to) {
+                        removed++;
+                        continue;
+                    }
+                    glm::dvec3 before = triangleNormal(points[corner[0]], points[corner[1]], points[corner[2]]);
+                    for (int k = 0; k < 3; k++)
+                        corner[k] = corner[k] == from ? to : corner[k];
+                    glm::dvec3 after = triangleNormal(points[corner[0]], points[corner[1]], points[corner[2]]);
+                    flips = glm::dot(before, after) < minNormalCosine * glm::length(before) * glm::length(after);
+                }
+                if (flips)
+                    continue;
+
+                collapsed[from] = to;
+                addQuadric(quadrics[to], quadrics[from]);
+                addQuadric(bounds[to], bounds[from]);
+                maxError = std::max(maxError, sumSquares(bounds[to], points[to]));
+                remaining -= removed;
+                performed++;
+                // the triangles around from change, so their corners wait for the next pass
+                for (size_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++) {
+                    for (int k = 0; k < 3; k++)
+                        touched[position[result[adjacency[i] * 3 + k]]] = true;
+                }
+            }
+            if (performed == 0)
+                break;
+
+            // moves the indices onto the surviving vertices and drops the degenerate triangles
+            size_t write = 0;
+            for (size_t t = 0; t < triangleCount; t++) {
+                GLuint corner[3];
+                for (int k = 0; k < 3; k++) {
+                    GLuint p = position[result[t * 3 + k]];
+                    corner[k] = collapsed[p] == p ? result[t * 3 + k] : wedge[collapsed[p]];
+                }
+                if (position[corner[0]] == position[corner[1]] || position[corner[1]] == position[corner[2]] ||
+                    position[corner[0]] == position[corner[2]])
+                    continue;
+                for (int k = 0; k < 3; k++)
+                    result[write++] = corner[k];
+            }
+            result.resize(write);
+            triangleCount = write / 3;
+
+            // collapsed positions leave the edge set, so border checks see the new ring
+            edges.clear();
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int k = 0; k < 3; k++)
+                    edges[edgeKey(position[result[t * 3 + k]], position[result[t * 3 + (k + 1) % 3]])]++;
+            }
+        }
+        return (float)sqrt(maxError);
+    }
+
+    void GenerateLods(gps::MeshData& mesh, int levels)
+    {
+        mesh.lods.clear();
+        gps::MeshLod full = { 0, (GLuint)mesh.indices.size(), 0.0f };
+        mesh.lods.push_back(full);
+
+        std::vector<GLuint> source = mesh.indices;
+        float error = 0.0f;
+        for (int level = 1; level < levels; level++) {
+            std::vector<GLuint> simplified;
+            // each level starts from the one before, so its error against the full mesh is
+            // counted as the sum of the steps, which can only overestimate it
+            error += SimplifyMesh(mesh.vertices, source, source.size() / 6 * 3, simplified);
+            if (simplified.empty() || simplified.size() > source.size() * (1.0 - minLodReduction))
+                break;
+            OptimizeVertexCache(simplified, mesh.vertices.size());
+            source = simplified;
+
+            gps::MeshLod lod = { (GLuint)mesh.indices.size(), (GLuint)simplified.size(), error };
+            mesh.lods.push_back(lod);
+            mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+        }
+    }
+}
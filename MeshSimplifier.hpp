@@ -0,0 +1,25 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Garland-Heckbert quadric error simplification by half edge collapses: each vertex
+    // position is merged into a neighbouring one, so every level of detail indexes the same
+    // vertex buffer. Vertices on attribute seams and non-manifold edges stay where they are and
+    // open borders only slide along themselves. Stops at targetIndexCount or when no collapse
+    // is left; returns a bound on the distance of the moved vertices from the planes of the
+    // triangles they replace, in model units.
+    float SimplifyMesh(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices,
+                       size_t targetIndexCount, std::vector<GLuint>& result);
+
+    // Appends up to levels - 1 coarser index lists to the mesh, each simplified from the one
+    // before to half its triangles, and records the ranges in mesh.lods.
+    // Levels that barely shrink or vanish altogether are not kept.
+    void GenerateLods(gps::MeshData& mesh, int levels);
+}
+
+#endif /* MeshSimplifier_hpp */
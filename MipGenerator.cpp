@@ -0,0 +1,346 @@
+#include "MipGenerator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace gps {
+
+    // Texels are filtered as four floats, which maps one texel onto one SSE register
+#if defined(__SSE2__)
+    typedef __m128 float4;
+    static inline float4 load4(const float* p) { return _mm_loadu_ps(p); }
+    static inline void store4(float* p, float4 v) { _mm_storeu_ps(p, v); }
+    static inline float4 splat4(float s) { return _mm_set1_ps(s); }
+    static inline float4 add4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+    static inline float4 mul4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+#else
+    struct float4 { float v[4]; };
+    static inline float4 load4(const float* p) { float4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+    static inline void store4(float* p, float4 v) { memcpy(p, v.v, sizeof(v.v)); }
+    static inline float4 splat4(float s) { float4 r = { { s, s, s, s } }; return r; }
+    static inline float4 add4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+    static inline float4 mul4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+#endif
+
+    // Kaiser windowed sinc, six taps around the centre of each 2x2 footprint
+    static const int kaiserTaps = 6;
+    static const double kaiserAlpha = 4.0;
+    static const double kaiserHalfWidth = 1.5;
+
+    static double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    static void kaiserWeights(double weights[kaiserTaps])
+    {
+        double total = 0.0;
+        for (int k = 0; k < kaiserTaps; k++) {
+            // source texel 2i - 2 + k, measured in destination texels from the footprint centre
+            double distance = (k - 2.5) / 2.0;
+            double sinc = std::sin(M_PI * distance) / (M_PI * distance);
+            double ratio = distance / kaiserHalfWidth;
+            double window = besselI0(kaiserAlpha * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) / besselI0(kaiserAlpha);
+            weights[k] = sinc * window;
+            total += weights[k];
+        }
+        for (int k = 0; k < kaiserTaps; k++)
+            weights[k] /= total;
+    }
+
+    static double srgbToLinear(double value)
+    {
+        return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+    }
+
+    static double linearToSrgb(double value)
+    {
+        return value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+    }
+
+    struct ConversionTables
+    {
+        float toLinear[256];
+        // indexed by the linear value in 16-bit fixed point
+        unsigned char toSrgb[65536];
+
+        ConversionTables()
+        {
+            for (int i = 0; i < 256; i++)
+                toLinear[i] = (float)srgbToLinear(i / 255.0);
+            for (int i = 0; i < 65536; i++)
+                toSrgb[i] = (unsigned char)(linearToSrgb(i / 65535.0) * 255.0 + 0.5);
+        }
+    };
+
+    static const ConversionTables& conversionTables()
+    {
+        static ConversionTables tables;
+        return tables;
+    }
+
+    static int levelCount(int width, int height)
+    {
+        int levels = 1;
+        while (width > 1 || height > 1) {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            levels++;
+        }
+        return levels;
+    }
+
+    static void toFloat(const unsigned char* source, size_t texels, int channels, bool srgb, float* destination)
+    {
+        const ConversionTables& tables = conversionTables();
+        for (size_t i = 0; i < texels; i++) {
+            for (int c = 0; c < 3; c++)
+                destination[i * 4 + c] = srgb ? tables.toLinear[source[i * channels + c]] : source[i * channels + c] / 255.0f;
+            destination[i * 4 + 3] = channels == 4 ? source[i * channels + 3] / 255.0f : 1.0f;
+        }
+    }
+
+    static void toBytes(const float* source, size_t texels, int channels, bool srgb, unsigned char* destination)
+    {
+        const ConversionTables& tables = conversionTables();
+        for (size_t i = 0; i < texels; i++) {
+            for (int c = 0; c < channels; c++) {
+                float value = std::min(1.0f, std::max(0.0f, source[i * 4 + c]));
+                if (srgb && c < 3)
+                    destination[i * channels + c] = tables.toSrgb[(int)(value * 65535.0f + 0.5f)];
+                else
+                    destination[i * channels + c] = (unsigned char)(value * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    // 2x2 average; odd sizes fold the last row/column into the previous one
+    static void boxDownsample(const float* source, int width, int height, float* destination)
+    {
+        int newWidth = std::max(1, width / 2);
+        int newHeight = std::max(1, height / 2);
+        float4 quarter = splat4(0.25f);
+
+        for (int y = 0; y < newHeight; y++) {
+            const float* row0 = source + (size_t)std::min(2 * y, height - 1) * width * 4;
+            const float* row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * 4;
+            float* out = destination + (size_t)y * newWidth * 4;
+            int x = 0;
+
+#if defined(__AVX__)
+            // two destination texels per iteration
+            __m256 quarter8 = _mm256_set1_ps(0.25f);
+            for (; 2 * x + 3 < width && x + 1 < newWidth; x += 2) {
+                __m256 a = _mm256_add_ps(_mm256_loadu_ps(row0 + 8 * x), _mm256_loadu_ps(row1 + 8 * x));
+                __m256 b = _mm256_add_ps(_mm256_loadu_ps(row0 + 8 * x + 8), _mm256_loadu_ps(row1 + 8 * x + 8));
+                __m256 sum = _mm256_add_ps(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31));
+                _mm256_storeu_ps(out + 4 * x, _mm256_mul_ps(sum, quarter8));
+            }
+#endif
+            for (; x < newWidth; x++) {
+                int x0 = std::min(2 * x, width - 1) * 4;
+                int x1 = std::min(2 * x + 1, width - 1) * 4;
+                float4 sum = add4(add4(load4(row0 + x0), load4(row0 + x1)), add4(load4(row1 + x0), load4(row1 + x1)));
+                store4(out + 4 * x, mul4(sum, quarter));
+            }
+        }
+    }
+
+    // Separable Kaiser filter: horizontal pass into scratch, then vertical pass
+    static void kaiserDownsample(const float* source, int width, int height, float* destination, std::vector<float>& scratch)
+    {
+        static double weights[kaiserTaps];
+        static bool weightsReady = (kaiserWeights(weights), true);
+        (void)weightsReady;
+
+        int newWidth = std::max(1, width / 2);
+        int newHeight = std::max(1, height / 2);
+        scratch.resize((size_t)newWidth * height * 4);
+
+        float4 tapWeights[kaiserTaps];
+        for (int k = 0; k < kaiserTaps; k++)
+            tapWeights[k] = splat4((float)weights[k]);
+
+        for (int y = 0; y < height; y++) {
+            const float* row = source + (size_t)y * width * 4;
+            float* out = &scratch[(size_t)y * newWidth * 4];
+            for (int x = 0; x < newWidth; x++) {
+                float4 sum = splat4(0.0f);
+                for (int k = 0; k < kaiserTaps; k++) {
+                    int sourceX = std::min(std::max(2 * x - 2 + k, 0), width - 1);
+                    sum = add4(sum, mul4(tapWeights[k], load4(row + sourceX * 4)));
+                }
+                store4(out + 4 * x, sum);
+            }
+        }
+
+        for (int y = 0; y < newHeight; y++) {
+            const float* rows[kaiserTaps];
+            for (int k = 0; k < kaiserTaps; k++)
+                rows[k] = &scratch[(size_t)std::min(std::max(2 * y - 2 + k, 0), height - 1) * newWidth * 4];
+            float* out = destination + (size_t)y * newWidth * 4;
+            int x = 0;
+
+#if defined(__AVX__)
+            // adjacent destination texels read adjacent scratch texels, so two fit one register
+            for (; x + 1 < newWidth; x += 2) {
+                __m256 sum = _mm256_setzero_ps();
+                for (int k = 0; k < kaiserTaps; k++)
+                    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps((float)weights[k]), _mm256_loadu_ps(rows[k] + 4 * x)));
+                _mm256_storeu_ps(out + 4 * x, sum);
+            }
+#endif
+            for (; x < newWidth; x++) {
+                float4 sum = splat4(0.0f);
+                for (int k = 0; k < kaiserTaps; k++)
+                    sum = add4(sum, mul4(tapWeights[k], load4(rows[k] + 4 * x)));
+                store4(out + 4 * x, sum);
+            }
+        }
+    }
+
+    const char* GetMipFilterName(MIP_FILTER filter)
+    {
+        return filter == MIP_BOX ? "box" : "kaiser";
+    }
+
+    void GenerateMipChain(gps::Image& image, MIP_FILTER filter, bool srgb)
+    {
+        int width = image.width, height = image.height, channels = image.channels;
+        int levels = levelCount(width, height);
+
+        std::vector<size_t> offsets;
+        size_t total = 0;
+        for (int level = 0, w = width, h = height; level < levels; level++) {
+            offsets.push_back(total);
+            total += (size_t)w * h * channels;
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+        offsets.push_back(total);
+
+        std::shared_ptr<unsigned char> chain(new unsigned char[total], std::default_delete<unsigned char[]>());
+        memcpy(chain.get(), image.pixels.get(), offsets[1]);
+
+        std::vector<float> current((size_t)width * height * 4);
+        std::vector<float> next;
+        std::vector<float> scratch;
+        toFloat(image.pixels.get(), (size_t)width * height, channels, srgb, current.data());
+
+        for (int level = 1; level < levels; level++) {
+            int newWidth = std::max(1, width / 2);
+            int newHeight = std::max(1, height / 2);
+            next.resize((size_t)newWidth * newHeight * 4);
+
+            if (filter == MIP_BOX)
+                boxDownsample(current.data(), width, height, next.data());
+            else
+                kaiserDownsample(current.data(), width, height, next.data(), scratch);
+
+            // each level is filtered from the float level above it, not from rounded bytes
+            toBytes(next.data(), (size_t)newWidth * newHeight, channels, srgb, chain.get() + offsets[level]);
+            current.swap(next);
+            width = newWidth;
+            height = newHeight;
+        }
+
+        image.pixels = chain;
+        image.levelOffsets = offsets;
+    }
+
+    void GenerateMipChainReference(gps::Image& image, MIP_FILTER filter, bool srgb)
+    {
+        int width = image.width, height = image.height, channels = image.channels;
+        int levels = levelCount(width, height);
+        double weights[kaiserTaps];
+        kaiserWeights(weights);
+
+        std::vector<double> current((size_t)width * height * 4);
+        for (size_t i = 0; i < (size_t)width * height; i++) {
+            for (int c = 0; c < 4; c++) {
+                double value = c < channels ? image.pixels.get()[i * channels + c] / 255.0 : 1.0;
+                current[i * 4 + c] = srgb && c < 3 ? srgbToLinear(value) : value;
+            }
+        }
+
+        std::vector<unsigned char> chain(image.pixels.get(), image.pixels.get() + (size_t)width * height * channels);
+        std::vector<size_t> offsets(1, 0);
+
+        for (int level = 1; level < levels; level++) {
+            int newWidth = std::max(1, width / 2);
+            int newHeight = std::max(1, height / 2);
+            std::vector<double> next((size_t)newWidth * newHeight * 4, 0.0);
+
+            for (int y = 0; y < newHeight; y++) {
+                for (int x = 0; x < newWidth; x++) {
+                    for (int c = 0; c < 4; c++) {
+                        double sum = 0.0;
+                        if (filter == MIP_BOX) {
+                            for (int dy = 0; dy < 2; dy++)
+                                for (int dx = 0; dx < 2; dx++)
+                                    sum += 0.25 * current[((size_t)std::min(2 * y + dy, height - 1) * width + std::min(2 * x + dx, width - 1)) * 4 + c];
+                        } else {
+                            for (int ky = 0; ky < kaiserTaps; ky++) {
+                                int sourceY = std::min(std::max(2 * y - 2 + ky, 0), height - 1);
+                                for (int kx = 0; kx < kaiserTaps; kx++) {
+                                    int sourceX = std::min(std::max(2 * x - 2 + kx, 0), width - 1);
+                                    sum += weights[ky] * weights[kx] * current[((size_t)sourceY * width + sourceX) * 4 + c];
+                                }
+                            }
+                        }
+                        next[((size_t)y * newWidth + x) * 4 + c] = sum;
+                    }
+                }
+            }
+
+            offsets.push_back(chain.size());
+            for (size_t i = 0; i < (size_t)newWidth * newHeight; i++) {
+                for (int c = 0; c < channels; c++) {
+                    double value = std::min(1.0, std::max(0.0, next[i * 4 + c]));
+                    if (srgb && c < 3)
+                        value = linearToSrgb(value);
+                    chain.push_back((unsigned char)(value * 255.0 + 0.5));
+                }
+            }
+
+            current.swap(next);
+            width = newWidth;
+            height = newHeight;
+        }
+        offsets.push_back(chain.size());
+
+        std::shared_ptr<unsigned char> pixels(new unsigned char[chain.size()], std::default_delete<unsigned char[]>());
+        memcpy(pixels.get(), chain.data(), chain.size());
+        image.pixels = pixels;
+        image.levelOffsets = offsets;
+    }
+
+    double CompareMipChains(const gps::Image& a, const gps::Image& b)
+    {
+        size_t total = std::min(a.levelOffsets.back(), b.levelOffsets.back());
+        double squaredError = 0.0;
+        for (size_t i = 0; i < total; i++) {
+            double difference = (double)a.pixels.get()[i] - b.pixels.get()[i];
+            squaredError += difference * difference;
+        }
+
+        if (squaredError == 0.0)
+            return INFINITY;
+        double meanSquaredError = squaredError / total;
+        return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef MipGenerator_hpp
+#define MipGenerator_hpp
+
+#include "Mesh.hpp"
+
+namespace gps {
+
+    enum MIP_FILTER {MIP_BOX, MIP_KAISER};
+
+    // "box" or "kaiser"
+    const char* GetMipFilterName(MIP_FILTER filter);
+
+    // Replaces the single level in image.pixels with the full mip chain, level 0 first,
+    // and fills image.levelOffsets. Works on 8-bit images with 3 or 4 channels; sRGB
+    // colour is filtered in linear space, alpha always is. Uses SSE, and AVX when built for it.
+    void GenerateMipChain(gps::Image& image, MIP_FILTER filter, bool srgb);
+
+    // Straightforward double precision version of the same filters, to check the fast path against
+    void GenerateMipChainReference(gps::Image& image, MIP_FILTER filter, bool srgb);
+
+    // Peak signal to noise ratio over every level of two chains of the same image
+    double CompareMipChains(const gps::Image& a, const gps::Image& b);
+}
+
+#endif /* MipGenerator_hpp */
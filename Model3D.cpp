@@ -1,7 +1,19 @@
 #include "Model3D.hpp"
+#include "DdsFile.hpp"
+#include "ImageUtils.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "ObjLoader.hpp"
+
+#include <chrono>
 
 namespace gps {
 
+	gps::TextureOptions Model3D::textureOptions;
+	gps::MeshOptions Model3D::meshOptions;
+	gps::TextureStats Model3D::textureStats;
+	gps::ArenaTotals Model3D::arenaTotals;
+
 	void Model3D::LoadModel(std::string fileName)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
@@ -13,16 +25,112 @@ namespace gps {
 		ReadOBJ(fileName, basePath);
 	}
 
+	static gps::VERTEX_LAYOUT GetVertexLayout() {
+		return Model3D::meshOptions.compactVertices ? gps::VERTEX_COMPACT : gps::VERTEX_FLOAT;
+	}
+
 	// Draw each mesh from the model
 	void Model3D::Draw(gps::Shader shaderProgram)
 	{
+		if (meshes.empty() && placeholder != NULL)
+			placeholder->Draw(shaderProgram);
+
 		for (int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shaderProgram);
 	}
 
+	// Draws each mesh at the coarsest level of detail the selection allows
+	void Model3D::Draw(gps::Shader shaderProgram, const gps::LodSelection& selection)
+	{
+		if (meshes.empty() && placeholder != NULL)
+			placeholder->Draw(shaderProgram);
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].Draw(shaderProgram, meshes[i].SelectLod(selection));
+	}
+
+	void Model3D::DrawDepth(gps::Shader shaderProgram, const gps::LodSelection& selection)
+	{
+		if (meshes.empty() && placeholder != NULL)
+			placeholder->DrawDepth(shaderProgram);
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].DrawDepth(shaderProgram, meshes[i].SelectLod(selection));
+	}
+
+	// Sphere around every mesh with known bounds, in model space
+	bool Model3D::GetBounds(glm::vec3& center, float& radius)
+	{
+		bool found = false;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			glm::vec3 meshCenter;
+			float meshRadius;
+			meshes[i].GetBounds(meshCenter, meshRadius);
+			if (meshRadius <= 0.0f)
+				continue;
+			if (!found) {
+				center = meshCenter;
+				radius = meshRadius;
+				found = true;
+				continue;
+			}
+			// grow the sphere just enough to hold the mesh's
+			float distance = glm::length(meshCenter - center);
+			if (distance + meshRadius <= radius)
+				continue;
+			if (distance + radius <= meshRadius) {
+				center = meshCenter;
+				radius = meshRadius;
+				continue;
+			}
+			float grown = (distance + radius + meshRadius) * 0.5f;
+			center += (meshCenter - center) * ((grown - radius) / distance);
+			radius = grown;
+		}
+		return found;
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
 
+		std::vector<MeshData> meshData;
+		ParseOBJ(fileName, basePath, meshData);
+
+		for (size_t s = 0; s < meshData.size(); s++) {
+			std::vector<gps::Texture> textures;
+			for (size_t t = 0; t < meshData[s].textures.size(); t++)
+				textures.push_back(LoadTexture(meshData[s].textures[t].path, meshData[s].textures[t].type));
+
+			meshes.push_back(gps::Mesh(meshData[s].vertices, meshData[s].indices, textures, GetVertexLayout(), meshData[s].lods));
+		}
+	}
+
+	// Cache key of the model as it is on disk now, 0 without a mesh cache
+	static uint64_t GetMeshCacheKey(std::string fileName, std::string basePath) {
+		if (Model3D::meshOptions.cache == NULL)
+			return 0;
+		// texture paths are stored with the base path, and optimized meshes apart from plain ones
+		std::string variant = Model3D::meshOptions.optimize ? "mesh-optimized-lod" + std::to_string(Model3D::meshOptions.lodLevels) : "mesh-parsed";
+		return MeshCache::GetKey(fileName, variant + "|" + basePath);
+	}
+
+	// Fills meshData from the mesh cache, false when it does not hold the file as it is now
+	bool Model3D::LoadCachedOBJ(std::string fileName, std::string basePath, std::vector<MeshData>& meshData) {
+		uint64_t cacheKey = GetMeshCacheKey(fileName, basePath);
+		if (cacheKey == 0 || !meshOptions.cache->Load(cacheKey, meshData))
+			return false;
+		std::cout << "Loading cached : " << fileName << std::endl;
+		return true;
+	}
+
+	// Parses the .obj file into CPU side mesh data - safe to call from a worker thread
+	void Model3D::ParseOBJ(std::string fileName, std::string basePath, std::vector<MeshData>& meshData, gps::ThreadPool* pool){
+
+		// keyed before parsing, so a file edited meanwhile is not stored under its new identity
+		uint64_t cacheKey = GetMeshCacheKey(fileName, basePath);
+		if (LoadCachedOBJ(fileName, basePath, meshData))
+			return;
+
         std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
@@ -30,7 +138,19 @@ namespace gps {
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		// parser temporaries only live until the shapes are stitched together; each loading
+		// thread keeps its arena, so the next model reuses the first block instead of new ones
+		static thread_local gps::Arena arena;
+		gps::ArenaStats before = arena.GetStats();
+		bool ret = gps::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE, pool, &arena);
+
+		gps::ArenaStats arenaStats = arena.GetStats();
+		arenaTotals.allocations += arenaStats.allocations - before.allocations;
+		arenaTotals.blocks += arenaStats.blocks - before.blocks;
+		long long peak = arenaTotals.peakBytes;
+		while (peak < (long long)arenaStats.peakBytes && !arenaTotals.peakBytes.compare_exchange_weak(peak, arenaStats.peakBytes)) {
+		}
+		arena.Reset();
 
 		if (!err.empty()) { // `err` may contain warning message.
 			std::cerr << err << std::endl;
@@ -48,6 +168,8 @@ namespace gps {
 			std::vector<gps::Vertex> vertices;
 			std::vector<GLuint> indices;
 			std::vector<gps::Texture> textures;
+			vertices.reserve(shapes[s].mesh.indices.size());
+			indices.reserve(shapes[s].mesh.indices.size());
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -97,43 +219,129 @@ namespace gps {
 			int a = shapes[s].mesh.material_ids.size();
 			if (a > 0 && materials.size()>0) {
 				materialId = shapes[s].mesh.material_ids[0];
-				if (materialId != -1) {
-					gps::Material currentMaterial;
-					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
-					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
-					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
-
-					//ambient texture
-					std::string ambientTexturePath = materials[materialId].ambient_texname;
-					if (!ambientTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
-						textures.push_back(currentTexture);
-					}
+				if (materialId != -1)
+					textures = GetMaterialTextures(materials[materialId], basePath);
+			}
 
-					//diffuse texture
-					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
-					if (!diffuseTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
-						textures.push_back(currentTexture);
-					}
+			meshData.push_back(MeshData());
+			meshData.back().vertices.swap(vertices);
+			meshData.back().indices.swap(indices);
+			meshData.back().textures.swap(textures);
+		}
 
-					//specular texture
-					std::string specularTexturePath = materials[materialId].specular_texname;
-					if (!specularTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
-						textures.push_back(currentTexture);
-					}
-				}
+		if (meshOptions.optimize) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			std::vector<gps::MeshOptimizationStats> meshStats(meshData.size());
+			std::function<void(size_t)> optimize = [&](size_t s) {
+				meshStats[s] = OptimizeMesh(meshData[s]);
+				if (meshOptions.lodLevels > 1)
+					GenerateLods(meshData[s], meshOptions.lodLevels);
+			};
+			if (pool != NULL)
+				pool->ParallelFor(meshData.size(), optimize);
+			else
+				for (size_t s = 0; s < meshData.size(); s++)
+					optimize(s);
+
+			gps::MeshOptimizationStats stats = CombineStats(meshStats);
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			printf("Optimized %s: %zu -> %zu vertices, ACMR %.3f -> %.3f -> %.3f, ATVR %.3f -> %.3f -> %.3f (%.1f ms)\n",
+			       fileName.c_str(), stats.verticesBefore, stats.verticesAfter,
+			       stats.parsed.acmr, stats.welded.acmr, stats.optimized.acmr,
+			       stats.parsed.atvr, stats.welded.atvr, stats.optimized.atvr, milliseconds);
+
+			// triangles drawn at each level of detail over the whole model, meshes with fewer
+			// levels counted at their coarsest
+			size_t levels = 0;
+			for (size_t s = 0; s < meshData.size(); s++)
+				levels = std::max(levels, meshData[s].lods.size());
+			std::vector<size_t> lodTriangles(levels, 0);
+			for (size_t s = 0; s < meshData.size(); s++) {
+				for (size_t l = 0; l < levels && !meshData[s].lods.empty(); l++)
+					lodTriangles[l] += meshData[s].lods[std::min(l, meshData[s].lods.size() - 1)].indexCount / 3;
 			}
+			if (lodTriangles.size() > 1) {
+				std::cout << "LOD triangles  :";
+				for (size_t l = 0; l < lodTriangles.size(); l++)
+					std::cout << " " << lodTriangles[l];
+				std::cout << std::endl;
+			}
+		}
+		if (cacheKey != 0)
+			meshOptions.cache->Store(cacheKey, meshData);
+	}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+	// Ambient, diffuse and specular maps of a material, ids left unresolved
+	std::vector<gps::Texture> Model3D::GetMaterialTextures(const tinyobj::material_t& material, std::string basePath) {
+
+		std::vector<gps::Texture> textures;
+		const std::string* paths[3] = { &material.ambient_texname, &material.diffuse_texname, &material.specular_texname };
+		const char* types[3] = { "ambientTexture", "diffuseTexture", "specularTexture" };
+		for (int i = 0; i < 3; i++) {
+			if (paths[i]->empty())
+				continue;
+			gps::Texture currentTexture;
+			currentTexture.id = 0;
+			currentTexture.type = types[i];
+			currentTexture.path = basePath + *paths[i];
+			textures.push_back(currentTexture);
 		}
+		return textures;
+	}
+
+	// Creates a GL mesh; textures not yet streamed in are bound to the placeholder
+	void Model3D::AddMesh(MeshData& meshData, GLuint placeholderTexture) {
+
+		std::vector<gps::Texture> textures = meshData.textures;
+		ResolveTextures(textures, placeholderTexture);
+		meshes.push_back(gps::Mesh(meshData.vertices, meshData.indices, textures, GetVertexLayout(), meshData.lods));
+	}
+
+	// Starts an empty mesh for streamed geometry and returns its index
+	int Model3D::AddStreamedMesh(std::vector<gps::Texture> textures, GLuint placeholderTexture) {
+
+		ResolveTextures(textures, placeholderTexture);
+		meshes.push_back(gps::Mesh(textures));
+		return (int)meshes.size() - 1;
+	}
+
+	// Appends a chunk of streamed vertices to a mesh started by AddStreamedMesh
+	void Model3D::AppendToMesh(int mesh, GLuint readBuffer, GLintptr readOffset, GLsizei vertexCount) {
+
+		meshes[mesh].Append(readBuffer, readOffset, vertexCount);
+	}
+
+	// Points textures at the ones already loaded, the rest at the placeholder
+	void Model3D::ResolveTextures(std::vector<gps::Texture>& textures, GLuint placeholderTexture) {
+
+		for (size_t t = 0; t < textures.size(); t++) {
+			textures[t].id = placeholderTexture;
+			for (size_t i = 0; i < loadedTextures.size(); i++) {
+				if (loadedTextures[i].path == textures[t].path)
+					textures[t].id = loadedTextures[i].id;
+			}
+		}
+	}
+
+	// Swaps a streamed in texture into every mesh that references it
+	void Model3D::SetTexture(std::string path, GLuint textureId) {
+
+		gps::Texture loadedTexture;
+		loadedTexture.id = textureId;
+		loadedTexture.path = path;
+		loadedTextures.push_back(loadedTexture);
+
+		for (size_t s = 0; s < meshes.size(); s++) {
+			for (size_t t = 0; t < meshes[s].textures.size(); t++) {
+				if (meshes[s].textures[t].path == path)
+					meshes[s].textures[t].id = textureId;
+			}
+		}
+	}
+
+	// Mesh drawn instead of the model while its geometry is still loading
+	void Model3D::SetPlaceholder(gps::Mesh* placeholderMesh) {
+		placeholder = placeholderMesh;
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
@@ -157,55 +365,124 @@ namespace gps {
 			return currentTexture;
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-		if (!image_data) {
+	// Decodes an image file and flips it for OpenGL - safe to call from a worker thread
+	bool Model3D::DecodeTexture(const char* file_name, gps::Image& image) {
+		// prefer the block compressed copy written by TextureConverter, unless the image is newer
+		if (GLEW_EXT_texture_compression_s3tc && HasCurrentDds(file_name) && ReadDds(GetDdsPath(file_name).c_str(), image)) {
+			return true;
+		}
+
+		std::vector<unsigned char> source;
+		if (!TextureCache::ReadFile(file_name, source)) {
+			fprintf(stderr, "ERROR: could not load %s\n", file_name);
+			return false;
+		}
+
+		// the cache is keyed by the file's contents, so an edited image is never served stale
+		gps::TextureCache* cache = textureOptions.cpuMipmaps ? textureOptions.cache : NULL;
+		uint64_t cacheKey = 0;
+		if (cache != NULL) {
+			cacheKey = TextureCache::GetKey(source.data(), source.size(), std::string("rgba-srgb-") + GetMipFilterName(textureOptions.filter));
+			if (cache->Load(cacheKey, image)) {
+				textureStats.cacheHits++;
+				return true;
+			}
+		}
+
+		// decoded to RGBA and flipped for OpenGL with the row kernels from ImageUtils
+		if (!DecodeRgba(source.data(), source.size(), true, image)) {
 			fprintf(stderr, "ERROR: could not load %s\n", file_name);
 			return false;
 		}
 		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
+		if ((image.width & (image.width - 1)) != 0 || (image.height & (image.height - 1)) != 0) {
 			fprintf(
 				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
 			);
 		}
 
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
-
-		for (int row = 0; row < half_height; row++) {
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-			for (int col = 0; col < width_in_bytes; col++) {
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
+		if (textureOptions.cpuMipmaps) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			GenerateMipChain(image, textureOptions.filter, true);
+			textureStats.mipMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
 		}
+		if (cache != NULL) {
+			textureStats.cacheMisses++;
+			cache->Store(cacheKey, image);
+		}
+		return true;
+	}
+
+	// Times glGenerateMipmap on the bound texture, for the driver mip path
+	void Model3D::GenerateDriverMipmaps(GLenum target) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		glGenerateMipmap(target);
+		// the driver may defer the work, wait for it so the timing is comparable
+		glFinish();
+		textureStats.mipMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Reads the pixel data from an image file and loads it into the video memory
+	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
+		gps::Image image;
+		if (!DecodeTexture(file_name, image)) {
+			return false;
+		}
+		return CreateTexture(image);
+	}
+
+	// Uploads a decoded image and its mip chain as a repeating texture (GL thread)
+	GLuint Model3D::CreateTexture(const gps::Image& image) {
+		int x = image.width;
+		int y = image.height;
 
 		GLuint textureID;
 		glGenTextures(1, &textureID);
 		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
+
+		if (image.compressedFormat != 0) {
+			int levels = (int)image.levelOffsets.size() - 1;
+			for (int level = 0; level < levels; level++) {
+				glCompressedTexImage2D(
+					GL_TEXTURE_2D,
+					level,
+					image.compressedFormat,
+					std::max(1, x >> level),
+					std::max(1, y >> level),
+					0,
+					image.levelOffsets[level + 1] - image.levelOffsets[level],
+					image.pixels.get() + image.levelOffsets[level]
+				);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			return textureID;
+		}
+
+		// one level, or the chain built by the mip generator
+		int levels = image.levelOffsets.empty() ? 1 : (int)image.levelOffsets.size() - 1;
+		for (int level = 0; level < levels; level++) {
+			glTexImage2D(
+				GL_TEXTURE_2D,
+				level,
+				GL_SRGB, //GL_SRGB,//GL_RGBA,
+				std::max(1, x >> level),
+				std::max(1, y >> level),
+				0,
+				GL_RGBA,
+				GL_UNSIGNED_BYTE,
+				image.pixels.get() + (image.levelOffsets.empty() ? 0 : image.levelOffsets[level])
+			);
+		}
+		if (levels > 1)
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		else
+			GenerateDriverMipmaps(GL_TEXTURE_2D);
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -225,9 +502,13 @@ namespace gps {
             GLuint VBO = meshes.at(i).getBuffers().VBO;
             GLuint EBO = meshes.at(i).getBuffers().EBO;
             GLuint VAO = meshes.at(i).getBuffers().VAO;
+            GLuint depthVBO = meshes.at(i).getBuffers().depthVBO;
+            GLuint depthVAO = meshes.at(i).getBuffers().depthVAO;
             glDeleteBuffers(1, &VBO);
             glDeleteBuffers(1, &EBO);
             glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(1, &depthVBO);
+            glDeleteVertexArrays(1, &depthVAO);
         }
 	}
 }
@@ -1,17 +1,66 @@
 #ifndef Model3D_hpp
 #define Model3D_hpp
 
+#include "Arena.hpp"
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
+#include "MipGenerator.hpp"
+#include "ThreadPool.hpp"
+#include "TextureCache.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <vector>
 
 namespace gps {
 
+	// How textures without a block compressed copy get their mip chain
+	struct TextureOptions
+	{
+		// false leaves mip generation to glGenerateMipmap
+		bool cpuMipmaps = true;
+		gps::MIP_FILTER filter = gps::MIP_KAISER;
+		// NULL disables the cache
+		gps::TextureCache* cache = NULL;
+	};
+
+	// What happens to parsed geometry before it reaches the GPU
+	struct MeshOptions
+	{
+		// weld, then reorder for the vertex cache, overdraw and vertex fetch
+		bool optimize = true;
+		// NULL disables the cache
+		gps::MeshCache* cache = NULL;
+		// indexed meshes use the 16 byte gps::CompactVertex on the GPU; streamed ones stay float
+		bool compactVertices = true;
+		// levels of detail generated per optimized mesh, counting the full one; 1 disables
+		int lodLevels = 4;
+	};
+
+	// Texture loading counters, updated from the worker threads
+	struct TextureStats
+	{
+		// CPU or driver time spent building mip chains
+		std::atomic<long long> mipMicroseconds;
+		std::atomic<int> cacheHits;
+		std::atomic<int> cacheMisses;
+	};
+
+	// Load arena counters summed over every parsed model, updated from the worker threads
+	struct ArenaTotals
+	{
+		// allocations served by the arenas instead of the heap, and the blocks that served them
+		std::atomic<long long> allocations;
+		std::atomic<long long> blocks;
+		// largest arena footprint of a single model
+		std::atomic<long long> peakBytes;
+	};
+
     class Model3D
     {
 
@@ -24,11 +73,65 @@ namespace gps {
 
 		void Draw(gps::Shader shaderProgram);
 
+		// Draws each mesh at the coarsest level of detail the selection allows
+		void Draw(gps::Shader shaderProgram, const gps::LodSelection& selection);
+
+		// The same levels of detail through the meshes' position-only streams, without textures
+		void DrawDepth(gps::Shader shaderProgram, const gps::LodSelection& selection);
+
+		// Sphere around every mesh with known bounds, in model space; false when there is none
+		// (still loading, or streamed)
+		bool GetBounds(glm::vec3& center, float& radius);
+
+		// Parses the .obj file into CPU side mesh data - safe to call from a worker thread.
+		// With a pool the file is parsed in parallel chunks. Meshes are optimized as set in
+		// meshOptions, and served from the mesh cache when it holds the file.
+		static void ParseOBJ(std::string fileName, std::string basePath, std::vector<MeshData>& meshData,
+		                     gps::ThreadPool* pool = NULL);
+
+		// Decodes an image file and flips it for OpenGL - safe to call from a worker thread
+		static bool DecodeTexture(const char* file_name, gps::Image& image);
+
+		// Uploads a decoded image and its mip chain as a repeating texture (GL thread)
+		static GLuint CreateTexture(const gps::Image& image);
+
+		// Times glGenerateMipmap on the bound texture, for the driver mip path
+		static void GenerateDriverMipmaps(GLenum target);
+
+		// Fills meshData from the mesh cache, false when it does not hold the file as it is now
+		static bool LoadCachedOBJ(std::string fileName, std::string basePath, std::vector<MeshData>& meshData);
+
+		static gps::TextureOptions textureOptions;
+		static gps::MeshOptions meshOptions;
+		static gps::TextureStats textureStats;
+		static gps::ArenaTotals arenaTotals;
+
+		// Ambient, diffuse and specular maps of a material, ids left unresolved
+		static std::vector<gps::Texture> GetMaterialTextures(const tinyobj::material_t& material, std::string basePath);
+
+		// Creates a GL mesh, so a model can go up a mesh at a time; textures not yet streamed
+		// in are bound to the placeholder
+		void AddMesh(MeshData& meshData, GLuint placeholderTexture);
+
+		// Streamed geometry: an empty mesh per material, grown chunk by chunk on the GPU
+		int AddStreamedMesh(std::vector<gps::Texture> textures, GLuint placeholderTexture);
+		void AppendToMesh(int mesh, GLuint readBuffer, GLintptr readOffset, GLsizei vertexCount);
+
+		// Swaps a streamed in texture into every mesh that references it
+		void SetTexture(std::string path, GLuint textureId);
+
+		// Mesh drawn instead of the model while its geometry is still loading
+		void SetPlaceholder(gps::Mesh* placeholderMesh);
+
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		gps::Mesh* placeholder = NULL;
+
+		// Points textures at the ones already loaded, the rest at the placeholder
+		void ResolveTextures(std::vector<gps::Texture>& textures, GLuint placeholderTexture);
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
@@ -0,0 +1,678 @@
+#include "ObjLoader.hpp"
+#include "FastFloat.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gps {
+
+    // Records that split or relabel the face stream, kept in file order
+    struct ObjCommand
+    {
+        enum Type { GROUP, OBJECT, USEMTL, MTLLIB } type;
+        // number of faces of the chunk before this record
+        size_t face;
+        std::string name;
+    };
+
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+
+        // all of it lives in the load arena, which is reset once the model is stitched together
+        explicit ObjChunk(gps::Arena& arena)
+            : vertices(ArenaAllocator<float>(arena)), normals(ArenaAllocator<float>(arena)),
+              texcoords(ArenaAllocator<float>(arena)), corners(ArenaAllocator<tinyobj::index_t>(arena)),
+              cornerStart(ArenaAllocator<size_t>(arena)), triangleStart(ArenaAllocator<size_t>(arena)),
+              relative(ArenaAllocator<size_t>(arena)), commands(ArenaAllocator<ObjCommand>(arena)) {}
+
+        ArenaVector<float> vertices;
+        ArenaVector<float> normals;
+        ArenaVector<float> texcoords;
+        // face corners with zero based indices, -1 where the corner has none
+        ArenaVector<tinyobj::index_t> corners;
+        // corners before each face and triangles before each face, both with a final total
+        ArenaVector<size_t> cornerStart;
+        ArenaVector<size_t> triangleStart;
+        // corner * 3 + component of negative indices, resolved only within the chunk so far
+        ArenaVector<size_t> relative;
+        ArenaVector<ObjCommand> commands;
+
+        // floats of the earlier chunks, filled in by the prefix sums
+        size_t vertexOffset, normalOffset, texcoordOffset;
+    };
+
+    // Faces [faceBegin, faceEnd) of one chunk that end up in one shape with one material
+    struct ObjSegment
+    {
+        size_t shape;
+        size_t chunk;
+        size_t faceBegin;
+        size_t faceEnd;
+        int material;
+        // where the segment's output starts in the shape
+        size_t indexOffset;
+        size_t faceOffset;
+    };
+
+    static inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    static inline const char* skipSpace(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    // Like tinyobj's parseFloat: the token up to the next blank, 0 (or fallback) if it is not a number
+    static inline float parseFloat(const char*& p, const char* end, double fallback = 0.0)
+    {
+        p = skipSpace(p, end);
+        const char* tokenEnd = p;
+        while (tokenEnd < end && !isSpace(*tokenEnd))
+            tokenEnd++;
+        double value = fallback;
+        ParseDouble(p, tokenEnd, value);
+        p = tokenEnd;
+        return (float)value;
+    }
+
+    static inline int parseInt(const char*& p, const char* end)
+    {
+        bool negative = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            negative = *p == '-';
+            p++;
+        }
+        int value = 0;
+        for (; p < end && (unsigned)(*p - '0') < 10; p++)
+            value = value * 10 + (*p - '0');
+        // like atoi followed by strcspn("/ \t\r")
+        while (p < end && *p != '/' && !isSpace(*p))
+            p++;
+        return negative ? -value : value;
+    }
+
+    static inline std::string parseName(const char* p, const char* end)
+    {
+        p = skipSpace(p, end);
+        const char* nameEnd = p;
+        while (nameEnd < end && !isSpace(*nameEnd))
+            nameEnd++;
+        return std::string(p, nameEnd);
+    }
+
+    // Zero based index; positive indices are final, negative ones are relative to what the
+    // chunk has seen so far and get the earlier chunks' counts added later
+    static inline int fixIndex(ObjChunk& chunk, int index, size_t count, int component)
+    {
+        if (index > 0)
+            return index - 1;
+        if (index == 0)
+            return 0;
+        chunk.relative.push_back(chunk.corners.size() * 3 + component);
+        return (int)count + index;
+    }
+
+    static void parseFace(ObjChunk& chunk, const char* p, const char* end)
+    {
+        size_t first = chunk.corners.size();
+        p = skipSpace(p, end);
+        while (p < end) {
+            tinyobj::index_t corner;
+            corner.vertex_index = fixIndex(chunk, parseInt(p, end), chunk.vertices.size() / 3, 0);
+            corner.normal_index = -1;
+            corner.texcoord_index = -1;
+
+            if (p < end && *p == '/') {
+                p++;
+                if (p < end && *p == '/') {
+                    p++;
+                    corner.normal_index = fixIndex(chunk, parseInt(p, end), chunk.normals.size() / 3, 1);
+                } else {
+                    corner.texcoord_index = fixIndex(chunk, parseInt(p, end), chunk.texcoords.size() / 2, 2);
+                    if (p < end && *p == '/') {
+                        p++;
+                        corner.normal_index = fixIndex(chunk, parseInt(p, end), chunk.normals.size() / 3, 1);
+                    }
+                }
+            }
+            chunk.corners.push_back(corner);
+            p = skipSpace(p, end);
+        }
+
+        size_t count = chunk.corners.size() - first;
+        chunk.cornerStart.push_back(chunk.corners.size());
+        chunk.triangleStart.push_back(chunk.triangleStart.back() + (count > 2 ? count - 2 : 0));
+    }
+
+    // Counts the records of the chunk so its arrays are sized once: the arena never gets back
+    // the buffers a growing vector leaves behind
+    static void reserveChunk(ObjChunk& chunk)
+    {
+        size_t vertices = 0, normals = 0, texcoords = 0, faces = 0, corners = 0;
+        const char* p = chunk.begin;
+        while (p < chunk.end) {
+            const char* lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+            if (!lineEnd)
+                lineEnd = chunk.end;
+            const char* token = skipSpace(p, lineEnd);
+            p = lineEnd + 1;
+            if (lineEnd - token < 2)
+                continue;
+
+            if (token[0] == 'v') {
+                vertices += isSpace(token[1]);
+                normals += token[1] == 'n';
+                texcoords += token[1] == 't';
+            } else if (token[0] == 'f' && isSpace(token[1])) {
+                faces++;
+                for (const char* q = token + 1; q + 1 < lineEnd; q++)
+                    corners += isSpace(q[0]) && !isSpace(q[1]) && q[1] != '\r';
+            }
+        }
+
+        chunk.vertices.reserve(vertices * 3);
+        chunk.normals.reserve(normals * 3);
+        chunk.texcoords.reserve(texcoords * 2);
+        chunk.corners.reserve(corners);
+        chunk.cornerStart.reserve(faces + 1);
+        chunk.triangleStart.reserve(faces + 1);
+    }
+
+    static void parseChunk(ObjChunk& chunk)
+    {
+        reserveChunk(chunk);
+        chunk.cornerStart.push_back(0);
+        chunk.triangleStart.push_back(0);
+
+        const char* p = chunk.begin;
+        while (p < chunk.end) {
+            const char* lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+            const char* next = lineEnd ? lineEnd + 1 : chunk.end;
+            if (!lineEnd)
+                lineEnd = chunk.end;
+            if (lineEnd > p && lineEnd[-1] == '\r')
+                lineEnd--;
+
+            const char* token = skipSpace(p, lineEnd);
+            size_t length = lineEnd - token;
+            p = next;
+            if (length < 2)
+                continue;
+
+            if (token[0] == 'v' && isSpace(token[1])) {
+                token += 2;
+                chunk.vertices.push_back(parseFloat(token, lineEnd));
+                chunk.vertices.push_back(parseFloat(token, lineEnd));
+                chunk.vertices.push_back(parseFloat(token, lineEnd));
+            } else if (token[0] == 'v' && token[1] == 'n' && length > 2 && isSpace(token[2])) {
+                token += 3;
+                chunk.normals.push_back(parseFloat(token, lineEnd));
+                chunk.normals.push_back(parseFloat(token, lineEnd));
+                chunk.normals.push_back(parseFloat(token, lineEnd));
+            } else if (token[0] == 'v' && token[1] == 't' && length > 2 && isSpace(token[2])) {
+                token += 3;
+                chunk.texcoords.push_back(parseFloat(token, lineEnd));
+                chunk.texcoords.push_back(parseFloat(token, lineEnd));
+            } else if (token[0] == 'f' && isSpace(token[1])) {
+                parseFace(chunk, token + 2, lineEnd);
+            } else {
+                ObjCommand command;
+                command.face = chunk.cornerStart.size() - 1;
+                if (token[0] == 'g' && isSpace(token[1])) {
+                    command.type = ObjCommand::GROUP;
+                } else if (token[0] == 'o' && isSpace(token[1])) {
+                    command.type = ObjCommand::OBJECT;
+                } else if (length > 6 && strncmp(token, "usemtl", 6) == 0 && isSpace(token[6])) {
+                    command.type = ObjCommand::USEMTL;
+                } else if (length > 6 && strncmp(token, "mtllib", 6) == 0 && isSpace(token[6])) {
+                    command.type = ObjCommand::MTLLIB;
+                } else {
+                    // comments, smoothing groups, tags and anything unknown
+                    continue;
+                }
+                command.name = parseName(token + (command.type == ObjCommand::USEMTL || command.type == ObjCommand::MTLLIB ? 7 : 2), lineEnd);
+                chunk.commands.push_back(command);
+            }
+        }
+    }
+
+    static void runParallel(gps::ThreadPool* pool, size_t count, std::function<void(size_t)> job)
+    {
+        if (pool != NULL && count > 1) {
+            pool->ParallelFor(count, job);
+        } else {
+            for (size_t i = 0; i < count; i++)
+                job(i);
+        }
+    }
+
+    // Replays the g/o/usemtl/mtllib records in file order, exactly as tinyobj::LoadObj does,
+    // to decide which faces go to which shape with which material
+    class ShapeBuilder
+    {
+    public:
+        ShapeBuilder(std::vector<ObjChunk>& chunks, std::vector<tinyobj::shape_t>& shapes,
+                     std::vector<tinyobj::material_t>* materials, std::string mtlBasePath, std::string* err)
+            : chunks(chunks), shapes(shapes), materials(materials), materialReader(mtlBasePath), err(err)
+        {
+            material = -1;
+            groupChunk = 0;
+            groupFace = 0;
+            shapeHasFaces = false;
+        }
+
+        std::vector<ObjSegment> segments;
+
+        void Run()
+        {
+            for (size_t c = 0; c < chunks.size(); c++) {
+                for (size_t i = 0; i < chunks[c].commands.size(); i++) {
+                    const ObjCommand& command = chunks[c].commands[i];
+                    if (command.type == ObjCommand::USEMTL) {
+                        std::map<std::string, int>::iterator found = materialMap.find(command.name);
+                        int newMaterial = found != materialMap.end() ? found->second : -1;
+                        if (newMaterial != material) {
+                            Export(c, command.face);
+                            material = newMaterial;
+                        }
+                    } else if (command.type == ObjCommand::MTLLIB) {
+                        std::string mtlErr;
+                        materialReader(command.name, materials, &materialMap, &mtlErr);
+                        if (err)
+                            (*err) += mtlErr;
+                    } else {
+                        // a shape is only kept if faces follow its last usemtl, as in tinyobj
+                        if (Export(c, command.face))
+                            PushShape();
+                        DropShape();
+                        name = command.name;
+                    }
+                }
+            }
+            size_t last = chunks.size() - 1;
+            if (Export(last, chunks[last].cornerStart.size() - 1) || shapeHasFaces)
+                PushShape();
+            DropShape();
+        }
+
+    private:
+        std::vector<ObjChunk>& chunks;
+        std::vector<tinyobj::shape_t>& shapes;
+        std::vector<tinyobj::material_t>* materials;
+        tinyobj::MaterialFileReader materialReader;
+        std::map<std::string, int> materialMap;
+        std::string* err;
+
+        std::string name;
+        int material;
+        // where the faces not yet exported start
+        size_t groupChunk, groupFace;
+        std::vector<ObjSegment> shapeSegments;
+        std::string shapeName;
+        bool shapeHasFaces;
+
+        bool Export(size_t chunk, size_t face)
+        {
+            bool any = false;
+            for (size_t c = groupChunk; c <= chunk; c++) {
+                ObjSegment segment;
+                segment.chunk = c;
+                segment.faceBegin = c == groupChunk ? groupFace : 0;
+                segment.faceEnd = c == chunk ? face : chunks[c].cornerStart.size() - 1;
+                segment.material = material;
+                if (segment.faceEnd > segment.faceBegin) {
+                    shapeSegments.push_back(segment);
+                    any = true;
+                }
+            }
+            groupChunk = chunk;
+            groupFace = face;
+            if (any) {
+                shapeName = name;
+                shapeHasFaces = true;
+            }
+            return any;
+        }
+
+        void PushShape()
+        {
+            shapes.push_back(tinyobj::shape_t());
+            shapes.back().name = shapeName;
+            for (size_t i = 0; i < shapeSegments.size(); i++) {
+                shapeSegments[i].shape = shapes.size() - 1;
+                segments.push_back(shapeSegments[i]);
+            }
+        }
+
+        void DropShape()
+        {
+            shapeSegments.clear();
+            shapeName.clear();
+            shapeHasFaces = false;
+        }
+    };
+
+    static void emitSegment(const ObjChunk& chunk, const ObjSegment& segment, tinyobj::mesh_t& mesh, bool triangulate)
+    {
+        tinyobj::index_t* indices = &mesh.indices[segment.indexOffset];
+        size_t faceOut = segment.faceOffset;
+
+        for (size_t f = segment.faceBegin; f < segment.faceEnd; f++) {
+            const tinyobj::index_t* face = &chunk.corners[chunk.cornerStart[f]];
+            size_t count = chunk.cornerStart[f + 1] - chunk.cornerStart[f];
+            if (triangulate) {
+                // triangle fan, like exportFaceGroupToShape
+                for (size_t k = 2; k < count; k++) {
+                    *indices++ = face[0];
+                    *indices++ = face[k - 1];
+                    *indices++ = face[k];
+                    mesh.num_face_vertices[faceOut] = 3;
+                    mesh.material_ids[faceOut++] = segment.material;
+                }
+            } else {
+                for (size_t k = 0; k < count; k++)
+                    *indices++ = face[k];
+                mesh.num_face_vertices[faceOut] = (unsigned char)count;
+                mesh.material_ids[faceOut++] = segment.material;
+            }
+        }
+    }
+
+    bool LoadObj(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                 std::vector<tinyobj::material_t>* materials, std::string* err,
+                 const char* fileName, const char* mtlBasePath, bool triangulate,
+                 gps::ThreadPool* pool, gps::Arena* arena)
+    {
+        gps::Arena localArena;
+        if (arena == NULL)
+            arena = &localArena;
+
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+
+        int file = open(fileName, O_RDONLY);
+        struct stat info;
+        if (file < 0 || fstat(file, &info) != 0) {
+            if (file >= 0)
+                close(file);
+            if (err)
+                (*err) = std::string("Cannot open file [") + fileName + "]\n";
+            return false;
+        }
+        size_t size = info.st_size;
+        void* mapping = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0) : NULL;
+        close(file);
+        if (mapping == MAP_FAILED) {
+            if (err)
+                (*err) = std::string("Cannot map file [") + fileName + "]\n";
+            return false;
+        }
+        const char* data = (const char*)mapping;
+        if (size > 0)
+            madvise(mapping, size, MADV_SEQUENTIAL);
+
+        // a few chunks per thread so uneven lines even out; boundaries move to the next line start
+        size_t threads = pool != NULL ? pool->GetThreadCount() + 1 : 1;
+        size_t chunkCount = std::max((size_t)1, std::min(size / (1024 * 1024), threads * 4));
+        std::vector<ObjChunk> chunks(chunkCount, ObjChunk(*arena));
+        const char* begin = data;
+        for (size_t c = 0; c < chunkCount; c++) {
+            const char* end = c + 1 == chunkCount ? data + size : data + size * (c + 1) / chunkCount;
+            if (end < begin)
+                end = begin;
+            if (c + 1 < chunkCount) {
+                const char* newline = (const char*)memchr(end, '\n', data + size - end);
+                end = newline != NULL ? newline + 1 : data + size;
+            }
+            chunks[c].begin = begin;
+            chunks[c].end = end;
+            begin = end;
+        }
+
+        runParallel(pool, chunkCount, [&chunks](size_t c) { parseChunk(chunks[c]); });
+
+        // prefix sums place every chunk's attributes, and resolve its relative indices
+        size_t vertexCount = 0, normalCount = 0, texcoordCount = 0;
+        for (size_t c = 0; c < chunkCount; c++) {
+            chunks[c].vertexOffset = vertexCount;
+            chunks[c].normalOffset = normalCount;
+            chunks[c].texcoordOffset = texcoordCount;
+            vertexCount += chunks[c].vertices.size();
+            normalCount += chunks[c].normals.size();
+            texcoordCount += chunks[c].texcoords.size();
+        }
+        attrib->vertices.resize(vertexCount);
+        attrib->normals.resize(normalCount);
+        attrib->texcoords.resize(texcoordCount);
+
+        runParallel(pool, chunkCount, [&chunks, attrib](size_t c) {
+            ObjChunk& chunk = chunks[c];
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(), attrib->vertices.begin() + chunk.vertexOffset);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), attrib->normals.begin() + chunk.normalOffset);
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib->texcoords.begin() + chunk.texcoordOffset);
+
+            int offsets[3] = { (int)(chunk.vertexOffset / 3), (int)(chunk.normalOffset / 3), (int)(chunk.texcoordOffset / 2) };
+            for (size_t i = 0; i < chunk.relative.size(); i++) {
+                tinyobj::index_t& corner = chunk.corners[chunk.relative[i] / 3];
+                int component = (int)(chunk.relative[i] % 3);
+                int& index = component == 0 ? corner.vertex_index : (component == 1 ? corner.normal_index : corner.texcoord_index);
+                index += offsets[component];
+            }
+        });
+
+        ShapeBuilder builder(chunks, *shapes, materials, mtlBasePath ? mtlBasePath : "", err);
+        builder.Run();
+        std::vector<ObjSegment>& segments = builder.segments;
+
+        // prefix sums over the segments of each shape give every segment its output range
+        std::vector<size_t> indexTotals(shapes->size(), 0), faceTotals(shapes->size(), 0);
+        for (size_t s = 0; s < segments.size(); s++) {
+            ObjSegment& segment = segments[s];
+            const ObjChunk& chunk = chunks[segment.chunk];
+            size_t faces = triangulate ? chunk.triangleStart[segment.faceEnd] - chunk.triangleStart[segment.faceBegin]
+                                       : segment.faceEnd - segment.faceBegin;
+            size_t indices = triangulate ? faces * 3 : chunk.cornerStart[segment.faceEnd] - chunk.cornerStart[segment.faceBegin];
+            segment.indexOffset = indexTotals[segment.shape];
+            segment.faceOffset = faceTotals[segment.shape];
+            indexTotals[segment.shape] += indices;
+            faceTotals[segment.shape] += faces;
+        }
+        for (size_t s = 0; s < shapes->size(); s++) {
+            (*shapes)[s].mesh.indices.resize(indexTotals[s]);
+            (*shapes)[s].mesh.num_face_vertices.resize(faceTotals[s]);
+            (*shapes)[s].mesh.material_ids.resize(faceTotals[s]);
+        }
+
+        runParallel(pool, segments.size(), [&](size_t s) {
+            emitSegment(chunks[segments[s].chunk], segments[s], (*shapes)[segments[s].shape].mesh, triangulate);
+        });
+
+        if (size > 0)
+            munmap(mapping, size);
+        return true;
+    }
+
+    // State shared by the tinyobj callbacks of StreamObj
+    struct ObjStream
+    {
+        const ObjStreamCallbacks* callbacks;
+        std::vector<float> vertices;
+        std::vector<float> normals;
+        std::vector<float> texcoords;
+        std::vector<tinyobj::material_t> materials;
+        // -2 until the first mesh begins
+        int materialId;
+        gps::Vertex* chunk;
+        size_t count;
+        bool stopped;
+    };
+
+    static void flushChunk(ObjStream& stream)
+    {
+        // an empty chunk still goes back to its owner
+        if (stream.chunk != NULL)
+            stream.callbacks->submitChunk(stream.chunk, stream.count);
+        stream.chunk = NULL;
+        stream.count = 0;
+    }
+
+    static void beginMesh(ObjStream& stream, int materialId)
+    {
+        flushChunk(stream);
+        stream.materialId = materialId;
+        bool known = materialId >= 0 && materialId < (int)stream.materials.size();
+        stream.callbacks->beginMesh(known ? &stream.materials[materialId] : NULL);
+    }
+
+    // Zero based index from a raw OBJ index, -1 when the corner has none
+    static inline int resolveIndex(int index, size_t count)
+    {
+        if (index > 0)
+            return index - 1;
+        return index < 0 ? (int)count + index : -1;
+    }
+
+    static void emitCorner(ObjStream& stream, const tinyobj::index_t& corner)
+    {
+        if (stream.chunk == NULL) {
+            stream.chunk = stream.callbacks->acquireChunk();
+            stream.stopped = stream.chunk == NULL;
+            if (stream.stopped)
+                return;
+        }
+
+        gps::Vertex& vertex = stream.chunk[stream.count++];
+        int v = resolveIndex(corner.vertex_index, stream.vertices.size() / 3);
+        int n = resolveIndex(corner.normal_index, stream.normals.size() / 3);
+        int t = resolveIndex(corner.texcoord_index, stream.texcoords.size() / 2);
+        vertex.Position = v >= 0 && (size_t)v * 3 < stream.vertices.size()
+            ? glm::vec3(stream.vertices[v * 3], stream.vertices[v * 3 + 1], stream.vertices[v * 3 + 2]) : glm::vec3(0.0f);
+        vertex.Normal = n >= 0 && (size_t)n * 3 < stream.normals.size()
+            ? glm::vec3(stream.normals[n * 3], stream.normals[n * 3 + 1], stream.normals[n * 3 + 2]) : glm::vec3(0.0f);
+        vertex.TexCoords = t >= 0 && (size_t)t * 2 < stream.texcoords.size()
+            ? glm::vec2(stream.texcoords[t * 2], stream.texcoords[t * 2 + 1]) : glm::vec2(0.0f);
+
+        if (stream.count == objChunkVertices)
+            flushChunk(stream);
+    }
+
+    static void streamVertex(void* data, float x, float y, float z, float)
+    {
+        ObjStream& stream = *(ObjStream*)data;
+        stream.vertices.push_back(x);
+        stream.vertices.push_back(y);
+        stream.vertices.push_back(z);
+    }
+
+    static void streamNormal(void* data, float x, float y, float z)
+    {
+        ObjStream& stream = *(ObjStream*)data;
+        stream.normals.push_back(x);
+        stream.normals.push_back(y);
+        stream.normals.push_back(z);
+    }
+
+    static void streamTexcoord(void* data, float x, float y, float)
+    {
+        ObjStream& stream = *(ObjStream*)data;
+        stream.texcoords.push_back(x);
+        stream.texcoords.push_back(y);
+    }
+
+    static void streamFace(void* data, tinyobj::index_t* corners, int count)
+    {
+        ObjStream& stream = *(ObjStream*)data;
+        if (stream.stopped)
+            return;
+        if (stream.materialId == -2)
+            beginMesh(stream, -1);
+
+        // triangles never straddle two chunks, so every chunk can be drawn on its own
+        for (int k = 2; k < count && !stream.stopped; k++) {
+            if (stream.chunk != NULL && stream.count + 3 > objChunkVertices)
+                flushChunk(stream);
+            emitCorner(stream, corners[0]);
+            emitCorner(stream, corners[k - 1]);
+            emitCorner(stream, corners[k]);
+        }
+    }
+
+    static void streamUsemtl(void* data, const char*, int materialId)
+    {
+        ObjStream& stream = *(ObjStream*)data;
+        if (!stream.stopped && materialId != stream.materialId)
+            beginMesh(stream, materialId);
+    }
+
+    static void streamMtllib(void* data, const tinyobj::material_t* materials, int count)
+    {
+        ObjStream& stream = *(ObjStream*)data;
+        stream.materials.assign(materials, materials + count);
+    }
+
+    // tinyobj's callback loader gives up on a missing .mtl and cannot pass on an empty one;
+    // LoadObj only warns, so do the same
+    class LenientMaterialReader : public tinyobj::MaterialReader
+    {
+    public:
+        explicit LenientMaterialReader(const std::string& basePath) : reader(basePath) {}
+
+        virtual bool operator()(const std::string& name, std::vector<tinyobj::material_t>* materials,
+                                std::map<std::string, int>* materialMap, std::string* err)
+        {
+            reader(name, materials, materialMap, err);
+            // unreachable through the map, it only keeps the array non-empty
+            if (materials->empty())
+                materials->push_back(tinyobj::material_t());
+            return true;
+        }
+
+    private:
+        tinyobj::MaterialFileReader reader;
+    };
+
+    bool StreamObj(const char* fileName, const char* mtlBasePath, const ObjStreamCallbacks& callbacks,
+                   std::string* err)
+    {
+        std::ifstream file(fileName);
+        if (!file) {
+            if (err)
+                *err = std::string("Cannot open file [") + fileName + "]\n";
+            return false;
+        }
+
+        ObjStream stream;
+        stream.callbacks = &callbacks;
+        stream.materialId = -2;
+        stream.chunk = NULL;
+        stream.count = 0;
+        stream.stopped = false;
+
+        tinyobj::callback_t callback;
+        callback.vertex_cb = streamVertex;
+        callback.normal_cb = streamNormal;
+        callback.texcoord_cb = streamTexcoord;
+        callback.index_cb = streamFace;
+        callback.usemtl_cb = streamUsemtl;
+        callback.mtllib_cb = streamMtllib;
+
+        LenientMaterialReader materialReader(mtlBasePath ? mtlBasePath : "");
+        bool ok = tinyobj::LoadObjWithCallback(file, callback, &stream, &materialReader, err);
+        flushChunk(stream);
+        return ok && !stream.stopped;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef ObjLoader_hpp
+#define ObjLoader_hpp
+
+#include "Arena.hpp"
+#include "Mesh.hpp"
+#include "ThreadPool.hpp"
+#include "tiny_obj_loader.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Multithreaded replacement for tinyobj::LoadObj with the same arguments and output.
+    // The file is memory mapped and cut into line aligned chunks; v/vn/vt/f records are
+    // parsed on the pool and the per-chunk results are stitched together with prefix sums.
+    // g, o, usemtl and mtllib behave as in tinyobj, including relative indices; 't' tags are
+    // skipped. pool may be NULL, then everything runs on the calling thread. The per-chunk
+    // temporaries come from arena, which the caller resets after the model; NULL uses a
+    // private one.
+    bool LoadObj(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                 std::vector<tinyobj::material_t>* materials, std::string* err,
+                 const char* fileName, const char* mtlBasePath, bool triangulate,
+                 gps::ThreadPool* pool, gps::Arena* arena = NULL);
+
+    // Vertices per chunk handed out by StreamObj (1 MB)
+    const size_t objChunkVertices = 32768;
+
+    // Where StreamObj sends its output
+    struct ObjStreamCallbacks
+    {
+        // Called before the first triangle and at every change of material; material is NULL
+        // when the faces have none. Later chunks belong to the new mesh.
+        std::function<void(const tinyobj::material_t* material)> beginMesh;
+        // Returns room for objChunkVertices vertices, may block until a chunk is free;
+        // NULL stops the parse
+        std::function<gps::Vertex*()> acquireChunk;
+        // Hands over a chunk holding count vertices, three per triangle
+        std::function<void(gps::Vertex* chunk, size_t count)> submitChunk;
+    };
+
+    // Parses the file with tinyobj::LoadObjWithCallback and streams de-indexed, fan triangulated
+    // vertices out in fixed size chunks, so the faces are never held in memory as a whole. Only
+    // the v/vn/vt pools the indices refer to are kept. Corners without a normal or texture
+    // coordinate get zeros.
+    bool StreamObj(const char* fileName, const char* mtlBasePath, const ObjStreamCallbacks& callbacks,
+                   std::string* err);
+}
+
+#endif /* ObjLoader_hpp */
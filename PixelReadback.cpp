@@ -0,0 +1,122 @@
+#include "PixelReadback.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+namespace gps {
+
+    PixelReadback::PixelReadback(int buffers) : first(0), pending(0), stalls(0)
+    {
+        slots.resize(std::max(buffers, 1));
+        for (size_t i = 0; i < slots.size(); i++) {
+            slots[i].buffer = 0;
+            slots[i].size = 0;
+            slots[i].fence = 0;
+        }
+    }
+
+    void PixelReadback::Init()
+    {
+        for (size_t i = 0; i < slots.size(); i++)
+            glGenBuffers(1, &slots[i].buffer);
+    }
+
+    void PixelReadback::Delete()
+    {
+        Flush();
+        for (size_t i = 0; i < slots.size(); i++) {
+            glDeleteBuffers(1, &slots[i].buffer);
+            slots[i].buffer = 0;
+            slots[i].size = 0;
+        }
+    }
+
+    void PixelReadback::Finish(Slot& slot)
+    {
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        size_t size = (size_t)slot.width * slot.height * 4;
+        std::vector<unsigned char> pixels(size);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        // copied out so the buffer can take the next read while the pixels are encoded
+        const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (mapped != NULL) {
+            memcpy(pixels.data(), mapped, size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else
+            pixels.clear();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        gps::ReadbackDone done = slot.done;
+        slot.done = nullptr;
+        first = (first + 1) % (int)slots.size();
+        pending--;
+        // a failed read still reports back, so whoever waits for it can move on
+        if (done)
+            done(pixels, slot.width, slot.height);
+    }
+
+    void PixelReadback::Read(int width, int height, gps::ReadbackDone done)
+    {
+        Poll();
+        if (IsFull()) {
+            Slot& oldest = slots[first];
+            glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            Finish(oldest);
+            stalls++;
+        }
+
+        Slot& slot = slots[(first + pending) % slots.size()];
+        size_t size = (size_t)width * height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        if (size > slot.size) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+            slot.size = size;
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // a fence the driver has not submitted yet never signals to Poll
+        glFlush();
+        slot.width = width;
+        slot.height = height;
+        slot.done = done;
+        pending++;
+    }
+
+    void PixelReadback::Poll()
+    {
+        while (pending > 0) {
+            Slot& oldest = slots[first];
+            GLenum status = glClientWaitSync(oldest.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            Finish(oldest);
+        }
+    }
+
+    void PixelReadback::Flush()
+    {
+        while (pending > 0) {
+            Slot& oldest = slots[first];
+            glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            Finish(oldest);
+        }
+    }
+
+    int PixelReadback::GetPending()
+    {
+        return pending;
+    }
+
+    bool PixelReadback::IsFull()
+    {
+        return pending == (int)slots.size();
+    }
+
+    int PixelReadback::GetStalls()
+    {
+        return stalls;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef PixelReadback_hpp
+#define PixelReadback_hpp
+
+#include <GL/glew.h>
+
+#include <functional>
+#include <stddef.h>
+#include <vector>
+
+namespace gps {
+
+    // Receives the RGBA rows of a finished read, bottom row first; the vector may be moved from,
+    // and is empty when the buffer could not be mapped
+    typedef std::function<void(std::vector<unsigned char>& pixels, int width, int height)> ReadbackDone;
+
+    // Reads framebuffers back through a ring of pixel pack buffers. Read only queues the copy
+    // into a buffer and a fence; Poll maps the buffers whose fences have signalled, a frame or
+    // more later, so the GL thread only waits for the GPU when every buffer is still in
+    // flight. Reads finish in the order they were queued. GL thread only.
+    class PixelReadback
+    {
+    public:
+        explicit PixelReadback(int buffers = 3);
+
+        void Init();
+        void Delete();
+
+        // Queues a read of width x height RGBA pixels of the bound read framebuffer; done runs
+        // from a later Poll, Read or Flush. Waits for the oldest read if the ring is full.
+        void Read(int width, int height, gps::ReadbackDone done);
+        // Finishes the reads the GPU is done with
+        void Poll();
+        // Finishes every read, waiting for the GPU
+        void Flush();
+
+        // Reads queued and not finished yet
+        int GetPending();
+        bool IsFull();
+        // Reads that had to wait for the GPU because the ring was full
+        int GetStalls();
+
+    private:
+        struct Slot
+        {
+            GLuint buffer;
+            size_t size;
+            GLsync fence;
+            int width;
+            int height;
+            gps::ReadbackDone done;
+        };
+
+        std::vector<Slot> slots;
+        // oldest read in flight, and how many are
+        int first;
+        int pending;
+        int stalls;
+
+        void Finish(Slot& slot);
+    };
+}
+
+#endif /* PixelReadback_hpp */
@@ -0,0 +1,351 @@
+#include "PngFile.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace gps {
+
+    static const uint32_t* GetCrcTable()
+    {
+        static uint32_t table[256];
+        static bool built = []() {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            return true;
+        }();
+        (void)built;
+        return table;
+    }
+
+    static uint32_t Crc32(uint32_t crc, const unsigned char* data, size_t size)
+    {
+        const uint32_t* table = GetCrcTable();
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static uint32_t Adler32(const unsigned char* data, size_t size)
+    {
+        uint32_t a = 1, b = 0;
+        while (size > 0) {
+            // the largest run whose sums cannot overflow before the modulo
+            size_t run = size < 5552 ? size : 5552;
+            size -= run;
+            for (size_t i = 0; i < run; i++) {
+                a += *data++;
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    static void PutBigEndian(std::vector<unsigned char>& out, uint32_t value)
+    {
+        out.push_back((unsigned char)(value >> 24));
+        out.push_back((unsigned char)(value >> 16));
+        out.push_back((unsigned char)(value >> 8));
+        out.push_back((unsigned char)value);
+    }
+
+    // Deflate output: values go in least significant bit first, Huffman codes most significant first
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<unsigned char>& out) : out(out), bits(0), count(0) {}
+
+        void Write(uint32_t value, int length)
+        {
+            bits |= value << count;
+            count += length;
+            while (count >= 8) {
+                out.push_back((unsigned char)bits);
+                bits >>= 8;
+                count -= 8;
+            }
+        }
+
+        void Flush()
+        {
+            if (count > 0)
+                out.push_back((unsigned char)bits);
+            bits = 0;
+            count = 0;
+        }
+
+    private:
+        std::vector<unsigned char>& out;
+        uint32_t bits;
+        int count;
+    };
+
+    static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                          1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const int distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    static uint32_t ReverseBits(uint32_t code, int length)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++)
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        return reversed;
+    }
+
+    // The fixed Huffman code, bit reversed for the writer, and the length code of every match length
+    struct FixedCodes
+    {
+        uint16_t symbols[288];
+        uint8_t symbolLengths[288];
+        uint16_t distances[30];
+        uint8_t lengthCodes[259];
+
+        FixedCodes()
+        {
+            for (int symbol = 0; symbol < 288; symbol++) {
+                if (symbol < 144)
+                    Set(symbol, 0x30 + symbol, 8);
+                else if (symbol < 256)
+                    Set(symbol, 0x190 + symbol - 144, 9);
+                else if (symbol < 280)
+                    Set(symbol, symbol - 256, 7);
+                else
+                    Set(symbol, 0xC0 + symbol - 280, 8);
+            }
+            for (int code = 0; code < 30; code++)
+                distances[code] = (uint16_t)ReverseBits(code, 5);
+            for (int length = 3, code = 0; length <= 258; length++) {
+                while (code < 28 && lengthBase[code + 1] <= length)
+                    code++;
+                lengthCodes[length] = (uint8_t)code;
+            }
+        }
+
+        void Set(int symbol, uint32_t code, int length)
+        {
+            symbols[symbol] = (uint16_t)ReverseBits(code, length);
+            symbolLengths[symbol] = (uint8_t)length;
+        }
+    };
+
+    static const FixedCodes fixedCodes;
+
+    static void WriteSymbol(BitWriter& writer, int symbol)
+    {
+        writer.Write(fixedCodes.symbols[symbol], fixedCodes.symbolLengths[symbol]);
+    }
+
+    static void WriteMatch(BitWriter& writer, int length, int distance)
+    {
+        int code = fixedCodes.lengthCodes[length];
+        WriteSymbol(writer, 257 + code);
+        writer.Write(length - lengthBase[code], lengthExtra[code]);
+        code = 29;
+        while (distanceBase[code] > distance)
+            code--;
+        writer.Write(fixedCodes.distances[code], 5);
+        writer.Write(distance - distanceBase[code], distanceExtra[code]);
+    }
+
+    // One final block with the fixed codes; matches are the longest of a few hash chain candidates
+    static void Deflate(const unsigned char* data, size_t size, std::vector<unsigned char>& out)
+    {
+        const int windowSize = 32768;
+        const int hashBits = 15;
+        const int maxChain = 16;
+        const int maxLength = 258;
+        std::vector<int> head((size_t)1 << hashBits, -1);
+        std::vector<int> previous(windowSize, -1);
+
+        BitWriter writer(out);
+        writer.Write(1, 1);
+        writer.Write(1, 2);
+
+        size_t i = 0;
+        auto hashAt = [&](size_t position) {
+            uint32_t value = data[position] | (data[position + 1] << 8) | (data[position + 2] << 16);
+            return (value * 2654435761u) >> (32 - hashBits);
+        };
+        auto insert = [&](size_t position) {
+            if (position + 3 > size)
+                return;
+            uint32_t hash = hashAt(position);
+            previous[position & (windowSize - 1)] = head[hash];
+            head[hash] = (int)position;
+        };
+
+        while (i < size) {
+            int bestLength = 0, bestDistance = 0;
+            if (i + 3 <= size) {
+                int limit = (int)(size - i < (size_t)maxLength ? size - i : maxLength);
+                int candidate = head[hashAt(i)];
+                for (int chain = 0; chain < maxChain && candidate >= 0; chain++) {
+                    int distance = (int)(i - candidate);
+                    if (distance > windowSize)
+                        break;
+                    const unsigned char* a = data + candidate;
+                    const unsigned char* b = data + i;
+                    if (a[bestLength] == b[bestLength]) {
+                        int length = 0;
+                        while (length < limit && a[length] == b[length])
+                            length++;
+                        if (length > bestLength) {
+                            bestLength = length;
+                            bestDistance = distance;
+                            if (length == limit)
+                                break;
+                        }
+                    }
+                    int next = previous[candidate & (windowSize - 1)];
+                    // the slot may have been reused by a newer position
+                    if (next >= candidate)
+                        break;
+                    candidate = next;
+                }
+            }
+            if (bestLength >= 3) {
+                WriteMatch(writer, bestLength, bestDistance);
+                for (int k = 0; k < bestLength; k++)
+                    insert(i + k);
+                i += bestLength;
+            } else {
+                WriteSymbol(writer, data[i]);
+                insert(i);
+                i++;
+            }
+        }
+        WriteSymbol(writer, 256);
+        writer.Flush();
+    }
+
+    static int Paeth(int a, int b, int c)
+    {
+        int p = a + b - c;
+        int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return a;
+        return pb <= pc ? b : c;
+    }
+
+    static void AppendChunk(std::vector<unsigned char>& png, const char* type, const unsigned char* data, size_t size)
+    {
+        PutBigEndian(png, (uint32_t)size);
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data, data + size);
+        PutBigEndian(png, Crc32(0, png.data() + start, size + 4));
+    }
+
+    void EncodePng(const unsigned char* pixels, int width, int height, int channels, std::vector<unsigned char>& png,
+                   bool flipRows, bool dropAlpha)
+    {
+        int outChannels = dropAlpha && (channels == 2 || channels == 4) ? channels - 1 : channels;
+        size_t rowBytes = (size_t)width * outChannels;
+
+        // filter type byte, then the residuals of each row
+        std::vector<unsigned char> filtered((rowBytes + 1) * height);
+        std::vector<unsigned char> current(rowBytes), above(rowBytes, 0), candidate(rowBytes), best(rowBytes);
+        for (int y = 0; y < height; y++) {
+            const unsigned char* source = pixels + (size_t)(flipRows ? height - 1 - y : y) * width * channels;
+            if (outChannels == channels) {
+                memcpy(current.data(), source, rowBytes);
+            } else {
+                for (int x = 0; x < width; x++)
+                    memcpy(&current[(size_t)x * outChannels], source + (size_t)x * channels, outChannels);
+            }
+
+            long long bestSum = -1;
+            int bestFilter = 0;
+            for (int filter = 0; filter < 5; filter++) {
+                // the first pixel has nothing to its left
+                for (int i = 0; i < outChannels; i++) {
+                    int up = above[i];
+                    int prediction = filter == 2 || filter == 4 ? up : filter == 3 ? up >> 1 : 0;
+                    candidate[i] = (unsigned char)(current[i] - prediction);
+                }
+                const unsigned char* row = current.data();
+                const unsigned char* up = above.data();
+                unsigned char* residual = candidate.data();
+                switch (filter) {
+                case 0:
+                    memcpy(residual, row, rowBytes);
+                    break;
+                case 1:
+                    for (size_t i = outChannels; i < rowBytes; i++)
+                        residual[i] = (unsigned char)(row[i] - row[i - outChannels]);
+                    break;
+                case 2:
+                    for (size_t i = outChannels; i < rowBytes; i++)
+                        residual[i] = (unsigned char)(row[i] - up[i]);
+                    break;
+                case 3:
+                    for (size_t i = outChannels; i < rowBytes; i++)
+                        residual[i] = (unsigned char)(row[i] - ((row[i - outChannels] + up[i]) >> 1));
+                    break;
+                case 4:
+                    for (size_t i = outChannels; i < rowBytes; i++)
+                        residual[i] = (unsigned char)(row[i] - Paeth(row[i - outChannels], up[i], up[i - outChannels]));
+                    break;
+                }
+                long long sum = 0;
+                for (size_t i = 0; i < rowBytes; i++)
+                    sum += residual[i] < 128 ? residual[i] : 256 - residual[i];
+                if (bestSum < 0 || sum < bestSum) {
+                    bestSum = sum;
+                    bestFilter = filter;
+                    best.swap(candidate);
+                }
+            }
+            unsigned char* row = &filtered[(rowBytes + 1) * y];
+            row[0] = (unsigned char)bestFilter;
+            memcpy(row + 1, best.data(), rowBytes);
+            above.swap(current);
+        }
+
+        std::vector<unsigned char> compressed;
+        compressed.reserve(filtered.size() / 2);
+        // zlib header: deflate with a 32 KB window, no preset dictionary
+        compressed.push_back(0x78);
+        compressed.push_back(0x01);
+        Deflate(filtered.data(), filtered.size(), compressed);
+        PutBigEndian(compressed, Adler32(filtered.data(), filtered.size()));
+
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        static const unsigned char colorTypes[5] = { 0, 0, 4, 2, 6 };
+        png.assign(signature, signature + 8);
+        std::vector<unsigned char> header;
+        PutBigEndian(header, (uint32_t)width);
+        PutBigEndian(header, (uint32_t)height);
+        header.push_back(8);
+        header.push_back(colorTypes[outChannels]);
+        // deflate, adaptive filtering, no interlacing
+        header.push_back(0);
+        header.push_back(0);
+        header.push_back(0);
+        AppendChunk(png, "IHDR", header.data(), header.size());
+        AppendChunk(png, "IDAT", compressed.data(), compressed.size());
+        AppendChunk(png, "IEND", NULL, 0);
+    }
+
+    bool WritePng(const std::string& fileName, const unsigned char* pixels, int width, int height, int channels,
+                  bool flipRows, bool dropAlpha)
+    {
+        std::vector<unsigned char> png;
+        EncodePng(pixels, width, height, channels, png, flipRows, dropAlpha);
+        FILE* file = fopen(fileName.c_str(), "wb");
+        if (file == NULL)
+            return false;
+        bool written = fwrite(png.data(), 1, png.size(), file) == png.size();
+        return fclose(file) == 0 && written;
+    }
+}
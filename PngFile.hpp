@@ -0,0 +1,21 @@
+#ifndef PngFile_hpp
+#define PngFile_hpp
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Encodes 8 bit gray, RGB or RGBA pixels (channels 1, 3 or 4, rows packed) as a PNG. Each
+    // row takes the filter with the smallest sum of residuals, then the filtered rows are
+    // deflated with greedy LZ77 and the fixed Huffman codes: a few times larger than zlib's
+    // best, but fast and with no dependency. flipRows writes the last row first, for GL
+    // readbacks; dropAlpha writes RGBA input as RGB. Safe to call from any thread.
+    void EncodePng(const unsigned char* pixels, int width, int height, int channels, std::vector<unsigned char>& png,
+                   bool flipRows = false, bool dropAlpha = false);
+
+    bool WritePng(const std::string& fileName, const unsigned char* pixels, int width, int height, int channels,
+                  bool flipRows = false, bool dropAlpha = false);
+}
+
+#endif /* PngFile_hpp */
@@ -0,0 +1,90 @@
+#include "ResolutionController.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    ResolutionController::ResolutionController(gps::ResolutionOptions options) : options(options), changes(0), skip(0), windowSum(0.0), windowCount(0),
+        lastAverage(0.0), lastScale(0.0f)
+    {
+        this->options.minScale = std::max(options.minScale, 0.05f);
+        this->options.maxScale = std::max(options.maxScale, this->options.minScale);
+        this->options.windowFrames = std::max(options.windowFrames, 1);
+        scale = this->options.maxScale;
+    }
+
+    void ResolutionController::AddFrameTime(double milliseconds)
+    {
+        gps::ResolutionSample sample;
+        sample.milliseconds = milliseconds;
+        sample.scale = scale;
+        history.push_back(sample);
+        while ((int)history.size() > options.historyLength)
+            history.pop_front();
+
+        if (skip > 0) {
+            skip--;
+            return;
+        }
+        windowSum += milliseconds;
+        if (++windowCount < options.windowFrames)
+            return;
+        double average = std::max(windowSum / windowCount, 1e-3);
+        windowSum = 0.0;
+        windowCount = 0;
+        double previousAverage = lastAverage;
+        float previousScale = lastScale;
+        lastAverage = average;
+        lastScale = scale;
+
+        double limit = options.budgetMilliseconds * (1.0 - options.margin);
+        bool over = average > limit;
+        bool under = average < options.budgetMilliseconds * options.headroom && scale < options.maxScale;
+        if (!over && !under)
+            return;
+        double target = (limit + options.budgetMilliseconds * options.headroom) * 0.5;
+        // time = fixed + perPixel * scale^2 through both windows, unless the load changed in
+        // between so much the fit makes no sense
+        double area = (double)scale * scale;
+        double previousArea = (double)previousScale * previousScale;
+        double perPixel = average / area;
+        double fixed = 0.0;
+        if (previousScale > 0.0f && std::fabs(area - previousArea) > 0.01) {
+            double slope = (average - previousAverage) / (area - previousArea);
+            double intercept = average - slope * area;
+            if (slope > 0.0 && intercept >= 0.0 && intercept < target) {
+                perPixel = slope;
+                fixed = intercept;
+            }
+        }
+        float next = (float)std::sqrt(std::max(target - fixed, 0.0) / perPixel);
+        next = std::min(next, scale + options.maxStepUp);
+        next = std::min(std::max(next, options.minScale), options.maxScale);
+        if (next == scale)
+            return;
+        scale = next;
+        changes++;
+        skip = options.settleFrames;
+    }
+
+    float ResolutionController::GetScale()
+    {
+        return scale;
+    }
+
+    int ResolutionController::GetChangeCount()
+    {
+        return changes;
+    }
+
+    const std::deque<gps::ResolutionSample>& ResolutionController::GetHistory()
+    {
+        return history;
+    }
+
+    gps::ResolutionOptions ResolutionController::GetOptions()
+    {
+        return options;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef ResolutionController_hpp
+#define ResolutionController_hpp
+
+#include <deque>
+
+namespace gps {
+
+    struct ResolutionOptions
+    {
+        // GPU milliseconds a frame should take
+        double budgetMilliseconds = 15.0;
+        // share of the budget left for frame to frame noise: averages above the rest shrink the scale
+        double margin = 0.1;
+        // share of the budget under which the scale grows again; in between the scale holds,
+        // so it does not flip back and forth
+        double headroom = 0.75;
+        // of the window's width and height
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+        // largest step up at once, so a cheap view does not jump straight to full resolution
+        float maxStepUp = 0.1f;
+        // frames averaged before each decision
+        int windowFrames = 8;
+        // frame times ignored after a change: those frames were queued at the old scale
+        int settleFrames = 5;
+        int historyLength = 240;
+    };
+
+    struct ResolutionSample
+    {
+        double milliseconds;
+        // the scale when the time arrived
+        float scale;
+    };
+
+    // Picks the resolution scale of the scene from measured frame times. Frame time is
+    // modelled as a fixed part plus a part proportional to the pixels drawn; when the average
+    // of a window of frames leaves the band the scale is aimed at the middle of it, with the
+    // model fitted through the last two windows, or all of the time taken as per pixel before
+    // there are two. No GL calls, so the benchmarks can check it.
+    class ResolutionController
+    {
+    public:
+        explicit ResolutionController(gps::ResolutionOptions options = gps::ResolutionOptions());
+
+        // Adds the time of one frame, oldest first
+        void AddFrameTime(double milliseconds);
+
+        float GetScale();
+        // changes of scale so far
+        int GetChangeCount();
+        // the last historyLength frame times, oldest first
+        const std::deque<gps::ResolutionSample>& GetHistory();
+        gps::ResolutionOptions GetOptions();
+
+    private:
+        gps::ResolutionOptions options;
+        float scale;
+        int changes;
+        int skip;
+        double windowSum;
+        int windowCount;
+        // average and scale of the window before, for the fit
+        double lastAverage;
+        float lastScale;
+        std::deque<gps::ResolutionSample> history;
+    };
+}
+
+#endif /* ResolutionController_hpp */
@@ -0,0 +1,103 @@
+#include "RingAllocator.hpp"
+
+namespace gps {
+
+    RingAllocator::RingAllocator(size_t capacity)
+    {
+        Reset(capacity);
+    }
+
+    void RingAllocator::Reset(size_t capacity)
+    {
+        this->capacity = capacity;
+        head = 0;
+        tail = 0;
+        empty = true;
+        openRanges = false;
+        submissions.clear();
+    }
+
+    bool RingAllocator::Allocate(size_t size, size_t alignment, size_t& offset)
+    {
+        if (size == 0 || size > capacity)
+            return false;
+
+        if (empty) {
+            head = 0;
+            tail = 0;
+        }
+
+        size_t aligned = (head + alignment - 1) / alignment * alignment;
+
+        if (empty || head > tail) {
+            // free space is [head, capacity) followed by [0, tail)
+            if (aligned + size <= capacity)
+                offset = aligned;
+            else if (!empty && size <= tail)
+                offset = 0;
+            else
+                return false;
+        } else if (head < tail) {
+            // free space is [head, tail)
+            if (aligned + size <= tail)
+                offset = aligned;
+            else
+                return false;
+        } else {
+            // head caught up with tail: every byte is in flight
+            return false;
+        }
+
+        head = offset + size;
+        empty = false;
+        openRanges = true;
+        return true;
+    }
+
+    void RingAllocator::Submit(uint64_t fence)
+    {
+        if (!openRanges)
+            return;
+
+        Submission submission;
+        submission.fence = fence;
+        submission.end = head;
+        submissions.push_back(submission);
+        openRanges = false;
+    }
+
+    void RingAllocator::Retire(std::function<bool(uint64_t)> isSignaled)
+    {
+        while (!submissions.empty() && isSignaled(submissions.front().fence)) {
+            tail = submissions.front().end;
+            submissions.pop_front();
+        }
+
+        if (submissions.empty() && !openRanges)
+            empty = true;
+    }
+
+    size_t RingAllocator::GetCapacity()
+    {
+        return capacity;
+    }
+
+    size_t RingAllocator::GetUsedBytes()
+    {
+        if (empty)
+            return 0;
+        if (head > tail)
+            return head - tail;
+        return capacity - tail + head;
+    }
+
+    size_t RingAllocator::GetPendingSubmissions()
+    {
+        return submissions.size();
+    }
+
+    bool RingAllocator::HasOpenRanges()
+    {
+        return openRanges;
+    }
+}
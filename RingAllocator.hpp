@@ -0,0 +1,51 @@
+#ifndef RingAllocator_hpp
+#define RingAllocator_hpp
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <stdint.h>
+
+namespace gps {
+
+    // Hands out byte ranges of a fixed size ring in FIFO order. Ranges are grouped
+    // into submissions tagged with a fence handle and only become reusable once the
+    // fence is reported signalled. Knows nothing about OpenGL, fences are opaque ids.
+    class RingAllocator
+    {
+    public:
+        explicit RingAllocator(size_t capacity = 0);
+
+        void Reset(size_t capacity);
+        // Returns false when the free space cannot fit the request right now
+        bool Allocate(size_t size, size_t alignment, size_t& offset);
+        // Tags every range allocated since the previous Submit with the fence
+        void Submit(uint64_t fence);
+        // Frees submissions oldest first for as long as isSignaled returns true
+        void Retire(std::function<bool(uint64_t)> isSignaled);
+
+        size_t GetCapacity();
+        size_t GetUsedBytes();
+        size_t GetPendingSubmissions();
+        // True when ranges were handed out since the previous Submit
+        bool HasOpenRanges();
+
+    private:
+        struct Submission
+        {
+            uint64_t fence;
+            // offset just past the last range of the submission
+            size_t end;
+        };
+
+        size_t capacity;
+        size_t head;
+        size_t tail;
+        bool empty;
+        // ranges handed out but not yet covered by a fence
+        bool openRanges;
+        std::deque<Submission> submissions;
+    };
+}
+
+#endif /* RingAllocator_hpp */
@@ -1,6 +1,13 @@
 #include "Shader.hpp"
 
+#include <chrono>
+#include <vector>
+
 namespace gps {
+    gps::ShaderOptions Shader::options;
+    gps::ShaderStats Shader::stats;
+    bool Shader::parallelCompileAvailable = false;
+
     std::string Shader::readShaderFile(std::string fileName)
     {
         std::ifstream shaderFile;
@@ -44,42 +51,325 @@ namespace gps {
         //check linking info
         glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &success);
         if(!success) {
-            glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+            glGetProgramInfoLog(shaderProgramId, 512, NULL, infoLog);
             std::cout << "Shader linking error\n" << infoLog << std::endl;
         }
     }
 
-    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
-    {
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
-
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
+    std::string Shader::addDefines(std::string source, std::string defines)
+    {
+        //the #version line has to stay first
+        size_t position = 0;
+        if (source.compare(0, 8, "#version") == 0) {
+            position = source.find('\n');
+            position = position == std::string::npos ? source.size() : position + 1;
+        }
+        return source.insert(position, defines);
+    }
+
+    std::string Shader::getFeatureDefines(unsigned features)
+    {
+        std::string defines;
+        if (features & SHADER_FOG)
+            defines += "#define FOG\n";
+        if (features & SHADER_POINT_LIGHT)
+            defines += "#define POINT_LIGHT\n";
+        if (features & SHADER_CLIP_PLANE)
+            defines += "#define CLIP_PLANE\n";
+        if (features & SHADER_DEPTH_ONLY)
+            defines += "#define DEPTH_ONLY\n";
+        if (features & SHADER_OVERDRAW)
+            defines += "#define OVERDRAW\n";
+        if (features & SHADER_CLUSTERED_LIGHTS)
+            defines += "#define CLUSTERED_LIGHTS\n";
+        if (features & SHADER_SHADOWS)
+            defines += "#define SHADOWS\n";
+        return defines;
+    }
+
+    void Shader::beginProgram(std::string vertexSource, std::string fragmentSource, std::string defines, Variant& variant)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<std::string> sources;
+        sources.push_back(addDefines(vertexSource, defines));
+        sources.push_back(addDefines(fragmentSource, defines));
+
+        variant.cacheKey = options.cache ? ShaderCache::GetKey(sources, defines) : 0;
+        variant.program = glCreateProgram();
+        variant.vertexShader = 0;
+        variant.fragmentShader = 0;
+        variant.pending = false;
+        if (variant.cacheKey != 0 && options.cache->Load(variant.cacheKey, variant.program)) {
+            stats.cached++;
+            stats.cacheMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return;
+        }
+
+        //a rejected binary leaves the program in an unknown state, so start from a fresh one
+        if (variant.cacheKey != 0) {
+            glDeleteProgram(variant.program);
+            variant.program = glCreateProgram();
+        }
+
+        //compile both stages; status is only queried in finishProgram, so with parallel
+        //compilation the driver keeps working while other variants are started
+        const GLchar* vertexShaderString = sources[0].c_str();
+        variant.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(variant.vertexShader, 1, &vertexShaderString, NULL);
+        glCompileShader(variant.vertexShader);
+
+        const GLchar* fragmentShaderString = sources[1].c_str();
+        variant.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(variant.fragmentShader, 1, &fragmentShaderString, NULL);
+        glCompileShader(variant.fragmentShader);
 
         //attach and link the shader programs
-        this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
-        glLinkProgram(this->shaderProgram);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        //check linking info
-        shaderLinkLog(this->shaderProgram);
+        glAttachShader(variant.program, variant.vertexShader);
+        glAttachShader(variant.program, variant.fragmentShader);
+        //ask the driver to keep the binary around for the program cache
+        glProgramParameteri(variant.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(variant.program);
+        variant.pending = true;
+        variant.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void Shader::finishProgram(Variant& variant)
+    {
+        if (!variant.pending)
+            return;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        //check compilation status and linking info; these wait for the driver
+        shaderCompileLog(variant.vertexShader);
+        shaderCompileLog(variant.fragmentShader);
+        shaderLinkLog(variant.program);
+        glDetachShader(variant.program, variant.vertexShader);
+        glDetachShader(variant.program, variant.fragmentShader);
+        glDeleteShader(variant.vertexShader);
+        glDeleteShader(variant.fragmentShader);
+        variant.pending = false;
+
+        stats.compiled++;
+        stats.compileMilliseconds += variant.milliseconds +
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(variant.program, GL_LINK_STATUS, &linked);
+        if (variant.cacheKey != 0 && linked == GL_TRUE)
+            options.cache->Store(variant.cacheKey, variant.program);
+    }
+
+    bool Shader::isProgramReady(const Variant& variant)
+    {
+        if (!variant.pending || !parallelCompileAvailable)
+            return true;
+        GLint done = GL_TRUE;
+#if defined(GL_COMPLETION_STATUS_KHR)
+        glGetProgramiv(variant.program, GL_COMPLETION_STATUS_KHR, &done);
+#endif
+        return done == GL_TRUE;
+    }
+
+    void Shader::deleteProgram(Variant& variant)
+    {
+        if (variant.pending) {
+            glDeleteShader(variant.vertexShader);
+            glDeleteShader(variant.fragmentShader);
+        }
+        glDeleteProgram(variant.program);
+    }
+
+    void Shader::readSources()
+    {
+        variantSet->vertexSource = readShaderFile(variantSet->vertexFileName);
+        variantSet->fragmentSource = readShaderFile(variantSet->fragmentFileName);
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string defines)
+    {
+        //a plain shader is a variant set with a single variant, so it reloads the same way
+        loadVariants(vertexShaderFileName, fragmentShaderFileName, 0);
+        variantSet->defines = defines;
+        selectVariant(0);
+    }
+
+    void Shader::loadVariants(std::string vertexShaderFileName, std::string fragmentShaderFileName, unsigned features)
+    {
+        variantSet = std::make_shared<VariantSet>();
+        variantSet->vertexFileName = vertexShaderFileName;
+        variantSet->fragmentFileName = fragmentShaderFileName;
+        variantSet->features = features;
+        readSources();
+        currentVariant = 0;
+        this->shaderProgram = 0;
+    }
+
+    void Shader::requestVariant(unsigned features)
+    {
+        features &= variantSet->features;
+        if (variantSet->variants.count(features))
+            return;
+        Variant& variant = variantSet->variants[features];
+        beginProgram(variantSet->vertexSource, variantSet->fragmentSource, variantSet->defines + getFeatureDefines(features), variant);
+    }
+
+    void Shader::selectVariant(unsigned features)
+    {
+        features &= variantSet->features;
+        requestVariant(features);
+        Variant& variant = variantSet->variants[features];
+        finishProgram(variant);
+        currentVariant = features;
+        this->shaderProgram = variant.program;
+    }
+
+    unsigned Shader::getVariant()
+    {
+        return currentVariant;
+    }
+
+    void Shader::deleteVariants()
+    {
+        if (!variantSet)
+            return;
+        for (std::map<unsigned, Variant>::iterator it = variantSet->variants.begin(); it != variantSet->variants.end(); ++it)
+            deleteProgram(it->second);
+        for (std::map<unsigned, Variant>::iterator it = variantSet->reloading.begin(); it != variantSet->reloading.end(); ++it)
+            deleteProgram(it->second);
+        variantSet->variants.clear();
+        variantSet->reloading.clear();
+        this->shaderProgram = 0;
+    }
+
+    bool Shader::usesFile(std::string fileName)
+    {
+        if (!variantSet)
+            return false;
+        std::string names[2] = { variantSet->vertexFileName, variantSet->fragmentFileName };
+        for (int i = 0; i < 2; i++) {
+            std::string name = names[i].substr(names[i].find_last_of('/') + 1);
+            if (name == fileName)
+                return true;
+        }
+        return false;
+    }
+
+    void Shader::reload()
+    {
+        //a newer edit replaces a rebuild still in progress
+        for (std::map<unsigned, Variant>::iterator it = variantSet->reloading.begin(); it != variantSet->reloading.end(); ++it)
+            deleteProgram(it->second);
+        variantSet->reloading.clear();
+
+        readSources();
+        for (std::map<unsigned, Variant>::iterator it = variantSet->variants.begin(); it != variantSet->variants.end(); ++it) {
+            Variant& variant = variantSet->reloading[it->first];
+            beginProgram(variantSet->vertexSource, variantSet->fragmentSource,
+                         variantSet->defines + getFeatureDefines(it->first), variant);
+        }
+    }
+
+    bool Shader::updateReload()
+    {
+        if (!variantSet || variantSet->reloading.empty())
+            return false;
+        std::map<unsigned, Variant>& reloading = variantSet->reloading;
+        for (std::map<unsigned, Variant>::iterator it = reloading.begin(); it != reloading.end(); ++it) {
+            if (!isProgramReady(it->second))
+                return false;
+        }
+
+        bool linked = true;
+        for (std::map<unsigned, Variant>::iterator it = reloading.begin(); it != reloading.end(); ++it) {
+            finishProgram(it->second);
+            GLint status = GL_FALSE;
+            glGetProgramiv(it->second.program, GL_LINK_STATUS, &status);
+            linked = linked && status == GL_TRUE;
+        }
+        if (!linked) {
+            std::cout << "Keeping the previous " << variantSet->fragmentFileName << " program" << std::endl;
+            for (std::map<unsigned, Variant>::iterator it = reloading.begin(); it != reloading.end(); ++it)
+                deleteProgram(it->second);
+            reloading.clear();
+            return false;
+        }
+
+        //swap all variants at once, so passes never mix old and new shaders
+        for (std::map<unsigned, Variant>::iterator it = reloading.begin(); it != reloading.end(); ++it) {
+            Variant& old = variantSet->variants[it->first];
+            //a variant still compiling was never drawn with, so it has no uniforms to keep
+            if (!old.pending)
+                copyUniforms(old.program, it->second.program);
+            deleteProgram(old);
+            old = it->second;
+        }
+        reloading.clear();
+        if (variantSet->variants.count(currentVariant))
+            this->shaderProgram = variantSet->variants[currentVariant].program;
+        return true;
+    }
+
+    void Shader::copyUniforms(GLuint from, GLuint to)
+    {
+        //values set once at startup, like sampler units and light colours, survive the reload
+        GLint count = 0;
+        glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint u = 0; u < count; u++) {
+            GLchar name[256];
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(to, u, sizeof(name), NULL, &size, &type, name);
+            std::string baseName = name;
+            if (baseName.size() > 3 && baseName.compare(baseName.size() - 3, 3, "[0]") == 0)
+                baseName.resize(baseName.size() - 3);
+
+            for (GLint element = 0; element < size; element++) {
+                std::string elementName = size > 1 ? baseName + "[" + std::to_string(element) + "]" : baseName;
+                GLint source = glGetUniformLocation(from, elementName.c_str());
+                GLint target = glGetUniformLocation(to, elementName.c_str());
+                if (source < 0 || target < 0)
+                    continue;
+                GLfloat f[16];
+                GLint i[4];
+                switch (type) {
+                    case GL_FLOAT: glGetUniformfv(from, source, f); glProgramUniform1fv(to, target, 1, f); break;
+                    case GL_FLOAT_VEC2: glGetUniformfv(from, source, f); glProgramUniform2fv(to, target, 1, f); break;
+                    case GL_FLOAT_VEC3: glGetUniformfv(from, source, f); glProgramUniform3fv(to, target, 1, f); break;
+                    case GL_FLOAT_VEC4: glGetUniformfv(from, source, f); glProgramUniform4fv(to, target, 1, f); break;
+                    case GL_FLOAT_MAT3: glGetUniformfv(from, source, f); glProgramUniformMatrix3fv(to, target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT4: glGetUniformfv(from, source, f); glProgramUniformMatrix4fv(to, target, 1, GL_FALSE, f); break;
+                    case GL_INT:
+                    case GL_BOOL:
+                    case GL_SAMPLER_2D:
+                    case GL_SAMPLER_CUBE:
+                        glGetUniformiv(from, source, i);
+                        glProgramUniform1iv(to, target, 1, i);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    void Shader::initParallelCompile()
+    {
+        if (!options.parallelCompile)
+            return;
+        //0xFFFFFFFF lets the driver pick how many threads to use
+#if defined(GL_KHR_parallel_shader_compile)
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            parallelCompileAvailable = true;
+            return;
+        }
+#endif
+#if defined(GL_ARB_parallel_shader_compile)
+        if (GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+            parallelCompileAvailable = true;
+        }
+#endif
     }
 
     void Shader::useShaderProgram()
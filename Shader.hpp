@@ -1,27 +1,134 @@
 #ifndef Shader_hpp
 #define Shader_hpp
 
+#include "ShaderCache.hpp"
+
 #include <GL/glew.h>
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
 
 namespace gps {
 
+// Compile time features of a shader; every combination a program asks for is built as its own
+// variant with the matching #define, so disabled features cost nothing per fragment
+enum SHADER_FEATURE
+{
+    SHADER_FOG = 1 << 0,
+    SHADER_POINT_LIGHT = 1 << 1,
+    SHADER_CLIP_PLANE = 1 << 2,
+    // positions only and no color output, for a depth pre-pass
+    SHADER_DEPTH_ONLY = 1 << 3,
+    // every shaded fragment adds a constant, to count overdraw with additive blending
+    SHADER_OVERDRAW = 1 << 4,
+    // loops over the point lights of the fragment's cluster (gps::ClusteredLighting)
+    SHADER_CLUSTERED_LIGHTS = 1 << 5,
+    // the directional light is shadowed by cascaded shadow maps (gps::ShadowMaps)
+    SHADER_SHADOWS = 1 << 6
+};
+
+struct ShaderOptions
+{
+    // NULL disables the program binary cache
+    gps::ShaderCache* cache = NULL;
+    // let the driver compile requested variants on its own threads (KHR_parallel_shader_compile)
+    bool parallelCompile = true;
+};
+
+// Program build counters, for the startup report
+struct ShaderStats
+{
+    int compiled;
+    int cached;
+    double compileMilliseconds;
+    double cacheMilliseconds;
+};
+
 class Shader
 {
 public:
     GLuint shaderProgram;
-    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+    // defines are inserted after the #version line of both stages, e.g. "#define FOG\n"
+    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string defines = "");
     void useShaderProgram();
 
+    // Reads the sources of a shader with variants; features are the SHADER_FEATURE bits they
+    // understand. Nothing is compiled until a variant is requested or selected.
+    void loadVariants(std::string vertexShaderFileName, std::string fragmentShaderFileName, unsigned features);
+    // Starts building a variant without waiting for it, so several compile at once
+    void requestVariant(unsigned features);
+    // Makes a variant current in shaderProgram, building it first if needed; bits the sources
+    // do not understand are ignored. Uniforms are per program, so set them after switching.
+    void selectVariant(unsigned features);
+    unsigned getVariant();
+    void deleteVariants();
+
+    // Hot reload: whether fileName (without its directory) is one of the sources
+    bool usesFile(std::string fileName);
+    // Rereads the sources and starts rebuilding every variant built so far
+    void reload();
+    // Called between frames; once every rebuilt variant has linked it replaces the old
+    // programs, with their uniform values copied over, and returns true. If any fails to
+    // link the old programs stay. Never waits while parallel compilation is available.
+    bool updateReload();
+
+    // Hands compiles to driver threads when KHR/ARB_parallel_shader_compile is there (GL thread)
+    static void initParallelCompile();
+
+    static gps::ShaderOptions options;
+    static gps::ShaderStats stats;
+
 private:
+    // A program being built: the shaders stay alive until it is finished, for their logs
+    struct Variant
+    {
+        GLuint program;
+        GLuint vertexShader;
+        GLuint fragmentShader;
+        uint64_t cacheKey;
+        bool pending;
+        double milliseconds;
+    };
+
+    // Shared between copies, since shaders are passed around by value
+    struct VariantSet
+    {
+        std::string vertexFileName;
+        std::string fragmentFileName;
+        // loadShader's defines, ahead of the feature ones
+        std::string defines;
+        std::string vertexSource;
+        std::string fragmentSource;
+        unsigned features;
+        std::map<unsigned, Variant> variants;
+        // replacements being built by reload
+        std::map<unsigned, Variant> reloading;
+    };
+
+    std::shared_ptr<VariantSet> variantSet;
+    unsigned currentVariant = 0;
+
     std::string readShaderFile(std::string fileName);
     void shaderCompileLog(GLuint shaderId);
     void shaderLinkLog(GLuint shaderProgramId);
+    std::string addDefines(std::string source, std::string defines);
+    void readSources();
+    void deleteProgram(Variant& variant);
+    static void copyUniforms(GLuint from, GLuint to);
+    std::string getFeatureDefines(unsigned features);
+    // Loads the program from the binary cache or starts compiling and linking it
+    void beginProgram(std::string vertexSource, std::string fragmentSource, std::string defines, Variant& variant);
+    // Waits for a started program, reports errors and stores it in the binary cache
+    void finishProgram(Variant& variant);
+    // Whether finishProgram would return without waiting
+    bool isProgramReady(const Variant& variant);
+
+    static bool parallelCompileAvailable;
 };
 
 }
@@ -0,0 +1,131 @@
+#include "ShaderCache.hpp"
+#include "TextureCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace gps {
+
+    static const uint32_t shaderCacheMagic = 0x48535047; // "GPSH"
+    static const uint32_t shaderCacheVersion = 1;
+
+    // followed by binaryLength bytes of program binary
+    struct ShaderCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t binaryFormat;
+        uint32_t binaryLength;
+    };
+
+    ShaderCache::ShaderCache(std::string directory, gps::TextureCache* trim) : directory(directory), trim(trim)
+    {
+    }
+
+    uint64_t ShaderCache::GetKey(const std::vector<std::string>& sources, std::string defines)
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats <= 0)
+            return 0;
+
+        // a driver update changes the version string, which retires every entry it cannot load
+        std::string bytes;
+        GLenum names[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (int n = 0; n < 3; n++) {
+            const GLubyte* name = glGetString(names[n]);
+            bytes += name ? (const char*)name : "";
+            bytes += '\n';
+        }
+        bytes += defines;
+        for (size_t s = 0; s < sources.size(); s++) {
+            // lengths keep "ab" + "c" apart from "a" + "bc"
+            bytes += std::to_string(sources[s].size()) + "|";
+            bytes += sources[s];
+        }
+        return TextureCache::GetKey((const unsigned char*)bytes.data(), bytes.size(), "program");
+    }
+
+    std::string ShaderCache::GetEntryPath(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+        return directory + "/" + name + ".prog";
+    }
+
+    bool ShaderCache::Load(uint64_t key, GLuint program)
+    {
+        std::vector<unsigned char> data;
+        std::string entryPath = GetEntryPath(key);
+        if (key == 0 || !TextureCache::ReadFile(entryPath.c_str(), data))
+            return false;
+
+        ShaderCacheHeader header;
+        if (data.size() < sizeof(header)) {
+            fprintf(stderr, "WARNING: ignoring damaged cache entry %s\n", entryPath.c_str());
+            return false;
+        }
+        memcpy(&header, data.data(), sizeof(header));
+        if (header.magic != shaderCacheMagic || header.version != shaderCacheVersion ||
+            header.binaryLength != data.size() - sizeof(header)) {
+            fprintf(stderr, "WARNING: ignoring damaged cache entry %s\n", entryPath.c_str());
+            return false;
+        }
+
+        // the driver may still refuse a binary it wrote, e.g. after a setting changed
+        glProgramBinary(program, header.binaryFormat, data.data() + sizeof(header), header.binaryLength);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked != GL_TRUE) {
+            remove(entryPath.c_str());
+            return false;
+        }
+        // touching the entry makes it the most recently used one for trimming
+        utimensat(AT_FDCWD, entryPath.c_str(), NULL, 0);
+        return true;
+    }
+
+    bool ShaderCache::Store(uint64_t key, GLuint program)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (key == 0 || length <= 0)
+            return false;
+
+        ShaderCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        std::vector<unsigned char> binary(length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, binary.data());
+        if (written <= 0)
+            return false;
+        header.magic = shaderCacheMagic;
+        header.version = shaderCacheVersion;
+        header.binaryFormat = format;
+        header.binaryLength = (uint32_t)written;
+
+        mkdir(directory.c_str(), 0755);
+        std::string entryPath = GetEntryPath(key);
+        // written under a private name and renamed, so a crash never leaves half an entry
+        std::string temporaryPath = entryPath + ".tmp";
+        FILE* file = fopen(temporaryPath.c_str(), "wb");
+        if (!file)
+            return false;
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(binary.data(), 1, header.binaryLength, file) == header.binaryLength;
+        ok = fclose(file) == 0 && ok;
+
+        if (!ok || rename(temporaryPath.c_str(), entryPath.c_str()) != 0) {
+            fprintf(stderr, "WARNING: could not write cache entry %s\n", entryPath.c_str());
+            remove(temporaryPath.c_str());
+            return false;
+        }
+        // each edited shader leaves a new entry behind, so they count against the limit too
+        if (trim != NULL)
+            trim->Trim();
+        return true;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef ShaderCache_hpp
+#define ShaderCache_hpp
+
+#include <GL/glew.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    class TextureCache;
+
+    // On-disk cache of linked program binaries (glGetProgramBinary), kept next to the texture
+    // and mesh cache entries. Binaries only load on the driver that wrote them, so the key
+    // covers the driver as well as the shader sources.
+    class ShaderCache
+    {
+    public:
+        // trim is the texture cache sharing the directory, which keeps all its entries under
+        // one size limit; NULL leaves the entries untrimmed
+        explicit ShaderCache(std::string directory = "cache", gps::TextureCache* trim = NULL);
+
+        // Key of a program's stage sources and defines on the current driver, 0 when the
+        // driver offers no binary formats (GL thread)
+        static uint64_t GetKey(const std::vector<std::string>& sources, std::string defines);
+
+        // GL thread only. Load links program from the cached binary and returns false when
+        // there is none or the driver rejects it; program is left unlinked then.
+        bool Load(uint64_t key, GLuint program);
+        bool Store(uint64_t key, GLuint program);
+
+    private:
+        std::string directory;
+        gps::TextureCache* trim;
+
+        std::string GetEntryPath(uint64_t key);
+    };
+}
+
+#endif /* ShaderCache_hpp */
@@ -0,0 +1,227 @@
+#include "ShadowMaps.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    // share of a cascade's radius the camera may move before it is refitted
+    static const float cascadeMargin = 0.15f;
+
+    ShadowMaps::ShadowMaps(gps::ShadowOptions options) : options(options), resolution(0), texture(0), lightDir(0.0f)
+    {
+        this->options.cascades = std::min(std::max(options.cascades, 1), maxCascades);
+        framebuffers[0] = framebuffers[1] = 0;
+        stats.staticDraws = stats.dynamicDraws = 0;
+    }
+
+    void ShadowMaps::Init()
+    {
+        int layers = options.cascades * (options.cacheStatic ? 2 : 1);
+        GLint maxSize = 4096;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        // 32 bit depth texels
+        resolution = std::min(maxSize, 4096);
+        while (resolution > 256 && (size_t)layers * resolution * resolution * 4 > options.memoryBudget)
+            resolution /= 2;
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, layers, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // linear filtering of comparisons gives 2x2 percentage closer filtering per fetch
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        // one to draw into, one to copy the static caches from; depth only
+        glGenFramebuffers(2, framebuffers);
+        for (int i = 0; i < 2; i++) {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        cascades.assign(options.cascades, Cascade());
+        InvalidateStatic();
+        for (size_t i = 0; i < cascades.size(); i++)
+            cascades[i].radius = 0.0f;
+    }
+
+    void ShadowMaps::Delete()
+    {
+        glDeleteFramebuffers(2, framebuffers);
+        glDeleteTextures(1, &texture);
+        framebuffers[0] = framebuffers[1] = texture = 0;
+    }
+
+    void ShadowMaps::InvalidateStatic()
+    {
+        for (size_t i = 0; i < cascades.size(); i++)
+            cascades[i].staticValid = false;
+    }
+
+    int ShadowMaps::GetResolution()
+    {
+        return resolution;
+    }
+
+    float ShadowMaps::GetTexelSize(int cascade)
+    {
+        return 2.0f * cascades[cascade].radius / resolution;
+    }
+
+    gps::ShadowStats ShadowMaps::GetStats()
+    {
+        return stats;
+    }
+
+    void ShadowMaps::AttachLayer(GLenum target, GLuint framebuffer, int layer)
+    {
+        glBindFramebuffer(target, framebuffer);
+        glFramebufferTextureLayer(target, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+    }
+
+    // Centres a cascade on a sphere with some margin, snapped to whole texels of the light's view
+    void ShadowMaps::Fit(Cascade& cascade, glm::vec3 center, float radius)
+    {
+        cascade.radius = radius * (1.0f + cascadeMargin);
+        glm::vec3 up = std::fabs(lightDir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 orientation = glm::lookAt(glm::vec3(0.0f), -lightDir, up);
+
+        float texel = 2.0f * cascade.radius / resolution;
+        glm::vec3 centerLight = glm::vec3(orientation * glm::vec4(center, 1.0f));
+        centerLight.x = std::floor(centerLight.x / texel) * texel;
+        centerLight.y = std::floor(centerLight.y / texel) * texel;
+        cascade.center = glm::vec3(glm::inverse(orientation) * glm::vec4(centerLight, 1.0f));
+
+        // casters in front of the near plane are kept by depth clamping
+        cascade.lightView = glm::lookAt(cascade.center + lightDir * cascade.radius, cascade.center, up);
+        cascade.lightProjection = glm::ortho(-cascade.radius, cascade.radius, -cascade.radius, cascade.radius, 0.0f, 2.0f * cascade.radius);
+        cascade.staticValid = false;
+        cascade.framesSinceUpdate = 0;
+    }
+
+    void ShadowMaps::Update(const glm::mat4& view, float fovY, float aspect, float near, glm::vec3 lightDir, gps::ShadowCasterDraw draw)
+    {
+        stats.staticDraws = stats.dynamicDraws = 0;
+        lightDir = glm::normalize(lightDir);
+        if (lightDir != this->lightDir) {
+            this->lightDir = lightDir;
+            for (size_t i = 0; i < cascades.size(); i++)
+                cascades[i].radius = 0.0f;
+        }
+
+        glm::mat4 cameraToWorld = glm::inverse(view);
+        glm::vec3 eye = glm::vec3(cameraToWorld[3]);
+        glm::vec3 forward = -glm::normalize(glm::vec3(cameraToWorld[2]));
+        float tanHalfY = std::tan(fovY * 0.5f);
+        float tanHalfX = tanHalfY * aspect;
+        float cornerSlope = tanHalfX * tanHalfX + tanHalfY * tanHalfY;
+
+        bool drawing = false;
+        float sliceNear = near;
+        int interval = 1;
+        for (int i = 0; i < options.cascades; i++, interval *= options.intervalGrowth) {
+            Cascade& cascade = cascades[i];
+            float share = (i + 1) / (float)options.cascades;
+            float sliceFar = options.splitLambda * near * std::pow(options.distance / near, share) +
+                             (1.0f - options.splitLambda) * (near + (options.distance - near) * share);
+            cascade.split = sliceFar;
+
+            // smallest sphere around the slice: its centre lies on the view axis, where the near
+            // and far corners are equally far, unless that is past the far plane
+            float centerDepth = std::min((sliceFar + sliceNear) * (1.0f + cornerSlope) * 0.5f, sliceFar);
+            float radius = std::sqrt(sliceFar * sliceFar * cornerSlope + (sliceFar - centerDepth) * (sliceFar - centerDepth));
+            glm::vec3 center = eye + forward * centerDepth;
+            sliceNear = sliceFar;
+
+            bool moved = cascade.radius == 0.0f || glm::length(center - cascade.center) + radius > cascade.radius;
+            if (moved)
+                Fit(cascade, center, radius);
+            cascade.framesSinceUpdate++;
+            if (!moved && cascade.staticValid && cascade.framesSinceUpdate < interval)
+                continue;
+            cascade.framesSinceUpdate = 0;
+
+            if (!drawing) {
+                drawing = true;
+                glViewport(0, 0, resolution, resolution);
+                glEnable(GL_DEPTH_CLAMP);
+                glEnable(GL_POLYGON_OFFSET_FILL);
+                glPolygonOffset(2.0f, 4.0f);
+            }
+
+            if (!options.cacheStatic) {
+                AttachLayer(GL_FRAMEBUFFER, framebuffers[0], i);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                draw(i, cascade.lightView, cascade.lightProjection, SHADOW_STATIC | SHADOW_DYNAMIC);
+                stats.staticDraws++;
+                stats.dynamicDraws++;
+                continue;
+            }
+
+            if (!cascade.staticValid) {
+                AttachLayer(GL_FRAMEBUFFER, framebuffers[1], options.cascades + i);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                draw(i, cascade.lightView, cascade.lightProjection, SHADOW_STATIC);
+                cascade.staticValid = true;
+                stats.staticDraws++;
+            }
+            // the static depth, then the moving casters over it
+            AttachLayer(GL_READ_FRAMEBUFFER, framebuffers[1], options.cascades + i);
+            AttachLayer(GL_DRAW_FRAMEBUFFER, framebuffers[0], i);
+            glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[0]);
+            draw(i, cascade.lightView, cascade.lightProjection, SHADOW_DYNAMIC);
+            stats.dynamicDraws++;
+        }
+
+        if (drawing) {
+            glDisable(GL_POLYGON_OFFSET_FILL);
+            glDisable(GL_DEPTH_CLAMP);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+    }
+
+    bool ShadowMaps::IsVisible(int cascade, glm::vec3 center, float radius)
+    {
+        const Cascade& shadow = cascades[cascade];
+        glm::vec3 position = glm::vec3(shadow.lightView * glm::vec4(center, 1.0f));
+        // anything towards the light casts, depth clamping flattens it onto the near plane
+        float extent = shadow.radius + radius;
+        return std::fabs(position.x) <= extent && std::fabs(position.y) <= extent && -position.z - radius <= 2.0f * shadow.radius;
+    }
+
+    void ShadowMaps::Bind(GLuint program, const glm::mat4& view)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(program, "shadowMap"), unit);
+
+        // eye space to shadow map coordinates in [0, 1]
+        glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+        glm::mat4 eyeToWorld = glm::inverse(view);
+        std::vector<glm::mat4> matrices(cascades.size());
+        glm::vec4 splits(0.0f), texelSizes(0.0f);
+        for (size_t i = 0; i < cascades.size(); i++) {
+            matrices[i] = bias * cascades[i].lightProjection * cascades[i].lightView * eyeToWorld;
+            splits[i] = cascades[i].split;
+            texelSizes[i] = GetTexelSize((int)i);
+        }
+        glUniformMatrix4fv(glGetUniformLocation(program, "shadowMatrices"), (GLsizei)matrices.size(), GL_FALSE, glm::value_ptr(matrices[0]));
+        glUniform4fv(glGetUniformLocation(program, "shadowSplits"), 1, glm::value_ptr(splits));
+        glUniform4fv(glGetUniformLocation(program, "shadowTexelSizes"), 1, glm::value_ptr(texelSizes));
+        glUniform1i(glGetUniformLocation(program, "shadowCascadeCount"), (GLint)cascades.size());
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef ShadowMaps_hpp
+#define ShadowMaps_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace gps {
+
+    struct ShadowOptions
+    {
+        int cascades = 4;
+        // bytes of depth texture for the cascades and their static caches; the resolution is
+        // the largest power of two that fits
+        size_t memoryBudget = 128 * 1024 * 1024;
+        // view distance the cascades cover
+        float distance = 120.0f;
+        // blend between logarithmic (1) and even (0) split distances
+        float splitLambda = 0.75f;
+        // keeps static casters of each cascade in a layer of their own, redrawn only when the
+        // cascade moves, so refreshing the moving casters costs a copy and their own draws
+        bool cacheStatic = true;
+        // cascade i redraws its moving casters every intervalGrowth^i frames
+        int intervalGrowth = 2;
+    };
+
+    enum SHADOW_CASTERS
+    {
+        SHADOW_STATIC = 1 << 0,
+        SHADOW_DYNAMIC = 1 << 1
+    };
+
+    // Draws the casters (SHADOW_CASTERS bits) of a cascade with a depth-only shader and the
+    // given light matrices; the shadow map's framebuffer and viewport are bound
+    typedef std::function<void(int cascade, const glm::mat4& lightView, const glm::mat4& lightProjection, unsigned casters)> ShadowCasterDraw;
+
+    struct ShadowStats
+    {
+        // redrawn in the last Update
+        int staticDraws;
+        int dynamicDraws;
+    };
+
+    // Cascaded shadow maps for a directional light, in the layers of one depth array texture.
+    // Each cascade covers a slice of the view frustum with a bounding sphere, so its size
+    // does not change as the camera turns, and its centre snaps to whole texels so edges do
+    // not shimmer. A cascade only moves once the camera leaves a margin around it, which is
+    // what keeps the static cache valid. GL thread only.
+    class ShadowMaps
+    {
+    public:
+        explicit ShadowMaps(gps::ShadowOptions options = gps::ShadowOptions());
+
+        void Init();
+        void Delete();
+
+        // Forgets the static caches, after static geometry changed
+        void InvalidateStatic();
+
+        // Fits the cascades to the camera and redraws the ones that moved or are due
+        void Update(const glm::mat4& view, float fovY, float aspect, float near, glm::vec3 lightDir, gps::ShadowCasterDraw draw);
+
+        // Whether a world space sphere can cast into a cascade
+        bool IsVisible(int cascade, glm::vec3 center, float radius);
+
+        // Binds the depth array and sets the shadow uniforms of the current program, for a pass
+        // drawn with the view Update was given
+        void Bind(GLuint program, const glm::mat4& view);
+
+        int GetResolution();
+        // world units per shadow texel
+        float GetTexelSize(int cascade);
+        gps::ShadowStats GetStats();
+
+    private:
+        // clear of the units meshes, terrain and clustered lighting use
+        static const int unit = 7;
+        static const int maxCascades = 4;
+
+        struct Cascade
+        {
+            // covered sphere, in world space; radius 0 until first fitted
+            glm::vec3 center;
+            float radius;
+            // view depth up to which fragments use this cascade
+            float split;
+            glm::mat4 lightView;
+            glm::mat4 lightProjection;
+            bool staticValid;
+            int framesSinceUpdate;
+        };
+
+        gps::ShadowOptions options;
+        int resolution;
+        GLuint texture;
+        GLuint framebuffers[2];
+        glm::vec3 lightDir;
+        std::vector<Cascade> cascades;
+        gps::ShadowStats stats;
+
+        void AttachLayer(GLenum target, GLuint framebuffer, int layer);
+        void Fit(Cascade& cascade, glm::vec3 center, float radius);
+    };
+}
+
+#endif /* ShadowMaps_hpp */
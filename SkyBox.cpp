@@ -1,10 +1,15 @@
 #include "SkyBox.hpp"
+#include "Model3D.hpp"
+#include "ImageUtils.hpp"
+
+#include <algorithm>
+#include <chrono>
 
 namespace gps {
     
     SkyBox::SkyBox()
     {
-        
+        cubemapTexture = 0;
     }
     
     void SkyBox::Load(std::vector<const GLchar*> cubeMapFaces)
@@ -40,25 +45,31 @@ namespace gps {
         glGenTextures(1, &textureID);
         glActiveTexture(GL_TEXTURE0);
         
-        int width,height, n;
-        unsigned char* image;
-        int force_channels = 3;
+        int levels = 1;
         
         glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
         for(GLuint i = 0; i < skyBoxFaces.size(); i++)
         {
-            image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
-            if (!image) {
-                fprintf(stderr, "ERROR: could not load %s\n", skyBoxFaces[i]);
+            gps::Image image;
+            if (!DecodeFace(skyBoxFaces[i], image)) {
                 return false;
             }
-            glTexImage2D(
-                         GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
-                         GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image
-                         );
+            levels = image.levelOffsets.empty() ? 1 : (int)image.levelOffsets.size() - 1;
+            for (int level = 0; level < levels; level++)
+            {
+                glTexImage2D(
+                             GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level,
+                             GL_RGB, std::max(1, image.width >> level), std::max(1, image.height >> level), 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                             image.pixels.get() + (image.levelOffsets.empty() ? 0 : image.levelOffsets[level])
+                             );
+            }
         }
+        if (levels > 1)
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        else
+            Model3D::GenerateDriverMipmaps(GL_TEXTURE_CUBE_MAP);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -130,4 +141,69 @@ namespace gps {
     {
         return cubemapTexture;
     }
+
+    void SkyBox::LoadPlaceholder(glm::vec3 color)
+    {
+        unsigned char texel[3] = {
+            (unsigned char)(color.x * 255.0f),
+            (unsigned char)(color.y * 255.0f),
+            (unsigned char)(color.z * 255.0f)
+        };
+
+        glGenTextures(1, &cubemapTexture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        for (GLuint i = 0; i < 6; i++)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, texel);
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        InitSkyBox();
+    }
+
+    void SkyBox::SetTexture(GLuint textureId)
+    {
+        if (cubemapTexture != 0)
+            glDeleteTextures(1, &cubemapTexture);
+        cubemapTexture = textureId;
+    }
+
+    bool SkyBox::DecodeFace(const GLchar* fileName, gps::Image& image)
+    {
+        std::vector<unsigned char> source;
+        if (!TextureCache::ReadFile(fileName, source)) {
+            fprintf(stderr, "ERROR: could not load %s\n", fileName);
+            return false;
+        }
+
+        gps::TextureCache* cache = Model3D::textureOptions.cpuMipmaps ? Model3D::textureOptions.cache : NULL;
+        uint64_t cacheKey = 0;
+        if (cache != NULL) {
+            cacheKey = TextureCache::GetKey(source.data(), source.size(), std::string("rgbx-") + GetMipFilterName(Model3D::textureOptions.filter));
+            if (cache->Load(cacheKey, image)) {
+                Model3D::textureStats.cacheHits++;
+                return true;
+            }
+        }
+
+        // padded to RGBA, the layout drivers take without converting; the texture stays GL_RGB
+        if (!DecodeRgba(source.data(), source.size(), false, image)) {
+            fprintf(stderr, "ERROR: could not load %s\n", fileName);
+            return false;
+        }
+
+        // the faces are uploaded as plain GL_RGB, so they are filtered as stored
+        if (Model3D::textureOptions.cpuMipmaps) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            GenerateMipChain(image, Model3D::textureOptions.filter, false);
+            Model3D::textureStats.mipMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (cache != NULL) {
+            Model3D::textureStats.cacheMisses++;
+            cache->Store(cacheKey, image);
+        }
+        return true;
+    }
 }
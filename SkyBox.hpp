@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include "Shader.hpp"
+#include "Mesh.hpp"
 #include <vector>
 #include "stb_image.h"
 #include "glm/glm.hpp"
@@ -16,6 +17,12 @@ namespace gps {
         void Load(std::vector<const GLchar*> cubeMapFaces);
         void Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
         GLuint GetTextureId();
+        // Draws a single colour cube map until the streamed faces arrive
+        void LoadPlaceholder(glm::vec3 color);
+        // Replaces the current cube map, deleting the previous one
+        void SetTexture(GLuint textureId);
+        // Decodes one cube map face - safe to call from a worker thread
+        static bool DecodeFace(const GLchar* fileName, gps::Image& image);
     private:
         GLuint skyboxVAO;
         GLuint skyboxVBO;
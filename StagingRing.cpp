@@ -0,0 +1,125 @@
+#include "StagingRing.hpp"
+
+namespace gps {
+
+    // slots start on a cache line so the copies into them stay aligned
+    static const size_t slotAlignment = 64;
+
+    static bool fenceSignaled(uint64_t fence, GLuint64 timeout)
+    {
+        GLsync sync = (GLsync)(uintptr_t)fence;
+        GLenum result = glClientWaitSync(sync, 0, timeout);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+            glDeleteSync(sync);
+            return true;
+        }
+        return false;
+    }
+
+    StagingRing::StagingRing()
+    {
+        buffer = 0;
+        mapped = NULL;
+        persistent = false;
+        rangeMapped = false;
+    }
+
+    void StagingRing::Init(size_t capacity)
+    {
+        allocator.Reset(capacity);
+        persistent = GLEW_ARB_buffer_storage != 0;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, capacity, flags);
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    void StagingRing::Delete()
+    {
+        if (buffer == 0)
+            return;
+
+        // the buffer cannot go away while uploads may still read from it
+        Submit();
+        allocator.Retire([](uint64_t fence) { return fenceSignaled(fence, 1000000000); });
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        if (persistent || rangeMapped)
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        mapped = NULL;
+        rangeMapped = false;
+    }
+
+    unsigned char* StagingRing::Allocate(size_t size, size_t& offset)
+    {
+        if (!allocator.Allocate(size, slotAlignment, offset))
+            return NULL;
+
+        if (persistent)
+            return mapped + offset;
+
+        // the fences already guarantee the range is idle, so skip the driver's own sync
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        unsigned char* range = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        rangeMapped = true;
+        return range;
+    }
+
+    void StagingRing::Commit()
+    {
+        // coherent persistent mappings need no flush
+        if (!rangeMapped)
+            return;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        rangeMapped = false;
+    }
+
+    void StagingRing::Submit()
+    {
+        if (!allocator.HasOpenRanges())
+            return;
+
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        allocator.Submit((uint64_t)(uintptr_t)fence);
+    }
+
+    void StagingRing::Retire()
+    {
+        allocator.Retire([](uint64_t fence) { return fenceSignaled(fence, 0); });
+    }
+
+    GLuint StagingRing::GetBuffer()
+    {
+        return buffer;
+    }
+
+    bool StagingRing::IsPersistent()
+    {
+        return persistent;
+    }
+
+    size_t StagingRing::GetUsedBytes()
+    {
+        return allocator.GetUsedBytes();
+    }
+
+    size_t StagingRing::GetCapacity()
+    {
+        return allocator.GetCapacity();
+    }
+}
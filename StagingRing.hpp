@@ -0,0 +1,46 @@
+#ifndef StagingRing_hpp
+#define StagingRing_hpp
+
+#include <GL/glew.h>
+
+#include "RingAllocator.hpp"
+
+namespace gps {
+
+    // Pixel unpack buffer used as a ring of upload slots. The buffer is mapped once
+    // and kept mapped when ARB_buffer_storage is available; slots are recycled when
+    // the fence placed after the uploads that read them has signalled.
+    class StagingRing
+    {
+    public:
+        StagingRing();
+
+        void Init(size_t capacity);
+        void Delete();
+
+        // Returns a write pointer for size bytes, or NULL while the ring is full.
+        // offset is the position to pass to glTexSubImage2D once the pointer is committed.
+        unsigned char* Allocate(size_t size, size_t& offset);
+        // Makes the bytes written since the last Allocate visible to the GL
+        void Commit();
+        // Fences every upload issued from the ring since the previous Submit
+        void Submit();
+        // Recycles slots the GPU has finished reading, never waits
+        void Retire();
+
+        GLuint GetBuffer();
+        bool IsPersistent();
+        size_t GetUsedBytes();
+        size_t GetCapacity();
+
+    private:
+        gps::RingAllocator allocator;
+        GLuint buffer;
+        unsigned char* mapped;
+        bool persistent;
+        // non-persistent path keeps one range mapped between Allocate and Commit
+        bool rangeMapped;
+    };
+}
+
+#endif /* StagingRing_hpp */
@@ -0,0 +1,362 @@
+#include "Terrain.hpp"
+#include "Model3D.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+namespace gps {
+
+    // texture units of the terrain's maps; basic.frag samples the first two
+    static const int diffuseUnit = 0;
+    static const int specularUnit = 1;
+    static const int heightUnit = 2;
+
+    Terrain::Terrain(gps::ThreadPool& pool, gps::HeightSource source, gps::TerrainOptions options)
+        : pool(pool), source(source), options(options)
+    {
+        levels = 1;
+        while ((options.chunkResolution << levels) <= options.tileResolution)
+            levels++;
+        for (int level = 0; level < levels; level++)
+            ranges.push_back(options.lodDistance * (float)(1 << level));
+
+        gridVAO = gridVBO = gridEBO = 0;
+        gridIndexCount = 0;
+        textures[0] = textures[1] = 0;
+        stats.residentTiles = stats.uploadedTiles = stats.pendingTiles = stats.drawnChunks = stats.culledChunks = 0;
+        stopping = false;
+    }
+
+    void Terrain::Init(std::string diffusePath, std::string specularPath)
+    {
+        // (n + 1)^2 grid points, x and z in quads, y unused
+        int n = options.chunkResolution;
+        std::vector<glm::vec3> points;
+        for (int z = 0; z <= n; z++)
+            for (int x = 0; x <= n; x++)
+                points.push_back(glm::vec3((float)x, 0.0f, (float)z));
+        std::vector<GLuint> indices;
+        for (int z = 0; z < n; z++) {
+            for (int x = 0; x < n; x++) {
+                GLuint a = z * (n + 1) + x, b = a + n + 1;
+                GLuint quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+        gridIndexCount = (GLsizei)indices.size();
+
+        glGenVertexArrays(1, &gridVAO);
+        glGenBuffers(1, &gridVBO);
+        glGenBuffers(1, &gridEBO);
+        glBindVertexArray(gridVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
+        glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(glm::vec3), points.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+        glBindVertexArray(0);
+
+        std::string paths[2] = { diffusePath, specularPath };
+        for (int unit = 0; unit < 2; unit++) {
+            std::string path = paths[unit];
+            pool.Submit([this, unit, path]() {
+                DecodedTexture decoded;
+                decoded.unit = unit;
+                if (stopping || !Model3D::DecodeTexture(path.c_str(), decoded.image))
+                    return;
+                std::lock_guard<std::mutex> lock(mutex);
+                decodedTextures.push_back(std::move(decoded));
+            });
+        }
+    }
+
+    void Terrain::Delete()
+    {
+        stopping = true;
+        for (std::map<TileKey, Tile>::iterator tile = tiles.begin(); tile != tiles.end(); ++tile)
+            glDeleteTextures(1, &tile->second.heightTexture);
+        tiles.clear();
+        glDeleteTextures(2, textures);
+        glDeleteBuffers(1, &gridVBO);
+        glDeleteBuffers(1, &gridEBO);
+        glDeleteVertexArrays(1, &gridVAO);
+    }
+
+    // Worker side: samples the tile with its apron and builds the node bounds bottom up
+    void Terrain::GenerateTile(TileKey key)
+    {
+        int resolution = options.tileResolution;
+        float spacing = options.tileSize / resolution;
+        int stride = resolution + 3;
+
+        GeneratedTile generated;
+        generated.key = key;
+        generated.heights.resize((size_t)stride * stride);
+        // the apron starts one sample before the tile
+        glm::ivec2 first(key.first * resolution - 1, key.second * resolution - 1);
+        source(first, spacing, resolution + 2, generated.heights.data());
+
+        int count = resolution / options.chunkResolution;
+        generated.bounds.resize(levels);
+        generated.bounds[0].resize(count * count);
+        for (int nodeZ = 0; nodeZ < count; nodeZ++) {
+            for (int nodeX = 0; nodeX < count; nodeX++) {
+                glm::vec2 bounds(INFINITY, -INFINITY);
+                for (int z = nodeZ * options.chunkResolution; z <= (nodeZ + 1) * options.chunkResolution; z++) {
+                    const float* row = &generated.heights[(size_t)(z + 1) * stride + 1];
+                    for (int x = nodeX * options.chunkResolution; x <= (nodeX + 1) * options.chunkResolution; x++) {
+                        bounds.x = std::min(bounds.x, row[x]);
+                        bounds.y = std::max(bounds.y, row[x]);
+                    }
+                }
+                generated.bounds[0][nodeZ * count + nodeX] = bounds;
+            }
+        }
+        for (int level = 1; level < levels; level++) {
+            int finer = count;
+            count /= 2;
+            generated.bounds[level].resize(count * count);
+            for (int z = 0; z < count; z++) {
+                for (int x = 0; x < count; x++) {
+                    const std::vector<glm::vec2>& children = generated.bounds[level - 1];
+                    glm::vec2 bounds = children[(2 * z) * finer + 2 * x];
+                    for (int child = 1; child < 4; child++) {
+                        glm::vec2 other = children[(2 * z + child / 2) * finer + 2 * x + child % 2];
+                        bounds.x = std::min(bounds.x, other.x);
+                        bounds.y = std::max(bounds.y, other.y);
+                    }
+                    generated.bounds[level][z * count + x] = bounds;
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        generatedTiles.push_back(std::move(generated));
+    }
+
+    void Terrain::UploadTile(GeneratedTile& generated)
+    {
+        int stride = options.tileResolution + 3;
+        Tile tile;
+        tile.bounds.swap(generated.bounds);
+        glGenTextures(1, &tile.heightTexture);
+        glBindTexture(GL_TEXTURE_2D, tile.heightTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, stride, stride, 0, GL_RED, GL_FLOAT, generated.heights.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        stats.uploadedTiles++;
+        tiles[generated.key] = tile;
+    }
+
+    void Terrain::Update(glm::vec3 eye)
+    {
+        TileKey center((int)floorf(eye.x / options.tileSize), (int)floorf(eye.z / options.tileSize));
+
+        // tiles a step past the radius stay, so moving back and forth over an edge does not thrash
+        for (std::map<TileKey, Tile>::iterator tile = tiles.begin(); tile != tiles.end();) {
+            if (std::abs(tile->first.first - center.first) > options.streamRadius + 1 ||
+                std::abs(tile->first.second - center.second) > options.streamRadius + 1) {
+                glDeleteTextures(1, &tile->second.heightTexture);
+                requested.erase(tile->first);
+                tiles.erase(tile++);
+            } else {
+                ++tile;
+            }
+        }
+
+        // nearest first, so the ground under the camera arrives before the horizon
+        std::vector<std::pair<int, TileKey>> missing;
+        for (int z = -options.streamRadius; z <= options.streamRadius; z++) {
+            for (int x = -options.streamRadius; x <= options.streamRadius; x++) {
+                TileKey key(center.first + x, center.second + z);
+                if (requested.count(key) == 0)
+                    missing.push_back(std::make_pair(x * x + z * z, key));
+            }
+        }
+        std::sort(missing.begin(), missing.end());
+        for (size_t i = 0; i < missing.size(); i++) {
+            TileKey key = missing[i].second;
+            requested.insert(key);
+            pool.Submit([this, key]() {
+                if (!stopping)
+                    GenerateTile(key);
+            });
+        }
+
+        for (int uploads = 0; uploads < options.uploadsPerFrame; uploads++) {
+            GeneratedTile generated;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (generatedTiles.empty())
+                    break;
+                generated = std::move(generatedTiles.front());
+                generatedTiles.pop_front();
+            }
+            // the camera may have moved on while the tile was generated, and come back for it
+            if (requested.count(generated.key) != 0 && tiles.count(generated.key) == 0)
+                UploadTile(generated);
+            else
+                uploads--;
+        }
+
+        for (;;) {
+            DecodedTexture decoded;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decodedTextures.empty())
+                    break;
+                decoded = std::move(decodedTextures.front());
+                decodedTextures.pop_front();
+            }
+            textures[decoded.unit] = Model3D::CreateTexture(decoded.image);
+        }
+        stats.residentTiles = (int)tiles.size();
+        stats.pendingTiles = (int)(requested.size() - tiles.size());
+    }
+
+    // True unless the box lies entirely behind one of the frustum planes
+    static bool boxInFrustum(const glm::vec4* planes, glm::vec3 low, glm::vec3 high)
+    {
+        for (int p = 0; p < 6; p++) {
+            glm::vec3 farthest(planes[p].x >= 0.0f ? high.x : low.x,
+                               planes[p].y >= 0.0f ? high.y : low.y,
+                               planes[p].z >= 0.0f ? high.z : low.z);
+            if (planes[p].x * farthest.x + planes[p].y * farthest.y + planes[p].z * farthest.z + planes[p].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    static bool sphereTouchesBox(glm::vec3 center, float radius, glm::vec3 low, glm::vec3 high)
+    {
+        glm::vec3 nearest = glm::min(glm::max(center, low), high);
+        return glm::length(nearest - center) <= radius;
+    }
+
+    // Draws a node whole when the next finer level's range does not reach it, otherwise recurses
+    void Terrain::SelectNodes(const Tile& tile, TileKey key, int level, int x, int z, const glm::vec4* frustum,
+                              glm::vec3 eye, std::vector<glm::vec4>& chunks)
+    {
+        int count = (options.tileResolution / options.chunkResolution) >> level;
+        float nodeSize = options.tileSize / count;
+        glm::vec2 origin(key.first * options.tileSize + x * nodeSize, key.second * options.tileSize + z * nodeSize);
+        glm::vec2 bounds = tile.bounds[level][z * count + x];
+        glm::vec3 low(origin.x, bounds.x, origin.y);
+        glm::vec3 high(origin.x + nodeSize, bounds.y, origin.y + nodeSize);
+
+        if (!boxInFrustum(frustum, low, high)) {
+            stats.culledChunks++;
+            return;
+        }
+        if (level > 0 && sphereTouchesBox(eye, ranges[level - 1], low, high)) {
+            for (int child = 0; child < 4; child++)
+                SelectNodes(tile, key, level - 1, 2 * x + child % 2, 2 * z + child / 2, frustum, eye, chunks);
+            return;
+        }
+        chunks.push_back(glm::vec4(origin.x, origin.y, nodeSize / options.chunkResolution, (float)level));
+    }
+
+    void Terrain::Draw(gps::Shader shader, const glm::mat4& modelViewProjection, glm::vec3 eye)
+    {
+        stats.drawnChunks = stats.culledChunks = 0;
+        if (tiles.empty())
+            return;
+
+        // Gribb-Hartmann: each frustum plane is the last row of the matrix plus or minus another
+        glm::vec4 frustum[6];
+        for (int axis = 0; axis < 3; axis++) {
+            for (int side = 0; side < 2; side++) {
+                glm::vec4& plane = frustum[axis * 2 + side];
+                for (int column = 0; column < 4; column++)
+                    plane[column] = modelViewProjection[column][3] + (side == 0 ? 1.0f : -1.0f) * modelViewProjection[column][axis];
+            }
+        }
+
+        shader.useShaderProgram();
+        GLuint program = shader.shaderProgram;
+        glUniform1i(glGetUniformLocation(program, "terrainChunk"), 1);
+        glUniform1i(glGetUniformLocation(program, "heightMap"), heightUnit);
+        glUniform1i(glGetUniformLocation(program, "diffuseTexture"), diffuseUnit);
+        glUniform1i(glGetUniformLocation(program, "specularTexture"), specularUnit);
+        glUniform3fv(glGetUniformLocation(program, "terrainEye"), 1, &eye[0]);
+        glUniform1f(glGetUniformLocation(program, "terrainTextureScale"), options.textureScale);
+        GLint tileLoc = glGetUniformLocation(program, "terrainTile");
+        GLint chunkLoc = glGetUniformLocation(program, "terrainChunkOrigin");
+        GLint morphLoc = glGetUniformLocation(program, "terrainMorph");
+
+        glActiveTexture(GL_TEXTURE0 + diffuseUnit);
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glActiveTexture(GL_TEXTURE0 + specularUnit);
+        glBindTexture(GL_TEXTURE_2D, textures[1]);
+        glBindVertexArray(gridVAO);
+
+        std::vector<glm::vec4> chunks;
+        for (std::map<TileKey, Tile>::iterator tile = tiles.begin(); tile != tiles.end(); ++tile) {
+            chunks.clear();
+            SelectNodes(tile->second, tile->first, levels - 1, 0, 0, frustum, eye, chunks);
+            if (chunks.empty())
+                continue;
+
+            // origin, sample spacing and samples per edge of the height texture, apron included
+            glm::vec4 tileParameters(tile->first.first * options.tileSize, tile->first.second * options.tileSize,
+                                     options.tileSize / options.tileResolution, (float)(options.tileResolution + 3));
+            glUniform4fv(tileLoc, 1, &tileParameters[0]);
+            glActiveTexture(GL_TEXTURE0 + heightUnit);
+            glBindTexture(GL_TEXTURE_2D, tile->second.heightTexture);
+
+            for (size_t c = 0; c < chunks.size(); c++) {
+                float range = ranges[(int)chunks[c].w];
+                glUniform3f(chunkLoc, chunks[c].x, chunks[c].y, chunks[c].z);
+                glUniform2f(morphLoc, range * options.morphStart, range);
+                glDrawElements(GL_TRIANGLES, gridIndexCount, GL_UNSIGNED_INT, 0);
+            }
+            stats.drawnChunks += (int)chunks.size();
+        }
+
+        glBindVertexArray(0);
+        for (int unit = 0; unit < 3; unit++) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glUniform1i(glGetUniformLocation(program, "terrainChunk"), 0);
+    }
+
+    gps::TerrainStats Terrain::GetStats()
+    {
+        return stats;
+    }
+
+    gps::HeightSource Terrain::ImageHeightSource(std::string path, float worldSize, float minHeight, float maxHeight)
+    {
+        int width = 0, height = 0, channels = 0;
+        std::shared_ptr<unsigned short> pixels(stbi_load_16(path.c_str(), &width, &height, &channels, 1), stbi_image_free);
+        if (!pixels) {
+            fprintf(stderr, "ERROR: could not load heightmap %s\n", path.c_str());
+            width = height = 1;
+            pixels.reset(new unsigned short[1](), std::default_delete<unsigned short[]>());
+        }
+
+        return [pixels, width, height, worldSize, minHeight, maxHeight](glm::ivec2 first, float spacing, int resolution, float* heights) {
+            const unsigned short* texels = pixels.get();
+            for (int j = 0; j <= resolution; j++) {
+                // texel space, wrapped so the image repeats
+                float v = (float)(first.y + j) * spacing / worldSize * height - 0.5f;
+                float fv = floorf(v);
+                int v0 = ((int)fv % height + height) % height, v1 = (v0 + 1) % height;
+                for (int i = 0; i <= resolution; i++) {
+                    float u = (float)(first.x + i) * spacing / worldSize * width - 0.5f;
+                    float fu = floorf(u);
+                    int u0 = ((int)fu % width + width) % width, u1 = (u0 + 1) % width;
+                    float top = glm::mix((float)texels[v0 * width + u0], (float)texels[v0 * width + u1], u - fu);
+                    float bottom = glm::mix((float)texels[v1 * width + u0], (float)texels[v1 * width + u1], u - fu);
+                    heights[j * (resolution + 1) + i] = minHeight + glm::mix(top, bottom, v - fv) / 65535.0f * (maxHeight - minHeight);
+                }
+            }
+        };
+    }
+}
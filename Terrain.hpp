@@ -0,0 +1,139 @@
+#ifndef Terrain_hpp
+#define Terrain_hpp
+
+#include "Mesh.hpp"
+#include "Shader.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gps {
+
+    // Fills (resolution + 1)^2 heights, row by row along x, for the samples (first + (i, j)) * spacing
+    // of the terrain's xz plane. Samples are numbered across the whole terrain, so neighbouring
+    // tiles pass the same index for the samples on their shared edge and must get the same
+    // height back; called from the worker threads
+    typedef std::function<void(glm::ivec2 first, float spacing, int resolution, float* heights)> HeightSource;
+
+    struct TerrainOptions
+    {
+        // world units along a tile edge; tiles are the unit of streaming
+        float tileSize = 64.0f;
+        // height samples along a tile edge, minus one; a power of two multiple of chunkResolution
+        int tileResolution = 256;
+        // quads along the edge of the grid mesh every chunk is drawn with
+        int chunkResolution = 32;
+        // tiles kept resident in each direction around the camera's tile
+        int streamRadius = 3;
+        // tiles uploaded at most per frame
+        int uploadsPerFrame = 2;
+        // distance up to which the finest chunks are used, doubling for each coarser level
+        float lodDistance = 16.0f;
+        // share of each level's range after which its vertices start morphing to the next
+        float morphStart = 0.7f;
+        // texture repeats per world unit
+        float textureScale = 0.125f;
+    };
+
+    struct TerrainStats
+    {
+        int residentTiles;
+        // tiles uploaded since Init; a change means the heightfield did
+        int uploadedTiles;
+        // requested around the eye and not uploaded yet
+        int pendingTiles;
+        int drawnChunks;
+        int culledChunks;
+    };
+
+    // Heightfield terrain drawn with continuous distance-dependent LOD (CDLOD): each streamed
+    // tile is a quadtree whose nodes are all drawn with the same grid mesh at their own scale,
+    // and basic.vert displaces the grid from the tile's height texture, morphing vertices into
+    // the next coarser level towards the end of each level's range so transitions do not pop.
+    class Terrain
+    {
+    public:
+        Terrain(gps::ThreadPool& pool, gps::HeightSource source, gps::TerrainOptions options = gps::TerrainOptions());
+
+        // Builds the grid mesh and starts decoding the textures (GL thread)
+        void Init(std::string diffusePath, std::string specularPath);
+        void Delete();
+
+        // Requests the tiles around eye, frees the ones left behind and uploads finished ones;
+        // eye is in the terrain's coordinates (GL thread)
+        void Update(glm::vec3 eye);
+
+        // Draws the resident tiles, culling quadtree nodes against the frustum of
+        // modelViewProjection; eye in the terrain's coordinates
+        void Draw(gps::Shader shader, const glm::mat4& modelViewProjection, glm::vec3 eye);
+
+        // Resident tiles, and the chunks the last Draw drew and culled
+        gps::TerrainStats GetStats();
+
+        // Samples a grayscale heightmap image (8 or 16 bit) bilinearly, repeated every worldSize
+        // units, with black at minHeight and white at maxHeight
+        static gps::HeightSource ImageHeightSource(std::string path, float worldSize, float minHeight, float maxHeight);
+
+    private:
+        typedef std::pair<int, int> TileKey;
+
+        struct Tile
+        {
+            GLuint heightTexture;
+            // min and max height of every quadtree node, finest level first, rows along x
+            std::vector<std::vector<glm::vec2>> bounds;
+        };
+
+        struct GeneratedTile
+        {
+            TileKey key;
+            // with a one sample apron all around, so normals match across tile edges
+            std::vector<float> heights;
+            std::vector<std::vector<glm::vec2>> bounds;
+        };
+
+        struct DecodedTexture
+        {
+            int unit;
+            gps::Image image;
+        };
+
+        gps::ThreadPool& pool;
+        gps::HeightSource source;
+        gps::TerrainOptions options;
+        int levels;
+        // distance up to which each level is drawn
+        std::vector<float> ranges;
+
+        // GL thread only
+        std::map<TileKey, Tile> tiles;
+        std::set<TileKey> requested;
+        GLuint gridVAO;
+        GLuint gridVBO;
+        GLuint gridEBO;
+        GLsizei gridIndexCount;
+        // diffuse and specular
+        GLuint textures[2];
+        gps::TerrainStats stats;
+
+        std::mutex mutex;
+        std::deque<GeneratedTile> generatedTiles;
+        std::deque<DecodedTexture> decodedTextures;
+        std::atomic<bool> stopping;
+
+        void GenerateTile(TileKey key);
+        void UploadTile(GeneratedTile& generated);
+        void SelectNodes(const Tile& tile, TileKey key, int level, int x, int z, const glm::vec4* frustum, glm::vec3 eye,
+                         std::vector<glm::vec4>& chunks);
+    };
+}
+
+#endif /* Terrain_hpp */
@@ -0,0 +1,251 @@
+#include "TextureCache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace gps {
+
+    static const uint32_t cacheMagic = 0x434d5047; // "GPMC"
+    static const uint32_t cacheVersion = 2;
+    static const char* entrySuffix = ".tex";
+    // every kind of entry kept in the directory, all trimmed against the one limit
+    static const char* trimmedSuffixes[] = { ".tex", ".mesh", ".prog" };
+
+    struct CacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint32_t levelCount;
+        // texels start here, page aligned so the mapping can be paged in directly
+        uint64_t dataOffset;
+    };
+
+    static uint64_t mix(uint64_t hash, uint64_t value)
+    {
+        hash ^= value;
+        hash *= 0x9e3779b97f4a7c15ULL;
+        return hash ^ (hash >> 29);
+    }
+
+    TextureCache::TextureCache(std::string directory, size_t maxBytes) : directory(directory), maxBytes(maxBytes)
+    {
+    }
+
+    uint64_t TextureCache::GetKey(const unsigned char* data, size_t size, std::string variant)
+    {
+        // eight bytes at a time; only has to spread keys, not resist collisions on purpose
+        uint64_t hash = mix(0xcbf29ce484222325ULL, size);
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            hash = mix(hash, word);
+        }
+        uint64_t tail = 0;
+        if (i < size)
+            memcpy(&tail, data + i, size - i);
+        hash = mix(hash, tail);
+
+        for (size_t c = 0; c < variant.size(); c++)
+            hash = mix(hash, (unsigned char)variant[c]);
+        return hash;
+    }
+
+    bool TextureCache::ReadFile(const char* fileName, std::vector<unsigned char>& data)
+    {
+        FILE* file = fopen(fileName, "rb");
+        if (!file)
+            return false;
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        data.resize(size > 0 ? size : 0);
+        bool ok = size >= 0 && fread(data.data(), 1, data.size(), file) == data.size();
+        fclose(file);
+        return ok;
+    }
+
+    std::string TextureCache::GetEntryPath(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+        return directory + "/" + name + entrySuffix;
+    }
+
+    bool TextureCache::Load(uint64_t key, gps::Image& image)
+    {
+        std::string entryPath = GetEntryPath(key);
+        int file = open(entryPath.c_str(), O_RDONLY);
+        if (file < 0)
+            return false;
+
+        struct stat info;
+        void* mapping = MAP_FAILED;
+        if (fstat(file, &info) == 0 && (size_t)info.st_size >= sizeof(CacheHeader))
+            mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if (mapping == MAP_FAILED)
+            return false;
+
+        size_t length = info.st_size;
+        const unsigned char* bytes = (const unsigned char*)mapping;
+        CacheHeader header;
+        memcpy(&header, bytes, sizeof(header));
+        bool ok = header.magic == cacheMagic && header.version == cacheVersion &&
+                  header.width > 0 && header.width <= 65536 && header.height > 0 && header.height <= 65536 &&
+                  header.channels > 0 && header.channels <= 4 && header.levelCount > 0 && header.levelCount <= 32 &&
+                  sizeof(header) + (header.levelCount + 1) * sizeof(uint64_t) <= header.dataOffset &&
+                  header.dataOffset <= length;
+
+        std::vector<uint64_t> offsets;
+        if (ok) {
+            offsets.resize(header.levelCount + 1);
+            memcpy(offsets.data(), bytes + sizeof(header), offsets.size() * sizeof(uint64_t));
+            ok = offsets[0] == 0 && offsets.back() <= length - header.dataOffset;
+            // every level must hold exactly the rows the upload reads from it
+            for (uint32_t level = 0; ok && level < header.levelCount; level++) {
+                uint64_t width = std::max(1u, header.width >> level), height = std::max(1u, header.height >> level);
+                ok = offsets[level + 1] >= offsets[level] &&
+                     offsets[level + 1] - offsets[level] == width * height * header.channels;
+            }
+        }
+        if (!ok) {
+            fprintf(stderr, "WARNING: ignoring damaged cache entry %s\n", entryPath.c_str());
+            munmap(mapping, length);
+            return false;
+        }
+
+        // start reading the texels in now, instead of faulting them in during the upload
+        madvise(mapping, length, MADV_WILLNEED);
+        // touching the entry makes it the most recently used one
+        utimensat(AT_FDCWD, entryPath.c_str(), NULL, 0);
+
+        image.width = header.width;
+        image.height = header.height;
+        image.channels = header.channels;
+        image.compressedFormat = 0;
+        image.levelOffsets.assign(offsets.begin(), offsets.end());
+        image.pixels = std::shared_ptr<unsigned char>((unsigned char*)mapping + header.dataOffset,
+                                                      [mapping, length](unsigned char*) { munmap(mapping, length); });
+        return true;
+    }
+
+    bool TextureCache::Store(uint64_t key, const gps::Image& image)
+    {
+        if (image.compressedFormat != 0)
+            return false;
+        mkdir(directory.c_str(), 0755);
+        std::string entryPath = GetEntryPath(key);
+
+        std::vector<uint64_t> offsets(image.levelOffsets.begin(), image.levelOffsets.end());
+        if (offsets.empty()) {
+            offsets.push_back(0);
+            offsets.push_back((uint64_t)image.width * image.height * image.channels);
+        }
+
+        CacheHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = cacheMagic;
+        header.version = cacheVersion;
+        header.width = image.width;
+        header.height = image.height;
+        header.channels = image.channels;
+        header.levelCount = (uint32_t)offsets.size() - 1;
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        size_t headerBytes = sizeof(header) + offsets.size() * sizeof(uint64_t);
+        header.dataOffset = (headerBytes + pageSize - 1) / pageSize * pageSize;
+        std::vector<unsigned char> padding(header.dataOffset - headerBytes, 0);
+
+        // written under a private name and renamed, so readers never see half an entry
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%zx.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+        std::string temporaryPath = entryPath + suffix;
+        FILE* file = fopen(temporaryPath.c_str(), "wb");
+        if (!file)
+            return false;
+
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = ok && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size();
+        ok = ok && fwrite(padding.data(), 1, padding.size(), file) == padding.size();
+        ok = ok && fwrite(image.pixels.get(), 1, offsets.back(), file) == offsets.back();
+        ok = fclose(file) == 0 && ok;
+
+        if (!ok || rename(temporaryPath.c_str(), entryPath.c_str()) != 0) {
+            fprintf(stderr, "WARNING: could not write cache entry %s\n", entryPath.c_str());
+            remove(temporaryPath.c_str());
+            return false;
+        }
+
+        Trim();
+        return true;
+    }
+
+    void TextureCache::Trim()
+    {
+        std::lock_guard<std::mutex> lock(trimMutex);
+        DIR* entries = opendir(directory.c_str());
+        if (!entries)
+            return;
+
+        struct Entry
+        {
+            std::string path;
+            size_t size;
+            struct timespec used;
+        };
+        std::vector<Entry> files;
+        size_t total = 0;
+        while (struct dirent* entry = readdir(entries)) {
+            std::string name = entry->d_name;
+            bool cached = false;
+            for (const char* suffix : trimmedSuffixes)
+                cached = cached || (name.size() > strlen(suffix) && name.compare(name.size() - strlen(suffix), std::string::npos, suffix) == 0);
+            if (!cached)
+                continue;
+            Entry file;
+            file.path = directory + "/" + name;
+            struct stat info;
+            if (stat(file.path.c_str(), &info) != 0)
+                continue;
+            file.size = info.st_size;
+            file.used = info.st_mtim;
+            files.push_back(file);
+            total += file.size;
+        }
+        closedir(entries);
+
+        std::sort(files.begin(), files.end(), [](const Entry& a, const Entry& b) {
+            return a.used.tv_sec != b.used.tv_sec ? a.used.tv_sec < b.used.tv_sec : a.used.tv_nsec < b.used.tv_nsec;
+        });
+        // a mapped entry stays readable after it is unlinked, so in-flight loads are safe
+        for (size_t i = 0; i < files.size() && total > maxBytes; i++) {
+            if (remove(files[i].path.c_str()) == 0)
+                total -= files[i].size;
+        }
+    }
+
+    void TextureCache::Clear()
+    {
+        std::lock_guard<std::mutex> lock(trimMutex);
+        DIR* entries = opendir(directory.c_str());
+        if (!entries)
+            return;
+        while (struct dirent* entry = readdir(entries)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..")
+                remove((directory + "/" + name).c_str());
+        }
+        closedir(entries);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef TextureCache_hpp
+#define TextureCache_hpp
+
+#include "Mesh.hpp"
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Content addressed on-disk cache of decoded, flipped and mipmapped textures.
+    // Entries are named after a hash of the source file's bytes and are memory mapped
+    // on load, so a warm start is a page-in plus the upload. The directory is kept
+    // under a size limit by deleting the least recently used entries, including the mesh
+    // and program cache entries stored next to them.
+    class TextureCache
+    {
+    public:
+        explicit TextureCache(std::string directory = "cache", size_t maxBytes = 512 * 1024 * 1024);
+
+        // Key of a source file's contents; variant tells apart copies that were processed
+        // differently, e.g. with another mip filter or channel count
+        static uint64_t GetKey(const unsigned char* data, size_t size, std::string variant);
+        // Reads a whole source file, to hash and then decode it from memory
+        static bool ReadFile(const char* fileName, std::vector<unsigned char>& data);
+
+        // Load, Store and Trim are safe to call from worker threads.
+        // On a hit image.pixels points into the mapped entry.
+        bool Load(uint64_t key, gps::Image& image);
+        bool Store(uint64_t key, const gps::Image& image);
+        // Deletes least recently used entries (.tex, .mesh and .prog) until the directory
+        // fits in maxBytes
+        void Trim();
+        // Deletes every entry, for measuring cold starts
+        void Clear();
+
+    private:
+        std::string directory;
+        size_t maxBytes;
+        // serialises trimming, so two workers never delete the same entries
+        std::mutex trimMutex;
+
+        std::string GetEntryPath(uint64_t key);
+    };
+}
+
+#endif /* TextureCache_hpp */
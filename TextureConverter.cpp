@@ -0,0 +1,154 @@
+// Offline tool: converts the scene's images into block compressed, mipmapped .dds files
+// that Model3D picks up instead of the originals.
+//
+//   TextureConverter [--bc1 | --bc3 | --bc5] [--threads N] [--repeat N] image...
+//
+// Each image is written next to its source as <name>.dds. Without a format flag normal maps
+// (names containing "normal" or ending in "NM") get BC5, images with transparency BC3 and
+// everything else BC1. --repeat encodes every level N times and reports the best time.
+
+#include "BlockCompression.hpp"
+#include "DdsFile.hpp"
+#include "MipGenerator.hpp"
+#include "ThreadPool.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct ConverterOptions
+{
+    bool forceFormat = false;
+    gps::BLOCK_FORMAT format = gps::BLOCK_BC1;
+    unsigned threads = 0;
+    int repeat = 1;
+};
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool isNormalMap(std::string path)
+{
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    name = name.substr(0, name.find_last_of('.'));
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    return lower.find("normal") != std::string::npos ||
+           (name.size() >= 2 && name.compare(name.size() - 2, 2, "NM") == 0);
+}
+
+bool hasTransparency(const unsigned char* rgba, size_t texelCount)
+{
+    for (size_t i = 0; i < texelCount; i++) {
+        if (rgba[i * 4 + 3] != 255)
+            return true;
+    }
+    return false;
+}
+
+bool convert(std::string path, const ConverterOptions& options, gps::ThreadPool& pool)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int width, height, n;
+    // stored bottom row first, like Model3D does after decoding
+    stbi_set_flip_vertically_on_load(1);
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &n, 4);
+    if (!data) {
+        std::cerr << "ERROR: could not load " << path << std::endl;
+        return false;
+    }
+    gps::Image image;
+    image.width = width;
+    image.height = height;
+    image.channels = 4;
+    image.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+    double decodeTime = millisecondsSince(start);
+
+    gps::BLOCK_FORMAT format = options.format;
+    if (!options.forceFormat) {
+        if (isNormalMap(path))
+            format = gps::BLOCK_BC5;
+        else if (hasTransparency(image.pixels.get(), (size_t)width * height))
+            format = gps::BLOCK_BC3;
+        else
+            format = gps::BLOCK_BC1;
+    }
+
+    // normal maps hold vectors, not sRGB colour
+    start = std::chrono::steady_clock::now();
+    gps::GenerateMipChain(image, gps::MIP_KAISER, format != gps::BLOCK_BC5);
+    double mipTime = millisecondsSince(start);
+
+    std::vector<std::vector<unsigned char> > levels;
+    double encodeTime = 0.0;
+    double megapixels = 0.0;
+    for (size_t level = 0; level + 1 < image.levelOffsets.size(); level++) {
+        int levelWidth = std::max(1, width >> level);
+        int levelHeight = std::max(1, height >> level);
+        levels.push_back(std::vector<unsigned char>());
+
+        double best = 1e30;
+        for (int run = 0; run < options.repeat; run++) {
+            start = std::chrono::steady_clock::now();
+            gps::CompressImage(format, image.pixels.get() + image.levelOffsets[level], levelWidth, levelHeight, levels.back(), &pool);
+            best = std::min(best, millisecondsSince(start));
+        }
+        encodeTime += best;
+        megapixels += levelWidth * (double)levelHeight / 1e6;
+    }
+    size_t sourceBytes = image.levelOffsets.back();
+
+    std::string outputPath = gps::GetDdsPath(path);
+    if (!gps::WriteDds(outputPath.c_str(), format, width, height, levels))
+        return false;
+
+    size_t compressedBytes = 0;
+    for (size_t i = 0; i < levels.size(); i++)
+        compressedBytes += levels[i].size();
+
+    const char* formatNames[] = { "BC1", "BC3", "BC5" };
+    std::cout << path << " " << width << "x" << height << " " << formatNames[format]
+              << ": decode " << decodeTime << " ms, mips " << mipTime << " ms, encode " << encodeTime
+              << " ms (" << megapixels / (encodeTime / 1000.0) << " MP/s on " << pool.GetThreadCount() << " threads), "
+              << sourceBytes / 1024 << " KB -> " << compressedBytes / 1024 << " KB" << std::endl;
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    ConverterOptions options;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--bc1" || argument == "--bc3" || argument == "--bc5") {
+            options.forceFormat = true;
+            options.format = argument == "--bc1" ? gps::BLOCK_BC1 : (argument == "--bc3" ? gps::BLOCK_BC3 : gps::BLOCK_BC5);
+        } else if (argument == "--threads" && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+        } else if (argument == "--repeat" && i + 1 < argc) {
+            options.repeat = std::max(1, atoi(argv[++i]));
+        } else {
+            inputs.push_back(argument);
+        }
+    }
+
+    if (inputs.empty()) {
+        std::cerr << "usage: TextureConverter [--bc1 | --bc3 | --bc5] [--threads N] [--repeat N] image..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    gps::ThreadPool pool(options.threads);
+    bool ok = true;
+    for (size_t i = 0; i < inputs.size(); i++)
+        ok = convert(inputs[i], options, pool) && ok;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,118 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace gps {
+
+    ThreadPool::ThreadPool(unsigned threadCount)
+    {
+        busyWorkers = 0;
+        stopping = false;
+
+        if (threadCount == 0) {
+            unsigned hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        for (unsigned i = 0; i < threadCount; i++)
+            workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    void ThreadPool::Submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        jobAvailable.notify_one();
+    }
+
+    void ThreadPool::WaitIdle()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return jobs.empty() && busyWorkers == 0; });
+    }
+
+    void ThreadPool::ParallelFor(size_t count, std::function<void(size_t)> job)
+    {
+        // helpers may only get to run after this returns, so the shared state outlives the call
+        struct Loop
+        {
+            std::function<void(size_t)> job;
+            size_t count;
+            std::atomic<size_t> next;
+            size_t remaining;
+            std::mutex doneMutex;
+            std::condition_variable done;
+        };
+        std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+        loop->job = job;
+        loop->count = count;
+        loop->next = 0;
+        loop->remaining = count;
+
+        std::function<void()> work = [loop]() {
+            for (size_t i = loop->next++; i < loop->count; i = loop->next++) {
+                loop->job(i);
+                std::lock_guard<std::mutex> lock(loop->doneMutex);
+                if (--loop->remaining == 0)
+                    loop->done.notify_all();
+            }
+        };
+
+        size_t helpers = std::min(count, workers.size());
+        for (size_t i = 0; i < helpers; i++)
+            Submit(work);
+
+        // if every worker is busy, possibly with the caller itself, this does all the work
+        work();
+
+        std::unique_lock<std::mutex> lock(loop->doneMutex);
+        loop->done.wait(lock, [&] { return loop->remaining == 0; });
+    }
+
+    unsigned ThreadPool::GetThreadCount()
+    {
+        return (unsigned)workers.size();
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                busyWorkers++;
+            }
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busyWorkers--;
+                if (jobs.empty() && busyWorkers == 0)
+                    idle.notify_all();
+            }
+        }
+    }
+}
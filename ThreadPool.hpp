@@ -0,0 +1,42 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    class ThreadPool
+    {
+    public:
+        // threadCount = 0 picks one worker per hardware thread, leaving one for the render thread
+        explicit ThreadPool(unsigned threadCount = 0);
+        ~ThreadPool();
+
+        // Queues a job to run on one of the worker threads
+        void Submit(std::function<void()> job);
+        // Blocks until the queue is empty and every worker is idle
+        void WaitIdle();
+        // Runs job(0) .. job(count - 1) on the workers and returns once all of them finished.
+        // The caller takes indices too, so it is safe to call from a worker thread.
+        void ParallelFor(size_t count, std::function<void(size_t)> job);
+        unsigned GetThreadCount();
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()> > jobs;
+        std::mutex mutex;
+        std::condition_variable jobAvailable;
+        std::condition_variable idle;
+        unsigned busyWorkers;
+        bool stopping;
+
+        void WorkerLoop();
+    };
+}
+
+#endif /* ThreadPool_hpp */
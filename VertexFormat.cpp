@@ -0,0 +1,84 @@
+#include "VertexFormat.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    static GLushort quantizeUnorm(float value, float offset, float scale)
+    {
+        float normalized = scale > 0.0f ? (value - offset) / scale : 0.0f;
+        return (GLushort)lrintf(std::min(std::max(normalized, 0.0f), 1.0f) * 65535.0f);
+    }
+
+    static GLshort quantizeSnorm(float value)
+    {
+        return (GLshort)lrintf(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+    }
+
+    // Projects the normal onto the octahedron |x| + |y| + |z| = 1 and folds the lower half
+    // over the upper one, so two components cover the sphere almost uniformly
+    static glm::vec2 encodeOctahedral(glm::vec3 normal)
+    {
+        float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+        if (length == 0.0f)
+            return glm::vec2(0.0f);
+        normal /= length;
+        glm::vec2 encoded(normal.x, normal.y);
+        if (normal.z < 0.0f) {
+            encoded.x = (1.0f - fabsf(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f);
+            encoded.y = (1.0f - fabsf(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return encoded;
+    }
+
+    void CompressVertices(const std::vector<gps::Vertex>& vertices, std::vector<gps::CompactVertex>& compact,
+                          gps::VertexDequantization& dequantization)
+    {
+        glm::vec3 positionMin(0.0f), positionMax(0.0f);
+        glm::vec2 texCoordMin(0.0f), texCoordMax(0.0f);
+        if (!vertices.empty()) {
+            positionMin = positionMax = vertices[0].Position;
+            texCoordMin = texCoordMax = vertices[0].TexCoords;
+        }
+        for (size_t i = 1; i < vertices.size(); i++) {
+            positionMin = glm::min(positionMin, vertices[i].Position);
+            positionMax = glm::max(positionMax, vertices[i].Position);
+            texCoordMin = glm::min(texCoordMin, vertices[i].TexCoords);
+            texCoordMax = glm::max(texCoordMax, vertices[i].TexCoords);
+        }
+        dequantization.positionOffset = positionMin;
+        dequantization.positionScale = positionMax - positionMin;
+        dequantization.texCoordOffset = texCoordMin;
+        dequantization.texCoordScale = texCoordMax - texCoordMin;
+
+        compact.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            for (int k = 0; k < 3; k++)
+                compact[i].Position[k] = quantizeUnorm(vertices[i].Position[k], positionMin[k], dequantization.positionScale[k]);
+            compact[i].Padding = 0;
+            glm::vec2 normal = encodeOctahedral(vertices[i].Normal);
+            compact[i].Normal[0] = quantizeSnorm(normal.x);
+            compact[i].Normal[1] = quantizeSnorm(normal.y);
+            for (int k = 0; k < 2; k++)
+                compact[i].TexCoords[k] = quantizeUnorm(vertices[i].TexCoords[k], texCoordMin[k], dequantization.texCoordScale[k]);
+        }
+    }
+
+    gps::Vertex DecompressVertex(const gps::CompactVertex& vertex, const gps::VertexDequantization& dequantization)
+    {
+        gps::Vertex decoded;
+        for (int k = 0; k < 3; k++)
+            decoded.Position[k] = vertex.Position[k] / 65535.0f * dequantization.positionScale[k] + dequantization.positionOffset[k];
+        for (int k = 0; k < 2; k++)
+            decoded.TexCoords[k] = vertex.TexCoords[k] / 65535.0f * dequantization.texCoordScale[k] + dequantization.texCoordOffset[k];
+
+        glm::vec3 normal(vertex.Normal[0] / 32767.0f, vertex.Normal[1] / 32767.0f, 0.0f);
+        normal.z = 1.0f - fabsf(normal.x) - fabsf(normal.y);
+        float fold = std::max(-normal.z, 0.0f);
+        normal.x += normal.x >= 0.0f ? -fold : fold;
+        normal.y += normal.y >= 0.0f ? -fold : fold;
+        decoded.Normal = glm::normalize(normal);
+        return decoded;
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef VertexFormat_hpp
+#define VertexFormat_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Quantizes positions and texture coordinates to 16 bits within their bounds and
+    // octahedral-encodes the normals into two 16 bit components
+    void CompressVertices(const std::vector<gps::Vertex>& vertices, std::vector<gps::CompactVertex>& compact,
+                          gps::VertexDequantization& dequantization);
+
+    // CPU mirror of the decoding in basic.vert, for checking the error
+    gps::Vertex DecompressVertex(const gps::CompactVertex& vertex, const gps::VertexDequantization& dequantization);
+}
+
+#endif /* VertexFormat_hpp */
@@ -0,0 +1,58 @@
+#include "Y4mFile.hpp"
+
+#include <stdio.h>
+
+namespace gps {
+
+    std::string GetY4mHeader(int width, int height, int frameRate)
+    {
+        char header[128];
+        snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, frameRate);
+        return header;
+    }
+
+    size_t GetI420Size(int width, int height)
+    {
+        size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+        return (size_t)width * height + 2 * chroma;
+    }
+
+    // BT.601 in 8 bit fixed point, luma in [16, 235] and chroma in [16, 240]
+    static inline unsigned char GetLuma(int r, int g, int b)
+    {
+        return (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+
+    void ConvertRgbaToI420(const unsigned char* rgba, int width, int height, bool flipRows, unsigned char* yuv)
+    {
+        int chromaWidth = (width + 1) / 2;
+        int chromaHeight = (height + 1) / 2;
+        unsigned char* lumaPlane = yuv;
+        unsigned char* uPlane = yuv + (size_t)width * height;
+        unsigned char* vPlane = uPlane + (size_t)chromaWidth * chromaHeight;
+
+        for (int y = 0; y < height; y++) {
+            const unsigned char* row = rgba + (size_t)(flipRows ? height - 1 - y : y) * width * 4;
+            unsigned char* luma = lumaPlane + (size_t)y * width;
+            for (int x = 0; x < width; x++)
+                luma[x] = GetLuma(row[x * 4], row[x * 4 + 1], row[x * 4 + 2]);
+        }
+
+        for (int cy = 0; cy < chromaHeight; cy++) {
+            // the last row and column of odd sizes pair with themselves
+            int y0 = cy * 2, y1 = cy * 2 + 1 < height ? cy * 2 + 1 : cy * 2;
+            const unsigned char* row0 = rgba + (size_t)(flipRows ? height - 1 - y0 : y0) * width * 4;
+            const unsigned char* row1 = rgba + (size_t)(flipRows ? height - 1 - y1 : y1) * width * 4;
+            for (int cx = 0; cx < chromaWidth; cx++) {
+                int x0 = cx * 2 * 4, x1 = (cx * 2 + 1 < width ? cx * 2 + 1 : cx * 2) * 4;
+                int r = row0[x0] + row0[x1] + row1[x0] + row1[x1];
+                int g = row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1];
+                int b = row0[x0 + 2] + row0[x1 + 2] + row1[x0 + 2] + row1[x1 + 2];
+                // sums of four, so the shift is two bits wider
+                size_t i = (size_t)cy * chromaWidth + cx;
+                uPlane[i] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+                vPlane[i] = (unsigned char)(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+            }
+        }
+    }
+}
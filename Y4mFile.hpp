@@ -0,0 +1,20 @@
+#ifndef Y4mFile_hpp
+#define Y4mFile_hpp
+
+#include <stddef.h>
+#include <string>
+
+namespace gps {
+
+    // Raw YUV4MPEG2 video, which ffmpeg and most players read: a header line, then per frame
+    // "FRAME\n" and the Y, U and V planes. Frames are 4:2:0 with BT.601 studio range.
+
+    std::string GetY4mHeader(int width, int height, int frameRate);
+    // Bytes of the planes of one frame; chroma planes round odd sizes up
+    size_t GetI420Size(int width, int height);
+    // Converts sRGB encoded RGBA pixels to the planes of one frame; chroma is the average of
+    // each 2x2 block. flipRows takes the last row first, for GL readbacks.
+    void ConvertRgbaToI420(const unsigned char* rgba, int width, int height, bool flipRows, unsigned char* yuv);
+}
+
+#endif /* Y4mFile_hpp */
@@ -1,2 +1,4 @@
 #!/bin/sh
-g++ -o Project -lGL -lGLEW -lglfw main.cpp Window.cpp Shader.cpp Camera.cpp Mesh.cpp Model3D.cpp stb_image.cpp tiny_obj_loader.cpp SkyBox.cpp
+g++ -O2 -march=native -pthread -o Project -lGL -lGLEW -lglfw main.cpp Window.cpp Shader.cpp ShaderCache.cpp GpuProfiler.cpp FileWatcher.cpp Camera.cpp Mesh.cpp Model3D.cpp stb_image.cpp tiny_obj_loader.cpp SkyBox.cpp ThreadPool.cpp AssetStreamer.cpp RingAllocator.cpp StagingRing.cpp BlockCompression.cpp DdsFile.cpp MipGenerator.cpp TextureCache.cpp ImageUtils.cpp ObjLoader.cpp Arena.cpp MeshOptimizer.cpp MeshCache.cpp VertexFormat.cpp MeshSimplifier.cpp Terrain.cpp DuneGenerator.cpp LightClusters.cpp ClusteredLighting.cpp ShadowMaps.cpp ResolutionController.cpp DynamicResolution.cpp PngFile.cpp PixelReadback.cpp BatchRenderer.cpp Y4mFile.cpp FrameCapture.cpp
+g++ -O2 -march=native -pthread -o TextureConverter TextureConverter.cpp BlockCompression.cpp DdsFile.cpp MipGenerator.cpp ThreadPool.cpp stb_image.cpp
+g++ -O2 -march=native -pthread -o Benchmarks Benchmarks.cpp Arena.cpp ImageUtils.cpp MipGenerator.cpp ObjLoader.cpp ThreadPool.cpp stb_image.cpp tiny_obj_loader.cpp MeshOptimizer.cpp VertexFormat.cpp MeshSimplifier.cpp DuneGenerator.cpp LightClusters.cpp ResolutionController.cpp PngFile.cpp Y4mFile.cpp RingAllocator.cpp BlockCompression.cpp
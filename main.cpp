@@ -12,8 +12,28 @@
 #include "Camera.hpp"
 #include "Model3D.hpp"
 #include "SkyBox.hpp"
-
+#include "ThreadPool.hpp"
+#include "AssetStreamer.hpp"
+#include "Terrain.hpp"
+#include "DuneGenerator.hpp"
+#include "FileWatcher.hpp"
+#include "GpuProfiler.hpp"
+#include "ClusteredLighting.hpp"
+#include "ShadowMaps.hpp"
+#include "DynamicResolution.hpp"
+#include "BatchRenderer.hpp"
+#include "FrameCapture.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <sys/resource.h>
 
 // window
 gps::Window myWindow;
@@ -31,6 +51,12 @@ glm::mat4 modelWater;
 // light parameters
 glm::vec3 lightDir;
 glm::vec3 lightColor;
+// --night: dim moonlight instead of the sun, and campfires and lanterns lit through clustered lighting
+int nightLightCount = 0;
+const glm::vec3 moonlightColor(0.1f, 0.12f, 0.2f);
+std::vector<gps::PointLight> nightLights;
+// nightLights with this frame's flicker
+std::vector<gps::PointLight> frameLights;
 
 // shader uniform locations
 GLuint modelLoc;
@@ -41,7 +67,6 @@ GLuint lightDirLoc;
 GLuint lightColorLoc;
 GLuint pointLightLoc;
 GLuint pointLightColorLoc;
-GLuint fogLoc;
 GLuint clipPlaneLoc;
 GLuint reflectTex;
 GLuint refractTex;
@@ -66,10 +91,92 @@ gps::Model3D heliBlades;
 gps::Shader myBasicShader;
 gps::Shader skyBoxShader;
 gps::Shader waterShader;
+gps::Shader upscaleShader;
+// GPU time of the reflection, refraction and main passes, with --gpu-profile
+gps::GpuProfiler gpuProfiler;
+bool gpuProfiling = false;
+const int gpuProfileReportFrames = 300;
+// edits to shaders/ are rebuilt and swapped in while the scene keeps running
+gps::FileWatcher shaderWatcher("shaders");
 
 // skybox
 gps::SkyBox mySkyBox;
 
+// background loading
+gps::ThreadPool workerPool;
+gps::AssetStreamer assetStreamer(workerPool);
+// bins the night lights into the main camera's clusters on the workers every frame
+gps::ClusteredLighting clusteredLighting(workerPool);
+// per-frame GPU upload budget for streamed assets
+const size_t uploadBudgetBytes = 8 * 1024 * 1024;
+const double uploadBudgetMilliseconds = 4.0;
+std::chrono::steady_clock::time_point startupTime;
+bool firstFrameDrawn = false;
+bool fullyLoaded = false;
+// decoded textures with their mip chains, kept between runs
+const size_t textureCacheBytes = 512 * 1024 * 1024;
+gps::TextureCache textureCache("cache", textureCacheBytes);
+// parsed and optimized models, next to the textures
+gps::MeshCache meshCache("cache", &textureCache);
+gps::ShaderCache shaderCache("cache", &textureCache);
+// level of detail tolerance of the pass being drawn, in world space; the water targets
+// are sampled distorted and blurred, so they accept coarser meshes
+gps::LodSelection lodSelection;
+const float sceneLodPixelError = 1.0f;
+const float waterLodPixelError = 4.0f;
+// shader variants of the passes: the water targets clip at the surface and skip the point
+// light, the main pass lights fully and needs no clip plane; fog is added while it is on,
+// and the main pass loops over the clustered lights at night and samples the shadow maps
+const unsigned waterPassFeatures = gps::SHADER_CLIP_PLANE;
+unsigned mainPassFeatures = gps::SHADER_POINT_LIGHT;
+// view-projection of the pass being drawn, for terrain culling
+glm::mat4 passViewProjection;
+// --shadows: cascaded shadow maps of the sun in the main pass, refitted to its camera
+gps::ShadowOptions shadowOptions;
+bool shadows = false;
+std::unique_ptr<gps::ShadowMaps> shadowMaps;
+const float shadowLodPixelError = 2.0f;
+// streaming progress when the static casters were last drawn
+size_t shadowUploadedBytes = 0;
+int shadowUploadedTiles = 0;
+// cascade redraws since the last --gpu-profile report
+long long shadowStaticDraws = 0;
+long long shadowDynamicDraws = 0;
+// the main pass lays down depth with positions only first, then shades with GL_EQUAL so
+// every visible pixel is lit once (--depth-prepass, toggled with P)
+bool depthPrepass = false;
+// O shows shaded fragments per pixel instead of the scene and prints their average
+bool overdrawView = false;
+// what the OVERDRAW variant adds per fragment, in 8 bit red; 31 layers saturate a pixel
+const int overdrawStep = 8;
+const int overdrawReportFrames = 120;
+int overdrawFrames = 0;
+// --dynamic-resolution: the scene and water passes draw at a scale of their targets that
+// follows the GPU frame time, and the scene is stretched over the window
+gps::ResolutionOptions resolutionOptions;
+bool dynamicResolution = false;
+std::unique_ptr<gps::DynamicResolution> sceneTarget;
+const int waterTargetSize = 2048;
+// --batch poses.txt: draws every camera pose of the file offscreen into its own PNG, then exits
+std::string batchPoses;
+gps::BatchOptions batchOptions;
+std::unique_ptr<gps::BatchRenderer> batchRenderer;
+// R records the window: a .y4m path is one video, anything else a directory of numbered PNGs.
+// Frames are read back a few frames late and encoded on the workers; by default frames the
+// readbacks or encoders have no room for are dropped so the frame time is not disturbed.
+gps::CaptureOptions captureOptions;
+bool recordAtStart = false;
+std::unique_ptr<gps::FrameCapture> frameCapture;
+int recordings = 0;
+
+// heightfield terrain drawn instead of desert.obj, from the heightmap given with --terrain
+// or generated dunes with --dunes
+std::string terrainHeightmap;
+bool terrainDunes = false;
+gps::DuneOptions duneOptions;
+std::unique_ptr<gps::Terrain> terrain;
+glm::mat4 modelTerrain(1.0f);
+
 // animation parameters
 float deltaMov = 0;
 float deltaAngle = 0;
@@ -96,6 +203,8 @@ double lastTimeStamp = glfwGetTime();
 
 // yaw pitch
 GLdouble yaw = 0, pitch = 0;
+// cursor movement per degree of camera rotation
+const GLfloat mouseSensitivity = 10;
 
 // fog
 GLboolean fog;
@@ -176,6 +285,68 @@ void windowResizeCallback(GLFWwindow *window, int width, int height)
     glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
     //set the viewport to the new dimensions
     glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+    if (sceneTarget)
+        sceneTarget->Resize(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+}
+
+// Later recordings get a number, so they do not overwrite the first: capture-2.y4m
+std::string getRecordingPath()
+{
+    if (recordings == 0)
+        return captureOptions.path;
+    std::string path = captureOptions.path;
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = path.size();
+    return path.substr(0, dot) + "-" + std::to_string(recordings + 1) + path.substr(dot);
+}
+
+void toggleRecording()
+{
+    if (!frameCapture)
+        return;
+    if (frameCapture->IsRecording())
+    {
+        frameCapture->Stop();
+        gps::CaptureStats stats = frameCapture->GetStats();
+        int encoded = std::max(stats.written + stats.failed, 1);
+        std::cout << "Recorded " << stats.written << " frames in " << stats.seconds << " s, "
+                  << stats.written / std::max(stats.seconds, 1e-6) << " frames/s; " << stats.dropped << " dropped, encoding "
+                  << stats.encodeMilliseconds / encoded << " ms and " << stats.bytes / encoded / 1024 << " KB per frame, "
+                  << stats.readbackStalls << " waits for the GPU, " << stats.encoderWaits << " for the encoders" << std::endl;
+        if (stats.failed > 0)
+            std::cerr << "ERROR: could not write " << stats.failed << " frames of the recording" << std::endl;
+        recordings++;
+        return;
+    }
+
+    // a fresh capture, so the path of this recording is used
+    gps::CaptureOptions options = captureOptions;
+    options.path = getRecordingPath();
+    frameCapture->Delete();
+    frameCapture.reset(new gps::FrameCapture(workerPool, options));
+    frameCapture->Init();
+    int width = myWindow.getWindowDimensions().width;
+    int height = myWindow.getWindowDimensions().height;
+    if (frameCapture->Start(width, height))
+        std::cout << "Recording " << width << "x" << height << " to " << options.path << std::endl;
+    else
+        std::cerr << "ERROR: could not create " << options.path << std::endl;
+}
+
+// Queues a readback of the finished frame in the back buffer while recording
+void captureFrame()
+{
+    if (!frameCapture)
+        return;
+    frameCapture->Poll();
+    if (!frameCapture->IsRecording())
+        return;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glReadBuffer(GL_BACK);
+    // a resized window drops frames until the recording is restarted
+    frameCapture->Capture(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
 }
 
 void keyboardCallback(GLFWwindow *window, int key, int scancode, int action, int mode)
@@ -192,12 +363,22 @@ void keyboardCallback(GLFWwindow *window, int key, int scancode, int action, int
             pressedKeys[key] = true;
             if (key == GLFW_KEY_F)
             {
+                // fog is compiled into the shader variants each pass selects
                 fog = !fog;
-                myBasicShader.useShaderProgram();
-                glUniform1i(fogLoc,fog);
-                skyBoxShader.useShaderProgram();
-                GLuint skyboxFogLoc = glGetUniformLocation(skyBoxShader.shaderProgram, "fog");;
-                glUniform1i(skyboxFogLoc,fog);
+            }
+            if (key == GLFW_KEY_P)
+            {
+                depthPrepass = !depthPrepass;
+                std::cout << "Depth pre-pass " << (depthPrepass ? "on" : "off") << std::endl;
+            }
+            if (key == GLFW_KEY_O)
+            {
+                overdrawView = !overdrawView;
+                overdrawFrames = 0;
+            }
+            if (key == GLFW_KEY_R)
+            {
+                toggleRecording();
             }
         }
         else if (action == GLFW_RELEASE)
@@ -209,7 +390,7 @@ void keyboardCallback(GLFWwindow *window, int key, int scancode, int action, int
 
 void mouseCallback(GLFWwindow *window, double xpos, double ypos)
 {
-    GLfloat sensitivity = 10;
+    GLfloat sensitivity = mouseSensitivity;
     glfwGetCursorPos(myWindow.getWindow(), &yaw, &pitch);
 
     if (pitch / sensitivity > 87)
@@ -305,23 +486,68 @@ void initOpenGLState()
 
 void initModels()
 {
-    desert.LoadModel("models/desert2/desert.obj");
-    casa.LoadModel("models/casa/casa.obj");
-    heli.LoadModel("models/Heli/heli_no_blades.obj");
-    heliBlades.LoadModel("models/Heli/blades.obj");
+    assetStreamer.SetUploadBudget(uploadBudgetBytes, uploadBudgetMilliseconds);
+    assetStreamer.Init();
+    if (terrainDunes || !terrainHeightmap.empty())
+    {
+        // the heightmap repeats every 1024 units and the dunes go on forever, so the desert has no edge
+        gps::TerrainOptions options;
+        options.tileSize = 128.0f;
+        options.lodDistance = 32.0f;
+        options.textureScale = 1.0f / 16.0f;
+        gps::HeightSource source = terrainDunes ? gps::DuneGenerator(duneOptions).GetHeightSource() :
+            gps::Terrain::ImageHeightSource(terrainHeightmap, 1024.0f, -10.0f, 30.0f);
+        terrain.reset(new gps::Terrain(workerPool, source, options));
+        terrain->Init("models/desert2/color.jpg", "models/desert2/spec.jpg");
+    }
+    else
+        assetStreamer.RequestModel(&desert, "models/desert2/desert.obj");
+    assetStreamer.RequestModel(&casa, "models/casa/casa.obj");
+    assetStreamer.RequestModel(&heli, "models/Heli/heli_no_blades.obj");
+    assetStreamer.RequestModel(&heliBlades, "models/Heli/blades.obj");
 }
 
 void initShaders()
 {
-    myBasicShader.loadShader(
+    gps::Shader::initParallelCompile();
+    myBasicShader.loadVariants(
         "shaders/basic.vert",
-        "shaders/basic.frag");
-    skyBoxShader.loadShader(
+        "shaders/basic.frag",
+        gps::SHADER_FOG | gps::SHADER_POINT_LIGHT | gps::SHADER_CLIP_PLANE | gps::SHADER_DEPTH_ONLY | gps::SHADER_OVERDRAW |
+        gps::SHADER_CLUSTERED_LIGHTS | gps::SHADER_SHADOWS);
+    skyBoxShader.loadVariants(
         "shaders/skyboxShader.vert",
-        "shaders/skyboxShader.frag");
+        "shaders/skyboxShader.frag",
+        gps::SHADER_FOG);
     waterShader.loadShader(
         "shaders/water.vert",
         "shaders/water.frag");
+    upscaleShader.loadShader(
+        "shaders/upscale.vert",
+        "shaders/upscale.frag");
+
+    // start every variant the first frame needs before waiting for any of them
+    myBasicShader.requestVariant(waterPassFeatures);
+    myBasicShader.requestVariant(mainPassFeatures);
+    skyBoxShader.requestVariant(0);
+    if (depthPrepass || shadows)
+        myBasicShader.requestVariant(gps::SHADER_DEPTH_ONLY);
+    myBasicShader.selectVariant(waterPassFeatures);
+    myBasicShader.selectVariant(mainPassFeatures);
+    skyBoxShader.selectVariant(0);
+    if (depthPrepass || shadows)
+        myBasicShader.selectVariant(gps::SHADER_DEPTH_ONLY);
+
+    // link status queries inside loadShader wait for the driver, so these are the real costs
+    const gps::ShaderStats& stats = gps::Shader::stats;
+    std::cout << "Shaders: " << stats.compiled << " compiled in " << stats.compileMilliseconds << " ms, "
+              << stats.cached << " loaded from the program cache in " << stats.cacheMilliseconds << " ms" << std::endl;
+
+    // the fog variants build in the background, so the first press of F does not stall
+    myBasicShader.requestVariant(waterPassFeatures | gps::SHADER_FOG);
+    myBasicShader.requestVariant(mainPassFeatures | gps::SHADER_FOG);
+    skyBoxShader.requestVariant(gps::SHADER_FOG);
+    myBasicShader.requestVariant(gps::SHADER_DEPTH_ONLY);
 }
 
 void initSkyBox()
@@ -333,7 +559,107 @@ void initSkyBox()
     faces.push_back("textures/skybox/bottom.tga");
     faces.push_back("textures/skybox/back.tga");
     faces.push_back("textures/skybox/front.tga");
-    mySkyBox.Load(faces);
+    assetStreamer.RequestSkyBox(&mySkyBox, faces);
+}
+
+// Rebuilds the shaders whose sources changed on disk. The new programs are only swapped in
+// between frames once they have all linked, so a broken edit leaves the old ones running.
+void updateShaderReload()
+{
+    gps::Shader* shaders[4] = { &myBasicShader, &skyBoxShader, &waterShader, &upscaleShader };
+    const char* names[4] = { "basic", "skyboxShader", "water", "upscale" };
+    std::vector<std::string> changed = shaderWatcher.Poll();
+    for (size_t f = 0; f < changed.size(); f++)
+    {
+        for (int s = 0; s < 4; s++)
+        {
+            if (shaders[s]->usesFile(changed[f]))
+            {
+                std::cout << "Rebuilding " << names[s] << " after a change to " << changed[f] << std::endl;
+                shaders[s]->reload();
+            }
+        }
+    }
+    for (int s = 0; s < 4; s++)
+    {
+        if (shaders[s]->updateReload())
+            std::cout << "Swapped in the new " << names[s] << " programs" << std::endl;
+    }
+}
+
+double millisecondsSinceStartup()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupTime).count();
+}
+
+// High water mark of the resident set so far
+long peakResidentMegabytes()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024;
+}
+
+// Uploads whatever the workers finished and reports the loading milestones
+void updateStreaming()
+{
+    assetStreamer.Update();
+    if (terrain)
+        terrain->Update(glm::vec3(glm::inverse(modelTerrain) * glm::vec4(myCamera.cameraPosition, 1.0f)));
+
+    if (!fullyLoaded && assetStreamer.IsIdle())
+    {
+        fullyLoaded = true;
+        std::cout << "Time to fully loaded: " << millisecondsSinceStartup() << " ms ("
+                  << assetStreamer.GetUploadedBytes() / (1024 * 1024) << " MB uploaded, peak RSS "
+                  << peakResidentMegabytes() << " MB)" << std::endl;
+
+        const gps::TextureOptions& options = gps::Model3D::textureOptions;
+        std::string mipPath = options.cpuMipmaps ? std::string("cpu ") + gps::GetMipFilterName(options.filter) : "driver";
+        // summed over the worker threads for the CPU path
+        std::cout << "Mip generation (" << mipPath << "): " << gps::Model3D::textureStats.mipMicroseconds / 1000.0
+                  << " ms, texture cache " << gps::Model3D::textureStats.cacheHits << " hits / "
+                  << gps::Model3D::textureStats.cacheMisses << " misses" << std::endl;
+
+        const gps::ArenaTotals& arenas = gps::Model3D::arenaTotals;
+        std::cout << "Load arenas: " << arenas.allocations - arenas.blocks << " heap allocations avoided ("
+                  << arenas.allocations << " served from " << arenas.blocks << " blocks), peak "
+                  << arenas.peakBytes / (1024.0 * 1024.0) << " MB per model" << std::endl;
+    }
+}
+
+// Scatters campfires (low, orange, wide) and lanterns (higher, yellow, small) around the oasis
+void initNightLights()
+{
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int i = 0; i < nightLightCount; i++)
+    {
+        gps::PointLight light;
+        float angle = unit(random) * 6.2831853f;
+        float distance = 2.0f + 38.0f * std::sqrt(unit(random));
+        bool campfire = i % 4 != 3;
+        light.position = glm::vec3(cosf(angle) * distance, campfire ? 0.3f : 1.2f + unit(random) * 0.8f, sinf(angle) * distance);
+        light.radius = campfire ? 3.0f + 3.0f * unit(random) : 1.5f + 1.5f * unit(random);
+        light.color = campfire ? glm::vec3(2.0f, 0.9f, 0.25f) : glm::vec3(1.0f, 0.8f, 0.5f);
+        nightLights.push_back(light);
+    }
+    frameLights = nightLights;
+}
+
+// Flickers the campfires, then bins every light for the main camera drawing at width x height
+void updateNightLights(int width, int height)
+{
+    float time = (float)glfwGetTime();
+    for (size_t i = 0; i < nightLights.size(); i++)
+    {
+        if (i % 4 == 3)
+            continue;
+        float phase = i * 1.7f;
+        float flicker = 0.85f + 0.15f * sinf(time * 11.0f + phase) * sinf(time * 7.3f + phase * 2.0f);
+        frameLights[i].color = nightLights[i].color * flicker;
+    }
+    clusteredLighting.Update(frameLights, view, glm::radians(45.0f), width, height);
 }
 
 void initUniforms()
@@ -368,12 +694,14 @@ void initUniforms()
 
     //set the light direction (direction towards the light)
     lightDir = glm::vec3(0.0f, 1.0f, 0.0f);
-    lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-    // send light dir to shader
-    glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
+    lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDirEye");
+    // send light dir to shader, in eye space
+    glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::normalize(glm::mat3(view) * lightDir)));
 
     //set light color
     lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
+    if (nightLightCount > 0)
+        lightColor = moonlightColor;
     lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
     // send light color to shader
     glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
@@ -382,15 +710,9 @@ void initUniforms()
     pointLightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightColor");
     glUniform3fv(pointLightColorLoc, 1, glm::value_ptr(lightColor2));
     glUniform3fv(pointLightLoc, 1, glm::value_ptr(pointLight));
-    //getting fog info and sending it to shader
-    fogLoc = glGetUniformLocation(myBasicShader.shaderProgram, "fog");
     fog = false;
-    glUniform1i(fogLoc,fog);
     clipPlaneLoc = glGetUniformLocation(myBasicShader.shaderProgram,"clipPlane");
     glUniform4fv(clipPlaneLoc,1,glm::value_ptr(NoclipPlane));
-    skyBoxShader.useShaderProgram();
-    GLuint skyboxFogLoc = glGetUniformLocation(skyBoxShader.shaderProgram, "fog");;
-    glUniform1i(skyboxFogLoc,fog);
     waterShader.useShaderProgram();
     reflectTex = glGetUniformLocation(waterShader.shaderProgram,"reflection");
     refractTex = glGetUniformLocation(waterShader.shaderProgram,"refraction");
@@ -462,8 +784,12 @@ void renderWater(gps::Shader shader){
     glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
     glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelWater));
+    // looked up again every frame, since a reloaded program may place them elsewhere
+    reflectTex = glGetUniformLocation(shader.shaderProgram, "reflection");
+    refractTex = glGetUniformLocation(shader.shaderProgram, "refraction");
     glUniform1i(reflectTex,0);
     glUniform1i(refractTex,1);
+    glUniform1f(glGetUniformLocation(shader.shaderProgram, "targetScale"), sceneTarget ? sceneTarget->GetScale() : 1.0f);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D,WaterTex[0]);
     glActiveTexture(GL_TEXTURE1);
@@ -473,20 +799,78 @@ void renderWater(gps::Shader shader){
     glBindVertexArray(0);
 }
 
-void renderDesert(gps::Shader shader)
+// Switches the basic shader to the pass's variant and sends it the pass's uniforms; each
+// variant is a program of its own, so nothing set on another one carries over
+void beginScenePass(unsigned features, const glm::mat4& passView, const glm::mat4& passProjection, const glm::vec4& clipPlane)
+{
+    // fog changes nothing the depth and overdraw variants write
+    if (fog && !(features & (gps::SHADER_DEPTH_ONLY | gps::SHADER_OVERDRAW)))
+        features |= gps::SHADER_FOG;
+    myBasicShader.selectVariant(features);
+    myBasicShader.useShaderProgram();
+    GLuint program = myBasicShader.shaderProgram;
+    modelLoc = glGetUniformLocation(program, "model");
+    viewLoc = glGetUniformLocation(program, "view");
+    projectionLoc = glGetUniformLocation(program, "projection");
+    normalMatrixLoc = glGetUniformLocation(program, "normalMatrix");
+    lightDirLoc = glGetUniformLocation(program, "lightDirEye");
+    lightColorLoc = glGetUniformLocation(program, "lightColor");
+    pointLightLoc = glGetUniformLocation(program, "pointLight");
+    pointLightColorLoc = glGetUniformLocation(program, "pointLightColor");
+    clipPlaneLoc = glGetUniformLocation(program, "clipPlane");
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(passView));
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(passProjection));
+    // the shader lights in eye space, so the direction is transformed here once per pass
+    glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::normalize(glm::mat3(passView) * lightDir)));
+    glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
+    glUniform3fv(pointLightLoc, 1, glm::value_ptr(pointLight));
+    glUniform3fv(pointLightColorLoc, 1, glm::value_ptr(lightColor2));
+    glUniform4fv(clipPlaneLoc, 1, glm::value_ptr(clipPlane));
+    if (features & gps::SHADER_CLUSTERED_LIGHTS)
+        clusteredLighting.Bind(program);
+    if (features & gps::SHADER_SHADOWS)
+        shadowMaps->Bind(program, passView);
+    // variants without CLIP_PLANE do not write gl_ClipDistance
+    if (features & gps::SHADER_CLIP_PLANE)
+        glEnable(GL_CLIP_DISTANCE0);
+    else
+        glDisable(GL_CLIP_DISTANCE0);
+}
+
+// The pass's selection with the camera moved into the model's coordinates
+gps::LodSelection lodSelectionFor(const glm::mat4& model)
+{
+    gps::LodSelection selection = lodSelection;
+    selection.eye = glm::vec3(glm::inverse(model) * glm::vec4(lodSelection.eye, 1.0f));
+    return selection;
+}
+
+void renderDesert(gps::Shader shader, bool depthOnly)
 {
     shader.useShaderProgram();
 
+    if (terrain)
+    {
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelTerrain));
+        normalMatrix = glm::mat3(glm::inverseTranspose(view * modelTerrain));
+        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+        terrain->Draw(shader, passViewProjection * modelTerrain, lodSelectionFor(modelTerrain).eye);
+        return;
+    }
+
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelDesert));
 
     normalMatrix = glm::mat3(glm::inverseTranspose(view * modelDesert));
     glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 
     // draw terrain
-    desert.Draw(shader);
+    if (depthOnly)
+        desert.DrawDepth(shader, lodSelectionFor(modelDesert));
+    else
+        desert.Draw(shader, lodSelectionFor(modelDesert));
 }
 
-void renderHouse(gps::Shader shader)
+void renderHouse(gps::Shader shader, bool depthOnly)
 {
     shader.useShaderProgram();
 
@@ -495,14 +879,16 @@ void renderHouse(gps::Shader shader)
     normalMatrix = glm::mat3(glm::inverseTranspose(view * modelCasa));
     glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 
-    // draw terrain
-    casa.Draw(shader);
+    // draw house
+    if (depthOnly)
+        casa.DrawDepth(shader, lodSelectionFor(modelCasa));
+    else
+        casa.Draw(shader, lodSelectionFor(modelCasa));
 }
 
-void renderHelicopter(gps::Shader shader)
+// Moves the helicopter once per frame, so every pass draws it in the same place
+void updateHelicopter()
 {
-    shader.useShaderProgram();
-
     double currentTimeStamp = glfwGetTime();
     updateDelta(currentTimeStamp - lastTimeStamp);
     lastTimeStamp = currentTimeStamp;
@@ -587,83 +973,349 @@ void renderHelicopter(gps::Shader shader)
         break;
     }
     }
+    heliBladeAngle += deltaAngle;
+    modelHeliBlades = glm::rotate(modelHeli, glm::radians(heliBladeAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void renderHelicopter(gps::Shader shader, bool depthOnly)
+{
+    shader.useShaderProgram();
+
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelHeli));
 
     normalMatrix = glm::mat3(glm::inverseTranspose(view * modelHeli));
     glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 
     // draw helicopter(bladeless)
-    heli.Draw(shader);
-    heliBladeAngle += deltaAngle;
-    modelHeliBlades = glm::rotate(modelHeli, glm::radians(heliBladeAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+    if (depthOnly)
+        heli.DrawDepth(shader, lodSelectionFor(modelHeli));
+    else
+        heli.Draw(shader, lodSelectionFor(modelHeli));
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelHeliBlades));
 
     normalMatrix = glm::mat3(glm::inverseTranspose(view * modelHeliBlades));
     glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
     // draw helicopter blades
-    heliBlades.Draw(shader);
+    if (depthOnly)
+        heliBlades.DrawDepth(shader, lodSelectionFor(modelHeliBlades));
+    else
+        heliBlades.Draw(shader, lodSelectionFor(modelHeliBlades));
+}
+
+// World space bounding sphere of a model; false while its bounds are unknown, with the
+// model's origin and radius 0 instead
+bool worldBounds(gps::Model3D& model, const glm::mat4& modelMatrix, glm::vec3& worldCenter, float& worldRadius)
+{
+    glm::vec3 center(0.0f);
+    float radius = 0.0f;
+    bool known = model.GetBounds(center, radius);
+    float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+                           std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    worldCenter = glm::vec3(modelMatrix * glm::vec4(center, 1.0f));
+    worldRadius = radius * scale;
+    return known;
+}
+
+// Distance from the pass's eye to the nearest point of a model's bounding sphere, 0 inside it;
+// models without known bounds count from their origin
+float distanceToModel(gps::Model3D& model, const glm::mat4& modelMatrix)
+{
+    glm::vec3 center;
+    float radius;
+    worldBounds(model, modelMatrix, center, radius);
+    return std::max(glm::length(lodSelection.eye - center) - radius, 0.0f);
+}
+
+// Whether a model can cast into a shadow cascade; models still loading always do
+bool castsIntoCascade(gps::Model3D& model, const glm::mat4& modelMatrix, int cascade)
+{
+    glm::vec3 center;
+    float radius;
+    return !worldBounds(model, modelMatrix, center, radius) || shadowMaps->IsVisible(cascade, center, radius);
+}
+
+// Draws a shadow cascade's casters through the depth-only variant; the desert and the house
+// are static, the helicopter moves
+void renderShadowCasters(int cascade, const glm::mat4& lightView, const glm::mat4& lightProjection, unsigned casters)
+{
+    beginScenePass(gps::SHADER_DEPTH_ONLY, lightView, lightProjection, NoclipPlane);
+    lodSelection.pixelsPerUnit = 1.0f / shadowMaps->GetTexelSize(cascade);
+    lodSelection.perspective = false;
+    lodSelection.maxPixelError = shadowLodPixelError;
+    passViewProjection = lightProjection * lightView;
+    if (casters & gps::SHADOW_STATIC)
+    {
+        renderDesert(myBasicShader, true);
+        if (castsIntoCascade(casa, modelCasa, cascade))
+            renderHouse(myBasicShader, true);
+    }
+    if ((casters & gps::SHADOW_DYNAMIC) &&
+        (castsIntoCascade(heli, modelHeli, cascade) || castsIntoCascade(heliBlades, modelHeliBlades, cascade)))
+        renderHelicopter(myBasicShader, true);
+}
+
+// Refits the shadow cascades to the main camera and redraws the ones that need it; static
+// caches are dropped whenever streamed geometry arrives. aspect is the main pass's
+void updateShadows(float aspect)
+{
+    size_t uploadedBytes = assetStreamer.GetUploadedBytes();
+    int uploadedTiles = terrain ? terrain->GetStats().uploadedTiles : 0;
+    if (uploadedBytes != shadowUploadedBytes || uploadedTiles != shadowUploadedTiles)
+    {
+        shadowMaps->InvalidateStatic();
+        shadowUploadedBytes = uploadedBytes;
+        shadowUploadedTiles = uploadedTiles;
+    }
+    shadowMaps->Update(view, glm::radians(45.0f), aspect, 0.1f, lightDir, renderShadowCasters);
+    shadowStaticDraws += shadowMaps->GetStats().staticDraws;
+    shadowDynamicDraws += shadowMaps->GetStats().dynamicDraws;
+}
+
+struct OpaqueDraw
+{
+    float distance;
+    void (*render)(gps::Shader, bool);
+};
+
+// Draws the opaque models nearest first, so the depth test rejects what they hide before it
+// is shaded. The desert goes last: it lies under everything else, which would otherwise all
+// be drawn over it.
+void renderOpaque(gps::Shader shader, bool depthOnly)
+{
+    OpaqueDraw draws[2] = {
+        { distanceToModel(casa, modelCasa), renderHouse },
+        { distanceToModel(heli, modelHeli), renderHelicopter }
+    };
+    std::sort(draws, draws + 2, [](const OpaqueDraw& a, const OpaqueDraw& b) { return a.distance < b.distance; });
+    for (int i = 0; i < 2; i++)
+        draws[i].render(shader, depthOnly);
+    renderDesert(shader, depthOnly);
+}
+
+// Reads back the overdraw counts of the bound width x height scene every few frames and
+// prints their average (stalls the pipeline)
+void reportOverdraw(int width, int height)
+{
+    if (++overdrawFrames < overdrawReportFrames)
+        return;
+    overdrawFrames = 0;
+
+    std::vector<unsigned char> counts((size_t)width * height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, counts.data());
+
+    long long fragments = 0;
+    long long covered = 0;
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        fragments += (counts[i] + overdrawStep / 2) / overdrawStep;
+        covered += counts[i] > 0;
+    }
+    std::cout << "Overdraw " << (depthPrepass ? "with" : "without") << " the depth pre-pass: "
+              << fragments / (double)std::max<size_t>(counts.size(), 1) << " shaded fragments per pixel, "
+              << fragments / (double)std::max(covered, 1LL) << " per covered pixel" << std::endl;
 }
 
 void renderScene()
 {
+    gpuProfiler.BeginFrame();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // the frame ends up in the window, or in the batch renderer's target
+    GLuint outputFramebuffer = 0;
+    int outputWidth = myWindow.getWindowDimensions().width;
+    int outputHeight = myWindow.getWindowDimensions().height;
+    if (batchRenderer)
+    {
+        outputFramebuffer = batchRenderer->GetFramebuffer();
+        outputWidth = batchRenderer->GetWidth();
+        outputHeight = batchRenderer->GetHeight();
+    }
+    // every pass draws into the lower left corner of its target, at this frame's scale
+    int sceneWidth = outputWidth;
+    int sceneHeight = outputHeight;
+    int waterSize = waterTargetSize;
+    if (sceneTarget)
+    {
+        sceneTarget->BeginFrame();
+        sceneWidth = sceneTarget->GetWidth();
+        sceneHeight = sceneTarget->GetHeight();
+        waterSize = std::max((int)lroundf(waterTargetSize * sceneTarget->GetScale()), 1);
+    }
+    skyBoxShader.selectVariant(fog ? gps::SHADER_FOG : 0);
+
+    if (shadowMaps)
+    {
+        gpuProfiler.Begin("shadows");
+        updateShadows((float)outputWidth / (float)outputHeight);
+        gpuProfiler.End();
+    }
 
     // Reflection Render Pass
     glm::mat4 TexProjection = glm::ortho(-2.0f, 2.0f, -2.0f, 2.0f, 0.1f, 0.5f);
     gps::Camera reflectCam = myCamera;
+    gpuProfiler.Begin("reflection");
     glBindTexture(GL_TEXTURE_2D,0);
     glBindFramebuffer(GL_FRAMEBUFFER,FBO[0]);
-    glViewport(0,0,2048,2048);
+    glViewport(0,0,waterSize,waterSize);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    myBasicShader.useShaderProgram();
     float dist = 2*(reflectCam.cameraPosition.y + 0.1f);
     reflectCam.move(gps::MOVE_DOWN,dist);
     reflectCam.rotate(-pitch,yaw);
-    viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
-    glUniformMatrix4fv(viewLoc,1,GL_FALSE,glm::value_ptr(reflectCam.getViewMatrix()));
-    projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc,1,GL_FALSE,glm::value_ptr(TexProjection));
-    glUniform4fv(clipPlaneLoc,1,glm::value_ptr(ReflectclipPlane));
-    renderDesert(myBasicShader);
-    renderHouse(myBasicShader);
-    renderHelicopter(myBasicShader);
-    glUniformMatrix4fv(viewLoc,1,GL_FALSE,glm::value_ptr(view));
+    beginScenePass(waterPassFeatures, reflectCam.getViewMatrix(), TexProjection, ReflectclipPlane);
+    // both water passes use the orthographic TexProjection, 4 units over waterSize pixels
+    lodSelection.eye = reflectCam.cameraPosition;
+    lodSelection.pixelsPerUnit = waterSize / 4.0f;
+    lodSelection.perspective = false;
+    lodSelection.maxPixelError = waterLodPixelError;
+    passViewProjection = TexProjection * reflectCam.getViewMatrix();
+    renderOpaque(myBasicShader, false);
     mySkyBox.Draw(skyBoxShader, reflectCam.getViewMatrix(), projection);
+    gpuProfiler.End();
 
  
     // Refraction Render Pass
+    gpuProfiler.Begin("refraction");
     glBindTexture(GL_TEXTURE_2D,0);
     glBindFramebuffer(GL_FRAMEBUFFER,FBO[1]);
-    glViewport(0,0,2048,2048);
+    glViewport(0,0,waterSize,waterSize);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    myBasicShader.useShaderProgram();
-    glUniform4fv(clipPlaneLoc,1,glm::value_ptr(RefractclipPlane));
-    renderDesert(myBasicShader);
-    renderHouse(myBasicShader);
-    renderHelicopter(myBasicShader);
+    beginScenePass(waterPassFeatures, view, TexProjection, RefractclipPlane);
+    lodSelection.eye = myCamera.cameraPosition;
+    passViewProjection = TexProjection * view;
+    renderOpaque(myBasicShader, false);
     mySkyBox.Draw(skyBoxShader, view, projection);
+    gpuProfiler.End();
 
     // render the terrain
+    if (nightLightCount > 0)
+        updateNightLights(sceneWidth, sceneHeight);
+    gpuProfiler.Begin("main");
     glBindTexture(GL_TEXTURE_2D,0);
-    glBindFramebuffer(GL_FRAMEBUFFER,0);
+    if (sceneTarget)
+        sceneTarget->Bind();
+    else
+        glBindFramebuffer(GL_FRAMEBUFFER,outputFramebuffer);
+    if (overdrawView)
+    {
+        // linear counts on black, added up by the blender
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glDisable(GL_FRAMEBUFFER_SRGB);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
-    myBasicShader.useShaderProgram();
-    projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc,1,GL_FALSE,glm::value_ptr(projection));
-    glUniform4fv(clipPlaneLoc,1,glm::value_ptr(NoclipPlane));
-    renderDesert(myBasicShader);
-    renderHouse(myBasicShader);
-    renderHelicopter(myBasicShader);
-    // render the skybox
-    mySkyBox.Draw(skyBoxShader, view, projection);
-    // render the water
-    renderWater(waterShader);
+    glViewport(0, 0, sceneWidth, sceneHeight);
+    lodSelection.eye = myCamera.cameraPosition;
+    lodSelection.pixelsPerUnit = sceneHeight / (2.0f * tanf(glm::radians(45.0f) / 2.0f));
+    lodSelection.perspective = true;
+    lodSelection.maxPixelError = sceneLodPixelError;
+    passViewProjection = projection * view;
+    if (depthPrepass)
+    {
+        gpuProfiler.Begin("depth prepass");
+        beginScenePass(gps::SHADER_DEPTH_ONLY, view, projection, NoclipPlane);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        renderOpaque(myBasicShader, true);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        // the depth buffer is final, only the nearest fragment of each pixel passes
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_EQUAL);
+        gpuProfiler.End();
+    }
+    beginScenePass(overdrawView ? (unsigned)gps::SHADER_OVERDRAW : mainPassFeatures, view, projection, NoclipPlane);
+    renderOpaque(myBasicShader, false);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    if (!overdrawView)
+    {
+        // render the skybox
+        mySkyBox.Draw(skyBoxShader, view, projection);
+        // render the water
+        renderWater(waterShader);
+    }
+    // multisampled targets are read back resolved
+    if (sceneTarget)
+        sceneTarget->Resolve();
+    if (overdrawView)
+    {
+        reportOverdraw(sceneWidth, sceneHeight);
+        glDisable(GL_BLEND);
+        glEnable(GL_FRAMEBUFFER_SRGB);
+        glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
+    }
+    gpuProfiler.End();
+    if (sceneTarget)
+    {
+        gpuProfiler.Begin("upscale");
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+        sceneTarget->Present(upscaleShader, outputWidth, outputHeight);
+        gpuProfiler.End();
+    }
     glCheckError();
+
+    if (gpuProfiling && gpuProfiler.GetFrameCount() >= gpuProfileReportFrames)
+    {
+        std::vector<std::pair<std::string, double>> averages = gpuProfiler.GetAverages();
+        std::cout << "GPU ms per frame over " << gpuProfiler.GetFrameCount() << " frames:";
+        for (size_t i = 0; i < averages.size(); i++)
+            std::cout << " " << averages[i].first << " " << averages[i].second;
+        std::cout << std::endl;
+        if (nightLightCount > 0)
+        {
+            gps::ClusterStats stats = clusteredLighting.GetStats();
+            std::cout << "Clustered lights: " << stats.visibleLights << " of " << nightLightCount << " visible, "
+                      << stats.lightIndices << " cluster entries, at most " << stats.maxClusterLights
+                      << " per cluster, binned in " << stats.binMilliseconds << " ms" << std::endl;
+        }
+        if (shadowMaps)
+        {
+            double frames = gpuProfiler.GetFrameCount();
+            std::cout << "Shadow cascades redrawn per frame: " << shadowStaticDraws / frames << " static, "
+                      << shadowDynamicDraws / frames << " moving casters" << std::endl;
+            shadowStaticDraws = shadowDynamicDraws = 0;
+        }
+        if (sceneTarget)
+        {
+            // the frames of this report, with the scale each was timed at
+            const std::deque<gps::ResolutionSample>& history = sceneTarget->GetController().GetHistory();
+            size_t first = history.size() - std::min(history.size(), (size_t)gpuProfiler.GetFrameCount());
+            double slowest = 0.0, lowestScale = 1.0, highestScale = 0.0;
+            int over = 0;
+            for (size_t i = first; i < history.size(); i++)
+            {
+                slowest = std::max(slowest, history[i].milliseconds);
+                if (history[i].milliseconds > resolutionOptions.budgetMilliseconds)
+                    over++;
+                lowestScale = std::min(lowestScale, (double)history[i].scale);
+                highestScale = std::max(highestScale, (double)history[i].scale);
+            }
+            std::cout << "Resolution scale " << sceneTarget->GetScale() << " (" << lowestScale << " to " << highestScale
+                      << " in these frames, " << sceneTarget->GetController().GetChangeCount() << " changes so far), slowest frame "
+                      << slowest << " ms, " << over << " over the " << resolutionOptions.budgetMilliseconds << " ms budget" << std::endl;
+        }
+        gpuProfiler.Reset();
+    }
 }
 
 void cleanup()
 {
+    gpuProfiler.Delete();
+    if (frameCapture && frameCapture->IsRecording())
+        toggleRecording();
+    if (frameCapture)
+        frameCapture->Delete();
+    if (batchRenderer)
+        batchRenderer->Delete();
+    if (sceneTarget)
+        sceneTarget->Delete();
+    clusteredLighting.Delete();
+    if (shadowMaps)
+        shadowMaps->Delete();
+    myBasicShader.deleteVariants();
+    skyBoxShader.deleteVariants();
+    assetStreamer.Delete();
+    if (terrain)
+        terrain->Delete();
     myWindow.Delete();
     //cleanup code for your own data
     glDeleteFramebuffers(2,FBO);
@@ -674,8 +1326,201 @@ void cleanup()
     glDeleteBuffers(1,&WaterVBO);
 }
 
+// Points the camera the way the mouse would have for the pose
+void setCameraPose(const gps::CameraPose& pose)
+{
+    myCamera.cameraPosition = pose.position;
+    myCamera.rotate(pose.pitch, pose.yaw);
+    // the cursor position mouseCallback reads, which the reflection pass uses too
+    yaw = pose.yaw * mouseSensitivity;
+    pitch = -pose.pitch * mouseSensitivity;
+    view = myCamera.getViewMatrix();
+}
+
+// Draws every pose of --batch into its own PNG, numbered in file order, and reports the throughput
+int runBatch()
+{
+    std::vector<gps::CameraPose> poses;
+    if (!gps::BatchRenderer::LoadPoses(batchPoses, poses) || poses.empty())
+    {
+        std::cerr << "ERROR: could not read camera poses from " << batchPoses << std::endl;
+        return EXIT_FAILURE;
+    }
+    projection = glm::perspective(glm::radians(45.0f), (float)batchRenderer->GetWidth() / (float)batchRenderer->GetHeight(), 0.1f, 1000.0f);
+    // the helicopter holds still, so every image depends on its pose only
+    updateHelicopter();
+
+    for (size_t i = 0; i < poses.size() && !glfwWindowShouldClose(myWindow.getWindow()); i++)
+    {
+        setCameraPose(poses[i]);
+        // every image is complete: the models and the terrain around the pose finish streaming first
+        updateStreaming();
+        while (!assetStreamer.IsIdle() || (terrain && terrain->GetStats().pendingTiles > 0))
+        {
+            batchRenderer->Poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            updateStreaming();
+        }
+        renderScene();
+        if (!batchRenderer->Capture())
+        {
+            std::cerr << "ERROR: could not create " << batchOptions.directory << std::endl;
+            return EXIT_FAILURE;
+        }
+        glfwPollEvents();
+        glCheckError();
+    }
+    batchRenderer->Finish();
+
+    gps::CaptureStats stats = batchRenderer->GetStats();
+    int encoded = std::max(stats.written + stats.failed, 1);
+    std::cout << "Batch: " << stats.written << " images of " << batchRenderer->GetWidth() << "x" << batchRenderer->GetHeight()
+              << " in " << stats.seconds << " s, " << stats.written / std::max(stats.seconds, 1e-6) << " images/s; encoding "
+              << stats.encodeMilliseconds / encoded << " ms and " << stats.bytes / encoded / 1024 << " KB per image on "
+              << workerPool.GetThreadCount() << " threads, " << stats.readbackStalls << " waits for the GPU, "
+              << stats.encoderWaits << " for the encoders" << std::endl;
+    if (stats.failed > 0)
+        std::cerr << "ERROR: could not write " << stats.failed << " images to " << batchOptions.directory << std::endl;
+    return stats.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// --driver-mipmaps: let glGenerateMipmap build the mip chains (no texture cache)
+// --box-mipmaps: CPU mip chains with the box filter instead of Kaiser
+// --no-texture-cache: always decode and filter the source images
+// --cold-start: empty the texture, mesh and shader caches first, to time a cold start against a warm one
+// --buffered-geometry: parse whole models on the CPU before uploading instead of streaming chunks
+// --warm-mesh-cache: parse streamed models once more afterwards to fill the mesh cache
+// --no-mesh-optimization: draw the meshes in file order, without welding or reordering
+// --no-mesh-cache: always parse the .obj files
+// --no-shader-cache: always compile and link the shaders
+// --gpu-profile: print the GPU time of each pass every 300 frames
+// --depth-prepass: lay down the main pass's depth before shading it (P toggles it)
+// --night [N]: moonlight and N campfires and lanterns (256 by default), shaded with clustered lighting
+// --shadows: cascaded shadow maps for the sun
+// --shadow-budget MB: depth texture memory of the shadow maps (128 MB by default), implies --shadows
+// --dynamic-resolution [ms]: scale the scene and water resolution to hold the GPU frame time
+//     under a budget (15 ms by default); --gpu-profile also prints the scale
+// --batch poses.txt: draw the "x y z yaw pitch" camera poses of the file into batch/00000.png
+//     and so on, then exit
+// --batch-size WxH: size of the batch images (1920x1080 by default)
+// --batch-output dir: where the batch images go
+// --record [path]: record the window from the start, to capture.y4m by default; a path that
+//     does not end in .y4m is a directory of PNGs. R starts and stops recordings.
+// --record-queue: keep every recorded frame, waiting for the GPU and the encoders instead of dropping
+// --float-vertices: upload 32 byte float vertices instead of the 16 byte quantized ones
+// --no-lod: draw every mesh at full detail
+// --terrain heightmap.png: stream a heightfield desert from a grayscale heightmap instead of desert.obj
+// --dunes [seed]: the same, with procedurally generated dunes
+void parseArguments(int argc, const char *argv[])
+{
+    gps::Model3D::textureOptions.cache = &textureCache;
+    gps::Model3D::meshOptions.cache = &meshCache;
+    gps::Shader::options.cache = &shaderCache;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--driver-mipmaps")
+            gps::Model3D::textureOptions.cpuMipmaps = false;
+        else if (argument == "--box-mipmaps")
+            gps::Model3D::textureOptions.filter = gps::MIP_BOX;
+        else if (argument == "--no-texture-cache")
+            gps::Model3D::textureOptions.cache = NULL;
+        else if (argument == "--cold-start")
+            textureCache.Clear();
+        else if (argument == "--buffered-geometry")
+            assetStreamer.SetGeometryStreaming(false);
+        else if (argument == "--warm-mesh-cache")
+            assetStreamer.SetMeshCacheWarming(true);
+        else if (argument == "--no-mesh-optimization")
+            gps::Model3D::meshOptions.optimize = false;
+        else if (argument == "--no-mesh-cache")
+            gps::Model3D::meshOptions.cache = NULL;
+        else if (argument == "--no-shader-cache")
+            gps::Shader::options.cache = NULL;
+        else if (argument == "--gpu-profile")
+            gpuProfiling = true;
+        else if (argument == "--depth-prepass")
+            depthPrepass = true;
+        else if (argument == "--night")
+        {
+            nightLightCount = 256;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+                nightLightCount = std::min(atoi(argv[++i]), gps::LightClusters::maxLights);
+            mainPassFeatures |= gps::SHADER_CLUSTERED_LIGHTS;
+        }
+        else if (argument == "--shadows")
+        {
+            shadows = true;
+            mainPassFeatures |= gps::SHADER_SHADOWS;
+        }
+        else if (argument == "--shadow-budget" && i + 1 < argc)
+        {
+            shadows = true;
+            mainPassFeatures |= gps::SHADER_SHADOWS;
+            shadowOptions.memoryBudget = (size_t)std::max(1, atoi(argv[++i])) * 1024 * 1024;
+        }
+        else if (argument == "--dynamic-resolution")
+        {
+            dynamicResolution = true;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+                resolutionOptions.budgetMilliseconds = std::max(atof(argv[++i]), 1.0);
+        }
+        else if (argument == "--batch" && i + 1 < argc)
+            batchPoses = argv[++i];
+        else if (argument == "--batch-size" && i + 1 < argc)
+        {
+            int width = 0, height = 0;
+            if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+            {
+                batchOptions.width = width;
+                batchOptions.height = height;
+            }
+            else
+                std::cerr << "WARNING: ignoring batch size " << argv[i] << std::endl;
+        }
+        else if (argument == "--batch-output" && i + 1 < argc)
+            batchOptions.directory = argv[++i];
+        else if (argument == "--record")
+        {
+            recordAtStart = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                captureOptions.path = argv[++i];
+        }
+        else if (argument == "--record-queue")
+            captureOptions.backpressure = gps::CAPTURE_QUEUE;
+        else if (argument == "--float-vertices")
+            gps::Model3D::meshOptions.compactVertices = false;
+        else if (argument == "--no-lod")
+            gps::Model3D::meshOptions.lodLevels = 1;
+        else if (argument == "--terrain" && i + 1 < argc)
+            terrainHeightmap = argv[++i];
+        else if (argument == "--dunes")
+        {
+            terrainDunes = true;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+                duneOptions.seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else
+            std::cerr << "WARNING: ignoring unknown argument " << argument << std::endl;
+    }
+    if (!batchPoses.empty() && dynamicResolution)
+    {
+        // batch images are always drawn at their full size
+        std::cerr << "WARNING: ignoring --dynamic-resolution with --batch" << std::endl;
+        dynamicResolution = false;
+    }
+    const std::string y4m = ".y4m";
+    const std::string& path = captureOptions.path;
+    bool video = path.size() >= y4m.size() && path.compare(path.size() - y4m.size(), y4m.size(), y4m) == 0;
+    captureOptions.format = video ? gps::CAPTURE_Y4M : gps::CAPTURE_PNG;
+}
+
 int main(int argc, const char *argv[])
 {
+    startupTime = std::chrono::steady_clock::now();
+    parseArguments(argc, argv);
+
     try
     {
         initOpenGLWindow();
@@ -689,22 +1534,67 @@ int main(int argc, const char *argv[])
     initOpenGLState();
     initModels();
     initShaders();
+    initNightLights();
     initUniforms();
     initSkyBox();
     initFBO();
     initWater();
+    // frame times come from the profiler's timestamps
+    if (gpuProfiling || dynamicResolution)
+        gpuProfiler.Init();
+    if (dynamicResolution)
+    {
+        GLint samples = 0;
+        glGetIntegerv(GL_SAMPLES, &samples);
+        sceneTarget.reset(new gps::DynamicResolution(resolutionOptions));
+        sceneTarget->Init(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height, samples);
+        gpuProfiler.SetFrameCallback([](double milliseconds) { sceneTarget->AddFrameTime(milliseconds); });
+    }
+    if (nightLightCount > 0)
+        clusteredLighting.Init();
+    if (shadows)
+    {
+        shadowMaps.reset(new gps::ShadowMaps(shadowOptions));
+        shadowMaps->Init();
+        std::cout << "Shadow maps: " << shadowOptions.cascades << " cascades of " << shadowMaps->GetResolution() << "x"
+                  << shadowMaps->GetResolution() << std::endl;
+    }
     setWindowCallbacks();
 
+    if (!batchPoses.empty())
+    {
+        batchRenderer.reset(new gps::BatchRenderer(workerPool, batchOptions));
+        batchRenderer->Init();
+        int result = runBatch();
+        cleanup();
+        return result;
+    }
+
+    frameCapture.reset(new gps::FrameCapture(workerPool, captureOptions));
+    frameCapture->Init();
+    if (recordAtStart)
+        toggleRecording();
+
     glCheckError();
     // application loop
     while (!glfwWindowShouldClose(myWindow.getWindow()))
     {
         processMovement();
+        updateStreaming();
+        updateShaderReload();
+        updateHelicopter();
         renderScene();
+        captureFrame();
 
         glfwPollEvents();
         glfwSwapBuffers(myWindow.getWindow());
 
+        if (!firstFrameDrawn)
+        {
+            firstFrameDrawn = true;
+            std::cout << "Time to first frame: " << millisecondsSinceStartup() << " ms" << std::endl;
+        }
+
         glCheckError();
     }
 
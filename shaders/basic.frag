@@ -1,19 +1,17 @@
 #version 410 core
 
-in vec3 fPosition;
-in vec3 fNormal;
+// eye space, from the vertex shader
+in vec3 fPositionEye;
+in vec3 fNormalEye;
 in vec2 fTexCoords;
+in vec3 fPointLightVector;
 
 out vec4 fColor;
 
-//matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat3 normalMatrix;
 //lighting
-uniform vec3 lightDir;
+//direction towards the light in eye space, normalized once per pass
+uniform vec3 lightDirEye;
 uniform vec3 lightColor;
-uniform vec3 pointLight;
 uniform vec3 pointLightColor;
 
 // textures
@@ -30,77 +28,159 @@ vec3 diffuse2;
 vec3 specular2;
 float specularStrength = 0.5f;
 
-uniform bool fog;
-
 float constant = 1.0f;
 float linear = 0.0045f;
 float quadratic = 0.0075f; 
 
-void computePointLight(){
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
-    vec3 lightPosEye = vec3(view * model * vec4(pointLight,1.0f));
-    vec3 lightDirN = normalize(lightPosEye - fPosEye.xyz);
-    vec3 viewDir = normalize(- fPosEye.xyz);
-    vec3 normalEye = normalize(normalMatrix * fNormal);
+void computePointLight(vec3 normalEye, vec3 viewDir){
+    vec3 lightDirN = normalize(fPointLightVector);
     vec3 halfVector = normalize(lightDirN + viewDir);
 
-    float dist = length(lightPosEye - fPosEye.xyz);
+    float dist = length(fPointLightVector);
     float att = 1.0f / (constant + linear * dist + quadratic * (dist * dist));
 
     ambient2 = att * ambientStrength * pointLightColor;
     diffuse2 = att * max(dot(normalEye, lightDirN), 0.0f) * pointLightColor;
 
     float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), 32);
-    specular = att * specularStrength * specCoeff * pointLightColor;
+    specular2 = att * specularStrength * specCoeff * pointLightColor;
 }
 
-void computeDirLight()
+void computeDirLight(vec3 normalEye, vec3 viewDir)
 {
-    //compute eye space coordinates
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
-    vec3 normalEye = normalize(normalMatrix * fNormal);
-
-    //normalize light direction
-    vec3 lightDirN = vec3(normalize(view * vec4(lightDir, 0.0f)));
-
-    //compute view direction (in eye coordinates, the viewer is situated at the origin
-    vec3 viewDir = normalize(- fPosEye.xyz);
-
     //compute ambient light
     ambient = ambientStrength * lightColor;
 
     //compute diffuse light
-    diffuse = max(dot(normalEye, lightDirN), 0.0f) * lightColor;
+    diffuse = max(dot(normalEye, lightDirEye), 0.0f) * lightColor;
 
     //compute specular light
-    vec3 reflectDir = reflect(-lightDirN, normalEye);
+    vec3 reflectDir = reflect(-lightDirEye, normalEye);
     float specCoeff = pow(max(dot(viewDir, reflectDir), 0.0f), 32);
     specular = specularStrength * specCoeff * lightColor;
 }
 
+#ifdef CLUSTERED_LIGHTS
+// first light index and light count of each cluster, x fastest, then y, then depth slice
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterLightIndices;
+// two texels per light: eye space position and radius, then color
+uniform samplerBuffer clusterLights;
+uniform ivec3 clusterCounts;
+// tiles per pixel
+uniform vec2 clusterTileScale;
+// log(depth) * x + y is the depth slice
+uniform vec2 clusterSliceParameters;
+
+vec3 computeClusteredLights(vec3 normalEye, vec3 viewDir, vec3 diffuseColor, vec3 specularColor)
+{
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTileScale), clusterCounts.xy - 1);
+    int slice = int(floor(log(max(-fPositionEye.z, 1e-4f)) * clusterSliceParameters.x + clusterSliceParameters.y));
+    slice = clamp(slice, 0, clusterCounts.z - 1);
+    uvec2 range = texelFetch(clusterRanges, (slice * clusterCounts.y + tile.y) * clusterCounts.x + tile.x).xy;
+
+    vec3 result = vec3(0.0f);
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(clusterLightIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, light * 2);
+        vec3 toLight = positionRadius.xyz - fPositionEye;
+        float dist = length(toLight);
+        if (dist >= positionRadius.w)
+            continue;
+        vec3 lightDirN = toLight / dist;
+        //the point light's falloff, windowed to reach zero at the light's radius
+        float window = 1.0f - pow(dist / positionRadius.w, 4.0f);
+        float att = window * window / (constant + linear * dist + quadratic * (dist * dist));
+        float diffuseCoeff = max(dot(normalEye, lightDirN), 0.0f);
+        float specCoeff = pow(max(dot(normalEye, normalize(lightDirN + viewDir)), 0.0f), 32);
+        vec3 color = texelFetch(clusterLights, light * 2 + 1).rgb * att;
+        result += (ambientStrength + diffuseCoeff) * color * diffuseColor + specularStrength * specCoeff * color * specularColor;
+    }
+    return result;
+}
+#endif
+
+#ifdef SHADOWS
+uniform sampler2DArrayShadow shadowMap;
+// eye space to shadow map coordinates of each cascade
+uniform mat4 shadowMatrices[4];
+// view depth where each cascade ends, and the world size of its texels
+uniform vec4 shadowSplits;
+uniform vec4 shadowTexelSizes;
+uniform int shadowCascadeCount;
+
+float computeShadow(vec3 normalEye)
+{
+    float depth = -fPositionEye.z;
+    int cascade = 0;
+    while (cascade < shadowCascadeCount && depth > shadowSplits[cascade])
+        cascade++;
+    if (cascade == shadowCascadeCount)
+        return 1.0f;
+
+    //pushed off the surface by a texel or so, against acne on slopes
+    vec3 position = fPositionEye + normalEye * shadowTexelSizes[cascade] * 1.5f;
+    vec3 shadowPosition = (shadowMatrices[cascade] * vec4(position, 1.0f)).xyz;
+    //four filtered comparisons half a texel apart, 4x4 texels in all
+    vec2 texel = 1.0f / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0f;
+    for (int y = -1; y <= 1; y += 2)
+        for (int x = -1; x <= 1; x += 2)
+            lit += texture(shadowMap, vec4(shadowPosition.xy + vec2(x, y) * 0.5f * texel, float(cascade), shadowPosition.z));
+    return lit * 0.25f;
+}
+#endif
+
 float computeFog()
 {
     float fogDensity = 0.05f;
-    float fragmentDistance = length(view * model * vec4(fPosition, 1.0f));
+    float fragmentDistance = length(fPositionEye);
     float fogFactor = exp(-pow(fragmentDistance * fogDensity, 2));
 
     return clamp(fogFactor, 0.0f, 1.0f);
 }
 
+// FOG, POINT_LIGHT, CLIP_PLANE, DEPTH_ONLY, OVERDRAW, CLUSTERED_LIGHTS and SHADOWS are defined per variant by gps::Shader
 void main() 
 {
-    computeDirLight();
-    computePointLight();
-    float fogFactor = computeFog();
+#ifdef DEPTH_ONLY
+    //the pre-pass only writes depth, the color mask is off
+    return;
+#endif
+#ifdef OVERDRAW
+    //blended additively: the red channel counts the fragments shaded per pixel, 8/255 each
+    fColor = vec4(8.0f / 255.0f, 0.0f, 0.0f, 1.0f);
+    return;
+#endif
+    //the viewer is at the origin in eye coordinates
+    vec3 normalEye = normalize(fNormalEye);
+    vec3 viewDir = normalize(-fPositionEye);
+    //each map is fetched once and shared by both lights
+    vec3 diffuseColor = texture(diffuseTexture, fTexCoords).rgb;
+    vec3 specularColor = texture(specularTexture, fTexCoords).rgb;
+
+    computeDirLight(normalEye, viewDir);
+    float shadow = 1.0f;
+#ifdef SHADOWS
+    shadow = computeShadow(normalEye);
+#endif
     //compute final vertex color
-    //computing dir light result
-    vec3 lightResult = ((ambient + diffuse) * texture(diffuseTexture, fTexCoords).rgb + specular * texture(specularTexture, fTexCoords).rgb);
+    //computing dir light result, the ambient part is never shadowed
+    vec3 lightResult = (ambient + shadow * diffuse) * diffuseColor + shadow * specular * specularColor;
+#ifdef POINT_LIGHT
+    computePointLight(normalEye, viewDir);
     //adding point light result
-    lightResult += ((ambient2 + diffuse2) * texture(diffuseTexture, fTexCoords).rgb + specular2 * texture(specularTexture, fTexCoords).rgb);
+    lightResult += (ambient2 + diffuse2) * diffuseColor + specular2 * specularColor;
+#endif
+#ifdef CLUSTERED_LIGHTS
+    lightResult += computeClusteredLights(normalEye, viewDir, diffuseColor, specularColor);
+#endif
     vec3 color = min(lightResult, 1.0f);
+#ifdef FOG
+    float fogFactor = computeFog();
     vec4 fogColor = vec4(0.75f, 0.7f, 0.5f, 1.0f);
-    if(fog)
-        fColor = mix(fogColor,vec4(color, 1.0f),fogFactor);
-    else
-        fColor = vec4(color, 1.0f);
+    fColor = mix(fogColor,vec4(color, 1.0f),fogFactor);
+#else
+    fColor = vec4(color, 1.0f);
+#endif
 }
@@ -4,21 +4,109 @@ layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
 
-out vec3 fPosition;
-out vec3 fNormal;
+// the depth pre-pass and the color pass after it are different programs; their depths must
+// match bit for bit for the GL_EQUAL test
+invariant gl_Position;
+
+// eye space, so the fragment shader does no matrix work
+out vec3 fPositionEye;
+out vec3 fNormalEye;
 out vec2 fTexCoords;
+// towards the point light; lightPosEye - positionEye is affine, so it interpolates exactly
+out vec3 fPointLightVector;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform mat3 normalMatrix;
+uniform vec3 pointLight;
 
 uniform vec4 clipPlane;
 
+// compact meshes: positions and texture coordinates are fractions of the mesh bounds,
+// normals octahedral encoded shorts (identity and false for float meshes)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec2 texCoordOffset;
+uniform vec2 texCoordScale;
+uniform bool octahedralNormals;
+
+// terrain chunks: vPosition is a point of the shared grid, displaced from the tile's heights
+uniform bool terrainChunk;
+uniform sampler2D heightMap;
+// tile origin xz, sample spacing and height texture size in samples (with a one sample apron)
+uniform vec4 terrainTile;
+// chunk origin xz and grid quad size
+uniform vec3 terrainChunkOrigin;
+// distances where morphing into the next coarser level starts and ends
+uniform vec2 terrainMorph;
+uniform vec3 terrainEye;
+uniform float terrainTextureScale;
+
+float terrainHeight(vec2 ground)
+{
+	vec2 texel = (ground - terrainTile.xy) / terrainTile.z + 1.5f;
+	return textureLod(heightMap, texel / terrainTile.w, 0.0f).r;
+}
+
+void terrainVertex(out vec3 position, out vec3 normal, out vec2 texCoords)
+{
+	vec2 grid = vPosition.xz;
+	vec2 ground = terrainChunkOrigin.xy + grid * terrainChunkOrigin.z;
+	float eyeDistance = length(terrainEye - vec3(ground.x, terrainHeight(ground), ground.y));
+	float morph = clamp((eyeDistance - terrainMorph.x) / (terrainMorph.y - terrainMorph.x), 0.0f, 1.0f);
+	// odd grid points slide onto their even neighbours, where the coarser level has its vertices
+	grid -= fract(grid * 0.5f) * 2.0f * morph;
+	ground = terrainChunkOrigin.xy + grid * terrainChunkOrigin.z;
+	position = vec3(ground.x, terrainHeight(ground), ground.y);
+
+	float d = terrainTile.z;
+	float left = terrainHeight(ground - vec2(d, 0.0f));
+	float right = terrainHeight(ground + vec2(d, 0.0f));
+	float back = terrainHeight(ground - vec2(0.0f, d));
+	float front = terrainHeight(ground + vec2(0.0f, d));
+	normal = normalize(vec3(left - right, 2.0f * d, back - front));
+	texCoords = ground * terrainTextureScale;
+}
+
+vec3 decodeOctahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+	return normalize(normal);
+}
+
 void main() 
 {
-	gl_ClipDistance[0] = dot(clipPlane, model * vec4(vPosition, 1.0f));
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fPosition = vPosition;
-	fNormal = vNormal;
-	fTexCoords = vTexCoords;
+	vec3 position;
+	vec3 normal;
+	if (terrainChunk) {
+		terrainVertex(position, normal, fTexCoords);
+	} else {
+		position = vPosition * positionScale + positionOffset;
+#ifndef DEPTH_ONLY
+		// the depth stream has no normals or texture coordinates
+		normal = octahedralNormals ? decodeOctahedral(vNormal.xy / 32767.0f) : vNormal;
+		fTexCoords = vTexCoords * texCoordScale + texCoordOffset;
+#endif
+	}
+	vec4 worldPosition = model * vec4(position, 1.0f);
+	vec4 positionEye = view * worldPosition;
+#ifdef CLIP_PLANE
+	gl_ClipDistance[0] = dot(clipPlane, worldPosition);
+#endif
+	gl_Position = projection * positionEye;
+#ifdef DEPTH_ONLY
+	return;
+#endif
+	fPositionEye = positionEye.xyz;
+	fNormalEye = normalMatrix * normal;
+#ifdef POINT_LIGHT
+	// the point light sits in each model's own space
+	fPointLightVector = vec3(view * model * vec4(pointLight, 1.0f)) - positionEye.xyz;
+#else
+	fPointLightVector = vec3(0.0f);
+#endif
 }
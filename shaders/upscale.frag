@@ -0,0 +1,17 @@
+#version 410 core
+
+in vec2 texCoord;
+
+out vec4 fColor;
+
+uniform sampler2D scene;
+// share of the texture the scene was drawn into
+uniform vec2 regionScale;
+
+void main()
+{
+    // kept half a texel inside the drawn corner, so filtering never reaches stale texels
+    vec2 halfTexel = 0.5 / vec2(textureSize(scene, 0));
+    vec2 coord = min(texCoord * regionScale, regionScale - halfTexel);
+    fColor = texture(scene, coord);
+}
@@ -6,13 +6,17 @@ out vec4 out_Color;
 
 uniform sampler2D reflection;
 uniform sampler2D refraction;
+// share of each target the passes drew into, under dynamic resolution
+uniform float targetScale;
 
 void main(void) {
 
 	vec2 ndc = (clipSpaceCoord.xy/clipSpaceCoord.w)/2.0 + 0.5;
 
-	vec2 refractCoord = vec2(ndc.x,ndc.y);
-	vec2 reflectCoord = vec2(ndc.x,-ndc.y);
+	// kept half a texel inside the drawn corner, so filtering never wraps into stale texels
+	float halfTexel = 0.5 / textureSize(reflection, 0).x;
+	vec2 refractCoord = clamp(vec2(ndc.x,ndc.y) * targetScale, halfTexel, targetScale - halfTexel);
+	vec2 reflectCoord = clamp(vec2(ndc.x,1.0-ndc.y) * targetScale, halfTexel, targetScale - halfTexel);
 	vec4 reflectColor = texture(reflection,reflectCoord);
 	vec4 refractColor = texture(refraction,refractCoord);
 	out_Color = mix(reflectColor,refractColor,0.50);